@@ -4,17 +4,35 @@ pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
     const optimize = b.standardOptimizeOption(.{});
 
+    // Event tracing (Chrome trace JSON); compiled out unless enabled
+    const build_options = b.addOptions();
+    build_options.addOption(bool, "trace", b.option(bool, "trace", "Record trace events for Chrome/Perfetto") orelse false);
+
+    const trace_module = b.createModule(.{
+        .root_source_file = b.path("src/trace/trace.zig"),
+        .target = target,
+        .optimize = optimize,
+        .imports = &.{
+            .{ .name = "build_options", .module = build_options.createModule() },
+        },
+    });
+
     // Create the root module for the serial terminal library
     const lib_module = b.createModule(.{
         .root_source_file = b.path("src/serial/c_api.zig"),
         .target = target,
         .optimize = optimize,
         .link_libc = true,
+        .imports = &.{
+            .{ .name = "trace", .module = trace_module },
+        },
     });
 
     // Link system libraries for macOS
-    lib_module.linkFramework("IOKit", .{});
-    lib_module.linkFramework("CoreFoundation", .{});
+    if (target.result.os.tag == .macos) {
+        lib_module.linkFramework("IOKit", .{});
+        lib_module.linkFramework("CoreFoundation", .{});
+    }
 
     // Build the serial terminal library
     const lib = b.addLibrary(.{
@@ -30,31 +48,143 @@ pub fn build(b: *std.Build) void {
     b.installFile("include/serialterm.h", "include/serialterm.h");
     b.installFile("include/transfer.h", "include/transfer.h");
 
+    // RFC 2217 network serial server (epoll based, Linux only)
+    const server_module = b.createModule(.{
+        .root_source_file = b.path("src/server/main.zig"),
+        .target = target,
+        .optimize = optimize,
+        .link_libc = true,
+        .imports = &.{
+            .{ .name = "serial", .module = lib_module },
+            .{ .name = "trace", .module = trace_module },
+        },
+    });
+
+    if (target.result.os.tag == .linux) {
+        const server = b.addExecutable(.{
+            .name = "serialterm-server",
+            .root_module = server_module,
+        });
+        b.installArtifact(server);
+    }
+
+    // Transfer protocol engines (XMODEM/YMODEM/ZMODEM)
+    const transfer_module = b.createModule(.{
+        .root_source_file = b.path("src/transfer/transfer.zig"),
+        .target = target,
+        .optimize = optimize,
+        .imports = &.{
+            .{ .name = "trace", .module = trace_module },
+        },
+    });
+
+    // Headless terminal (picocom-style raw stdin/stdout bridge)
+    const cli_module = b.createModule(.{
+        .root_source_file = b.path("src/cli/main.zig"),
+        .target = target,
+        .optimize = optimize,
+        .link_libc = true,
+        .imports = &.{
+            .{ .name = "serial", .module = lib_module },
+            .{ .name = "transfer", .module = transfer_module },
+            .{ .name = "trace", .module = trace_module },
+        },
+    });
+
+    const cli = b.addExecutable(.{
+        .name = "serialterm-cli",
+        .root_module = cli_module,
+    });
+    b.installArtifact(cli);
+
+    const run_cli = b.addRunArtifact(cli);
+    if (b.args) |args| run_cli.addArgs(args);
+    const run_cli_step = b.step("run-cli", "Run the headless terminal");
+    run_cli_step.dependOn(&run_cli.step);
+
+    // End-to-end I/O benchmarks over virtual port pairs (JSON on stdout)
+    const bench_module = b.createModule(.{
+        .root_source_file = b.path("src/bench/main.zig"),
+        .target = target,
+        .optimize = optimize,
+        .link_libc = true,
+        .imports = &.{
+            .{ .name = "serial", .module = lib_module },
+            .{ .name = "transfer", .module = transfer_module },
+        },
+    });
+
+    const bench = b.addExecutable(.{
+        .name = "serialterm-bench",
+        .root_module = bench_module,
+    });
+
+    const run_bench = b.addRunArtifact(bench);
+    if (b.args) |args| run_bench.addArgs(args);
+    const bench_step = b.step("bench", "Run serial I/O benchmarks (JSON on stdout)");
+    bench_step.dependOn(&run_bench.step);
+
     // Build tests
     const main_test_module = b.createModule(.{
         .root_source_file = b.path("src/serial/Port.zig"),
         .target = target,
         .optimize = optimize,
+        .link_libc = true,
+        .imports = &.{
+            .{ .name = "trace", .module = trace_module },
+        },
     });
 
     const transfer_test_module = b.createModule(.{
         .root_source_file = b.path("src/transfer/xmodem.zig"),
         .target = target,
         .optimize = optimize,
+        .imports = &.{
+            .{ .name = "trace", .module = trace_module },
+        },
     });
 
     const main_tests = b.addTest(.{
         .root_module = main_test_module,
     });
 
+    // Core modules re-exported by the C API (Hub, scan, ...)
+    const core_tests = b.addTest(.{
+        .root_module = lib_module,
+    });
+
     const transfer_tests = b.addTest(.{
         .root_module = transfer_test_module,
     });
 
     const run_main_tests = b.addRunArtifact(main_tests);
     const run_transfer_tests = b.addRunArtifact(transfer_tests);
+    const run_core_tests = b.addRunArtifact(core_tests);
 
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_main_tests.step);
     test_step.dependOn(&run_transfer_tests.step);
+    test_step.dependOn(&run_core_tests.step);
+
+    const trace_tests = b.addTest(.{
+        .root_module = trace_module,
+    });
+    test_step.dependOn(&b.addRunArtifact(trace_tests).step);
+
+    const cli_tests = b.addTest(.{
+        .root_module = cli_module,
+    });
+    test_step.dependOn(&b.addRunArtifact(cli_tests).step);
+
+    const bench_tests = b.addTest(.{
+        .root_module = bench_module,
+    });
+    test_step.dependOn(&b.addRunArtifact(bench_tests).step);
+
+    if (target.result.os.tag == .linux) {
+        const server_tests = b.addTest(.{
+            .root_module = server_module,
+        });
+        test_step.dependOn(&b.addRunArtifact(server_tests).step);
+    }
 }
@@ -13,8 +13,40 @@ extern "C" {
 // Types
 // ============================================================================
 
-/// Opaque handle to a serial port
-typedef void* SerialPortHandle;
+/// Serial port handle: slot index and generation packed into 32 bits.
+/// Handles of closed ports stay invalid even after the slot is reused,
+/// and 0 is never a valid handle.
+typedef uint32_t SerialPortHandle;
+
+/// Opaque handle to a shared-port hub
+typedef void* SerialHubHandle;
+
+/// Opaque handle to a hub consumer
+typedef void* SerialConsumerHandle;
+
+/// Opaque handle to an expect session
+typedef void* SerialExpectHandle;
+
+/// Opaque handle to a modem-line watcher
+typedef void* SerialLineWatcherHandle;
+
+/// Opaque handle to a hotplug-tracking port registry
+typedef void* SerialRegistryHandle;
+
+/// Opaque handle to a reconnect supervisor
+typedef void* SerialSupervisorHandle;
+
+/// Opaque handle to a frame decoder
+typedef void* SerialFramerHandle;
+
+/// Opaque handle to a Modbus RTU master
+typedef void* SerialModbusHandle;
+
+/// Opaque handle to a Modbus RTU bus monitor
+typedef void* SerialModbusSnifferHandle;
+
+/// Opaque handle to an NMEA decoder
+typedef void* SerialNmeaHandle;
 
 /// Error codes
 typedef enum {
@@ -29,6 +61,16 @@ typedef enum {
     SERIAL_ERROR_PORT_CLOSED = -8,
     SERIAL_ERROR_INVALID_HANDLE = -9,
     SERIAL_ERROR_OUT_OF_MEMORY = -10,
+    SERIAL_ERROR_DISCONNECTED = -11,
+    SERIAL_ERROR_TOO_MANY_CONSUMERS = -12,
+    SERIAL_ERROR_INVALID_PATTERN = -13,
+    SERIAL_ERROR_LINE_CONTROL_FAILED = -14,
+    SERIAL_ERROR_NOT_FOUND = -15,
+    SERIAL_ERROR_TOO_MANY_PORTS = -16,
+    SERIAL_ERROR_ALLOCATOR_IN_USE = -17,
+    SERIAL_ERROR_RECONNECTED = -18,   // Not a failure: marks a reconnection gap
+    SERIAL_ERROR_FRAME_TOO_LARGE = -19,
+    SERIAL_ERROR_BAD_FRAME = -20,     // CRC mismatch or a reply from the wrong unit
 } SerialError;
 
 /// Parity modes
@@ -43,8 +85,16 @@ typedef enum {
     SERIAL_FLOW_NONE = 0,
     SERIAL_FLOW_HARDWARE = 1,  // RTS/CTS
     SERIAL_FLOW_SOFTWARE = 2,  // XON/XOFF
+    SERIAL_FLOW_SOFTWARE_USERSPACE = 3,  // XON/XOFF at the hub ring's watermarks
 } SerialFlowControl;
 
+/// Slow-consumer policies for shared ports
+typedef enum {
+    SERIAL_POLICY_DROP_OLDEST = 0,  // Skip ahead, counting lost bytes
+    SERIAL_POLICY_BLOCK = 1,        // Stall the reader until caught up
+    SERIAL_POLICY_DISCONNECT = 2,   // Detach the consumer
+} SerialConsumerPolicy;
+
 /// Line ending modes
 typedef enum {
     SERIAL_LINE_CR = 0,
@@ -61,6 +111,7 @@ typedef struct {
     uint8_t flow_control;      // SerialFlowControl
     bool local_echo;
     uint8_t line_ending;       // SerialLineEnding
+    bool mark_errors;          // PARMRK: strip and count in-band error markers
 } SerialConfig;
 
 /// Modem status lines
@@ -103,6 +154,46 @@ static inline SerialConfig serial_config_arduino(void) {
     };
 }
 
+// ============================================================================
+// Memory
+// ============================================================================
+
+/// Allocation callback: returns a block of at least `size` bytes aligned to
+/// `alignment` (a power of two), or NULL when out of memory
+typedef void* (*SerialAllocFn)(size_t size, size_t alignment, void* context);
+
+/// Frees a block from SerialAllocFn; size and alignment are those requested
+typedef void (*SerialFreeFn)(void* ptr, size_t size, size_t alignment, void* context);
+
+/**
+ * Routes every allocation the library makes through host callbacks.
+ *
+ * Only possible while the library holds no memory, so call it before
+ * opening the first port. Passing NULL for either callback restores the
+ * built-in allocator.
+ *
+ * Once set up, the steady state does not allocate: reads, writes and
+ * line control never touch the heap, closed ports are recycled for the
+ * next serial_open, and an expect session keeps its scratch memory
+ * between serial_expect calls.
+ *
+ * @param alloc_fn Allocation callback
+ * @param free_fn Free callback
+ * @param context Passed through to both callbacks
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_ALLOCATOR_IN_USE if the library
+ *         already holds memory
+ */
+SerialError serial_set_allocator(SerialAllocFn alloc_fn, SerialFreeFn free_fn, void* context);
+
+/**
+ * Reserves storage for `count` open ports, so the serial_open calls that
+ * follow do not allocate.
+ *
+ * @param count Number of ports to reserve (capped at the port limit)
+ * @return SERIAL_SUCCESS or SERIAL_ERROR_OUT_OF_MEMORY
+ */
+SerialError serial_reserve_ports(size_t count);
+
 // ============================================================================
 // Port Management
 // ============================================================================
@@ -112,7 +203,7 @@ static inline SerialConfig serial_config_arduino(void) {
  *
  * @param path Path to the serial device (e.g., "/dev/cu.usbserial-0001")
  * @param config Pointer to configuration structure
- * @param handle_out Pointer to receive the port handle
+ * @param handle_out Pointer to receive the port handle (0 on failure)
  * @return SERIAL_SUCCESS on success, error code on failure
  */
 SerialError serial_open(const char* path, const SerialConfig* config, SerialPortHandle* handle_out);
@@ -120,10 +211,51 @@ SerialError serial_open(const char* path, const SerialConfig* config, SerialPort
 /**
  * Closes a serial port and releases resources.
  *
+ * Safe to call while other threads are using the handle: calls already in
+ * progress complete before the port is freed, and later calls return
+ * SERIAL_ERROR_INVALID_HANDLE. Hubs, expect sessions, line watchers,
+ * supervisors and Modbus sessions keep the port pinned: it is freed once
+ * the last of them has been destroyed.
+ *
  * @param handle The port handle to close
  */
 void serial_close(SerialPortHandle handle);
 
+/// Virtual pair backends
+typedef enum {
+    SERIAL_VIRTUAL_MEMORY = 0,  // In-process socket pair
+    SERIAL_VIRTUAL_PTY = 1,     // Two pseudo-terminals opened like real devices
+} SerialVirtualMode;
+
+/// Behaviour of the emulated line between a virtual pair
+typedef struct {
+    uint8_t mode;              // SerialVirtualMode
+    uint8_t char_bits;         // Start + data + parity + stop bits (10 for 8N1)
+    uint32_t baud_rate;        // Paces each direction; 0 delivers at once
+    uint32_t fifo_depth;       // Bytes in flight per direction before the writer is held off
+    uint32_t corrupt_one_in;   // Flip a bit in 1 of N bytes (counted as parity errors); 0 = never
+    uint32_t drop_one_in;      // Lose 1 of N bytes (counted as overruns); 0 = never
+    uint64_t seed;             // Seed for the error injection
+} SerialVirtualOptions;
+
+/**
+ * Opens two ports connected to each other, with no hardware involved.
+ *
+ * Whatever one end writes, the other reads, paced to the configured baud
+ * rate and with the configured errors injected. DTR/RTS are wired
+ * null-modem style (DTR to the peer's DSR/DCD, RTS to its CTS), and
+ * serial_get_line_stats reports line changes, breaks and injected errors.
+ * In SERIAL_VIRTUAL_PTY mode both ends are real terminals opened through
+ * the same code path as serial_open.
+ *
+ * @param options Line emulation settings
+ * @param config Configuration applied to both ends
+ * @param a_out Receives the first port handle
+ * @param b_out Receives the second port handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_open_virtual_pair(const SerialVirtualOptions* options, const SerialConfig* config, SerialPortHandle* a_out, SerialPortHandle* b_out);
+
 // ============================================================================
 // Data Transfer
 // ============================================================================
@@ -152,14 +284,123 @@ SerialError serial_write(SerialPortHandle handle, const uint8_t* data, size_t da
 
 /**
  * Writes all data to the serial port, handling partial writes.
+ * Paced when serial_set_pacing is in effect.
  *
  * @param handle The port handle
  * @param data Data to write
  * @param data_len Number of bytes to write
- * @return SERIAL_SUCCESS on success, error code on failure
+ * @return SERIAL_SUCCESS on success, SERIAL_ERROR_TIMEOUT when a line is
+ *         not echoed in time (echo pacing), other error codes on failure
  */
 SerialError serial_write_all(SerialPortHandle handle, const uint8_t* data, size_t data_len);
 
+/**
+ * Asynchronous write notifications.
+ */
+typedef enum {
+    SERIAL_WRITE_ACCEPTED = 0,  /**< The driver has taken the whole message */
+    SERIAL_WRITE_DRAINED = 1,   /**< The message has been sent on the wire */
+    SERIAL_WRITE_FAILED = 2,    /**< Not written, or the port closed before it drained */
+} SerialWriteEvent;
+
+/**
+ * Callback for serial_write_async; runs on the port's writer thread.
+ */
+typedef void (*SerialWriteCallback)(SerialWriteEvent event, void* context);
+
+/**
+ * Queues data as one message for the port's writer thread and returns
+ * without waiting for the port; it only blocks while the 64 KiB queue is
+ * full. Messages go out in submission order through the same path as
+ * serial_write_all, so pacing applies. The data is copied.
+ *
+ * The callback gets SERIAL_WRITE_ACCEPTED or SERIAL_WRITE_FAILED, then
+ * SERIAL_WRITE_DRAINED (or FAILED if the port closes first) when
+ * want_drained is set. Drain tracking compares bytes accepted with the
+ * driver's output queue (TIOCOUTQ), so it reports even while output
+ * continues. serial_close fails whatever is still queued.
+ *
+ * @param handle The port handle
+ * @param data Data to write
+ * @param data_len Number of bytes to write
+ * @param want_drained Also report when the message has been sent
+ * @param callback Notification callback, or NULL
+ * @param context Passed to the callback
+ * @return SERIAL_SUCCESS once queued, error code on failure
+ */
+SerialError serial_write_async(SerialPortHandle handle, const uint8_t* data, size_t data_len, bool want_drained, SerialWriteCallback callback, void* context);
+
+/**
+ * Changes settings on an open port without closing it. Only the settings
+ * that differ from the current configuration are applied, in one
+ * tcsetattr: DTR stays asserted, buffered data is kept, and serial_close
+ * still restores the original settings.
+ *
+ * @param handle The port handle
+ * @param config New configuration
+ * @param drain true to let queued output go out at the old settings first
+ *              (TCSADRAIN), false to switch immediately (TCSANOW)
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_reconfigure(SerialPortHandle handle, const SerialConfig* config, bool drain);
+
+/**
+ * Detects the rate the peer is sending at. Common rates are tried in
+ * turn, each sampled for window_ms and scored on printable text, line
+ * structure, framing errors and known boot banners; the first convincing
+ * one wins. The port is left at the detected rate (other settings are
+ * kept), or at its original rate if nothing convinced.
+ *
+ * The peer has to be talking: pass break_ms or poke for boards that only
+ * answer a break or a keystroke.
+ *
+ * @param handle The port handle
+ * @param window_ms Sampling time per rate (0 = 50 ms)
+ * @param break_ms Break held before each sample (0 = none)
+ * @param poke Text sent before each sample, or NULL
+ * @param baud_out Receives the detected rate
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_NOT_FOUND if no rate convinced
+ */
+SerialError serial_detect_baud(SerialPortHandle handle, uint32_t window_ms, uint32_t break_ms, const char* poke, uint32_t* baud_out);
+
+/**
+ * Transmit pacing modes.
+ */
+typedef enum {
+    SERIAL_PACING_OFF = 0,
+    SERIAL_PACING_PER_CHAR = 1,     /**< One character at a time */
+    SERIAL_PACING_PER_LINE = 2,     /**< One line at a time, each drained first */
+    SERIAL_PACING_TOKEN_BUCKET = 3, /**< Bursts of up to `burst` characters */
+    SERIAL_PACING_ECHO = 4,         /**< One line at a time, each echoed first */
+} SerialPacingMode;
+
+/**
+ * Transmit pacing parameters. Delays are derived from the port's baud
+ * rate, data bits, parity and stop bits.
+ */
+typedef struct {
+    uint8_t mode;             /**< SerialPacingMode */
+    uint8_t rate_percent;     /**< Pace at this percentage of the line rate (1-100) */
+    uint16_t burst;           /**< Token bucket depth, usually the target's FIFO size */
+    uint32_t char_delay_us;   /**< Extra gap after each character (per char) */
+    uint32_t line_delay_us;   /**< Extra gap after each line (per line, echo) */
+    uint32_t max_queued;      /**< Driver output queue ceiling in bytes (TIOCOUTQ) */
+    uint32_t echo_timeout_ms; /**< How long to wait for each line's echo */
+} SerialPacing;
+
+/**
+ * Paces serial_write_all for targets with shallow receive FIFOs.
+ *
+ * Echo pacing watches the port's reads for each line's terminator, so
+ * another thread must be reading the port while serial_write_all runs.
+ * Set pacing before traffic starts.
+ *
+ * @param handle The port handle
+ * @param pacing Pacing parameters, or NULL to turn pacing off
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_set_pacing(SerialPortHandle handle, const SerialPacing* pacing);
+
 // ============================================================================
 // Control Signals
 // ============================================================================
@@ -212,13 +453,22 @@ SerialError serial_get_modem_status(SerialPortHandle handle, ModemStatus* status
 SerialError serial_flush_input(SerialPortHandle handle);
 
 /**
- * Flushes the output buffer (waits for data to be sent).
+ * Discards output not yet sent (TCOFLUSH). To wait for it to be sent
+ * instead, use serial_drain.
  *
  * @param handle The port handle
  * @return SERIAL_SUCCESS on success, error code on failure
  */
 SerialError serial_flush_output(SerialPortHandle handle);
 
+/**
+ * Waits until everything written has been sent on the wire (tcdrain).
+ *
+ * @param handle The port handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_drain(SerialPortHandle handle);
+
 /**
  * Flushes both input and output buffers.
  *
@@ -252,6 +502,87 @@ bool serial_wait_for_data(SerialPortHandle handle, uint32_t timeout_ms);
  */
 int serial_get_fd(SerialPortHandle handle);
 
+// ============================================================================
+// Line Statistics
+// ============================================================================
+
+/// Driver interrupt counters (Linux TIOCGICOUNT)
+typedef struct {
+    uint32_t rx;
+    uint32_t tx;
+    uint32_t frame;        // Framing errors
+    uint32_t parity;       // Parity errors
+    uint32_t overrun;      // UART FIFO overruns
+    uint32_t buf_overrun;  // Kernel buffer overruns
+    uint32_t brk;          // Breaks received
+} SerialLineCounters;
+
+/// Line error statistics
+typedef struct {
+    bool counters_valid;          // false if the driver keeps no counters
+    SerialLineCounters total;     // Since the driver started counting
+    SerialLineCounters delta;     // Since the previous call
+    uint64_t marked_errors;       // Seen via PARMRK (mark_errors)
+    uint64_t marked_breaks;
+    uint64_t interval_ns;         // Time covered by delta (since open on first call)
+} SerialLineStats;
+
+/**
+ * Reads UART error and traffic counters. Call periodically: delta holds
+ * the change since the previous call, or since the port was opened on the
+ * first call. Counters are available on Linux
+ * for drivers that implement TIOCGICOUNT; PARMRK counts work everywhere
+ * when the port was opened with mark_errors.
+ *
+ * @param handle The port handle
+ * @param stats Pointer to receive the statistics
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_get_line_stats(SerialPortHandle handle, SerialLineStats* stats);
+
+/// Latency distribution summary (values are bucket upper bounds, <= 12.5% error)
+typedef struct {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} SerialLatency;
+
+/// Traffic statistics
+typedef struct {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t read_calls;        // rx_bytes / read_calls = bytes per syscall
+    uint64_t write_calls;
+    uint64_t ring_high_water;   // Largest shared-ring backlog (hub)
+    uint64_t dropped_bytes;     // Lost to slow drop-oldest consumers
+    SerialLatency rx_latency;   // Data ready (poll) -> returned by read
+    SerialLatency drain_latency; // Write submitted -> output queue empty
+} SerialStats;
+
+/**
+ * Snapshots the port's always-on traffic counters and latency
+ * histograms. Safe to call from any thread.
+ *
+ * @param handle The port handle
+ * @param stats Pointer to receive the statistics
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_get_stats(SerialPortHandle handle, SerialStats* stats);
+
+/**
+ * Writes the trace events recorded by every thread (port reads/writes,
+ * transfer state changes, ...) as Chrome trace JSON, viewable in
+ * chrome://tracing or ui.perfetto.dev. Requires a -Dtrace=true build.
+ *
+ * @param path File to create or overwrite
+ * @return SERIAL_SUCCESS on success, SERIAL_ERROR_OPEN_FAILED if tracing
+ *         is not compiled in, SERIAL_ERROR_WRITE_ERROR on I/O failure
+ */
+SerialError serial_trace_dump(const char* path);
+
 // ============================================================================
 // Port Enumeration
 // ============================================================================
@@ -273,6 +604,699 @@ typedef void (*SerialEnumCallback)(const char* path, void* context);
  */
 SerialError serial_enumerate_ports(SerialEnumCallback callback, void* context);
 
+// ============================================================================
+// Port Registry
+// ============================================================================
+
+/**
+ * Callback for registry changes.
+ *
+ * @param is_added true when the device appeared, false when it went away
+ * @param path Device path, valid only during the call
+ * @param context User context passed to serial_registry_create
+ */
+typedef void (*SerialRegistryCallback)(bool is_added, const char* path, void* context);
+
+/**
+ * Scans /dev once, then keeps the port list current from hotplug
+ * notifications (inotify on Linux, kqueue on macOS) on a helper thread.
+ *
+ * @param callback Called on the helper thread for each change (may be NULL)
+ * @param context User context passed to callback
+ * @param registry_out Receives the registry handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_registry_create(SerialRegistryCallback callback, void* context, SerialRegistryHandle* registry_out);
+
+/**
+ * Stops tracking and frees the registry; destroy any supervisors using it
+ * first. No callbacks run after this returns.
+ */
+void serial_registry_destroy(SerialRegistryHandle registry);
+
+/**
+ * Returns a counter that increments on every change to the port list,
+ * so pickers can skip refreshing when nothing happened.
+ */
+uint64_t serial_registry_generation(SerialRegistryHandle registry);
+
+/**
+ * Lists the current ports from the registry's snapshot without touching
+ * /dev.
+ *
+ * @param registry Registry handle
+ * @param callback Function to call for each port
+ * @param context User context passed to callback
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_registry_ports(SerialRegistryHandle registry, SerialEnumCallback callback, void* context);
+
+/// Device identity (Linux sysfs and udev links). Strings are
+/// NUL-terminated and empty when unknown.
+typedef struct {
+    char path[128];
+    char serial_number[128];
+    char manufacturer[128];
+    char product[128];
+    char driver[128];
+    char by_id[128];            ///< /dev/serial/by-id/... link
+    char by_path[128];          ///< /dev/serial/by-path/... link
+    uint16_t vendor_id;         ///< USB VID, 0 if unknown
+    uint16_t product_id;        ///< USB PID, 0 if unknown
+    int16_t interface_number;   ///< USB interface, -1 if unknown
+} SerialPortInfo;
+
+/// Callback receiving one port's metadata, valid only during the call
+typedef void (*SerialPortInfoCallback)(const SerialPortInfo* info, void* context);
+
+/**
+ * Finds a port in the registry's index. Metadata is read once when a
+ * device appears, so lookups never touch sysfs.
+ *
+ * @param registry Registry handle
+ * @param key Device path, /dev name, USB serial number, or by-id/by-path link
+ * @param info_out Receives the port's metadata
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_NOT_FOUND if nothing matches
+ */
+SerialError serial_registry_lookup(SerialRegistryHandle registry, const char* key, SerialPortInfo* info_out);
+
+/**
+ * Calls callback with the metadata of every port in the current list.
+ */
+SerialError serial_registry_port_infos(SerialRegistryHandle registry, SerialPortInfoCallback callback, void* context);
+
+// ============================================================================
+// Shared Port (Hub)
+// ============================================================================
+
+/**
+ * Shares an open port between several consumers. A reader thread copies
+ * received data once into a shared ring; each consumer reads it through
+ * its own cursor. Destroy the hub before closing the port.
+ *
+ * @param handle The port handle
+ * @param ring_size Ring capacity in bytes (rounded up to a power of two)
+ * @param hub_out Pointer to receive the hub handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_hub_create(SerialPortHandle handle, size_t ring_size, SerialHubHandle* hub_out);
+
+/**
+ * Sets where the hub stops and restarts the peer under
+ * SERIAL_FLOW_SOFTWARE_USERSPACE: XOFF goes out once the slowest
+ * consumer's unread backlog reaches high_water bytes, XON once it is back
+ * down to low_water. Defaults are 3/4 and 1/4 of the ring.
+ *
+ * @param hub The hub handle
+ * @param high_water Backlog that sends XOFF
+ * @param low_water Backlog that sends XON (below high_water)
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_hub_set_watermarks(SerialHubHandle hub, size_t high_water, size_t low_water);
+
+/**
+ * Stops the reader thread and frees the hub. The port stays open.
+ *
+ * @param hub The hub handle
+ */
+void serial_hub_destroy(SerialHubHandle hub);
+
+/**
+ * Attaches a consumer. It receives only data arriving after this call.
+ *
+ * @param hub The hub handle
+ * @param policy SerialConsumerPolicy applied when the consumer falls a ring behind
+ * @param consumer_out Pointer to receive the consumer handle
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_TOO_MANY_CONSUMERS
+ */
+SerialError serial_hub_attach(SerialHubHandle hub, uint8_t policy, SerialConsumerHandle* consumer_out);
+
+/**
+ * Detaches a consumer.
+ *
+ * @param consumer The consumer handle
+ */
+void serial_hub_detach(SerialConsumerHandle consumer);
+
+/**
+ * Reads unread data for a consumer.
+ *
+ * @param consumer The consumer handle
+ * @param buffer Buffer to receive data
+ * @param buffer_len Size of the buffer
+ * @param timeout_ms Time to wait for data (0 = don't wait)
+ * @param bytes_read Pointer to receive number of bytes read (0 on timeout)
+ * @return SERIAL_SUCCESS, SERIAL_ERROR_DISCONNECTED or SERIAL_ERROR_PORT_CLOSED;
+ *         SERIAL_ERROR_RECONNECTED (once, with no data) where a supervised
+ *         port was reopened, so the consumer can mark the gap
+ */
+SerialError serial_hub_read(SerialConsumerHandle consumer, uint8_t* buffer, size_t buffer_len, uint32_t timeout_ms, size_t* bytes_read);
+
+/**
+ * Returns the number of bytes a drop-oldest consumer has lost.
+ *
+ * @param consumer The consumer handle
+ * @return Dropped byte count
+ */
+uint64_t serial_hub_dropped(SerialConsumerHandle consumer);
+
+/**
+ * Writes data as one message. Concurrent writers are served in arrival
+ * order and their messages never interleave.
+ *
+ * @param hub The hub handle
+ * @param data Data to write
+ * @param data_len Number of bytes to write
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_hub_write(SerialHubHandle hub, const uint8_t* data, size_t data_len);
+
+// ============================================================================
+// Reconnect
+// ============================================================================
+
+/**
+ * Follows the port's device by USB serial number (by-id link for ports
+ * sharing one, path for devices without USB identity) and reopens the
+ * port in place with the same configuration when the adapter comes back
+ * after a reset or re-plug, even under a new /dev name. The handle stays
+ * valid throughout.
+ *
+ * A hub passed here waits out the outage: its ring and consumers carry
+ * on, hub writes wait and are resent whole, and each consumer's read
+ * returns SERIAL_ERROR_RECONNECTED once at the gap.
+ *
+ * The device is tracked through a registry from serial_registry_create,
+ * which any number of supervisors can share. Destroy its supervisors
+ * before the registry.
+ *
+ * @param handle The port handle
+ * @param registry Registry tracking the device
+ * @param hub Hub reading the port, or NULL
+ * @param supervisor_out Pointer to receive the supervisor handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_supervise(SerialPortHandle handle, SerialRegistryHandle registry, SerialHubHandle hub, SerialSupervisorHandle* supervisor_out);
+
+/**
+ * Stops supervising. Destroy a supervised hub first.
+ */
+void serial_supervisor_destroy(SerialSupervisorHandle supervisor);
+
+/**
+ * Returns how many times the port has been reopened.
+ */
+uint64_t serial_supervisor_reconnects(SerialSupervisorHandle supervisor);
+
+// ============================================================================
+// Framing
+// ============================================================================
+
+/// Frame formats
+typedef enum {
+    SERIAL_FRAME_LINE = 0,        // Newline-terminated; a preceding CR is stripped
+    SERIAL_FRAME_SLIP = 1,        // RFC 1055
+    SERIAL_FRAME_COBS = 2,        // Zero-delimited
+    SERIAL_FRAME_LENGTH_U8 = 3,   // Payload length header, then payload
+    SERIAL_FRAME_LENGTH_U16 = 4,
+    SERIAL_FRAME_LENGTH_U32 = 5,
+} SerialFrameKind;
+
+/// CRC trailer after the payload (not used with SERIAL_FRAME_LINE)
+typedef enum {
+    SERIAL_FRAME_CRC_NONE = 0,
+    SERIAL_FRAME_CRC16_CCITT = 1,   // CRC-16/XMODEM, big-endian
+    SERIAL_FRAME_CRC16_MODBUS = 2,  // Little-endian
+    SERIAL_FRAME_CRC32 = 3,         // IEEE, little-endian
+} SerialFrameCrc;
+
+/// Frame format for serial_framer_create and serial_frame_encode
+typedef struct {
+    uint8_t kind;           // SerialFrameKind
+    uint8_t crc;            // SerialFrameCrc
+    bool little_endian;     // Byte order of length headers
+    uint32_t max_frame;     // Largest payload accepted (0 = 4096)
+} SerialFramerOptions;
+
+/**
+ * Creates an incremental frame decoder. Frames come out as pointers into
+ * the decoder's buffer, valid until the next feed or read; SLIP and COBS
+ * frames are decoded in place. Frames with bad encoding or a bad CRC are
+ * skipped, and the stream resynchronises at the next delimiter.
+ *
+ * @param options Frame format
+ * @param framer_out Pointer to receive the decoder handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_framer_create(const SerialFramerOptions* options, SerialFramerHandle* framer_out);
+
+/**
+ * Frees a frame decoder.
+ */
+void serial_framer_destroy(SerialFramerHandle framer);
+
+/**
+ * Copies received bytes into the decoder, as many as fit. Take frames
+ * with serial_framer_next until it returns false before feeding the rest.
+ *
+ * @param framer The decoder handle
+ * @param data Received bytes
+ * @param data_len Number of bytes
+ * @param accepted Pointer to receive how many bytes were taken
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_framer_feed(SerialFramerHandle framer, const uint8_t* data, size_t data_len, size_t* accepted);
+
+/**
+ * Takes the next complete frame.
+ *
+ * @param framer The decoder handle
+ * @param frame Pointer to receive the payload (CRC removed)
+ * @param frame_len Pointer to receive the payload length
+ * @return true if a frame was available
+ */
+bool serial_framer_next(SerialFramerHandle framer, const uint8_t** frame, size_t* frame_len);
+
+/**
+ * Reads the port directly into the decoder until a frame is complete.
+ * Do not mix with serial_read on the same port.
+ *
+ * @param framer The decoder handle
+ * @param handle The port handle
+ * @param timeout_ms Longest wait for a complete frame
+ * @param frame Pointer to receive the payload
+ * @param frame_len Pointer to receive the payload length
+ * @return SERIAL_SUCCESS, SERIAL_ERROR_TIMEOUT, or another error code
+ */
+SerialError serial_framer_read(SerialFramerHandle framer, SerialPortHandle handle, uint32_t timeout_ms, const uint8_t** frame, size_t* frame_len);
+
+/**
+ * Encodes one frame, CRC and delimiters included, ready to write.
+ *
+ * @param options Frame format
+ * @param payload Frame payload
+ * @param payload_len Payload length
+ * @param out Output buffer
+ * @param out_len Output buffer size
+ * @param encoded_len Pointer to receive the encoded length
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_FRAME_TOO_LARGE if the payload
+ *         exceeds max_frame or the encoding does not fit in out
+ */
+SerialError serial_frame_encode(const SerialFramerOptions* options, const uint8_t* payload, size_t payload_len, uint8_t* out, size_t out_len, size_t* encoded_len);
+
+// ============================================================================
+// Modbus RTU
+// ============================================================================
+
+/// A received Modbus frame. data points into the master or sniffer and
+/// stays valid until its next call.
+typedef struct {
+    uint8_t unit;
+    uint8_t function;       // Bit 7 set for an exception response
+    bool response;          // Sniffer: answers the previous frame
+    const uint8_t* data;    // PDU after the function code, CRC removed
+    size_t data_len;
+    uint64_t timestamp_ns;  // When the last byte was read (CLOCK_MONOTONIC)
+} SerialModbusFrame;
+
+/// One slave query for serial_modbus_poll. Zero failures and skip at
+/// first and keep the array between cycles: they hold the back-off for
+/// slaves that stop answering.
+typedef struct {
+    uint8_t unit;
+    uint8_t function;
+    const uint8_t* data;    // Request PDU after the function code
+    size_t data_len;
+    uint32_t failures;
+    uint32_t skip;
+} SerialModbusPoll;
+
+/**
+ * Callback for serial_modbus_poll. response is NULL unless status is
+ * SERIAL_SUCCESS.
+ */
+typedef void (*SerialModbusPollCallback)(const SerialModbusPoll* poll, SerialError status, const SerialModbusFrame* response, void* context);
+
+/**
+ * Starts a Modbus RTU master on the port. Frames end at 3.5 character
+ * times of silence, computed from the port's current configuration; a
+ * response of known length completes as soon as its last byte arrives.
+ * The port stays open until serial_modbus_destroy.
+ *
+ * @param handle The port handle
+ * @param response_timeout_ms How long a slave may take to answer (0 = 100)
+ * @param master_out Pointer to receive the master handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_modbus_create(SerialPortHandle handle, uint32_t response_timeout_ms, SerialModbusHandle* master_out);
+
+/**
+ * Frees a Modbus master.
+ */
+void serial_modbus_destroy(SerialModbusHandle master);
+
+/**
+ * Sends one request and waits for the response. A broadcast (unit 0)
+ * returns with no response once the turnaround delay is scheduled.
+ *
+ * @param master The master handle
+ * @param unit Slave address
+ * @param function Function code
+ * @param data Request PDU after the function code
+ * @param data_len Length of data
+ * @param response Receives the response (zeroed for broadcasts)
+ * @return SERIAL_SUCCESS (check response->function for an exception),
+ *         SERIAL_ERROR_TIMEOUT, SERIAL_ERROR_BAD_FRAME, or another error
+ */
+SerialError serial_modbus_transact(SerialModbusHandle master, uint8_t unit, uint8_t function, const uint8_t* data, size_t data_len, SerialModbusFrame* response);
+
+/**
+ * Runs one polling cycle: requests go out back to back, each right after
+ * the previous response plus the inter-frame silence. A slave that fails
+ * three times in a row is retried only every eighth cycle, so it does not
+ * cost a timeout every cycle.
+ *
+ * @param master The master handle
+ * @param polls Queries, updated in place
+ * @param count Number of queries
+ * @param callback Receives each result
+ * @param context Passed to callback
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_modbus_poll(SerialModbusHandle master, SerialModbusPoll* polls, size_t count, SerialModbusPollCallback callback, void* context);
+
+/**
+ * Starts a passive bus monitor on the port; it never transmits. Requests
+ * and responses the driver delivers in one read are split apart by CRC.
+ *
+ * @param handle The port handle
+ * @param sniffer_out Pointer to receive the monitor handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_modbus_sniffer_create(SerialPortHandle handle, SerialModbusSnifferHandle* sniffer_out);
+
+/**
+ * Frees a bus monitor.
+ */
+void serial_modbus_sniffer_destroy(SerialModbusSnifferHandle sniffer);
+
+/**
+ * Waits for the next frame with a good CRC.
+ *
+ * @param sniffer The monitor handle
+ * @param timeout_ms Longest wait
+ * @param frame Receives the frame
+ * @return SERIAL_SUCCESS, SERIAL_ERROR_TIMEOUT, or another error code
+ */
+SerialError serial_modbus_sniff(SerialModbusSnifferHandle sniffer, uint32_t timeout_ms, SerialModbusFrame* frame);
+
+// ============================================================================
+// NMEA
+// ============================================================================
+
+/// Fix data (GGA). Empty fields read as NaN, or UINT32_MAX for time_ms.
+typedef struct {
+    double latitude;            // Degrees, south negative
+    double longitude;           // Degrees, west negative
+    float hdop;
+    float altitude_m;           // Above mean sea level
+    float geoid_separation_m;
+    uint32_t time_ms;           // UTC milliseconds since midnight
+    uint8_t quality;            // 0 no fix, 1 GPS, 2 DGPS, 4 RTK fixed, 5 RTK float
+    uint8_t satellites;
+} SerialNmeaGga;
+
+/// Recommended minimum data (RMC). Empty fields read as NaN, UINT32_MAX
+/// for time_ms, or a zero date.
+typedef struct {
+    double latitude;
+    double longitude;
+    float speed_knots;
+    float course_deg;
+    uint32_t time_ms;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    bool valid;                 // Status A (V: no valid fix)
+} SerialNmeaRmc;
+
+/// One satellite in view; -1 where the field is empty
+typedef struct {
+    uint16_t prn;
+    int16_t elevation_deg;
+    int16_t azimuth_deg;
+    int16_t snr;                // C/N0 in dB-Hz
+} SerialNmeaSatellite;
+
+/// Satellites in view (GSV), up to four per sentence
+typedef struct {
+    uint8_t total_messages;
+    uint8_t message;
+    uint8_t satellites_in_view;
+    uint8_t count;              // Entries used in satellites
+    int16_t signal_id;          // NMEA 4.10 signal ID, or -1
+    SerialNmeaSatellite satellites[4];
+} SerialNmeaGsv;
+
+/// Sentence types decoded into structs
+typedef enum {
+    SERIAL_NMEA_OTHER = 0,
+    SERIAL_NMEA_GGA = 1,
+    SERIAL_NMEA_RMC = 2,
+    SERIAL_NMEA_GSV = 3,
+} SerialNmeaKind;
+
+/// A sentence with a good checksum. Only the pointer matching kind is
+/// set; everything is valid only during the callback.
+typedef struct {
+    const char* raw;            // From '$' up to the '*', not NUL-terminated
+    size_t raw_len;
+    char talker[4];             // "GP", "GN", ... ("P" if proprietary)
+    char formatter[8];          // "GGA", "RMC", ...
+    uint8_t kind;               // SerialNmeaKind
+    const SerialNmeaGga* gga;
+    const SerialNmeaRmc* rmc;
+    const SerialNmeaGsv* gsv;
+} SerialNmeaSentence;
+
+/**
+ * Callback for decoded sentences; runs on the calling thread.
+ */
+typedef void (*SerialNmeaCallback)(const SerialNmeaSentence* sentence, void* context);
+
+/**
+ * Creates a streaming NMEA-0183 decoder. Sentences are found with vector
+ * scans, checksums verified and fields split without allocating; a
+ * sentence cut off at the end of a read is completed by the next.
+ *
+ * @param decoder_out Pointer to receive the decoder handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_nmea_create(SerialNmeaHandle* decoder_out);
+
+/**
+ * Frees an NMEA decoder.
+ */
+void serial_nmea_destroy(SerialNmeaHandle decoder);
+
+/**
+ * Decodes received bytes, calling callback for each complete sentence.
+ *
+ * @param decoder The decoder handle
+ * @param data Received bytes
+ * @param data_len Number of bytes
+ * @param callback Receives each sentence
+ * @param context Passed to callback
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_nmea_feed(SerialNmeaHandle decoder, const uint8_t* data, size_t data_len, SerialNmeaCallback callback, void* context);
+
+/**
+ * Waits for data on the port, reads it and decodes it. Do not mix with
+ * serial_read on the same port.
+ *
+ * @param decoder The decoder handle
+ * @param handle The port handle
+ * @param timeout_ms Longest wait for data
+ * @param callback Receives each sentence
+ * @param context Passed to callback
+ * @return SERIAL_SUCCESS, SERIAL_ERROR_TIMEOUT, or another error code
+ */
+SerialError serial_nmea_read(SerialNmeaHandle decoder, SerialPortHandle handle, uint32_t timeout_ms, SerialNmeaCallback callback, void* context);
+
+// ============================================================================
+// Expect Automation
+// ============================================================================
+
+/// One alternative for serial_expect
+typedef struct {
+    const char* literal;  // Text that triggers the match (required)
+    const char* regex;    // Must also match the current line, or NULL
+    const char* reply;    // Sent immediately on match, or NULL
+} SerialExpectPattern;
+
+/**
+ * Starts an expect session. The session buffers data received after a
+ * match for the next serial_expect call, so do not mix it with
+ * serial_read on the same port.
+ *
+ * @param handle The port handle
+ * @param session_out Pointer to receive the session handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_expect_create(SerialPortHandle handle, SerialExpectHandle* session_out);
+
+/**
+ * Frees an expect session. The port stays open.
+ *
+ * @param session The session handle
+ */
+void serial_expect_destroy(SerialExpectHandle session);
+
+/**
+ * Writes data to the port.
+ *
+ * @param session The session handle
+ * @param data Data to send
+ * @param data_len Number of bytes to send
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_expect_send(SerialExpectHandle session, const uint8_t* data, size_t data_len);
+
+/**
+ * Waits until any of the patterns appears in the received stream. All
+ * literals are matched at once; a pattern's reply is sent before any
+ * further data is read.
+ *
+ * @param session The session handle
+ * @param patterns Array of patterns (at most 64)
+ * @param count Number of patterns
+ * @param timeout_ms Timeout in milliseconds
+ * @param match_index Pointer to receive the index of the matching pattern
+ * @return SERIAL_SUCCESS on match, SERIAL_ERROR_TIMEOUT on timeout,
+ *         SERIAL_ERROR_INVALID_PATTERN for an empty literal or bad regex
+ */
+SerialError serial_expect(SerialExpectHandle session, const SerialExpectPattern* patterns, size_t count, uint32_t timeout_ms, size_t* match_index);
+
+// ============================================================================
+// Line Sequencing
+// ============================================================================
+
+/// One step of a DTR/RTS waveform
+typedef struct {
+    int8_t dtr;        // 1 = assert, 0 = deassert, -1 = unchanged
+    int8_t rts;        // 1 = assert, 0 = deassert, -1 = unchanged
+    uint32_t hold_us;  // Time until the next step
+} SerialLineStep;
+
+/// Achieved timing of a sequence run
+typedef struct {
+    uint32_t steps;
+    uint64_t max_jitter_ns;   // Worst deviation of a line change from schedule
+    uint64_t mean_jitter_ns;
+    uint64_t total_ns;
+} SerialLineTiming;
+
+/// Built-in sequences
+typedef enum {
+    SERIAL_LINE_PRESET_ESP32_BOOTLOADER = 0,  // EN on RTS, IO0 on DTR
+    SERIAL_LINE_PRESET_ESP32_RESET = 1,
+    SERIAL_LINE_PRESET_STM32_BOOTLOADER = 2,  // NRST on DTR, BOOT0 on RTS
+    SERIAL_LINE_PRESET_STM32_RESET = 3,
+} SerialLinePreset;
+
+/**
+ * Plays a DTR/RTS waveform. Each step changes both lines with a single
+ * ioctl; holds are timed against the monotonic clock with a final
+ * busy-wait, so steps land within microseconds of their schedule.
+ *
+ * @param handle The port handle
+ * @param steps Array of steps (at most 64)
+ * @param count Number of steps
+ * @param timing Optional pointer to receive the achieved timing
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_run_line_sequence(SerialPortHandle handle, const SerialLineStep* steps, size_t count, SerialLineTiming* timing);
+
+/**
+ * Plays a built-in reset or bootloader-entry sequence.
+ *
+ * @param handle The port handle
+ * @param preset One of SerialLinePreset
+ * @param timing Optional pointer to receive the achieved timing
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_run_line_preset(SerialPortHandle handle, uint8_t preset, SerialLineTiming* timing);
+
+// ============================================================================
+// Modem-Line Watching
+// ============================================================================
+
+/// A change on CTS/DSR/DCD/RI
+typedef struct {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    ModemStatus status;     // Line state after the change
+    uint32_t cts_changes;   // Transitions since the previous event;
+    uint32_t dsr_changes;   // more than one means a short pulse was
+    uint32_t dcd_changes;   // folded into this event
+    uint32_t ri_changes;
+} SerialLineEvent;
+
+/**
+ * Callback for modem-line events. Runs on the watcher thread.
+ *
+ * @param event The event
+ * @param context User-provided context pointer
+ */
+typedef void (*SerialLineEventCallback)(const SerialLineEvent* event, void* context);
+
+/**
+ * Chooses the signal used to wake watcher threads out of TIOCMIWAIT when
+ * they stop. A no-op handler is installed for it, without SA_RESTART, when
+ * the next watcher starts. The default is SIGURG, which is ignored by
+ * default, so deliveries are harmless. Pass 0 to use no signal; watchers
+ * then poll every 10 ms. Call this before starting any watcher.
+ *
+ * @param signal Signal number, or 0
+ * @return SERIAL_SUCCESS, or SERIAL_ERROR_CONFIG_FAILED for an invalid number
+ */
+SerialError serial_line_watch_set_signal(int signal);
+
+/**
+ * Starts watching CTS, DSR, DCD and RI on a helper thread. On Linux the
+ * thread sleeps in TIOCMIWAIT and uses TIOCGICOUNT to count transitions;
+ * elsewhere it polls every 10 ms. Events are passed to the callback (if
+ * any) and queued for serial_line_watch_poll.
+ *
+ * Stopping a watcher interrupts TIOCMIWAIT with a signal sent to the
+ * watcher thread only (SIGURG unless changed with
+ * serial_line_watch_set_signal).
+ *
+ * @param handle The port handle
+ * @param callback Optional callback for each event (may be NULL)
+ * @param context User context passed to callback
+ * @param watcher_out Pointer to receive the watcher handle
+ * @return SERIAL_SUCCESS on success, error code on failure
+ */
+SerialError serial_line_watch_start(SerialPortHandle handle, SerialLineEventCallback callback, void* context, SerialLineWatcherHandle* watcher_out);
+
+/**
+ * Stops a watcher. No callbacks run after this returns.
+ *
+ * @param watcher The watcher handle
+ */
+void serial_line_watch_stop(SerialLineWatcherHandle watcher);
+
+/**
+ * Copies queued events, oldest first. The queue holds the last 64 events.
+ *
+ * @param watcher The watcher handle
+ * @param events Buffer to receive events
+ * @param max_events Capacity of the buffer
+ * @return Number of events copied
+ */
+size_t serial_line_watch_poll(SerialLineWatcherHandle watcher, SerialLineEvent* events, size_t max_events);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,413 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const serial = @import("serial");
+const transfer = @import("transfer");
+const Report = @import("report.zig").Report;
+
+const Port = serial.port.Port;
+const VirtualPort = serial.virtual_port.VirtualPort;
+const Histogram = serial.stats.Histogram;
+const clock = serial.clock;
+
+const usage =
+    \\Usage: serialterm-bench [options]
+    \\
+    \\Runs serial I/O scenarios over virtual port pairs (in-memory and pty)
+    \\and writes the results to stdout as JSON.
+    \\
+    \\Options:
+    \\  -q, --quick             Short runs, for CI smoke checks
+    \\  -s, --scenario <name>   Run only this scenario: rx_throughput,
+    \\                          tx_write_latency, echo_rtt, many_ports,
+    \\                          transfer_goodput
+    \\  -h, --help              Show this help
+    \\
+;
+
+const Scenario = enum {
+    rx_throughput,
+    tx_write_latency,
+    echo_rtt,
+    many_ports,
+    transfer_goodput,
+};
+
+const backends = [_]VirtualPort.Mode{ .memory, .pty };
+
+/// Shared by every scenario
+const Bench = struct {
+    allocator: std.mem.Allocator,
+    report: *Report,
+    quick: bool,
+
+    fn pick(self: Bench, quick: anytype, full: @TypeOf(quick)) @TypeOf(quick) {
+        return if (self.quick) quick else full;
+    }
+};
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var quick = false;
+    var only: ?Scenario = null;
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "-h") or std.mem.eql(u8, arg, "--help")) {
+            std.debug.print("{s}", .{usage});
+            return;
+        } else if (std.mem.eql(u8, arg, "-q") or std.mem.eql(u8, arg, "--quick")) {
+            quick = true;
+        } else if (std.mem.eql(u8, arg, "-s") or std.mem.eql(u8, arg, "--scenario")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            only = std.meta.stringToEnum(Scenario, args[i]) orelse return fail("unknown scenario: {s}", .{args[i]});
+        } else {
+            return fail("unknown option: {s}", .{arg});
+        }
+    }
+
+    var report = Report{ .fd = std.posix.STDOUT_FILENO };
+    try report.begin(@tagName(builtin.os.tag), quick);
+    const bench = Bench{ .allocator = allocator, .report = &report, .quick = quick };
+
+    for (std.enums.values(Scenario)) |scenario| {
+        if (only != null and only.? != scenario) continue;
+        const result = switch (scenario) {
+            .rx_throughput => rxThroughput(bench),
+            .tx_write_latency => txWriteLatency(bench),
+            .echo_rtt => echoRtt(bench),
+            .many_ports => manyPorts(bench),
+            .transfer_goodput => transferGoodput(bench),
+        };
+        // A failed scenario is logged and skipped; the rest still run
+        result catch |err| std.log.err("{s}: {s}", .{ @tagName(scenario), @errorName(err) });
+    }
+    try report.finish();
+}
+
+fn fail(comptime fmt: []const u8, args: anytype) error{InvalidArgument} {
+    std.log.err(fmt, args);
+    return error.InvalidArgument;
+}
+
+/// An open virtual pair; `ports[0]` and `ports[1]` are the two ends
+const Pair = struct {
+    ports: [2]Port,
+
+    fn open(allocator: std.mem.Allocator, options: VirtualPort.Options) !Pair {
+        const pair = try VirtualPort.create(allocator, options);
+        defer pair.release();
+        return .{ .ports = try pair.open(.{}) };
+    }
+
+    fn close(self: *Pair) void {
+        for (&self.ports) |*p| p.close();
+    }
+};
+
+fn readExactly(port: *Port, out: []u8) !void {
+    var got: usize = 0;
+    while (got < out.len) {
+        if (!port.waitForData(5000)) return error.Timeout;
+        got += try port.read(out[got..]);
+    }
+}
+
+/// Writes `total` bytes in `chunk`-sized writes, on its own thread
+fn writeFor(port: *Port, total: usize, chunk: usize) void {
+    var buf: [4096]u8 = undefined;
+    for (&buf, 0..) |*b, n| b.* = @truncate(n);
+    var sent: usize = 0;
+    while (sent < total) {
+        const n = @min(chunk, buf.len, total - sent);
+        port.writeAll(buf[0..n]) catch return;
+        sent += n;
+    }
+}
+
+fn seconds(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_s;
+}
+
+/// Sustained one-way throughput at simulated line rates (0 = unpaced)
+fn rxThroughput(bench: Bench) !void {
+    const bauds = [_]u32{ 115200, 921600, 0 };
+    for (backends) |mode| {
+        for (bauds) |baud| {
+            // Paced runs last about a second (a quarter in quick mode)
+            const total: usize = if (baud == 0) bench.pick(@as(usize, 4 << 20), 64 << 20) else baud / 10 / bench.pick(@as(usize, 4), 1);
+
+            var pair = try Pair.open(bench.allocator, .{ .mode = mode, .baud = baud });
+            defer pair.close();
+
+            const start = clock.now();
+            const writer = try std.Thread.spawn(.{}, writeFor, .{ &pair.ports[0], total, 4096 });
+            var buf: [4096]u8 = undefined;
+            var got: usize = 0;
+            while (got < total) {
+                if (!pair.ports[1].waitForData(5000)) break;
+                got += try pair.ports[1].read(&buf);
+            }
+            const elapsed = clock.now() - start;
+            writer.join();
+
+            const rate = @as(f64, @floatFromInt(got)) / seconds(elapsed);
+            const rx = pair.ports[1].stats.snapshot();
+            try bench.report.result("rx_throughput", @tagName(mode));
+            try bench.report.field("baud", baud);
+            try bench.report.field("bytes", got);
+            try bench.report.field("seconds", seconds(elapsed));
+            try bench.report.field("bytes_per_second", rate);
+            if (baud != 0) try bench.report.field("line_efficiency", rate / (@as(f64, @floatFromInt(baud)) / 10));
+            try bench.report.field("bytes_per_read", rx.bytesPerRead());
+            try bench.report.endResult();
+        }
+    }
+}
+
+/// Drains a port until `stop` is set
+fn drain(port: *Port, stop: *std.atomic.Value(bool)) void {
+    var buf: [4096]u8 = undefined;
+    while (!stop.load(.acquire)) {
+        if (port.waitForData(50)) _ = port.read(&buf) catch return;
+    }
+}
+
+/// Time spent in write() for small writes, with the peer draining
+fn txWriteLatency(bench: Bench) !void {
+    const iterations = bench.pick(@as(usize, 2_000), 50_000);
+    for (backends) |mode| {
+        var pair = try Pair.open(bench.allocator, .{ .mode = mode });
+        defer pair.close();
+
+        var stop = std.atomic.Value(bool).init(false);
+        const reader = try std.Thread.spawn(.{}, drain, .{ &pair.ports[1], &stop });
+        defer {
+            stop.store(true, .release);
+            reader.join();
+        }
+
+        var histogram = Histogram{};
+        const payload = "AT+CSQ\r\n";
+        for (0..iterations) |_| {
+            const start = clock.now();
+            try pair.ports[0].writeAll(payload);
+            histogram.record(clock.now() - start);
+        }
+
+        try bench.report.result("tx_write_latency", @tagName(mode));
+        try bench.report.field("write_bytes", payload.len);
+        try bench.report.latency("write", histogram.summarize());
+        try bench.report.endResult();
+    }
+}
+
+/// Echoes everything back until `stop` is set
+fn echo(port: *Port, stop: *std.atomic.Value(bool)) void {
+    var buf: [256]u8 = undefined;
+    while (!stop.load(.acquire)) {
+        if (!port.waitForData(50)) continue;
+        const n = port.read(&buf) catch return;
+        port.writeAll(buf[0..n]) catch return;
+    }
+}
+
+/// One byte out, the same byte back: the full round trip through both
+/// ports and the wire
+fn echoRtt(bench: Bench) !void {
+    const iterations = bench.pick(@as(usize, 1_000), 20_000);
+    for (backends) |mode| {
+        var pair = try Pair.open(bench.allocator, .{ .mode = mode });
+        defer pair.close();
+
+        var stop = std.atomic.Value(bool).init(false);
+        const echoer = try std.Thread.spawn(.{}, echo, .{ &pair.ports[1], &stop });
+        defer {
+            stop.store(true, .release);
+            echoer.join();
+        }
+
+        var histogram = Histogram{};
+        var byte: [1]u8 = undefined;
+        for (0..iterations) |n| {
+            const start = clock.now();
+            const out = [1]u8{@truncate(n)};
+            try pair.ports[0].writeAll(&out);
+            try readExactly(&pair.ports[0], &byte);
+            histogram.record(clock.now() - start);
+        }
+
+        try bench.report.result("echo_rtt", @tagName(mode));
+        try bench.report.latency("rtt", histogram.summarize());
+        try bench.report.endResult();
+    }
+}
+
+/// Aggregate throughput with many ports busy at once, read from one
+/// poll loop as a multi-port server would
+fn manyPorts(bench: Bench) !void {
+    const MAX_PAIRS = 16;
+    const count = bench.pick(@as(usize, 4), MAX_PAIRS);
+    const per_port = bench.pick(@as(usize, 1 << 20), 8 << 20);
+
+    var pairs: [MAX_PAIRS]Pair = undefined;
+    var opened: usize = 0;
+    defer for (pairs[0..opened]) |*pair| pair.close();
+    while (opened < count) : (opened += 1) {
+        pairs[opened] = try Pair.open(bench.allocator, .{});
+    }
+
+    var writers: [MAX_PAIRS]std.Thread = undefined;
+    var started: usize = 0;
+    defer for (writers[0..started]) |t| t.join();
+
+    const start = clock.now();
+    while (started < count) : (started += 1) {
+        writers[started] = try std.Thread.spawn(.{}, writeFor, .{ &pairs[started].ports[0], per_port, 4096 });
+    }
+
+    var fds: [MAX_PAIRS]std.posix.pollfd = undefined;
+    for (pairs[0..count], fds[0..count]) |*pair, *fd| {
+        fd.* = .{ .fd = pair.ports[1].fd, .events = std.posix.POLL.IN, .revents = 0 };
+    }
+    var received: [MAX_PAIRS]usize = [_]usize{0} ** MAX_PAIRS;
+    var total: usize = 0;
+    var buf: [16 * 1024]u8 = undefined;
+    while (total < count * per_port) {
+        if (try std.posix.poll(fds[0..count], 5000) == 0) break;
+        for (pairs[0..count], fds[0..count], received[0..count]) |*pair, *fd, *got| {
+            if (fd.revents & std.posix.POLL.IN == 0) continue;
+            const n = try pair.ports[1].read(&buf);
+            got.* += n;
+            total += n;
+            if (got.* >= per_port) fd.fd = -1;
+        }
+    }
+    const elapsed = clock.now() - start;
+
+    try bench.report.result("many_ports", "memory");
+    try bench.report.field("ports", count);
+    try bench.report.field("bytes", total);
+    try bench.report.field("seconds", seconds(elapsed));
+    try bench.report.field("bytes_per_second", @as(f64, @floatFromInt(total)) / seconds(elapsed));
+    try bench.report.endResult();
+}
+
+/// One side of a transfer, driven from its own thread so a streaming
+/// sender blocking in write cannot stall the receiver
+fn TransferSide(comptime Engine: type) type {
+    return struct {
+        const Self = @This();
+
+        port: *Port,
+        engine: Engine = undefined,
+        errors: u32 = 0,
+        failed: bool = false,
+
+        fn onEvent(event: transfer.common.Event, context: ?*anyopaque) void {
+            const self: *Self = @ptrCast(@alignCast(context.?));
+            switch (event) {
+                .send_data => |bytes| self.port.writeAll(bytes) catch {
+                    self.failed = true;
+                },
+                .progress => |p| self.errors = p.error_count,
+                .failed, .cancelled => self.failed = true,
+                else => {},
+            }
+        }
+
+        fn run(self: *Self) void {
+            var buf: [4096]u8 = undefined;
+            var idle_ms: u32 = 0;
+            while (self.engine.isActive() and !self.failed) {
+                if (!self.port.waitForData(100)) {
+                    idle_ms += 100;
+                    if (idle_ms >= 10_000) {
+                        self.engine.cancel();
+                        self.failed = true;
+                    }
+                    continue;
+                }
+                idle_ms = 0;
+                const n = self.port.read(&buf) catch {
+                    self.failed = true;
+                    return;
+                };
+                self.engine.processData(buf[0..n]);
+            }
+        }
+    };
+}
+
+/// File goodput of each protocol engine between two ports
+fn transferGoodput(bench: Bench) !void {
+    const size = bench.pick(@as(usize, 32 * 1024), 256 * 1024);
+    const data = try bench.allocator.alloc(u8, size);
+    defer bench.allocator.free(data);
+    var prng = std.Random.DefaultPrng.init(0x5e7a1);
+    prng.random().bytes(data);
+
+    const bauds = [_]u32{ 921600, 0 };
+    inline for (.{ transfer.XModem, transfer.YModem, transfer.ZModem }) |Engine| {
+        for (bauds) |baud| {
+            try runTransfer(Engine, bench, data, baud);
+        }
+    }
+}
+
+fn runTransfer(comptime Engine: type, bench: Bench, data: []const u8, baud: u32) !void {
+    const Side = TransferSide(Engine);
+    var pair = try Pair.open(bench.allocator, .{ .baud = baud });
+    defer pair.close();
+
+    var sender = Side{ .port = &pair.ports[0] };
+    var receiver = Side{ .port = &pair.ports[1] };
+    sender.engine = Engine.init(bench.allocator, Side.onEvent, &sender);
+    defer sender.engine.deinit();
+    receiver.engine = Engine.init(bench.allocator, Side.onEvent, &receiver);
+    defer receiver.engine.deinit();
+
+    const start = clock.now();
+    if (Engine == transfer.XModem) {
+        try receiver.engine.reserveReceive(data.len);
+        sender.engine.startSend(data);
+    } else {
+        sender.engine.startSend("bench.bin", data);
+    }
+    receiver.engine.startReceive();
+
+    const send_thread = try std.Thread.spawn(.{}, Side.run, .{&sender});
+    receiver.run();
+    const elapsed = clock.now() - start;
+    send_thread.join();
+
+    const received = receiver.engine.getReceivedData();
+    const ok = !receiver.failed and received.len >= data.len and std.mem.eql(u8, received[0..data.len], data);
+    const goodput = @as(f64, @floatFromInt(data.len)) / seconds(elapsed);
+    const name = comptime blk: {
+        const full = @typeName(Engine);
+        const dot = std.mem.lastIndexOfScalar(u8, full, '.').?;
+        break :blk full[dot + 1 ..];
+    };
+
+    try bench.report.result("transfer_goodput", "memory");
+    try bench.report.field("protocol", name);
+    try bench.report.field("baud", baud);
+    try bench.report.field("bytes", data.len);
+    try bench.report.field("ok", ok);
+    try bench.report.field("seconds", seconds(elapsed));
+    try bench.report.field("goodput_bytes_per_second", goodput);
+    if (baud != 0) try bench.report.field("line_efficiency", goodput / (@as(f64, @floatFromInt(baud)) / 10));
+    try bench.report.field("retries", receiver.errors + sender.errors);
+    try bench.report.endResult();
+}
+
+test {
+    _ = @import("report.zig");
+}
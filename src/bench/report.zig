@@ -0,0 +1,107 @@
+const std = @import("std");
+const serial = @import("serial");
+
+const Summary = serial.stats.Histogram.Summary;
+
+/// Streams benchmark results as one JSON document:
+/// {"benchmark":"serialterm","results":[{"scenario":...}, ...]}
+/// Each result is flushed on its own line as its scenario finishes, so
+/// long runs show progress.
+pub const Report = struct {
+    fd: std.posix.fd_t,
+    buffer: [4096]u8 = undefined,
+    len: usize = 0,
+    results: usize = 0,
+    fields: usize = 0,
+
+    pub fn begin(self: *Report, os: []const u8, quick: bool) !void {
+        try self.print("{{\"benchmark\":\"serialterm\",\"os\":\"{s}\",\"quick\":{s},\"results\":[", .{ os, boolText(quick) });
+    }
+
+    pub fn finish(self: *Report) !void {
+        try self.print("\n]}}\n", .{});
+        try self.flush();
+    }
+
+    /// Opens a result; fields follow until `endResult`
+    pub fn result(self: *Report, scenario: []const u8, backend: []const u8) !void {
+        if (self.results > 0) try self.print(",", .{});
+        self.results += 1;
+        self.fields = 0;
+        try self.print("\n{{", .{});
+        try self.field("scenario", scenario);
+        try self.field("backend", backend);
+    }
+
+    pub fn endResult(self: *Report) !void {
+        try self.print("}}", .{});
+        try self.flush();
+    }
+
+    /// Integers, floats, bools and strings (strings are not escaped:
+    /// names come from this program)
+    pub fn field(self: *Report, name: []const u8, value: anytype) !void {
+        if (self.fields > 0) try self.print(",", .{});
+        self.fields += 1;
+        const T = @TypeOf(value);
+        switch (@typeInfo(T)) {
+            .int, .comptime_int => try self.print("\"{s}\":{d}", .{ name, value }),
+            .float, .comptime_float => try self.print("\"{s}\":{d:.3}", .{ name, value }),
+            .bool => try self.print("\"{s}\":{s}", .{ name, boolText(value) }),
+            else => try self.print("\"{s}\":\"{s}\"", .{ name, value }),
+        }
+    }
+
+    /// Latency quantiles in nanoseconds, as `<prefix>_p50_ns` etc.
+    pub fn latency(self: *Report, comptime prefix: []const u8, summary: Summary) !void {
+        try self.field(prefix ++ "_samples", summary.count);
+        try self.field(prefix ++ "_p50_ns", summary.p50);
+        try self.field(prefix ++ "_p99_ns", summary.p99);
+        try self.field(prefix ++ "_p999_ns", summary.p999);
+        try self.field(prefix ++ "_max_ns", summary.max);
+    }
+
+    fn boolText(value: bool) []const u8 {
+        return if (value) "true" else "false";
+    }
+
+    fn print(self: *Report, comptime fmt: []const u8, args: anytype) !void {
+        if (self.len + 512 > self.buffer.len) try self.flush();
+        const text = try std.fmt.bufPrint(self.buffer[self.len..], fmt, args);
+        self.len += text.len;
+    }
+
+    fn flush(self: *Report) !void {
+        var written: usize = 0;
+        while (written < self.len) {
+            written += try std.posix.write(self.fd, self.buffer[written..self.len]);
+        }
+        self.len = 0;
+    }
+};
+
+test "report is valid JSON" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+
+    var report = Report{ .fd = fds[1] };
+    try report.begin("linux", true);
+    try report.result("rx_throughput", "memory");
+    try report.field("baud", @as(u32, 115200));
+    try report.field("bytes_per_second", @as(f64, 11520.5));
+    try report.endResult();
+    try report.result("echo_rtt", "pty");
+    try report.latency("rtt", .{ .count = 3, .p50 = 10, .p99 = 20, .p999 = 30, .max = 40 });
+    try report.endResult();
+    try report.finish();
+    std.posix.close(fds[1]);
+
+    var buf: [1024]u8 = undefined;
+    const n = try std.posix.read(fds[0], &buf);
+    const parsed = try std.json.parseFromSlice(std.json.Value, std.testing.allocator, buf[0..n], .{});
+    defer parsed.deinit();
+    const results = parsed.value.object.get("results").?.array;
+    try std.testing.expectEqual(@as(usize, 2), results.items.len);
+    try std.testing.expectEqual(@as(i64, 115200), results.items[0].object.get("baud").?.integer);
+    try std.testing.expectEqual(@as(i64, 30), results.items[1].object.get("rtt_p999_ns").?.integer);
+}
@@ -0,0 +1,142 @@
+const std = @import("std");
+
+/// Available commands (mirrors CommandModeHandler.swift)
+pub const Command = enum {
+    quit, // Ctrl+A, Q - Disconnect
+    send_break, // Ctrl+A, B - Send break signal
+    toggle_dtr, // Ctrl+A, D - Toggle DTR line
+    toggle_rts, // Ctrl+A, r - Toggle RTS line (lowercase)
+    upload_xmodem, // Ctrl+A, X - Upload via XMODEM
+    upload_ymodem, // Ctrl+A, Y - Upload via YMODEM
+    upload_zmodem, // Ctrl+A, Z - Upload via ZMODEM
+    download_receive, // Ctrl+A, Shift+R - Receive download
+    show_help, // Ctrl+A, H or ? - Show help
+    send_escape, // Ctrl+A, Ctrl+A - Send literal escape character
+    toggle_local_echo, // Ctrl+A, E - Toggle local echo
+    clear_screen, // Ctrl+A, C - Clear terminal
+    show_port_settings, // Ctrl+A, S - Show port settings
+    dump_trace, // Ctrl+A, T - Write Chrome trace (-Dtrace builds)
+};
+
+/// Handles escape character sequences for command mode
+/// Default escape is Ctrl+A (like picocom)
+pub const CommandMode = struct {
+    /// Command mode is cancelled if no key follows the escape in time
+    pub const TIMEOUT_MS = 2000;
+
+    escape_character: u8 = 0x01,
+    last_key_was_escape: bool = false,
+    escape_time_ms: i64 = 0,
+
+    pub const Result = struct {
+        consumed: bool,
+        command: ?Command = null,
+    };
+
+    pub const help_text =
+        "*** Command mode (Ctrl+A, then) ***\r\n" ++
+        "  q  quit              b  send break\r\n" ++
+        "  d  toggle DTR        r  toggle RTS\r\n" ++
+        "  x  send XMODEM       y  send YMODEM\r\n" ++
+        "  z  send ZMODEM       R  receive file\r\n" ++
+        "  e  local echo        c  clear screen\r\n" ++
+        "  s  port settings     t  dump trace\r\n" ++
+        "  h  this help\r\n" ++
+        "  Ctrl+A  send literal Ctrl+A\r\n";
+
+    /// Process a key input
+    /// - consumed: true if the key was handled by command mode
+    /// - command: the command to execute, if any
+    pub fn processKey(self: *CommandMode, key: u8, now_ms: i64) Result {
+        self.expire(now_ms);
+
+        if (self.last_key_was_escape) {
+            self.last_key_was_escape = false;
+
+            if (key == self.escape_character) {
+                // Double escape sends literal escape character
+                return .{ .consumed = true, .command = .send_escape };
+            }
+
+            return .{ .consumed = true, .command = switch (key) {
+                'q', 'Q' => .quit,
+                'b', 'B' => .send_break,
+                'd', 'D' => .toggle_dtr,
+                'r' => .toggle_rts,
+                'R' => .download_receive,
+                'x', 'X' => .upload_xmodem,
+                'y', 'Y' => .upload_ymodem,
+                'z', 'Z' => .upload_zmodem,
+                'h', 'H', '?' => .show_help,
+                'e', 'E' => .toggle_local_echo,
+                'c', 'C' => .clear_screen,
+                's', 'S' => .show_port_settings,
+                't', 'T' => .dump_trace,
+                // Unknown command, just consume it
+                else => null,
+            } };
+        }
+
+        // Check for escape character
+        if (key == self.escape_character) {
+            self.last_key_was_escape = true;
+            self.escape_time_ms = now_ms;
+            return .{ .consumed = true };
+        }
+
+        // Not in command mode, don't consume the key
+        return .{ .consumed = false };
+    }
+
+    /// Cancels a pending escape once the timeout has passed
+    pub fn expire(self: *CommandMode, now_ms: i64) void {
+        if (self.last_key_was_escape and now_ms - self.escape_time_ms >= TIMEOUT_MS) {
+            self.last_key_was_escape = false;
+        }
+    }
+
+    pub fn isInCommandMode(self: *const CommandMode) bool {
+        return self.last_key_was_escape;
+    }
+
+    /// Reset command mode state
+    pub fn reset(self: *CommandMode) void {
+        self.last_key_was_escape = false;
+    }
+};
+
+test "command mode escape sequence" {
+    var handler = CommandMode{};
+
+    // First Ctrl+A enters command mode
+    const first = handler.processKey(0x01, 0);
+    try std.testing.expect(first.consumed);
+    try std.testing.expectEqual(@as(?Command, null), first.command);
+    try std.testing.expect(handler.isInCommandMode());
+
+    // Q quits
+    const second = handler.processKey('q', 10);
+    try std.testing.expect(second.consumed);
+    try std.testing.expectEqual(@as(?Command, .quit), second.command);
+    try std.testing.expect(!handler.isInCommandMode());
+
+    // Ordinary keys pass through
+    try std.testing.expect(!handler.processKey('a', 20).consumed);
+}
+
+test "command mode double escape and timeout" {
+    var handler = CommandMode{};
+
+    _ = handler.processKey(0x01, 0);
+    try std.testing.expectEqual(@as(?Command, .send_escape), handler.processKey(0x01, 5).command);
+
+    // Lowercase r toggles RTS, uppercase R receives
+    _ = handler.processKey(0x01, 10);
+    try std.testing.expectEqual(@as(?Command, .toggle_rts), handler.processKey('r', 11).command);
+    _ = handler.processKey(0x01, 12);
+    try std.testing.expectEqual(@as(?Command, .download_receive), handler.processKey('R', 13).command);
+
+    // After the timeout the next key is ordinary input again
+    _ = handler.processKey(0x01, 100);
+    try std.testing.expect(!handler.processKey('q', 100 + CommandMode.TIMEOUT_MS).consumed);
+}
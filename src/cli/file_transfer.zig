@@ -0,0 +1,223 @@
+const std = @import("std");
+const serial = @import("serial");
+const transfer = @import("transfer");
+const Monitor = @import("monitor.zig").Monitor;
+
+const Port = serial.port.Port;
+const Event = transfer.common.Event;
+
+pub const Protocol = enum {
+    xmodem,
+    ymodem,
+    zmodem,
+
+    pub fn name(self: Protocol) []const u8 {
+        return switch (self) {
+            .xmodem => "XMODEM",
+            .ymodem => "YMODEM",
+            .zmodem => "ZMODEM",
+        };
+    }
+};
+
+const Engine = union(Protocol) {
+    xmodem: transfer.XModem,
+    ymodem: transfer.YModem,
+    zmodem: transfer.ZModem,
+};
+
+/// Abort a transfer after this long without any data from the peer
+const IDLE_TIMEOUT_MS = 30_000;
+
+/// Drives one transfer engine synchronously over a port.
+/// Ctrl+C or Ctrl+X on stdin cancels the transfer.
+pub const Transfer = struct {
+    port: *Port,
+    engine: Engine,
+    output: std.posix.fd_t,
+    /// Metrics endpoint kept answering (and updated) during the transfer
+    monitor: ?*Monitor = null,
+    failure: ?[]const u8 = null,
+    last_percent: i32 = -1,
+
+    /// Sends `data` to the remote side
+    pub fn send(allocator: std.mem.Allocator, port: *Port, output: std.posix.fd_t, monitor: ?*Monitor, protocol: Protocol, file_name: []const u8, data: []const u8) !void {
+        var self = Transfer{ .port = port, .output = output, .monitor = monitor, .engine = undefined };
+        self.initEngine(allocator, protocol);
+        defer self.deinit();
+
+        switch (self.engine) {
+            .xmodem => |*e| e.startSend(data),
+            .ymodem => |*e| e.startSend(file_name, data),
+            .zmodem => |*e| e.startSend(file_name, data),
+        }
+        try self.run(&.{});
+    }
+
+    /// Receives a file and returns its contents and name (caller frees both).
+    /// `initial` is data already read from the port, e.g. a ZMODEM auto-start.
+    pub fn receive(allocator: std.mem.Allocator, port: *Port, output: std.posix.fd_t, monitor: ?*Monitor, protocol: Protocol, initial: []const u8) !Received {
+        var self = Transfer{ .port = port, .output = output, .monitor = monitor, .engine = undefined };
+        self.initEngine(allocator, protocol);
+        defer self.deinit();
+
+        switch (self.engine) {
+            inline else => |*e| e.startReceive(),
+        }
+        try self.run(initial);
+
+        const data: []const u8 = switch (self.engine) {
+            inline else => |*e| e.getReceivedData(),
+        };
+        const name: ?[]const u8 = switch (self.engine) {
+            .xmodem => null,
+            inline .ymodem, .zmodem => |*e| e.getFileName(),
+        };
+        const owned_data = try allocator.dupe(u8, data);
+        errdefer allocator.free(owned_data);
+        const owned_name = if (name) |n| try allocator.dupe(u8, std.fs.path.basename(n)) else null;
+        return .{ .data = owned_data, .file_name = owned_name };
+    }
+
+    pub const Received = struct {
+        data: []u8,
+        file_name: ?[]u8,
+
+        pub fn deinit(self: Received, allocator: std.mem.Allocator) void {
+            allocator.free(self.data);
+            if (self.file_name) |n| allocator.free(n);
+        }
+    };
+
+    fn initEngine(self: *Transfer, allocator: std.mem.Allocator, protocol: Protocol) void {
+        self.engine = switch (protocol) {
+            .xmodem => .{ .xmodem = transfer.XModem.init(allocator, onEvent, self) },
+            .ymodem => .{ .ymodem = transfer.YModem.init(allocator, onEvent, self) },
+            .zmodem => .{ .zmodem = transfer.ZModem.init(allocator, onEvent, self) },
+        };
+    }
+
+    fn deinit(self: *Transfer) void {
+        switch (self.engine) {
+            inline else => |*e| e.deinit(),
+        }
+    }
+
+    fn isActive(self: *Transfer) bool {
+        return switch (self.engine) {
+            inline else => |*e| e.isActive(),
+        };
+    }
+
+    fn cancel(self: *Transfer) void {
+        switch (self.engine) {
+            inline else => |*e| e.cancel(),
+        }
+    }
+
+    fn processData(self: *Transfer, data: []const u8) void {
+        switch (self.engine) {
+            inline else => |*e| e.processData(data),
+        }
+    }
+
+    fn run(self: *Transfer, initial: []const u8) !void {
+        if (self.monitor) |m| m.transfers.begin(serial.clock.now());
+        if (initial.len > 0) self.processData(initial);
+
+        var buf: [4096]u8 = undefined;
+        const idle_timeout_ns = IDLE_TIMEOUT_MS * std.time.ns_per_ms;
+        var idle_deadline = serial.clock.now() + idle_timeout_ns;
+        // Once stdin is at EOF (e.g. redirected) it would poll readable forever
+        var stdin_open = true;
+        while (self.isActive()) {
+            var fds: [2 + Monitor.POLL_FDS]std.posix.pollfd = undefined;
+            fds[0] = .{ .fd = self.port.fd, .events = std.posix.POLL.IN, .revents = 0 };
+            fds[1] = .{ .fd = if (stdin_open) std.posix.STDIN_FILENO else -1, .events = std.posix.POLL.IN, .revents = 0 };
+            const monitor_fds = fds[2..];
+            if (self.monitor) |m| {
+                m.pollFds(monitor_fds);
+            } else {
+                for (monitor_fds) |*entry| entry.* = .{ .fd = -1, .events = 0, .revents = 0 };
+            }
+            const ready = try std.posix.poll(&fds, 100);
+
+            if (self.monitor) |m| m.serve(monitor_fds);
+
+            if (fds[1].revents != 0) {
+                var key: [1]u8 = undefined;
+                const n = std.posix.read(std.posix.STDIN_FILENO, &key) catch 0;
+                if (n == 0) stdin_open = false;
+                if (n == 1 and (key[0] == 0x03 or key[0] == 0x18)) {
+                    self.cancel();
+                    break;
+                }
+            }
+
+            if (ready > 0 and fds[0].revents & std.posix.POLL.IN != 0) {
+                const n = try self.port.read(&buf);
+                if (n > 0) {
+                    idle_deadline = serial.clock.now() + idle_timeout_ns;
+                    self.processData(buf[0..n]);
+                    continue;
+                }
+            }
+
+            if (serial.clock.now() >= idle_deadline) {
+                self.cancel();
+                self.failure = "Timed out";
+            }
+        }
+
+        if (self.monitor) |m| m.transfers.finish(self.failure == null, serial.clock.now());
+        self.print("\r\n", .{});
+        if (self.failure) |message| {
+            self.print("*** Transfer failed: {s} ***\r\n", .{message});
+            return error.TransferFailed;
+        }
+    }
+
+    fn onEvent(event: Event, context: ?*anyopaque) void {
+        const self: *Transfer = @ptrCast(@alignCast(context.?));
+        switch (event) {
+            .send_data => |bytes| self.port.writeAll(bytes) catch {
+                self.failure = "Write error";
+            },
+            .started => |info| {
+                if (info.file_name) |n| {
+                    self.print("*** {s} ({d} bytes) ***\r\n", .{ n, info.file_size });
+                }
+            },
+            .progress => |p| {
+                if (self.monitor) |m| m.transfers.progress(p.bytes_transferred, p.error_count);
+                const percent: i32 = @intFromFloat(p.percentComplete());
+                if (percent == self.last_percent and p.total_bytes != 0) return;
+                self.last_percent = percent;
+                if (p.total_bytes != 0) {
+                    self.print("\r{d} / {d} bytes ({d}%)", .{ p.bytes_transferred, p.total_bytes, percent });
+                } else {
+                    self.print("\r{d} bytes", .{p.bytes_transferred});
+                }
+            },
+            .completed => self.print("\r\n*** Transfer complete ***", .{}),
+            .failed => |message| self.failure = message,
+            .cancelled => {
+                if (self.failure == null) self.failure = "Cancelled";
+            },
+        }
+    }
+
+    fn print(self: *Transfer, comptime fmt: []const u8, args: anytype) void {
+        var buf: [256]u8 = undefined;
+        const text = std.fmt.bufPrint(&buf, fmt, args) catch return;
+        writeAllFd(self.output, text);
+    }
+};
+
+/// Writes everything to `fd`, ignoring errors (terminal output)
+pub fn writeAllFd(fd: std.posix.fd_t, bytes: []const u8) void {
+    var written: usize = 0;
+    while (written < bytes.len) {
+        written += std.posix.write(fd, bytes[written..]) catch return;
+    }
+}
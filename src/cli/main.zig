@@ -0,0 +1,455 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const serial = @import("serial");
+const transfer = @import("transfer");
+const trace = @import("trace");
+const command_mode = @import("command_mode.zig");
+const file_transfer = @import("file_transfer.zig");
+const monitor = @import("monitor.zig");
+
+const posix = std.posix;
+
+const Port = serial.port.Port;
+const Config = serial.config.Config;
+const CommandMode = command_mode.CommandMode;
+const Protocol = file_transfer.Protocol;
+const Transfer = file_transfer.Transfer;
+const Monitor = monitor.Monitor;
+const writeAllFd = file_transfer.writeAllFd;
+
+const c = @cImport({
+    @cDefine("_GNU_SOURCE", {});
+    @cInclude("fcntl.h");
+});
+
+const usage =
+    \\Usage: serialterm-cli [options] <device>
+    \\
+    \\Options:
+    \\  -b, --baud <rate>       Baud rate (default 115200)
+    \\  -d, --databits <5-8>    Data bits (default 8)
+    \\  -p, --parity <n|o|e>    Parity (default n)
+    \\  -s, --stopbits <1|2>    Stop bits (default 1)
+    \\  -f, --flow <n|h|s>      Flow control: none, RTS/CTS, XON/XOFF (default n)
+    \\  -l, --line-ending <cr|lf|crlf>
+    \\                          Sent for the Enter key (default cr)
+    \\  -e, --echo              Enable local echo
+    \\  -m, --metrics <addr>    Serve Prometheus metrics over HTTP on
+    \\                          [host:]port (default host 127.0.0.1) or unix:<path>
+    \\  -h, --help              Show this help
+    \\
+    \\Press Ctrl+A then H inside the session for command help.
+    \\
+;
+
+/// Written by Ctrl+A, T in the working directory
+const trace_file = "serialterm-trace.json";
+
+const stdin_fd = posix.STDIN_FILENO;
+const stdout_fd = posix.STDOUT_FILENO;
+
+/// Puts the controlling terminal into raw mode for the session
+const RawTerminal = struct {
+    original: ?posix.termios = null,
+
+    fn enable() RawTerminal {
+        if (!posix.isatty(stdin_fd)) return .{};
+        const original = posix.tcgetattr(stdin_fd) catch return .{};
+
+        var raw = original;
+        raw.iflag.IGNBRK = false;
+        raw.iflag.BRKINT = false;
+        raw.iflag.ICRNL = false;
+        raw.iflag.INLCR = false;
+        raw.iflag.IXON = false;
+        raw.oflag.OPOST = false;
+        raw.lflag.ECHO = false;
+        raw.lflag.ECHONL = false;
+        raw.lflag.ICANON = false;
+        raw.lflag.ISIG = false;
+        raw.lflag.IEXTEN = false;
+        raw.cc[@intFromEnum(posix.V.MIN)] = 1;
+        raw.cc[@intFromEnum(posix.V.TIME)] = 0;
+        posix.tcsetattr(stdin_fd, .FLUSH, raw) catch return .{};
+
+        return .{ .original = original };
+    }
+
+    fn restore(self: RawTerminal) void {
+        if (self.original) |original| posix.tcsetattr(stdin_fd, .FLUSH, original) catch {};
+    }
+};
+
+const Session = struct {
+    allocator: std.mem.Allocator,
+    port: *Port,
+    commands: CommandMode = .{},
+    local_echo: bool,
+    dtr: bool = true,
+    rts: bool = true,
+    running: bool = true,
+    /// Zero-copy port -> stdout forwarding (Linux, stdout is a pipe)
+    use_splice: bool,
+    /// Metrics endpoint, served from the same poll loop
+    monitor: ?*Monitor = null,
+
+    fn status(self: *Session, comptime fmt: []const u8, args: anytype) void {
+        _ = self;
+        var buf: [512]u8 = undefined;
+        const text = std.fmt.bufPrint(&buf, "\r\n*** " ++ fmt ++ " ***\r\n", args) catch return;
+        writeAllFd(stdout_fd, text);
+    }
+
+    /// Single poll loop over the terminal and the port
+    fn run(self: *Session) !void {
+        var buf: [4096]u8 = undefined;
+        var fds: [2 + Monitor.POLL_FDS]posix.pollfd = undefined;
+        fds[0] = .{ .fd = stdin_fd, .events = posix.POLL.IN, .revents = 0 };
+        fds[1] = .{ .fd = self.port.fd, .events = posix.POLL.IN, .revents = 0 };
+        const monitor_fds = fds[2..];
+
+        while (self.running) {
+            // Wake up in time to expire a pending Ctrl+A or an idle scrape
+            var timeout: i32 = if (self.commands.isInCommandMode()) 250 else -1;
+            if (self.monitor) |m| {
+                m.pollFds(monitor_fds);
+                if (timeout < 0) timeout = m.timeout();
+            } else {
+                for (monitor_fds) |*entry| entry.* = .{ .fd = -1, .events = 0, .revents = 0 };
+            }
+            _ = try posix.poll(&fds, timeout);
+            self.commands.expire(std.time.milliTimestamp());
+
+            if (fds[1].revents & (posix.POLL.HUP | posix.POLL.ERR) != 0) {
+                self.status("Port closed", .{});
+                return;
+            }
+
+            if (fds[1].revents & posix.POLL.IN != 0) {
+                if (!self.spliceToStdout()) {
+                    const n = try self.port.read(&buf);
+                    if (n > 0) try self.handleSerialData(buf[0..n]);
+                }
+            }
+
+            if (self.monitor) |m| m.serve(monitor_fds);
+
+            if (fds[0].revents & posix.POLL.HUP != 0 and fds[0].revents & posix.POLL.IN == 0) return;
+            if (fds[0].revents & posix.POLL.IN != 0) {
+                const n = try posix.read(stdin_fd, &buf);
+                if (n == 0) return;
+                try self.handleKeys(buf[0..n]);
+            }
+        }
+    }
+
+    /// Moves serial data to stdout inside the kernel. Returns false when
+    /// splice is unavailable so the caller falls back to read/write.
+    fn spliceToStdout(self: *Session) bool {
+        if (builtin.os.tag != .linux) return false;
+        if (!self.use_splice) return false;
+        const moved = c.splice(self.port.fd, null, stdout_fd, null, 64 * 1024, c.SPLICE_F_MOVE | c.SPLICE_F_NONBLOCK);
+        if (moved < 0) {
+            if (posix.errno(moved) == .AGAIN) return true;
+            // Not a pipe, or the tty driver has no splice support
+            self.use_splice = false;
+            return false;
+        }
+        if (moved > 0) self.port.stats.recordRead(@intCast(moved));
+        return true;
+    }
+
+    fn handleSerialData(self: *Session, data: []const u8) !void {
+        writeAllFd(stdout_fd, data);
+
+        if (transfer.ZModem.detectAutoStart(data)) {
+            self.status("ZMODEM transfer detected", .{});
+            try self.receive(.zmodem, data);
+        }
+    }
+
+    fn handleKeys(self: *Session, keys: []const u8) !void {
+        var start: usize = 0;
+        for (keys, 0..) |key, i| {
+            const result = self.commands.processKey(key, std.time.milliTimestamp());
+            if (!result.consumed and key != '\r') continue;
+
+            // Flush ordinary keys before the one needing special handling
+            try self.sendKeys(keys[start..i]);
+            start = i + 1;
+
+            if (!result.consumed) {
+                // Enter sends the configured line ending
+                try self.sendKeys(self.port.config.line_ending.bytes());
+            } else if (result.command) |command| {
+                try self.execute(command);
+                if (!self.running) return;
+            }
+        }
+        try self.sendKeys(keys[start..]);
+    }
+
+    fn sendKeys(self: *Session, keys: []const u8) !void {
+        if (keys.len == 0) return;
+        try self.port.writeAll(keys);
+        if (self.local_echo) writeAllFd(stdout_fd, keys);
+    }
+
+    fn execute(self: *Session, command: command_mode.Command) !void {
+        switch (command) {
+            .quit => {
+                self.status("Disconnected", .{});
+                self.running = false;
+            },
+            .send_break => {
+                self.port.sendBreak();
+                self.status("Break sent", .{});
+            },
+            .toggle_dtr => {
+                self.dtr = !self.dtr;
+                self.port.setDTR(self.dtr);
+                self.status("DTR {s}", .{if (self.dtr) "on" else "off"});
+            },
+            .toggle_rts => {
+                self.rts = !self.rts;
+                self.port.setRTS(self.rts);
+                self.status("RTS {s}", .{if (self.rts) "on" else "off"});
+            },
+            .upload_xmodem => try self.upload(.xmodem),
+            .upload_ymodem => try self.upload(.ymodem),
+            .upload_zmodem => try self.upload(.zmodem),
+            .download_receive => {
+                var answer: [16]u8 = undefined;
+                const choice = self.prompt("Receive protocol [x/y/z]: ", &answer) orelse return;
+                const protocol: Protocol = if (choice.len == 0) return else switch (choice[0]) {
+                    'x', 'X' => .xmodem,
+                    'y', 'Y' => .ymodem,
+                    'z', 'Z' => .zmodem,
+                    else => return,
+                };
+                try self.receive(protocol, &.{});
+            },
+            .show_help => writeAllFd(stdout_fd, "\r\n" ++ CommandMode.help_text),
+            .send_escape => try self.port.writeAll(&[_]u8{self.commands.escape_character}),
+            .toggle_local_echo => {
+                self.local_echo = !self.local_echo;
+                self.status("Local echo {s}", .{if (self.local_echo) "on" else "off"});
+            },
+            .clear_screen => writeAllFd(stdout_fd, "\x1b[2J\x1b[H"),
+            .show_port_settings => {
+                var buf: [64]u8 = undefined;
+                const settings = self.port.config.formatString(&buf) catch "?";
+                self.status("{s} {s}", .{ self.port.path, settings });
+            },
+            .dump_trace => {
+                if (!trace.enabled) return self.status("Tracing not compiled in (build with -Dtrace=true)", .{});
+                trace.dumpToFile(trace_file) catch |err| return self.status("Trace dump failed: {s}", .{@errorName(err)});
+                self.status("Trace written to {s}", .{trace_file});
+            },
+        }
+    }
+
+    fn upload(self: *Session, protocol: Protocol) !void {
+        var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const path = self.prompt("File to send: ", &path_buf) orelse return;
+        if (path.len == 0) return;
+
+        const data = readFile(self.allocator, path) catch |err| {
+            self.status("Cannot read {s}: {s}", .{ path, @errorName(err) });
+            return;
+        };
+        defer self.allocator.free(data);
+
+        self.status("Sending {s} via {s}", .{ path, protocol.name() });
+        Transfer.send(self.allocator, self.port, stdout_fd, self.monitor, protocol, std.fs.path.basename(path), data) catch {};
+    }
+
+    fn receive(self: *Session, protocol: Protocol, initial: []const u8) !void {
+        const received = Transfer.receive(self.allocator, self.port, stdout_fd, self.monitor, protocol, initial) catch return;
+        defer received.deinit(self.allocator);
+
+        var name_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const name = received.file_name orelse
+            (self.prompt("Save as: ", &name_buf) orelse return);
+        if (name.len == 0) return;
+
+        std.fs.cwd().writeFile(.{ .sub_path = name, .data = received.data }) catch |err| {
+            self.status("Cannot write {s}: {s}", .{ name, @errorName(err) });
+            return;
+        };
+        self.status("Saved {s} ({d} bytes)", .{ name, received.data.len });
+    }
+
+    /// Reads a line from the raw terminal with minimal editing.
+    /// Returns null if the user pressed Ctrl+C or Escape.
+    fn prompt(self: *Session, text: []const u8, buf: []u8) ?[]const u8 {
+        _ = self;
+        writeAllFd(stdout_fd, "\r\n");
+        writeAllFd(stdout_fd, text);
+
+        var len: usize = 0;
+        while (true) {
+            var key: [1]u8 = undefined;
+            const n = posix.read(stdin_fd, &key) catch return null;
+            if (n == 0) return null;
+            switch (key[0]) {
+                '\r', '\n' => break,
+                0x03, 0x1b => {
+                    writeAllFd(stdout_fd, "\r\n");
+                    return null;
+                },
+                0x08, 0x7f => if (len > 0) {
+                    len -= 1;
+                    writeAllFd(stdout_fd, "\x08 \x08");
+                },
+                else => if (len < buf.len and key[0] >= 0x20) {
+                    buf[len] = key[0];
+                    len += 1;
+                    writeAllFd(stdout_fd, &key);
+                },
+            }
+        }
+        writeAllFd(stdout_fd, "\r\n");
+        return buf[0..len];
+    }
+};
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var config = Config{};
+    var device: ?[]const u8 = null;
+    var metrics_addr: ?[]const u8 = null;
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "-h") or std.mem.eql(u8, arg, "--help")) {
+            std.debug.print("{s}", .{usage});
+            return;
+        } else if (std.mem.eql(u8, arg, "-e") or std.mem.eql(u8, arg, "--echo")) {
+            config.local_echo = true;
+        } else if (std.mem.eql(u8, arg, "-m") or std.mem.eql(u8, arg, "--metrics")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            metrics_addr = args[i];
+        } else if (std.mem.startsWith(u8, arg, "-")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            parseOption(&config, arg, args[i]) catch return fail("invalid value for {s}: {s}", .{ arg, args[i] });
+        } else {
+            device = arg;
+        }
+    }
+
+    const path = device orelse {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    };
+
+    var port = Port.open(path, config) catch |err| return fail("{s}: open failed: {s}", .{ path, @errorName(err) });
+    defer port.close();
+
+    var metrics_monitor: ?Monitor = null;
+    if (metrics_addr) |addr| {
+        metrics_monitor = Monitor.init(addr, &port) catch |err| return fail("{s}: metrics listen failed: {s}", .{ addr, @errorName(err) });
+    }
+    defer if (metrics_monitor) |*m| m.deinit();
+
+    var buf: [64]u8 = undefined;
+    const settings = config.formatString(&buf) catch "";
+    std.debug.print("Connected to {s} ({s}). Ctrl+A H for help, Ctrl+A Q to quit.\n", .{ path, settings });
+
+    const terminal = RawTerminal.enable();
+    defer terminal.restore();
+
+    var session = Session{
+        .allocator = allocator,
+        .port = &port,
+        .local_echo = config.local_echo,
+        // Pipelines get the zero-copy path; interactive use keeps
+        // ZMODEM auto-start detection, which needs to see the bytes
+        .use_splice = !posix.isatty(stdout_fd),
+        .monitor = if (metrics_monitor) |*m| m else null,
+    };
+    try session.run();
+}
+
+fn readFile(allocator: std.mem.Allocator, path: []const u8) ![]u8 {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+
+    const size: usize = @intCast(try file.getEndPos());
+    const data = try allocator.alloc(u8, size);
+    errdefer allocator.free(data);
+
+    var filled: usize = 0;
+    while (filled < size) {
+        const n = try posix.read(file.handle, data[filled..]);
+        if (n == 0) return error.UnexpectedEndOfFile;
+        filled += n;
+    }
+    return data;
+}
+
+fn parseOption(config: *Config, option: []const u8, value: []const u8) !void {
+    if (value.len == 0) return error.InvalidValue;
+    if (std.mem.eql(u8, option, "-b") or std.mem.eql(u8, option, "--baud")) {
+        const speed = try std.fmt.parseInt(u32, value, 10);
+        config.baud_rate = Config.BaudRate.fromSpeed(speed) orelse return error.InvalidValue;
+    } else if (std.mem.eql(u8, option, "-d") or std.mem.eql(u8, option, "--databits")) {
+        config.data_bits = switch (try std.fmt.parseInt(u8, value, 10)) {
+            5 => .five,
+            6 => .six,
+            7 => .seven,
+            8 => .eight,
+            else => return error.InvalidValue,
+        };
+    } else if (std.mem.eql(u8, option, "-p") or std.mem.eql(u8, option, "--parity")) {
+        config.parity = switch (value[0]) {
+            'n', 'N' => .none,
+            'o', 'O' => .odd,
+            'e', 'E' => .even,
+            else => return error.InvalidValue,
+        };
+    } else if (std.mem.eql(u8, option, "-s") or std.mem.eql(u8, option, "--stopbits")) {
+        config.stop_bits = switch (try std.fmt.parseInt(u8, value, 10)) {
+            1 => .one,
+            2 => .two,
+            else => return error.InvalidValue,
+        };
+    } else if (std.mem.eql(u8, option, "-f") or std.mem.eql(u8, option, "--flow")) {
+        config.flow_control = switch (value[0]) {
+            'n', 'N' => .none,
+            'h', 'H' => .hardware,
+            's', 'S' => .software,
+            else => return error.InvalidValue,
+        };
+    } else if (std.mem.eql(u8, option, "-l") or std.mem.eql(u8, option, "--line-ending")) {
+        config.line_ending = if (std.mem.eql(u8, value, "lf"))
+            .lf
+        else if (std.mem.eql(u8, value, "crlf"))
+            .crlf
+        else if (std.mem.eql(u8, value, "cr"))
+            .cr
+        else
+            return error.InvalidValue;
+    } else {
+        return error.UnknownOption;
+    }
+}
+
+fn fail(comptime fmt: []const u8, args: anytype) error{InvalidArgument} {
+    std.log.err(fmt, args);
+    return error.InvalidArgument;
+}
+
+test {
+    _ = command_mode;
+    _ = monitor;
+}
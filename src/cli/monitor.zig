@@ -0,0 +1,76 @@
+const std = @import("std");
+const serial = @import("serial");
+
+const Port = serial.port.Port;
+const metrics = serial.metrics;
+const posix = std.posix;
+
+/// Serves port and transfer metrics from the session's poll loops.
+/// Render buffers are part of the struct, so scrapes never allocate, and
+/// scrapes are stepped on readiness so a slow scraper never stalls the
+/// terminal or a transfer.
+pub const Monitor = struct {
+    endpoint: metrics.Endpoint,
+    port: *Port,
+    transfers: metrics.TransferStats = .{},
+    scrapes: [MAX_SCRAPES]metrics.Scrape = [_]metrics.Scrape{.{}} ** MAX_SCRAPES,
+    buffers: [MAX_SCRAPES][metrics.Scrape.HEADER_ROOM + 16 * 1024]u8 = undefined,
+
+    /// Scrapes served concurrently; further connections are refused
+    pub const MAX_SCRAPES = 2;
+    /// Entries a poll set needs for the listener and every scrape
+    pub const POLL_FDS = 1 + MAX_SCRAPES;
+
+    pub fn init(spec: []const u8, port: *Port) metrics.Endpoint.Error!Monitor {
+        return .{ .endpoint = try metrics.Endpoint.listen(spec), .port = port };
+    }
+
+    pub fn deinit(self: *Monitor) void {
+        for (&self.scrapes) |*scrape| scrape.expire(std.math.maxInt(i64));
+        self.endpoint.close();
+    }
+
+    /// Fills the poll entries for the listener and the active scrapes
+    pub fn pollFds(self: *const Monitor, fds: *[POLL_FDS]posix.pollfd) void {
+        fds[0] = .{ .fd = self.endpoint.fd, .events = posix.POLL.IN, .revents = 0 };
+        for (&self.scrapes, fds[1..]) |*scrape, *entry| {
+            entry.* = .{ .fd = scrape.fd, .events = scrape.events(), .revents = 0 };
+        }
+    }
+
+    /// poll timeout that keeps idle scrapes expiring
+    pub fn timeout(self: *const Monitor) i32 {
+        for (&self.scrapes) |*scrape| {
+            if (scrape.isActive()) return 250;
+        }
+        return -1;
+    }
+
+    /// Steps every scrape `fds` (from `pollFds`) reports ready and takes
+    /// new connections
+    pub fn serve(self: *Monitor, fds: *const [POLL_FDS]posix.pollfd) void {
+        const now = std.time.milliTimestamp();
+        for (&self.scrapes, fds[1..]) |*scrape, entry| {
+            if (entry.fd >= 0 and entry.revents != 0) self.step(scrape);
+            scrape.expire(now);
+        }
+        if (fds[0].revents & posix.POLL.IN == 0) return;
+        while (self.endpoint.accept()) |conn| {
+            for (&self.scrapes, &self.buffers) |*scrape, *buffer| {
+                if (scrape.isActive()) continue;
+                scrape.start(conn, buffer, now);
+                self.step(scrape);
+                break;
+            } else posix.close(conn);
+        }
+    }
+
+    fn step(self: *Monitor, scrape: *metrics.Scrape) void {
+        if (scrape.advance() != .needs_body) return;
+        var e = metrics.Exposition.init(scrape.body());
+        metrics.renderPorts(&e, &.{self.port});
+        metrics.renderTransfer(&e, self.transfers, serial.clock.now());
+        scrape.reply(e.bytes().len);
+        _ = scrape.advance();
+    }
+};
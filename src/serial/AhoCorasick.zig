@@ -0,0 +1,155 @@
+const std = @import("std");
+
+/// Multi-pattern literal matcher compiled to a dense DFA.
+///
+/// Goto and failure transitions are folded into one 256-entry row per trie
+/// node, so scanning costs one table lookup per byte. Matching state is kept
+/// between calls, so a pattern split across RX chunks is still found.
+pub const AhoCorasick = struct {
+    /// Pattern sets are reported as a bit mask per state
+    pub const MAX_PATTERNS = 64;
+
+    allocator: std.mem.Allocator,
+    /// transitions[state * 256 + byte] -> next state
+    transitions: []u32,
+    /// Patterns ending at each state (including via failure links)
+    outputs: []u64,
+    state: u32 = 0,
+
+    pub const Error = error{TooManyPatterns} || std.mem.Allocator.Error;
+
+    pub const Match = struct {
+        /// Index into the pattern list passed to `init`
+        pattern: usize,
+        /// Offset just past the last matched byte in the scanned slice
+        end: usize,
+    };
+
+    pub fn init(allocator: std.mem.Allocator, patterns: []const []const u8) Error!AhoCorasick {
+        if (patterns.len > MAX_PATTERNS) return Error.TooManyPatterns;
+
+        var max_states: usize = 1;
+        for (patterns) |p| max_states += p.len;
+
+        const transitions = try allocator.alloc(u32, max_states * 256);
+        errdefer allocator.free(transitions);
+        const outputs = try allocator.alloc(u64, max_states);
+        errdefer allocator.free(outputs);
+        const fail = try allocator.alloc(u32, max_states);
+        defer allocator.free(fail);
+
+        // 0 means "no edge" while building the trie; state 0 is the root
+        // and never a goto target, so it is unambiguous
+        @memset(transitions, 0);
+        @memset(outputs, 0);
+
+        // Build the trie
+        var state_count: u32 = 1;
+        for (patterns, 0..) |p, index| {
+            var s: u32 = 0;
+            for (p) |byte| {
+                const slot = @as(usize, s) * 256 + byte;
+                if (transitions[slot] == 0) {
+                    transitions[slot] = state_count;
+                    state_count += 1;
+                }
+                s = transitions[slot];
+            }
+            outputs[s] |= @as(u64, 1) << @intCast(index);
+        }
+
+        // Breadth-first pass: compute failure links and fill missing edges
+        // with the failure state's edge, turning the trie into a DFA
+        const queue = try allocator.alloc(u32, state_count);
+        defer allocator.free(queue);
+        var head: usize = 0;
+        var tail: usize = 0;
+
+        for (0..256) |byte| {
+            const next = transitions[byte];
+            if (next != 0) {
+                fail[next] = 0;
+                queue[tail] = next;
+                tail += 1;
+            }
+        }
+
+        while (head < tail) {
+            const s = queue[head];
+            head += 1;
+            outputs[s] |= outputs[fail[s]];
+
+            const row = @as(usize, s) * 256;
+            const fail_row = @as(usize, fail[s]) * 256;
+            for (0..256) |byte| {
+                const next = transitions[row + byte];
+                if (next != 0) {
+                    fail[next] = transitions[fail_row + byte];
+                    queue[tail] = next;
+                    tail += 1;
+                } else {
+                    transitions[row + byte] = transitions[fail_row + byte];
+                }
+            }
+        }
+
+        return .{
+            .allocator = allocator,
+            .transitions = transitions,
+            .outputs = outputs,
+        };
+    }
+
+    pub fn deinit(self: *AhoCorasick) void {
+        self.allocator.free(self.transitions);
+        self.allocator.free(self.outputs);
+    }
+
+    /// Forgets any partial match carried over from earlier chunks
+    pub fn reset(self: *AhoCorasick) void {
+        self.state = 0;
+    }
+
+    /// Scans `data` from the current state and returns the first match.
+    /// When several patterns end at the same byte the lowest index wins.
+    /// Call again with `data[match.end..]` to continue scanning.
+    pub fn next(self: *AhoCorasick, data: []const u8) ?Match {
+        var s = self.state;
+        for (data, 0..) |byte, i| {
+            s = self.transitions[@as(usize, s) * 256 + byte];
+            const out = self.outputs[s];
+            if (out != 0) {
+                self.state = s;
+                return .{ .pattern = @ctz(out), .end = i + 1 };
+            }
+        }
+        self.state = s;
+        return null;
+    }
+};
+
+test "AhoCorasick finds overlapping patterns" {
+    const patterns = [_][]const u8{ "he", "she", "his", "hers" };
+    var ac = try AhoCorasick.init(std.testing.allocator, &patterns);
+    defer ac.deinit();
+
+    const text = "ushers";
+    const first = ac.next(text).?;
+    // "she" and "he" both end at index 4; "he" has the lower index
+    try std.testing.expectEqual(@as(usize, 0), first.pattern);
+    try std.testing.expectEqual(@as(usize, 4), first.end);
+
+    const second = ac.next(text[first.end..]).?;
+    try std.testing.expectEqual(@as(usize, 3), second.pattern);
+}
+
+test "AhoCorasick matches across chunk boundaries" {
+    const patterns = [_][]const u8{ "login:", "Hit any key" };
+    var ac = try AhoCorasick.init(std.testing.allocator, &patterns);
+    defer ac.deinit();
+
+    try std.testing.expectEqual(@as(?AhoCorasick.Match, null), ac.next("U-Boot 2024.01\r\nHit an"));
+    const match = ac.next("y key to stop autoboot").?;
+    try std.testing.expectEqual(@as(usize, 1), match.pattern);
+    try std.testing.expectEqual(@as(usize, 5), match.end);
+}
@@ -9,6 +9,9 @@ pub const Config = struct {
     flow_control: FlowControl = .none,
     local_echo: bool = false,
     line_ending: LineEnding = .cr,
+    /// Report framing/parity errors and breaks in-band (PARMRK); `Port.read`
+    /// strips the markers and counts them
+    mark_errors: bool = false,
 
     /// Standard baud rates
     pub const BaudRate = enum(u32) {
@@ -28,6 +31,25 @@ pub const Config = struct {
         pub fn toSpeed(self: BaudRate) u32 {
             return @intFromEnum(self);
         }
+
+        /// Returns the matching standard rate, or null for non-standard speeds
+        pub fn fromSpeed(speed: u32) ?BaudRate {
+            return switch (speed) {
+                300 => .B300,
+                1200 => .B1200,
+                2400 => .B2400,
+                4800 => .B4800,
+                9600 => .B9600,
+                19200 => .B19200,
+                38400 => .B38400,
+                57600 => .B57600,
+                115200 => .B115200,
+                230400 => .B230400,
+                460800 => .B460800,
+                921600 => .B921600,
+                else => null,
+            };
+        }
     };
 
     /// Data bits per character
@@ -67,6 +89,7 @@ pub const Config = struct {
         none,
         hardware, // RTS/CTS
         software, // XON/XOFF
+        software_userspace, // XON/XOFF against the hub ring (SoftFlow)
     };
 
     /// Line ending for transmitted data
@@ -84,6 +107,48 @@ pub const Config = struct {
         }
     };
 
+    /// Which settings differ between two configurations
+    pub const Changes = struct {
+        baud_rate: bool = false,
+        /// Data bits, parity or stop bits
+        framing: bool = false,
+        flow_control: bool = false,
+        mark_errors: bool = false,
+        /// Settings only this library acts on (local echo, line ending)
+        local: bool = false,
+
+        /// Whether the driver needs new termios settings
+        pub fn termios(self: Changes) bool {
+            return self.baud_rate or self.framing or self.flow_control or self.mark_errors;
+        }
+    };
+
+    /// Settings that change going from `self` to `other`
+    pub fn diff(self: Config, other: Config) Changes {
+        return .{
+            .baud_rate = self.baud_rate != other.baud_rate,
+            .framing = self.data_bits != other.data_bits or self.parity != other.parity or self.stop_bits != other.stop_bits,
+            .flow_control = self.flow_control != other.flow_control,
+            .mark_errors = self.mark_errors != other.mark_errors,
+            .local = self.local_echo != other.local_echo or self.line_ending != other.line_ending,
+        };
+    }
+
+    /// Bits on the wire per character: start, data, parity and stop bits
+    pub fn bitsPerChar(self: Config) u32 {
+        const parity: u32 = if (self.parity == .none) 0 else 1;
+        const stop: u32 = switch (self.stop_bits) {
+            .one => 1,
+            .two => 2,
+        };
+        return 1 + @as(u32, @intFromEnum(self.data_bits)) + parity + stop;
+    }
+
+    /// Time one character takes on the wire
+    pub fn charTimeNs(self: Config) u64 {
+        return @as(u64, self.bitsPerChar()) * std.time.ns_per_s / self.baud_rate.toSpeed();
+    }
+
     /// Returns the configuration as a string for display
     pub fn formatString(self: Config, buf: []u8) ![]u8 {
         const parity_char: u8 = switch (self.parity) {
@@ -101,6 +166,7 @@ pub const Config = struct {
             .none => "None",
             .hardware => "RTS/CTS",
             .software => "XON/XOFF",
+            .software_userspace => "XON/XOFF (user)",
         };
 
         return std.fmt.bufPrint(buf, "{d} {d}{c}{c} {s}", .{
@@ -160,3 +226,19 @@ test "Config presets" {
     try std.testing.expectEqual(@as(u32, 9600), arduino.baud_rate.toSpeed());
     try std.testing.expectEqual(Config.DataBits.eight, arduino.data_bits);
 }
+
+test "Config character time" {
+    try std.testing.expectEqual(@as(u32, 10), (Config{}).bitsPerChar());
+    const framed = Config{ .baud_rate = .B9600, .data_bits = .seven, .parity = .even, .stop_bits = .two };
+    try std.testing.expectEqual(@as(u32, 11), framed.bitsPerChar());
+    try std.testing.expectEqual(@as(u64, 1_145_833), framed.charTimeNs());
+}
+
+test "Config diff" {
+    const base = Config{};
+    try std.testing.expect(!base.diff(base).termios());
+    const faster = Config{ .baud_rate = .B921600, .line_ending = .lf };
+    const changes = base.diff(faster);
+    try std.testing.expect(changes.baud_rate and changes.local and changes.termios());
+    try std.testing.expect(!changes.framing and !changes.flow_control);
+}
@@ -0,0 +1,79 @@
+const std = @import("std");
+
+const Alignment = std.mem.Alignment;
+
+/// Allocator wrapper that counts heap activity: every allocation, every
+/// in-place resize or remap, and the blocks still outstanding. The C API
+/// routes everything through one, so it knows when the backing allocator
+/// can be swapped, and tests use it to pin down allocation-free paths.
+pub const CountingAllocator = struct {
+    child: std.mem.Allocator,
+    /// Allocations, resizes and remaps that went to the child
+    calls: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    /// Blocks allocated and not yet freed
+    live: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+
+    pub fn init(child: std.mem.Allocator) CountingAllocator {
+        return .{ .child = child };
+    }
+
+    pub fn allocator(self: *CountingAllocator) std.mem.Allocator {
+        return .{ .ptr = self, .vtable = &vtable };
+    }
+
+    pub fn callCount(self: *const CountingAllocator) u64 {
+        return self.calls.load(.monotonic);
+    }
+
+    pub fn liveCount(self: *const CountingAllocator) u64 {
+        return self.live.load(.monotonic);
+    }
+
+    const vtable = std.mem.Allocator.VTable{
+        .alloc = alloc,
+        .resize = resize,
+        .remap = remap,
+        .free = free,
+    };
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: Alignment, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        _ = self.calls.fetchAdd(1, .monotonic);
+        const ptr = self.child.rawAlloc(len, alignment, ret_addr) orelse return null;
+        _ = self.live.fetchAdd(1, .monotonic);
+        return ptr;
+    }
+
+    fn resize(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) bool {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        _ = self.calls.fetchAdd(1, .monotonic);
+        return self.child.rawResize(memory, alignment, new_len, ret_addr);
+    }
+
+    fn remap(ctx: *anyopaque, memory: []u8, alignment: Alignment, new_len: usize, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        _ = self.calls.fetchAdd(1, .monotonic);
+        return self.child.rawRemap(memory, alignment, new_len, ret_addr);
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: Alignment, ret_addr: usize) void {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.child.rawFree(memory, alignment, ret_addr);
+        _ = self.live.fetchSub(1, .monotonic);
+    }
+};
+
+test "counts calls and outstanding blocks" {
+    var counting = CountingAllocator.init(std.testing.allocator);
+    const a = counting.allocator();
+
+    const first = try a.alloc(u8, 16);
+    const second = try a.create(u64);
+    try std.testing.expectEqual(@as(u64, 2), counting.callCount());
+    try std.testing.expectEqual(@as(u64, 2), counting.liveCount());
+
+    a.free(first);
+    a.destroy(second);
+    try std.testing.expectEqual(@as(u64, 2), counting.callCount());
+    try std.testing.expectEqual(@as(u64, 0), counting.liveCount());
+}
@@ -0,0 +1,259 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const Hub = @import("Hub.zig").Hub;
+const AhoCorasick = @import("AhoCorasick.zig").AhoCorasick;
+const regex = @import("regex.zig");
+
+/// Send/expect automation over a serial stream.
+///
+/// Matching runs in the thread that reads the port: every chunk goes
+/// straight through a compiled Aho-Corasick automaton, and a pattern's
+/// reply is written before the next read, so there is no process or
+/// thread hop between seeing a prompt and answering it.
+pub const Expect = struct {
+    const READ_CHUNK = 4096;
+    const LINE_SIZE = 256;
+
+    source: Source,
+    /// Received bytes not yet consumed by a match
+    buffer: [READ_CHUNK]u8 = undefined,
+    start: usize = 0,
+    end: usize = 0,
+    /// Tail of the current line, checked by a pattern's regex stage
+    line: [LINE_SIZE]u8 = undefined,
+    line_len: usize = 0,
+    /// Optional tap that sees every received byte (e.g. for logging)
+    on_data: ?*const fn (data: []const u8, context: ?*anyopaque) void = null,
+    context: ?*anyopaque = null,
+
+    pub const Error = error{
+        Timeout,
+        InvalidPattern,
+    } || AhoCorasick.Error || Hub.Error;
+
+    /// Where RX data comes from and TX data goes to
+    pub const Source = union(enum) {
+        port: *Port,
+        /// Read through a hub cursor; writes go through the hub's TX queue
+        consumer: *Hub.Consumer,
+    };
+
+    pub const Pattern = struct {
+        /// Literal text that triggers the match
+        literal: []const u8,
+        /// Must also match the current line (up to the end of the literal)
+        regex: ?[]const u8 = null,
+        /// Sent as soon as the pattern matches
+        reply: ?[]const u8 = null,
+    };
+
+    /// A compiled set of alternatives
+    pub const Matcher = struct {
+        automaton: AhoCorasick,
+        patterns: []const Pattern,
+
+        pub fn init(allocator: std.mem.Allocator, patterns: []const Pattern) Error!Matcher {
+            const literals = try allocator.alloc([]const u8, patterns.len);
+            defer allocator.free(literals);
+            for (patterns, literals) |pattern, *literal| {
+                if (pattern.literal.len == 0) return Error.InvalidPattern;
+                if (pattern.regex) |re| try regex.validate(re);
+                literal.* = pattern.literal;
+            }
+            return .{
+                .automaton = try AhoCorasick.init(allocator, literals),
+                .patterns = patterns,
+            };
+        }
+
+        pub fn deinit(self: *Matcher) void {
+            self.automaton.deinit();
+        }
+    };
+
+    pub const Step = union(enum) {
+        /// Write bytes
+        send: []const u8,
+        /// Wait for any of the patterns
+        expect: struct {
+            patterns: []const Pattern,
+            timeout_ms: u32 = 10_000,
+        },
+        /// Pause without reading
+        sleep_ms: u32,
+    };
+
+    /// A sequence of steps with matchers compiled up front, so running
+    /// it does not allocate
+    pub const Script = struct {
+        allocator: std.mem.Allocator,
+        steps: []const Step,
+        matchers: []?Matcher,
+        /// Index of the step that was running when `run` returned
+        current_step: usize = 0,
+
+        pub fn init(allocator: std.mem.Allocator, steps: []const Step) Error!Script {
+            const matchers = try allocator.alloc(?Matcher, steps.len);
+            @memset(matchers, null);
+            var self = Script{ .allocator = allocator, .steps = steps, .matchers = matchers };
+            errdefer self.deinit();
+
+            for (steps, matchers) |step, *matcher| {
+                if (step == .expect) matcher.* = try Matcher.init(allocator, step.expect.patterns);
+            }
+            return self;
+        }
+
+        pub fn deinit(self: *Script) void {
+            for (self.matchers) |*matcher| {
+                if (matcher.*) |*m| m.deinit();
+            }
+            self.allocator.free(self.matchers);
+        }
+
+        /// Runs every step in order, stopping at the first failure
+        pub fn run(self: *Script, session: *Expect) Error!void {
+            for (self.steps, 0..) |step, i| {
+                self.current_step = i;
+                switch (step) {
+                    .send => |data| try session.send(data),
+                    .expect => |e| _ = try session.expect(&self.matchers[i].?, e.timeout_ms),
+                    .sleep_ms => |ms| std.Thread.sleep(@as(u64, ms) * std.time.ns_per_ms),
+                }
+            }
+        }
+    };
+
+    pub fn init(source: Source) Expect {
+        return .{ .source = source };
+    }
+
+    /// Writes `data` to the port
+    pub fn send(self: *Expect, data: []const u8) Error!void {
+        switch (self.source) {
+            .port => |p| try p.writeAll(data),
+            .consumer => |c| try c.hub.write(data),
+        }
+    }
+
+    /// Reads until one of the matcher's patterns is seen and returns its
+    /// index. Bytes after the match stay buffered for the next call.
+    pub fn expect(self: *Expect, matcher: *Matcher, timeout_ms: u32) Error!usize {
+        matcher.automaton.reset();
+        const started = std.time.Instant.now() catch return Error.Timeout;
+        const timeout_ns = @as(u64, timeout_ms) * std.time.ns_per_ms;
+
+        while (true) {
+            while (self.start < self.end) {
+                const chunk = self.buffer[self.start..self.end];
+                const hit = matcher.automaton.next(chunk) orelse {
+                    self.consume(chunk);
+                    self.start = self.end;
+                    break;
+                };
+                self.consume(chunk[0..hit.end]);
+                self.start += hit.end;
+
+                const pattern = matcher.patterns[hit.pattern];
+                if (pattern.regex) |re| {
+                    if (!regex.search(re, self.line[0..self.line_len])) continue;
+                }
+                if (pattern.reply) |reply| try self.send(reply);
+                return hit.pattern;
+            }
+
+            const now = std.time.Instant.now() catch return Error.Timeout;
+            const elapsed = now.since(started);
+            if (elapsed >= timeout_ns) return Error.Timeout;
+            const remaining_ms: u32 = @intCast((timeout_ns - elapsed + std.time.ns_per_ms - 1) / std.time.ns_per_ms);
+            try self.fill(remaining_ms);
+        }
+    }
+
+    /// Convenience wrapper: expects a single literal
+    pub fn expectLiteral(self: *Expect, allocator: std.mem.Allocator, literal: []const u8, timeout_ms: u32) Error!void {
+        const patterns = [_]Pattern{.{ .literal = literal }};
+        var matcher = try Matcher.init(allocator, &patterns);
+        defer matcher.deinit();
+        _ = try self.expect(&matcher, timeout_ms);
+    }
+
+    /// Discards buffered input
+    pub fn clear(self: *Expect) void {
+        self.start = 0;
+        self.end = 0;
+        self.line_len = 0;
+    }
+
+    fn fill(self: *Expect, timeout_ms: u32) Error!void {
+        const n = switch (self.source) {
+            .port => |p| blk: {
+                if (!p.waitForData(timeout_ms)) break :blk 0;
+                break :blk p.read(&self.buffer) catch |err| switch (err) {
+                    Port.Error.WouldBlock => 0,
+                    else => return err,
+                };
+            },
+            .consumer => |c| try c.read(&self.buffer, timeout_ms),
+        };
+        self.start = 0;
+        self.end = n;
+    }
+
+    /// Passes bytes to the tap and tracks the current line
+    fn consume(self: *Expect, data: []const u8) void {
+        if (self.on_data) |callback| callback(data, self.context);
+        for (data) |byte| {
+            if (byte == '\n' or byte == '\r') {
+                self.line_len = 0;
+                continue;
+            }
+            if (self.line_len == LINE_SIZE) {
+                // Keep the most recent half of an over-long line
+                std.mem.copyForwards(u8, self.line[0 .. LINE_SIZE / 2], self.line[LINE_SIZE / 2 ..]);
+                self.line_len = LINE_SIZE / 2;
+            }
+            self.line[self.line_len] = byte;
+            self.line_len += 1;
+        }
+    }
+};
+
+test "expect finds prompts and keeps the rest buffered" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    var session = Expect.init(.{ .port = &port });
+
+    const boot = [_]Expect.Pattern{
+        .{ .literal = "Kernel panic" },
+        .{ .literal = "Hit any key" },
+    };
+    var matcher = try Expect.Matcher.init(std.testing.allocator, &boot);
+    defer matcher.deinit();
+
+    _ = try std.posix.write(fds[1], "U-Boot 2024.01\r\nHit any key to stop autoboot\r\nlogin: ");
+    try std.testing.expectEqual(@as(usize, 1), try session.expect(&matcher, 1000));
+    try session.expectLiteral(std.testing.allocator, "login:", 1000);
+    try std.testing.expectError(Expect.Error.Timeout, session.expect(&matcher, 10));
+}
+
+test "regex stage rejects literal hits on the wrong line" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    var session = Expect.init(.{ .port = &port });
+
+    const prompt = [_]Expect.Pattern{
+        .{ .literal = "# ", .regex = "^root@\\w+:.*# $" },
+    };
+    var matcher = try Expect.Matcher.init(std.testing.allocator, &prompt);
+    defer matcher.deinit();
+
+    _ = try std.posix.write(fds[1], "note: # not a prompt\r\n");
+    try std.testing.expectError(Expect.Error.Timeout, session.expect(&matcher, 10));
+    _ = try std.posix.write(fds[1], "root@imx8:~# ");
+    try std.testing.expectEqual(@as(usize, 0), try session.expect(&matcher, 1000));
+}
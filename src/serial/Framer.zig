@@ -0,0 +1,445 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const scan = @import("scan.zig");
+
+/// Incremental frame decoder (and encoder) over a raw byte stream.
+///
+/// Received bytes go into the framer's own buffer, straight from the port
+/// with `readFrom` or copied with `feed`; `next` then yields whole frames
+/// as views into that buffer. Delimiters are found with the vectorized
+/// scanners, and SLIP/COBS frames are decoded in place, so a frame is
+/// never copied after it arrives. A view stays valid until the next
+/// `feed` or `readFrom`.
+///
+/// Frames that fail to decode or fail their CRC are skipped and counted;
+/// a frame that outgrows the buffer is dropped and counted as an overflow.
+pub const Framer = struct {
+    pub const Kind = enum(u8) {
+        /// Newline-terminated; a CR before the LF is stripped
+        line,
+        /// RFC 1055 SLIP, END-delimited
+        slip,
+        /// Consistent overhead byte stuffing, zero-delimited
+        cobs,
+        /// Length header (payload bytes, excluding header and CRC)
+        length_u8,
+        length_u16,
+        length_u32,
+    };
+
+    /// Trailer after the payload (binary kinds only). Each CRC keeps the
+    /// byte order of the protocol it comes from.
+    pub const Crc = enum(u8) {
+        none,
+        /// CRC-16/XMODEM, big-endian
+        crc16_ccitt,
+        /// CRC-16/MODBUS, little-endian
+        crc16_modbus,
+        /// CRC-32 (IEEE), little-endian
+        crc32,
+
+        fn size(self: Crc) usize {
+            return switch (self) {
+                .none => 0,
+                .crc16_ccitt, .crc16_modbus => 2,
+                .crc32 => 4,
+            };
+        }
+
+        /// Writes the CRC of `payload` into `out`; returns its length
+        fn put(self: Crc, payload: []const u8, out: *[4]u8) usize {
+            switch (self) {
+                .none => {},
+                .crc16_ccitt => std.mem.writeInt(u16, out[0..2], std.hash.crc.Crc16Xmodem.hash(payload), .big),
+                .crc16_modbus => std.mem.writeInt(u16, out[0..2], std.hash.crc.Crc16Modbus.hash(payload), .little),
+                .crc32 => std.mem.writeInt(u32, out[0..4], std.hash.Crc32.hash(payload), .little),
+            }
+            return self.size();
+        }
+    };
+
+    pub const Options = struct {
+        kind: Kind = .line,
+        crc: Crc = .none,
+        /// Byte order of length headers
+        endian: std.builtin.Endian = .big,
+        /// Largest payload accepted
+        max_frame: usize = 4096,
+    };
+
+    pub const Error = error{ BufferTooSmall, FrameTooLarge };
+
+    const SLIP_END = 0xC0;
+    const SLIP_ESC = 0xDB;
+    const SLIP_ESC_END = 0xDC;
+    const SLIP_ESC_ESC = 0xDD;
+
+    allocator: std.mem.Allocator,
+    options: Options,
+    /// Room for the largest frame in its worst-case encoding
+    buffer: []u8,
+    /// Unconsumed bytes are buffer[start..end]
+    start: usize = 0,
+    end: usize = 0,
+    /// Delimiter search resumes here
+    scanned: usize = 0,
+    /// Inside a frame that overflowed: everything up to the next
+    /// delimiter is dropped rather than surfacing as a frame of its own
+    discarding: bool = false,
+    frames: u64 = 0,
+    /// Frames skipped for bad encoding or CRC
+    errors: u64 = 0,
+    overflows: u64 = 0,
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) std.mem.Allocator.Error!Framer {
+        const buffer = try allocator.alloc(u8, encodedLimit(options) + 1);
+        return .{ .allocator = allocator, .options = options, .buffer = buffer };
+    }
+
+    pub fn deinit(self: *Framer) void {
+        self.allocator.free(self.buffer);
+    }
+
+    /// Copies as much of `data` as fits and returns how much that was.
+    /// Call `next` until it returns null before feeding the rest.
+    pub fn feed(self: *Framer, data: []const u8) usize {
+        self.compact();
+        const n = @min(data.len, self.buffer.len - self.end);
+        @memcpy(self.buffer[self.end..][0..n], data[0..n]);
+        self.end += n;
+        return n;
+    }
+
+    /// Reads from `port` straight into the buffer
+    pub fn readFrom(self: *Framer, port: *Port) Port.Error!usize {
+        self.compact();
+        if (self.end == self.buffer.len) return 0;
+        const n = try port.read(self.buffer[self.end..]);
+        self.end += n;
+        return n;
+    }
+
+    /// The next complete frame's payload, or null until more data arrives
+    pub fn next(self: *Framer) ?[]const u8 {
+        const frame = switch (self.options.kind) {
+            .line, .slip, .cobs => self.nextDelimited(),
+            .length_u8, .length_u16, .length_u32 => self.nextPrefixed(),
+        } orelse return null;
+        self.frames += 1;
+        return frame;
+    }
+
+    fn nextDelimited(self: *Framer) ?[]const u8 {
+        const delimiter: u8 = switch (self.options.kind) {
+            .line => '\n',
+            .slip => SLIP_END,
+            else => 0,
+        };
+        while (true) {
+            const i = scan.indexOfByte(self.buffer[0..self.end], self.scanned, delimiter) orelse {
+                self.scanned = self.end;
+                if (self.discarding) {
+                    self.start = self.end;
+                } else if (self.start == 0 and self.end == self.buffer.len) {
+                    // No delimiter in a full buffer: too long to ever fit
+                    self.overflows += 1;
+                    self.start = self.end;
+                    self.discarding = true;
+                }
+                return null;
+            };
+            const raw = self.buffer[self.start..i];
+            self.start = i + 1;
+            self.scanned = self.start;
+            if (self.discarding) {
+                // The tail of the frame that overflowed
+                self.discarding = false;
+                continue;
+            }
+
+            switch (self.options.kind) {
+                .line => return if (raw.len > 0 and raw[raw.len - 1] == '\r') raw[0 .. raw.len - 1] else raw,
+                // Back-to-back delimiters separate nothing
+                .slip, .cobs => if (raw.len == 0) continue,
+                else => unreachable,
+            }
+            const decoded = if (self.options.kind == .slip) decodeSlip(raw) else decodeCobs(raw);
+            if (decoded) |body| {
+                if (self.checked(body)) |payload| return payload;
+            }
+            self.errors += 1;
+        }
+    }
+
+    fn nextPrefixed(self: *Framer) ?[]const u8 {
+        const header: usize = switch (self.options.kind) {
+            .length_u8 => 1,
+            .length_u16 => 2,
+            else => 4,
+        };
+        const crc_size = self.options.crc.size();
+        while (self.end - self.start >= header) {
+            const head = self.buffer[self.start..][0..header];
+            const len: usize = switch (header) {
+                1 => head[0],
+                2 => std.mem.readInt(u16, head[0..2], self.options.endian),
+                else => std.mem.readInt(u32, head[0..4], self.options.endian),
+            };
+            if (len > self.options.max_frame) {
+                // There is no way to resynchronise inside a length stream
+                self.overflows += 1;
+                self.start = self.end;
+                return null;
+            }
+            const total = header + len + crc_size;
+            if (self.end - self.start < total) return null;
+            const body = self.buffer[self.start + header ..][0 .. len + crc_size];
+            self.start += total;
+            if (self.checked(body)) |payload| return payload;
+            self.errors += 1;
+        }
+        return null;
+    }
+
+    /// Strips and verifies the CRC trailer; null on mismatch
+    fn checked(self: *const Framer, body: []u8) ?[]u8 {
+        const size = self.options.crc.size();
+        if (size == 0) return body;
+        if (body.len < size) return null;
+        const payload = body[0 .. body.len - size];
+        var expected: [4]u8 = undefined;
+        _ = self.options.crc.put(payload, &expected);
+        if (!std.mem.eql(u8, expected[0..size], body[payload.len..])) return null;
+        return payload;
+    }
+
+    /// Moves unconsumed bytes to the front of the buffer
+    fn compact(self: *Framer) void {
+        if (self.start == 0) return;
+        std.mem.copyForwards(u8, self.buffer, self.buffer[self.start..self.end]);
+        self.end -= self.start;
+        self.scanned -= self.start;
+        self.start = 0;
+    }
+
+    /// Longest encoding of a `max_frame` payload plus its CRC
+    fn encodedLimit(options: Options) usize {
+        const body = options.max_frame + options.crc.size();
+        return switch (options.kind) {
+            .line => body + 2,
+            .slip => 2 * body + 2,
+            .cobs => body + body / 254 + 2,
+            .length_u8 => body + 1,
+            .length_u16 => body + 2,
+            .length_u32 => body + 4,
+        };
+    }
+
+    /// SLIP-decodes `raw` in place; null on a bad escape
+    fn decodeSlip(raw: []u8) ?[]u8 {
+        var out: usize = 0;
+        var i: usize = 0;
+        while (i < raw.len) {
+            const esc = scan.indexOfByte(raw, i, SLIP_ESC) orelse raw.len;
+            std.mem.copyForwards(u8, raw[out..], raw[i..esc]);
+            out += esc - i;
+            if (esc == raw.len) break;
+            if (esc + 1 == raw.len) return null;
+            raw[out] = switch (raw[esc + 1]) {
+                SLIP_ESC_END => SLIP_END,
+                SLIP_ESC_ESC => SLIP_ESC,
+                else => return null,
+            };
+            out += 1;
+            i = esc + 2;
+        }
+        return raw[0..out];
+    }
+
+    /// COBS-decodes `raw` (without its delimiter) in place; null if a
+    /// block runs past the end
+    fn decodeCobs(raw: []u8) ?[]u8 {
+        var out: usize = 0;
+        var i: usize = 0;
+        while (i < raw.len) {
+            const code = raw[i];
+            if (code == 0 or i + code > raw.len) return null;
+            std.mem.copyForwards(u8, raw[out..], raw[i + 1 .. i + code]);
+            out += code - 1;
+            i += code;
+            if (code != 0xFF and i < raw.len) {
+                raw[out] = 0;
+                out += 1;
+            }
+        }
+        return raw[0..out];
+    }
+
+    /// Encodes `payload` as one frame into `out`; returns the used part.
+    /// Line frames carry no CRC.
+    pub fn encode(options: Options, payload: []const u8, out: []u8) Error![]u8 {
+        if (payload.len > options.max_frame) return Error.FrameTooLarge;
+        var trailer: [4]u8 = undefined;
+        const crc = if (options.kind == .line) 0 else options.crc.put(payload, &trailer);
+        const parts = [_][]const u8{ payload, trailer[0..crc] };
+
+        const len = switch (options.kind) {
+            .line => blk: {
+                if (out.len < payload.len + 1) return Error.BufferTooSmall;
+                @memcpy(out[0..payload.len], payload);
+                out[payload.len] = '\n';
+                break :blk payload.len + 1;
+            },
+            .slip => try encodeSlip(&parts, out),
+            .cobs => try encodeCobs(&parts, out),
+            .length_u8, .length_u16, .length_u32 => blk: {
+                const header: usize = switch (options.kind) {
+                    .length_u8 => 1,
+                    .length_u16 => 2,
+                    else => 4,
+                };
+                if (payload.len > (@as(u64, 1) << @intCast(8 * header)) - 1) return Error.FrameTooLarge;
+                const total = header + payload.len + crc;
+                if (out.len < total) return Error.BufferTooSmall;
+                switch (header) {
+                    1 => out[0] = @intCast(payload.len),
+                    2 => std.mem.writeInt(u16, out[0..2], @intCast(payload.len), options.endian),
+                    else => std.mem.writeInt(u32, out[0..4], @intCast(payload.len), options.endian),
+                }
+                @memcpy(out[header..][0..payload.len], payload);
+                @memcpy(out[header + payload.len ..][0..crc], trailer[0..crc]);
+                break :blk total;
+            },
+        };
+        return out[0..len];
+    }
+
+    /// END, escaped data, END (the leading END flushes line noise)
+    fn encodeSlip(parts: []const []const u8, out: []u8) Error!usize {
+        var o: usize = 0;
+        if (out.len < 2) return Error.BufferTooSmall;
+        out[o] = SLIP_END;
+        o += 1;
+        for (parts) |part| {
+            var i: usize = 0;
+            while (i < part.len) {
+                const special = scan.indexOfEither(part, i, SLIP_END, SLIP_ESC) orelse part.len;
+                const run = special - i;
+                if (o + run + 3 > out.len) return Error.BufferTooSmall;
+                @memcpy(out[o..][0..run], part[i..special]);
+                o += run;
+                if (special == part.len) break;
+                out[o] = SLIP_ESC;
+                out[o + 1] = if (part[special] == SLIP_END) SLIP_ESC_END else SLIP_ESC_ESC;
+                o += 2;
+                i = special + 1;
+            }
+        }
+        if (o >= out.len) return Error.BufferTooSmall;
+        out[o] = SLIP_END;
+        return o + 1;
+    }
+
+    /// COBS blocks followed by the zero delimiter
+    fn encodeCobs(parts: []const []const u8, out: []u8) Error!usize {
+        if (out.len < 2) return Error.BufferTooSmall;
+        var code_at: usize = 0;
+        var o: usize = 1;
+        var code: u8 = 1;
+        for (parts) |part| {
+            for (part) |byte| {
+                if (o >= out.len) return Error.BufferTooSmall;
+                if (byte == 0) {
+                    out[code_at] = code;
+                    code_at = o;
+                    o += 1;
+                    code = 1;
+                    continue;
+                }
+                out[o] = byte;
+                o += 1;
+                code += 1;
+                if (code == 0xFF) {
+                    if (o >= out.len) return Error.BufferTooSmall;
+                    out[code_at] = code;
+                    code_at = o;
+                    o += 1;
+                    code = 1;
+                }
+            }
+        }
+        if (o >= out.len) return Error.BufferTooSmall;
+        out[code_at] = code;
+        out[o] = 0;
+        return o + 1;
+    }
+};
+
+fn roundTrip(options: Framer.Options, payloads: []const []const u8) !void {
+    var framer = try Framer.init(std.testing.allocator, options);
+    defer framer.deinit();
+
+    var wire: [2048]u8 = undefined;
+    var len: usize = 0;
+    for (payloads) |payload| len += (try Framer.encode(options, payload, wire[len..])).len;
+
+    // Byte-at-a-time delivery exercises every partial-frame path
+    var seen: usize = 0;
+    for (wire[0..len]) |byte| {
+        try std.testing.expectEqual(@as(usize, 1), framer.feed(&[_]u8{byte}));
+        while (framer.next()) |frame| : (seen += 1) {
+            try std.testing.expectEqualSlices(u8, payloads[seen], frame);
+        }
+    }
+    try std.testing.expectEqual(payloads.len, seen);
+    try std.testing.expectEqual(@as(u64, 0), framer.errors);
+}
+
+test "every kind round-trips through encode and decode" {
+    var long: [300]u8 = undefined;
+    for (&long, 0..) |*byte, i| byte.* = @truncate(i + 1);
+    const binary = [_][]const u8{ "plain", "\x00zero\x00", "\xc0end\xdbesc\xdc", &long, "" };
+
+    try roundTrip(.{ .kind = .line }, &.{ "first", "", "third" });
+    try roundTrip(.{ .kind = .slip, .crc = .crc16_ccitt }, binary[0..4]);
+    try roundTrip(.{ .kind = .cobs, .crc = .crc32 }, binary[0..4]);
+    try roundTrip(.{ .kind = .cobs }, binary[0..4]);
+    try roundTrip(.{ .kind = .length_u16, .crc = .crc16_modbus }, &binary);
+    try roundTrip(.{ .kind = .length_u32, .endian = .little }, &binary);
+}
+
+test "corrupt frames are skipped and the stream resynchronises" {
+    const options = Framer.Options{ .kind = .cobs, .crc = .crc16_ccitt };
+    var framer = try Framer.init(std.testing.allocator, options);
+    defer framer.deinit();
+
+    var wire: [64]u8 = undefined;
+    const bad = try Framer.encode(options, "damaged", &wire);
+    bad[2] ^= 0x40;
+    _ = framer.feed(bad);
+    const good = try Framer.encode(options, "intact", &wire);
+    _ = framer.feed(good);
+
+    try std.testing.expectEqualStrings("intact", framer.next().?);
+    try std.testing.expect(framer.next() == null);
+    try std.testing.expectEqual(@as(u64, 1), framer.errors);
+}
+
+test "a line longer than the buffer is dropped" {
+    var framer = try Framer.init(std.testing.allocator, .{ .max_frame = 8 });
+    defer framer.deinit();
+
+    // Its tail, once it arrives, must not come out as a frame either
+    const input = "0123456789abcdefghij\r\nok\r\n";
+    var fed: usize = 0;
+    var frames: usize = 0;
+    while (fed < input.len) {
+        fed += framer.feed(input[fed..]);
+        while (framer.next()) |frame| {
+            try std.testing.expectEqualStrings("ok", frame);
+            frames += 1;
+        }
+    }
+    try std.testing.expectEqual(@as(usize, 1), frames);
+    try std.testing.expectEqual(@as(u64, 1), framer.overflows);
+}
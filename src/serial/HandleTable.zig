@@ -0,0 +1,159 @@
+const std = @import("std");
+
+/// Fixed slot array mapping 32-bit handles to objects.
+///
+/// A handle packs a 16-bit slot index with the slot's 16-bit generation,
+/// so a handle to a closed object never resolves again, even once its
+/// slot is reused. Each slot keeps a count of in-flight calls: `acquire`
+/// and `release` bracket every use, and `remove` only marks the slot
+/// closing; whichever of it or the last `release` runs second calls
+/// `destroy`. Lookups are lock-free; only insert and slot recycling take
+/// the mutex. Handle 0 is never issued.
+pub fn HandleTable(comptime T: type, comptime capacity: u16, comptime destroy: fn (T) void) type {
+    return struct {
+        const Self = @This();
+
+        /// Slot state: generation(16) | closing(1) | live(1) | refs(14)
+        const CLOSING: u32 = 1 << 15;
+        const LIVE: u32 = 1 << 14;
+        const REFS_MASK: u32 = LIVE - 1;
+
+        const Slot = struct {
+            state: std.atomic.Value(u32) = std.atomic.Value(u32).init(1 << 16),
+            value: T = undefined,
+        };
+
+        slots: [capacity]Slot = [_]Slot{.{}} ** capacity,
+        mutex: std.Thread.Mutex = .{},
+        /// Recycled slot indices
+        free: [capacity]u16 = undefined,
+        free_len: usize = 0,
+        /// Slots below this have been handed out at least once
+        used: usize = 0,
+
+        /// Returns the new handle, or null when every slot is taken
+        pub fn insert(self: *Self, value: T) ?u32 {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+
+            const index: u16 = if (self.free_len > 0) blk: {
+                self.free_len -= 1;
+                break :blk self.free[self.free_len];
+            } else if (self.used < capacity) blk: {
+                self.used += 1;
+                break :blk @intCast(self.used - 1);
+            } else return null;
+
+            const slot = &self.slots[index];
+            const generation = slot.state.load(.monotonic) & ~(CLOSING | LIVE | REFS_MASK);
+            slot.value = value;
+            slot.state.store(generation | LIVE, .release);
+            return generation | index;
+        }
+
+        /// Resolves `handle` and pins it until the matching `release`.
+        /// Null for stale, closed or never-issued handles.
+        pub fn acquire(self: *Self, handle: u32) ?T {
+            const slot = self.slotOf(handle) orelse return null;
+            var state = slot.state.load(.acquire);
+            while (true) {
+                if (state & ~(CLOSING | LIVE | REFS_MASK) != handle & 0xFFFF_0000) return null;
+                if (state & (LIVE | CLOSING) != LIVE) return null;
+                if (state & REFS_MASK == REFS_MASK) return null;
+                state = slot.state.cmpxchgWeak(state, state + 1, .acquire, .acquire) orelse return slot.value;
+            }
+        }
+
+        pub fn release(self: *Self, handle: u32) void {
+            const slot = self.slotOf(handle).?;
+            const previous = slot.state.fetchSub(1, .acq_rel);
+            if (previous & CLOSING != 0 and previous & REFS_MASK == 1) self.retire(handle);
+        }
+
+        /// Invalidates `handle`; the object is destroyed once in-flight
+        /// calls have released it. Returns false for an invalid handle.
+        pub fn remove(self: *Self, handle: u32) bool {
+            const slot = self.slotOf(handle) orelse return false;
+            var state = slot.state.load(.acquire);
+            while (true) {
+                if (state & ~(CLOSING | LIVE | REFS_MASK) != handle & 0xFFFF_0000) return false;
+                if (state & (LIVE | CLOSING) != LIVE) return false;
+                state = slot.state.cmpxchgWeak(state, state | CLOSING, .acq_rel, .acquire) orelse {
+                    if (state & REFS_MASK == 0) self.retire(handle);
+                    return true;
+                };
+            }
+        }
+
+        fn slotOf(self: *Self, handle: u32) ?*Slot {
+            const index = handle & 0xFFFF;
+            if (index >= capacity) return null;
+            return &self.slots[index];
+        }
+
+        /// Destroys the object and recycles the slot under a new generation
+        fn retire(self: *Self, handle: u32) void {
+            const index: u16 = @intCast(handle & 0xFFFF);
+            const slot = &self.slots[index];
+            destroy(slot.value);
+
+            var generation = (handle >> 16) +% 1;
+            if (generation > 0xFFFF) generation = 1;
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            slot.state.store(generation << 16, .release);
+            self.free[self.free_len] = index;
+            self.free_len += 1;
+        }
+    };
+}
+
+var destroyed_count: usize = 0;
+
+fn countDestroy(_: *u8) void {
+    destroyed_count += 1;
+}
+
+test "stale handles never resolve" {
+    var table: HandleTable(*u8, 4, countDestroy) = .{};
+    var a: u8 = 1;
+    var b: u8 = 2;
+    destroyed_count = 0;
+
+    const first = table.insert(&a).?;
+    try std.testing.expect(first != 0);
+    try std.testing.expectEqual(&a, table.acquire(first).?);
+    table.release(first);
+
+    try std.testing.expect(table.remove(first));
+    try std.testing.expectEqual(@as(usize, 1), destroyed_count);
+    try std.testing.expect(table.acquire(first) == null);
+    try std.testing.expect(!table.remove(first));
+
+    // Same slot, new generation
+    const second = table.insert(&b).?;
+    try std.testing.expectEqual(first & 0xFFFF, second & 0xFFFF);
+    try std.testing.expect(first != second);
+    try std.testing.expect(table.acquire(first) == null);
+    try std.testing.expectEqual(&b, table.acquire(second).?);
+    table.release(second);
+}
+
+test "removal waits for in-flight calls" {
+    var table: HandleTable(*u8, 2, countDestroy) = .{};
+    var a: u8 = 1;
+    destroyed_count = 0;
+
+    const handle = table.insert(&a).?;
+    _ = table.acquire(handle).?;
+    try std.testing.expect(table.remove(handle));
+    // Closing: new calls fail, the in-flight one keeps the object alive
+    try std.testing.expect(table.acquire(handle) == null);
+    try std.testing.expectEqual(@as(usize, 0), destroyed_count);
+    table.release(handle);
+    try std.testing.expectEqual(@as(usize, 1), destroyed_count);
+
+    _ = table.insert(&a).?;
+    _ = table.insert(&a).?;
+    try std.testing.expect(table.insert(&a) == null);
+}
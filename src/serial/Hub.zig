@@ -0,0 +1,520 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const Supervisor = @import("Supervisor.zig").Supervisor;
+
+/// Shares one open `Port` between several consumers.
+///
+/// A reader thread copies RX data once into a shared ring; every consumer
+/// keeps its own cursor into it and a policy for what happens when it falls
+/// a full ring behind. TX from several writers is serialised in FIFO order
+/// so that each `write` reaches the wire as one uninterrupted message.
+///
+/// With `FlowControl.software_userspace` the hub also throttles the peer:
+/// XOFF once the furthest-behind consumer's backlog reaches `high_water`,
+/// XON once it is back down to `low_water`.
+///
+/// Under a `Supervisor` the hub survives the adapter going away: reads and
+/// writes wait for it to be reopened, and each consumer's `read` returns
+/// `Error.Reconnected` once at the point in the stream where the outage
+/// was, so a logger or capture can mark the gap.
+pub const Hub = struct {
+    pub const MAX_CONSUMERS = 16;
+    const READ_CHUNK = 4096;
+    const POLL_MS = 100;
+
+    allocator: std.mem.Allocator,
+    port: *Port,
+    ring: []u8,
+    /// Total bytes ever written into the ring
+    head: u64 = 0,
+    /// Backlog levels for userspace XON/XOFF (see `setWatermarks`)
+    high_water: u64,
+    low_water: u64,
+    /// Set by `supervise`
+    supervisor: ?*Supervisor = null,
+    /// Reconnections seen so far, and where in the stream the last was
+    reconnects: u64 = 0,
+    gap_at: u64 = 0,
+
+    mutex: std.Thread.Mutex = .{},
+    data_ready: std.Thread.Condition = .{},
+    space_ready: std.Thread.Condition = .{},
+    consumers: [MAX_CONSUMERS]Consumer = [_]Consumer{.{}} ** MAX_CONSUMERS,
+    thread: ?std.Thread = null,
+    running: bool = false,
+    failed: bool = false,
+
+    // TX arbitration (ticket queue)
+    tx_mutex: std.Thread.Mutex = .{},
+    tx_turn: std.Thread.Condition = .{},
+    tx_next_ticket: u64 = 0,
+    tx_now_serving: u64 = 0,
+
+    pub const Error = error{
+        TooManyConsumers,
+        Disconnected,
+        PortClosed,
+        Reconnected,
+    } || Port.Error || std.mem.Allocator.Error || std.Thread.SpawnError;
+
+    /// What happens to a consumer that falls a full ring behind
+    pub const Policy = enum(u8) {
+        /// Skip ahead, losing the oldest unread bytes (counted in `dropped`)
+        drop_oldest = 0,
+        /// Stall the reader thread until this consumer catches up
+        block = 1,
+        /// Detach the consumer; further reads fail with `Disconnected`
+        disconnect = 2,
+    };
+
+    /// Independent read cursor over the shared ring
+    pub const Consumer = struct {
+        hub: *Hub = undefined,
+        in_use: bool = false,
+        policy: Policy = .drop_oldest,
+        cursor: u64 = 0,
+        dropped: u64 = 0,
+        disconnected: bool = false,
+        /// `hub.reconnects` as of the last gap reported to this consumer
+        reconnects_seen: u64 = 0,
+
+        /// Copies unread bytes into `buffer`, waiting up to `timeout_ms`
+        /// for data. Returns 0 on timeout, and `Error.Reconnected` once
+        /// the cursor reaches a reconnection gap.
+        pub fn read(self: *Consumer, buffer: []u8, timeout_ms: u32) Error!usize {
+            const hub = self.hub;
+            hub.mutex.lock();
+            defer hub.mutex.unlock();
+
+            while (true) {
+                const gap = self.reconnects_seen != hub.reconnects;
+                if (gap and self.cursor >= hub.gap_at) {
+                    self.reconnects_seen = hub.reconnects;
+                    return Error.Reconnected;
+                }
+                if (self.cursor != hub.head) break;
+                if (self.disconnected) return Error.Disconnected;
+                if (hub.failed or !hub.running) return Error.PortClosed;
+                if (timeout_ms == 0) return 0;
+                hub.data_ready.timedWait(&hub.mutex, @as(u64, timeout_ms) * std.time.ns_per_ms) catch return 0;
+            }
+            if (self.disconnected) return Error.Disconnected;
+
+            // Stop at a gap so it is reported between the right bytes
+            const end = if (self.reconnects_seen != hub.reconnects) hub.gap_at else hub.head;
+            const available: usize = @intCast(end - self.cursor);
+            const n = @min(buffer.len, available);
+            hub.copyOut(self.cursor, buffer[0..n]);
+            self.cursor += n;
+
+            if (self.policy == .block) hub.space_ready.signal();
+            hub.throttleLocked();
+            return n;
+        }
+
+        /// Number of unread bytes
+        pub fn available(self: *Consumer) usize {
+            const hub = self.hub;
+            hub.mutex.lock();
+            defer hub.mutex.unlock();
+            return @intCast(hub.head - self.cursor);
+        }
+    };
+
+    /// Creates a hub over `port` with a ring of at least `capacity` bytes
+    /// (rounded up to a power of two) and starts its reader thread.
+    /// The port must outlive the hub.
+    pub fn create(allocator: std.mem.Allocator, port: *Port, capacity: usize) Error!*Hub {
+        const size = std.math.ceilPowerOfTwo(usize, @max(capacity, READ_CHUNK)) catch return Error.OutOfMemory;
+
+        const self = try allocator.create(Hub);
+        errdefer allocator.destroy(self);
+        const ring = try allocator.alloc(u8, size);
+        errdefer allocator.free(ring);
+
+        self.* = .{
+            .allocator = allocator,
+            .port = port,
+            .ring = ring,
+            .high_water = size / 4 * 3,
+            .low_water = size / 4,
+            .running = true,
+        };
+        self.thread = try std.Thread.spawn(.{}, readerLoop, .{self});
+        return self;
+    }
+
+    /// Stops the reader thread and frees the hub
+    pub fn destroy(self: *Hub) void {
+        self.mutex.lock();
+        self.running = false;
+        self.data_ready.broadcast();
+        self.space_ready.broadcast();
+        self.mutex.unlock();
+
+        if (self.thread) |t| t.join();
+        self.allocator.free(self.ring);
+        self.allocator.destroy(self);
+    }
+
+    /// Rides out adapter resets with `supervisor` (null to stop). Destroy
+    /// the hub before the supervisor.
+    pub fn supervise(self: *Hub, supervisor: ?*Supervisor) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.supervisor = supervisor;
+    }
+
+    /// Sets the backlog that stops the peer and the one that restarts it
+    pub fn setWatermarks(self: *Hub, high_water: usize, low_water: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.high_water = @min(high_water, self.ring.len);
+        self.low_water = @min(low_water, self.high_water);
+        self.throttleLocked();
+    }
+
+    /// Attaches a new consumer. It sees only data received from now on.
+    pub fn attach(self: *Hub, policy: Policy) Error!*Consumer {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        for (&self.consumers) |*consumer| {
+            if (consumer.in_use) continue;
+            consumer.* = .{
+                .hub = self,
+                .in_use = true,
+                .policy = policy,
+                .cursor = self.head,
+                .reconnects_seen = self.reconnects,
+            };
+            return consumer;
+        }
+        return Error.TooManyConsumers;
+    }
+
+    /// Detaches a consumer, releasing any backpressure it was applying
+    pub fn detach(self: *Hub, consumer: *Consumer) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        consumer.in_use = false;
+        self.space_ready.signal();
+        self.throttleLocked();
+    }
+
+    /// Writes `data` as one message. Concurrent writers are served in
+    /// arrival order and never interleave. Under a supervisor, a message
+    /// cut off by the adapter going away is sent again in full once it is
+    /// back; the reset device dropped the part it had.
+    pub fn write(self: *Hub, data: []const u8) Error!void {
+        self.tx_mutex.lock();
+        const ticket = self.tx_next_ticket;
+        self.tx_next_ticket += 1;
+        while (self.tx_now_serving != ticket) self.tx_turn.wait(&self.tx_mutex);
+        self.tx_mutex.unlock();
+
+        defer {
+            self.tx_mutex.lock();
+            self.tx_now_serving += 1;
+            self.tx_turn.broadcast();
+            self.tx_mutex.unlock();
+        }
+        while (true) {
+            self.port.writeAll(data) catch |err| {
+                self.mutex.lock();
+                const supervisor = self.supervisor;
+                self.mutex.unlock();
+                const sup = supervisor orelse return err;
+                sup.lost();
+                if (!self.followSupervisor(sup)) return err;
+                continue;
+            };
+            return;
+        }
+    }
+
+    fn readerLoop(self: *Hub) void {
+        while (true) {
+            self.mutex.lock();
+            const supervisor = self.supervisor;
+            self.mutex.unlock();
+            if (supervisor) |sup| {
+                if (!self.followSupervisor(sup)) return;
+            }
+
+            const ready = self.port.waitForData(POLL_MS);
+            // Size the read to what is waiting, so a lagging consumer only
+            // gives up the bytes this read overwrites. A hung-up tty reports
+            // nothing waiting but must still be read to notice.
+            const waiting = if (ready) @max(self.port.bytesAvailable(), 1) else 0;
+
+            self.mutex.lock();
+            var window = self.writableLocked();
+            while (window == 0 and self.running) {
+                // A blocking consumer is a full ring behind
+                self.space_ready.wait(&self.mutex);
+                window = self.writableLocked();
+            }
+            if (!self.running) {
+                self.mutex.unlock();
+                return;
+            }
+            const start = self.head;
+            const offset: usize = @intCast(start & (self.ring.len - 1));
+            const len = @min(window, self.ring.len - offset, READ_CHUNK, waiting);
+            if (ready) self.reclaimLocked(start + len);
+            self.mutex.unlock();
+
+            if (!ready) continue;
+
+            // The syscall writes straight into the ring, outside the lock;
+            // no consumer can be reading [start, start + len) at this point
+            const n = self.port.read(self.ring[offset..][0..len]) catch |err| switch (err) {
+                Port.Error.WouldBlock => continue,
+                else => if (supervisor) |sup| {
+                    sup.lost();
+                    continue;
+                } else {
+                    self.mutex.lock();
+                    self.failed = true;
+                    self.data_ready.broadcast();
+                    self.mutex.unlock();
+                    return;
+                },
+            };
+            if (n == 0) {
+                // Readable but empty: possibly a hung-up tty
+                if (supervisor) |sup| _ = sup.check();
+                continue;
+            }
+
+            self.mutex.lock();
+            self.head = start + n;
+            self.port.stats.recordBacklog(self.backlogLocked());
+            self.throttleLocked();
+            self.data_ready.broadcast();
+            self.mutex.unlock();
+        }
+    }
+
+    /// Waits out an outage of the supervised port and records where the
+    /// stream resumed after a reconnection. False once the hub is being
+    /// destroyed.
+    fn followSupervisor(self: *Hub, supervisor: *Supervisor) bool {
+        while (!supervisor.waitConnected(POLL_MS)) {
+            self.mutex.lock();
+            const running = self.running;
+            self.mutex.unlock();
+            if (!running) return false;
+        }
+        const count = supervisor.reconnectCount();
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (count != self.reconnects) {
+            self.reconnects = count;
+            self.gap_at = self.head;
+            self.data_ready.broadcast();
+        }
+        return self.running;
+    }
+
+    /// Bytes that can be written without overrunning a blocking consumer
+    fn writableLocked(self: *Hub) usize {
+        var window: u64 = self.ring.len;
+        for (&self.consumers) |*consumer| {
+            if (!consumer.in_use or consumer.disconnected or consumer.policy != .block) continue;
+            const used = self.head - consumer.cursor;
+            window = @min(window, self.ring.len - used);
+        }
+        return @intCast(window);
+    }
+
+    /// Unread bytes held for the furthest-behind consumer
+    fn backlogLocked(self: *Hub) u64 {
+        var backlog: u64 = 0;
+        for (&self.consumers) |*consumer| {
+            if (!consumer.in_use or consumer.disconnected) continue;
+            backlog = @max(backlog, self.head - consumer.cursor);
+        }
+        return backlog;
+    }
+
+    /// Stops or restarts the peer at the watermarks; a no-op unless the
+    /// port uses userspace XON/XOFF
+    fn throttleLocked(self: *Hub) void {
+        if (self.port.config.flow_control != .software_userspace) return;
+        const backlog = self.backlogLocked();
+        if (backlog >= self.high_water) {
+            self.port.throttle(true);
+        } else if (backlog <= self.low_water) {
+            self.port.throttle(false);
+        }
+    }
+
+    /// Moves lagging non-blocking consumers out of the region about to be
+    /// overwritten, i.e. everything before `new_head - ring.len`
+    fn reclaimLocked(self: *Hub, new_head: u64) void {
+        if (new_head <= self.ring.len) return;
+        const limit = new_head - self.ring.len;
+        for (&self.consumers) |*consumer| {
+            if (!consumer.in_use or consumer.disconnected or consumer.cursor >= limit) continue;
+            switch (consumer.policy) {
+                .drop_oldest => {
+                    consumer.dropped += limit - consumer.cursor;
+                    self.port.stats.recordDropped(limit - consumer.cursor);
+                    consumer.cursor = limit;
+                },
+                .disconnect => {
+                    consumer.disconnected = true;
+                    self.data_ready.broadcast();
+                },
+                .block => {},
+            }
+        }
+    }
+
+    fn copyOut(self: *Hub, position: u64, out: []u8) void {
+        const offset: usize = @intCast(position & (self.ring.len - 1));
+        const first = @min(out.len, self.ring.len - offset);
+        @memcpy(out[0..first], self.ring[offset..][0..first]);
+        @memcpy(out[first..], self.ring[0 .. out.len - first]);
+    }
+};
+
+fn readExactly(consumer: *Hub.Consumer, out: []u8) !void {
+    var got: usize = 0;
+    while (got < out.len) {
+        const n = try consumer.read(out[got..], 1000);
+        if (n == 0) return error.Timeout;
+        got += n;
+    }
+}
+
+test "consumers see the same stream independently" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    defer std.posix.close(fds[0]);
+
+    const hub = try Hub.create(std.testing.allocator, &port, 4096);
+    defer hub.destroy();
+
+    const a = try hub.attach(.block);
+    const b = try hub.attach(.block);
+
+    _ = try std.posix.write(fds[1], "hello hub");
+
+    var buf_a: [9]u8 = undefined;
+    var buf_b: [9]u8 = undefined;
+    try readExactly(a, &buf_a);
+    try readExactly(b, &buf_b);
+    try std.testing.expectEqualStrings("hello hub", &buf_a);
+    try std.testing.expectEqualStrings("hello hub", &buf_b);
+}
+
+test "slow drop_oldest consumer loses data without stalling others" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    defer std.posix.close(fds[0]);
+
+    const hub = try Hub.create(std.testing.allocator, &port, 4096);
+    defer hub.destroy();
+
+    const fast = try hub.attach(.block);
+    const slow = try hub.attach(.drop_oldest);
+
+    var data: [3 * 4096]u8 = undefined;
+    for (&data, 0..) |*byte, i| byte.* = @truncate(i);
+    _ = try std.posix.write(fds[1], &data);
+
+    var out: [data.len]u8 = undefined;
+    try readExactly(fast, &out);
+    try std.testing.expectEqualSlices(u8, &data, &out);
+
+    const tail = slow.available();
+    try std.testing.expect(slow.dropped > 0);
+    try std.testing.expectEqual(@as(u64, data.len), slow.dropped + tail);
+}
+
+test "drop_oldest consumer only loses what a read overwrites" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    defer std.posix.close(fds[0]);
+
+    const hub = try Hub.create(std.testing.allocator, &port, 4096);
+    defer hub.destroy();
+    const slow = try hub.attach(.drop_oldest);
+
+    // Leave the head just past a ring boundary, where the next read's
+    // window spans almost the whole ring
+    var data: [4000]u8 = undefined;
+    for (&data, 0..) |*byte, i| byte.* = @truncate(i);
+    var out: [data.len]u8 = undefined;
+    _ = try std.posix.write(fds[1], data[0..2000]);
+    try readExactly(slow, out[0..2000]);
+    _ = try std.posix.write(fds[1], data[0..2100]);
+    try readExactly(slow, out[0..2100]);
+
+    _ = try std.posix.write(fds[1], &data);
+    while (slow.available() + slow.dropped < data.len) std.Thread.sleep(std.time.ns_per_ms);
+    _ = try std.posix.write(fds[1], data[0..50]);
+    while (slow.available() + slow.dropped < data.len + 50) std.Thread.sleep(std.time.ns_per_ms);
+
+    // 4050 unread bytes fit in the ring: nothing had to go
+    try std.testing.expectEqual(@as(u64, 0), slow.dropped);
+    try std.testing.expectEqual(@as(usize, data.len + 50), slow.available());
+}
+
+test "userspace flow control throttles at the watermarks" {
+    const rx = try std.posix.pipe();
+    defer std.posix.close(rx[1]);
+    var port = Port.fromFdForTesting(rx[0], .{});
+    defer std.posix.close(rx[0]);
+    port.config.flow_control = .software_userspace;
+
+    const hub = try Hub.create(std.testing.allocator, &port, 4096);
+    defer hub.destroy();
+    hub.setWatermarks(1024, 256);
+    // XOFF/XON writes fail on the pipe's read end; the state is what counts
+    const consumer = try hub.attach(.block);
+
+    var data: [2048]u8 = undefined;
+    @memset(&data, 'x');
+    _ = try std.posix.write(rx[1], &data);
+    var out: [512]u8 = undefined;
+    while (consumer.available() < data.len) std.Thread.sleep(std.time.ns_per_ms);
+    try std.testing.expect(port.flow.throttled.load(.monotonic));
+
+    var drained: usize = 0;
+    while (drained < data.len - 256) drained += try consumer.read(&out, 1000);
+    try std.testing.expect(!port.flow.throttled.load(.monotonic));
+    try std.testing.expectEqual(@as(u64, 1), port.flow.xoff_sent.load(.monotonic));
+}
+
+test "consumers see a reconnection gap once, in stream order" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    defer std.posix.close(fds[0]);
+
+    const hub = try Hub.create(std.testing.allocator, &port, 4096);
+    defer hub.destroy();
+    const consumer = try hub.attach(.block);
+
+    _ = try std.posix.write(fds[1], "before");
+    while (consumer.available() < 6) std.Thread.sleep(std.time.ns_per_ms);
+    // What `followSupervisor` records after a reconnection
+    hub.mutex.lock();
+    hub.reconnects += 1;
+    hub.gap_at = hub.head;
+    hub.mutex.unlock();
+    _ = try std.posix.write(fds[1], "after");
+    while (consumer.available() < 11) std.Thread.sleep(std.time.ns_per_ms);
+
+    var buf: [16]u8 = undefined;
+    try std.testing.expectEqualStrings("before", buf[0..try consumer.read(&buf, 0)]);
+    try std.testing.expectError(Hub.Error.Reconnected, consumer.read(&buf, 0));
+    try std.testing.expectEqualStrings("after", buf[0..try consumer.read(&buf, 0)]);
+}
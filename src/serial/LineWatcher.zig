@@ -0,0 +1,211 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const Port = @import("Port.zig").Port;
+const clock = @import("clock.zig");
+
+/// Watches CTS, DSR, DCD and RI on a helper thread.
+///
+/// On Linux the thread blocks in TIOCMIWAIT and wakes as soon as a line
+/// changes; TIOCGICOUNT deltas reveal pulses shorter than the wakeup
+/// latency. Drivers without TIOCMIWAIT, and macOS, fall back to polling.
+/// Events go to an optional callback (called on the watcher thread) and
+/// to a fixed ring drained with `poll`.
+///
+/// TIOCMIWAIT can only be left early by a signal: `destroy` sends
+/// `wake_signal` to the watcher thread alone (pthread_kill), with a no-op
+/// handler installed without SA_RESTART.
+pub const LineWatcher = struct {
+    pub const RING_SIZE = 64;
+    const POLL_MS = 10;
+
+    /// Signal that interrupts TIOCMIWAIT on shutdown; set it before the
+    /// first watcher starts. SIGURG is ignored by default, so a stray
+    /// delivery is harmless. 0 uses no signal, and watchers poll instead.
+    pub var wake_signal: u6 = if (builtin.os.tag == .linux) std.posix.SIG.URG else 0;
+
+    pub const Event = struct {
+        /// CLOCK_MONOTONIC nanoseconds when the change was seen
+        timestamp_ns: u64,
+        status: Port.ModemStatus,
+        /// Transitions since the previous event (0 when counters are
+        /// unavailable); more than one means a pulse was missed
+        cts_changes: u32 = 0,
+        dsr_changes: u32 = 0,
+        dcd_changes: u32 = 0,
+        ri_changes: u32 = 0,
+    };
+
+    pub const Callback = *const fn (event: *const Event, context: ?*anyopaque) void;
+
+    allocator: std.mem.Allocator,
+    port: *Port,
+    callback: ?Callback,
+    context: ?*anyopaque,
+    thread: ?std.Thread = null,
+    /// `wake_signal` when the watcher started; 0 when it polls
+    signal: u6 = 0,
+    /// Set by `destroy`; also cuts a polling watcher's sleep short
+    stopped: std.Thread.ResetEvent = .{},
+    finished: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    mutex: std.Thread.Mutex = .{},
+    ring: [RING_SIZE]Event = undefined,
+    head: u64 = 0,
+    tail: u64 = 0,
+    /// Events lost because the ring was full
+    overflows: u64 = 0,
+
+    /// Starts watching `port`. The port must outlive the watcher.
+    pub fn create(allocator: std.mem.Allocator, port: *Port, callback: ?Callback, context: ?*anyopaque) !*LineWatcher {
+        const self = try allocator.create(LineWatcher);
+        errdefer allocator.destroy(self);
+        self.* = .{
+            .allocator = allocator,
+            .port = port,
+            .callback = callback,
+            .context = context,
+            .signal = wake_signal,
+        };
+        if (self.signal != 0) installWakeHandler(self.signal);
+        // Baseline taken here, so every change after create is reported
+        self.thread = try std.Thread.spawn(.{}, watchLoop, .{ self, port.getModemStatus(), port.getCounters() });
+        return self;
+    }
+
+    /// Stops the watcher thread and frees the watcher
+    pub fn destroy(self: *LineWatcher) void {
+        self.stopped.set();
+        if (self.thread) |t| {
+            // Repeated: the first signal may land before the thread
+            // enters TIOCMIWAIT
+            while (self.signal != 0 and !self.finished.load(.acquire)) {
+                _ = pthread_kill(t.getHandle(), self.signal);
+                std.Thread.sleep(std.time.ns_per_ms);
+            }
+            t.join();
+        }
+        self.allocator.destroy(self);
+    }
+
+    /// Copies out queued events, oldest first
+    pub fn poll(self: *LineWatcher, out: []Event) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        var n: usize = 0;
+        while (n < out.len and self.tail != self.head) : (n += 1) {
+            out[n] = self.ring[@intCast(self.tail % RING_SIZE)];
+            self.tail += 1;
+        }
+        return n;
+    }
+
+    fn watchLoop(self: *LineWatcher, initial_status: Port.ModemStatus, initial_counters: ?Port.Counters) void {
+        defer self.finished.store(true, .release);
+        var status = initial_status;
+        var counters = initial_counters;
+
+        while (!self.stopped.isSet()) {
+            // Without a wake signal only the bounded virtual wait is usable
+            const blocking = self.signal != 0 or self.port.virtual != null;
+            if (!blocking or !self.port.waitModemChange()) {
+                if (self.stopped.isSet()) break;
+                // Unsupported, or a virtual wait that timed out
+                if (self.port.virtual == null) self.stopped.timedWait(POLL_MS * std.time.ns_per_ms) catch {};
+            }
+            if (self.stopped.isSet()) break;
+
+            const timestamp = clock.now();
+            const new_status = self.port.getModemStatus();
+            const new_counters = self.port.getCounters();
+
+            var event = Event{ .timestamp_ns = timestamp, .status = new_status };
+            if (counters != null and new_counters != null) {
+                const before = counters.?;
+                const after = new_counters.?;
+                event.cts_changes = after.cts -% before.cts;
+                event.dsr_changes = after.dsr -% before.dsr;
+                event.dcd_changes = after.dcd -% before.dcd;
+                event.ri_changes = after.rng -% before.rng;
+            } else {
+                event.cts_changes = @intFromBool(new_status.cts != status.cts);
+                event.dsr_changes = @intFromBool(new_status.dsr != status.dsr);
+                event.dcd_changes = @intFromBool(new_status.dcd != status.dcd);
+                event.ri_changes = @intFromBool(new_status.ri != status.ri);
+            }
+            status = new_status;
+            counters = new_counters;
+
+            if ((event.cts_changes | event.dsr_changes | event.dcd_changes | event.ri_changes) == 0) continue;
+            self.push(event);
+            if (self.callback) |callback| callback(&event, self.context);
+        }
+    }
+
+    fn push(self: *LineWatcher, event: Event) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (self.head - self.tail == RING_SIZE) {
+            self.tail += 1;
+            self.overflows += 1;
+        }
+        self.ring[@intCast(self.head % RING_SIZE)] = event;
+        self.head += 1;
+    }
+
+    extern "c" fn pthread_kill(thread: std.Thread.Handle, sig: c_int) c_int;
+
+    var wake_mutex: std.Thread.Mutex = .{};
+    var wake_installed: u6 = 0;
+
+    fn installWakeHandler(signal: u6) void {
+        wake_mutex.lock();
+        defer wake_mutex.unlock();
+        if (wake_installed == signal) return;
+        const action = std.posix.Sigaction{
+            .handler = .{ .handler = onWakeSignal },
+            .mask = std.posix.sigemptyset(),
+            .flags = 0,
+        };
+        std.posix.sigaction(signal, &action, null);
+        wake_installed = signal;
+    }
+
+    fn onWakeSignal(_: i32) callconv(.c) void {}
+};
+
+test "line watcher stops cleanly on a port without modem lines" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+
+    const watcher = try LineWatcher.create(std.testing.allocator, &port, null, null);
+    std.Thread.sleep(20 * std.time.ns_per_ms);
+    var events: [4]LineWatcher.Event = undefined;
+    try std.testing.expectEqual(@as(usize, 0), watcher.poll(&events));
+    watcher.destroy();
+}
+
+test "line watcher reports a line change with its transition count" {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = try VirtualPort.create(std.testing.allocator, .{});
+    var ports = pair.open(.{}) catch |err| {
+        pair.release();
+        return err;
+    };
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    const watcher = try LineWatcher.create(std.testing.allocator, &ports[0], null, null);
+    defer watcher.destroy();
+    // The peer's RTS is our CTS
+    ports[1].setRTS(true);
+
+    var events: [4]LineWatcher.Event = undefined;
+    const deadline = clock.now() + 2 * std.time.ns_per_s;
+    var n: usize = 0;
+    while (n == 0 and clock.now() < deadline) : (std.Thread.sleep(std.time.ns_per_ms)) n = watcher.poll(&events);
+    try std.testing.expect(n >= 1);
+    try std.testing.expect(events[0].status.cts);
+    try std.testing.expectEqual(@as(u32, 1), events[0].cts_changes);
+}
@@ -0,0 +1,96 @@
+const std = @import("std");
+const scan = @import("scan.zig");
+
+/// Strips PARMRK error markers from received data.
+///
+/// With PARMRK set the driver escapes a data byte 0xFF as 0xFF 0xFF, sends
+/// a break as 0xFF 0x00 0x00 and a byte X received with a framing or
+/// parity error as 0xFF 0x00 X. A marker may straddle two reads; the
+/// decoder keeps its state between calls.
+pub const MarkDecoder = struct {
+    state: State = .data,
+    /// Pass bytes received with errors through instead of dropping them
+    keep_error_bytes: bool = false,
+    /// Framing/parity errors seen
+    errors: u64 = 0,
+    /// Breaks seen (indistinguishable from a NUL received with an error)
+    breaks: u64 = 0,
+
+    pub const State = enum { data, escape, error_byte };
+
+    /// Decodes `buffer` in place and returns the length of the clean data
+    pub fn decode(self: *MarkDecoder, buffer: []u8) usize {
+        var out: usize = 0;
+        var i: usize = 0;
+        while (i < buffer.len) {
+            switch (self.state) {
+                .data => {
+                    // Copy the run up to the next 0xFF in one go
+                    const next = scan.indexOfByte(buffer, i, 0xFF) orelse buffer.len;
+                    if (out != i) std.mem.copyForwards(u8, buffer[out..][0 .. next - i], buffer[i..next]);
+                    out += next - i;
+                    i = next;
+                    if (i < buffer.len) {
+                        self.state = .escape;
+                        i += 1;
+                    }
+                },
+                .escape => {
+                    const byte = buffer[i];
+                    i += 1;
+                    switch (byte) {
+                        0xFF => {
+                            buffer[out] = 0xFF;
+                            out += 1;
+                            self.state = .data;
+                        },
+                        0x00 => self.state = .error_byte,
+                        else => {
+                            // Not a valid marker; keep the byte, drop the 0xFF
+                            buffer[out] = byte;
+                            out += 1;
+                            self.state = .data;
+                        },
+                    }
+                },
+                .error_byte => {
+                    const byte = buffer[i];
+                    i += 1;
+                    if (byte == 0) {
+                        self.breaks += 1;
+                    } else {
+                        self.errors += 1;
+                        if (self.keep_error_bytes) {
+                            buffer[out] = byte;
+                            out += 1;
+                        }
+                    }
+                    self.state = .data;
+                },
+            }
+        }
+        return out;
+    }
+};
+
+test "mark decoder strips escapes, errors and breaks" {
+    var decoder = MarkDecoder{};
+    var data = [_]u8{ 'a', 0xFF, 0xFF, 'b', 0xFF, 0x00, 'x', 'c', 0xFF, 0x00, 0x00, 'd' };
+    const n = decoder.decode(&data);
+    try std.testing.expectEqualSlices(u8, &[_]u8{ 'a', 0xFF, 'b', 'c', 'd' }, data[0..n]);
+    try std.testing.expectEqual(@as(u64, 1), decoder.errors);
+    try std.testing.expectEqual(@as(u64, 1), decoder.breaks);
+}
+
+test "mark decoder handles markers split across reads" {
+    var decoder = MarkDecoder{ .keep_error_bytes = true };
+    var first = [_]u8{ 'a', 0xFF };
+    var second = [_]u8{0x00};
+    var third = [_]u8{ 'q', 'b' };
+
+    try std.testing.expectEqual(@as(usize, 1), decoder.decode(&first));
+    try std.testing.expectEqual(@as(usize, 0), decoder.decode(&second));
+    const n = decoder.decode(&third);
+    try std.testing.expectEqualSlices(u8, "qb", third[0..n]);
+    try std.testing.expectEqual(@as(u64, 1), decoder.errors);
+}
@@ -0,0 +1,234 @@
+const std = @import("std");
+const Config = @import("Config.zig").Config;
+const Port = @import("Port.zig").Port;
+const clock = @import("clock.zig");
+const scan = @import("scan.zig");
+
+/// Transmit pacing for targets that cannot keep up with the line rate:
+/// bootloaders and consoles with shallow receive FIFOs, or firmware that
+/// echoes each line before reading the next. Delays follow the port's
+/// framing (see `Config.charTimeNs`), and the driver's output queue
+/// (TIOCOUTQ) is held under `max_queued` bytes so kernel buffering does
+/// not undo the pacing.
+///
+/// Installed with `Port.setPacing`; `Port.writeAll` then goes through it.
+pub const Pacer = struct {
+    options: Options,
+    /// Character time at the configured framing and `rate_percent`
+    ns_per_char: u64,
+    /// When the wire should go idle given everything sent so far. The
+    /// token bucket is kept as this virtual finish time: up to `burst`
+    /// characters may run ahead of it.
+    idle_ns: u64 = 0,
+    /// Echo mode: the byte that ends the line in flight
+    awaited: std.atomic.Value(u8) = std.atomic.Value(u8).init(0),
+    /// Echo mode: how many `awaited` bytes the receive side has seen
+    echoes: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+
+    /// How long before a deadline to stop sleeping and spin
+    const spin_ns = 100 * std.time.ns_per_us;
+
+    pub const Mode = enum {
+        /// One character at a time, each after the previous one has left
+        /// the wire plus `char_delay_us`
+        per_char,
+        /// A line at a time, each after the previous one has drained plus
+        /// `line_delay_us`
+        per_line,
+        /// Bursts of up to `burst` characters, refilled at line rate
+        token_bucket,
+        /// A line at a time, each after the target has echoed the previous
+        /// line's terminator. Something must be reading the port meanwhile
+        /// (another thread or a hub): the echo is seen in `Port.read`.
+        echo,
+    };
+
+    pub const Options = struct {
+        mode: Mode = .token_bucket,
+        /// Extra gap after each character (per_char)
+        char_delay_us: u32 = 0,
+        /// Extra gap after each line (per_line, echo)
+        line_delay_us: u32 = 0,
+        /// Token bucket depth; usually the target's receive FIFO size
+        burst: u16 = 16,
+        /// Pace at this percentage of the line rate (1-100)
+        rate_percent: u8 = 100,
+        /// Driver output queue ceiling, in bytes
+        max_queued: u32 = 16,
+        /// Echo mode: how long to wait for each line's echo
+        echo_timeout_ms: u32 = 1000,
+    };
+
+    pub fn init(config: Config, options: Options) Pacer {
+        var pacer = Pacer{ .options = options, .ns_per_char = 0 };
+        pacer.retime(config);
+        return pacer;
+    }
+
+    /// Recomputes the character time after a configuration change
+    pub fn retime(self: *Pacer, config: Config) void {
+        const percent: u64 = std.math.clamp(self.options.rate_percent, 1, 100);
+        self.ns_per_char = config.charTimeNs() * 100 / percent;
+    }
+
+    /// Writes all of `data` at the configured pace. Echo mode fails with
+    /// `Error.Timeout` when a line is not echoed in time.
+    pub fn writeAll(self: *Pacer, port: *Port, data: []const u8) Port.Error!void {
+        switch (self.options.mode) {
+            .per_char => {
+                const gap = @as(u64, self.options.char_delay_us) * std.time.ns_per_us;
+                for (0..data.len) |i| {
+                    clock.waitUntil(self.idle_ns + gap, spin_ns);
+                    try self.send(port, data[i .. i + 1]);
+                }
+            },
+            .token_bucket => {
+                var rest = data;
+                while (rest.len > 0) {
+                    const n = self.admit(rest.len);
+                    try self.send(port, rest[0..n]);
+                    rest = rest[n..];
+                }
+            },
+            .per_line, .echo => {
+                var start: usize = 0;
+                while (start < data.len) {
+                    const end = lineEnd(data, start);
+                    try self.sendLine(port, data[start..end]);
+                    start = end;
+                }
+            },
+        }
+    }
+
+    /// Receive-side hook called by `Port.read` with the decoded bytes
+    pub fn observe(self: *Pacer, data: []const u8) void {
+        const byte = self.awaited.load(.monotonic);
+        if (byte == 0) return;
+        const seen = scan.countByte(data, byte);
+        if (seen == 0) return;
+        _ = self.echoes.fetchAdd(@intCast(seen), .release);
+        std.Thread.Futex.wake(&self.echoes, 1);
+    }
+
+    fn sendLine(self: *Pacer, port: *Port, line: []const u8) Port.Error!void {
+        const last = line[line.len - 1];
+        const terminated = last == '\r' or last == '\n';
+        const echo = self.options.mode == .echo and terminated;
+
+        const before = self.echoes.load(.acquire);
+        if (echo) self.awaited.store(last, .monotonic);
+        try self.send(port, line);
+
+        if (echo) {
+            try self.awaitEcho(before);
+        } else if (terminated) {
+            self.drain(port);
+        }
+        if (terminated and self.options.line_delay_us != 0) {
+            clock.waitUntil(clock.now() + @as(u64, self.options.line_delay_us) * std.time.ns_per_us, spin_ns);
+        }
+    }
+
+    /// Index just past the next line terminator (CR LF stays together)
+    fn lineEnd(data: []const u8, start: usize) usize {
+        const i = scan.indexOfEither(data, start, '\r', '\n') orelse return data.len;
+        if (data[i] == '\r' and i + 1 < data.len and data[i + 1] == '\n') return i + 2;
+        return i + 1;
+    }
+
+    /// Waits until a token is available and returns how many of `want`
+    /// characters may go now
+    fn admit(self: *Pacer, want: usize) usize {
+        const depth = @as(u64, @max(self.options.burst, 1)) * self.ns_per_char;
+        clock.waitUntil((self.idle_ns + self.ns_per_char) -| depth, spin_ns);
+        const ahead = self.idle_ns -| clock.now();
+        const tokens = (depth -| ahead) / @max(self.ns_per_char, 1);
+        return @min(want, @max(tokens, 1));
+    }
+
+    /// Hands `chunk` to the driver without letting its queue grow past
+    /// `max_queued`, then advances the virtual finish time
+    fn send(self: *Pacer, port: *Port, chunk: []const u8) Port.Error!void {
+        var written: usize = 0;
+        while (written < chunk.len) {
+            const room = self.queueRoom(port);
+            const end = @min(chunk.len, written + room);
+            written += try port.write(chunk[written..end]);
+        }
+        self.idle_ns = @max(self.idle_ns, clock.now()) + chunk.len * self.ns_per_char;
+    }
+
+    /// Free space under the queue ceiling, sleeping while there is none.
+    /// Catches everything the character-time estimate misses: flow control
+    /// stalls, a UART slower than configured, other writers.
+    fn queueRoom(self: *Pacer, port: *Port) usize {
+        const limit: usize = @max(self.options.max_queued, 1);
+        while (true) {
+            const queued = port.outputQueued();
+            if (queued < limit) return limit - queued;
+            clock.sleepUntil(clock.now() + (queued - limit + 1) * self.ns_per_char);
+        }
+    }
+
+    /// Waits for the driver's output queue to empty
+    fn drain(self: *Pacer, port: *Port) void {
+        clock.waitUntil(self.idle_ns, spin_ns);
+        while (true) {
+            const queued = port.outputQueued();
+            if (queued == 0) return;
+            clock.sleepUntil(clock.now() + queued * self.ns_per_char);
+        }
+    }
+
+    fn awaitEcho(self: *Pacer, before: u32) Port.Error!void {
+        const deadline = clock.now() + @as(u64, self.options.echo_timeout_ms) * std.time.ns_per_ms;
+        defer self.awaited.store(0, .monotonic);
+        while (self.echoes.load(.acquire) == before) {
+            const now = clock.now();
+            if (now >= deadline) return Port.Error.Timeout;
+            std.Thread.Futex.timedWait(&self.echoes, before, deadline - now) catch {};
+        }
+    }
+};
+
+test "token bucket holds the line rate after the first burst" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    var p = Port.fromFdForTesting(fds[1], .{ .baud_rate = .B9600 });
+    defer p.close();
+
+    var pacer = Pacer.init(p.config, .{ .burst = 4 });
+    const start = clock.now();
+    try pacer.writeAll(&p, "0123456789abcdefghij");
+    const elapsed = clock.now() - start;
+    // 16 characters past the burst at ~1.04 ms each
+    try std.testing.expect(elapsed >= 16 * p.config.charTimeNs());
+
+    var buf: [32]u8 = undefined;
+    try std.testing.expectEqualStrings("0123456789abcdefghij", buf[0..try std.posix.read(fds[0], &buf)]);
+}
+
+fn echoLater(pacer: *Pacer) void {
+    std.Thread.sleep(5 * std.time.ns_per_ms);
+    pacer.observe("ls\r\n");
+}
+
+test "echo mode waits for each line's terminator" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    var p = Port.fromFdForTesting(fds[1], .{});
+    defer p.close();
+
+    var pacer = Pacer.init(p.config, .{ .mode = .echo, .echo_timeout_ms = 1000 });
+    const thread = try std.Thread.spawn(.{}, echoLater, .{&pacer});
+    const start = clock.now();
+    try pacer.writeAll(&p, "ls\r");
+    thread.join();
+    try std.testing.expect(clock.now() - start >= 5 * std.time.ns_per_ms);
+
+    pacer.options.echo_timeout_ms = 10;
+    try std.testing.expectError(Port.Error.Timeout, pacer.writeAll(&p, "pwd\r"));
+    // An unterminated tail goes out without waiting
+    try pacer.writeAll(&p, "cd");
+}
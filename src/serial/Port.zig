@@ -1,6 +1,14 @@
 const std = @import("std");
 const builtin = @import("builtin");
 const Config = @import("Config.zig").Config;
+const MarkDecoder = @import("MarkDecoder.zig").MarkDecoder;
+const clock = @import("clock.zig");
+const Stats = @import("Stats.zig").Stats;
+const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+const Pacer = @import("Pacer.zig").Pacer;
+const SoftFlow = @import("SoftFlow.zig").SoftFlow;
+const TxQueue = @import("TxQueue.zig").TxQueue;
+const trace = @import("trace");
 
 /// Platform-specific constants
 const c = if (builtin.os.tag == .macos) @cImport({
@@ -14,14 +22,33 @@ const c = if (builtin.os.tag == .macos) @cImport({
     @cInclude("unistd.h");
     @cInclude("fcntl.h");
     @cInclude("sys/ioctl.h");
+    @cInclude("linux/serial.h");
 });
 
 /// Serial port abstraction for macOS/POSIX systems
 pub const Port = struct {
     fd: std.posix.fd_t,
     path: []const u8,
-    original_termios: std.posix.termios,
+    /// Restored on close; null for descriptors that are not ttys of our
+    /// own (virtual memory ends, test fixtures)
+    original_termios: ?std.posix.termios,
     config: Config,
+    /// Strips PARMRK markers from reads when `config.mark_errors` is set
+    marks: MarkDecoder = .{},
+    /// Counter snapshot that `getLineStats` deltas are taken against
+    stats_baseline: ?Counters = null,
+    stats_time_ns: u64 = 0,
+    /// Traffic counters and latency histograms (see `Stats`)
+    stats: Stats = .{},
+    /// Set for one end of a `VirtualPort` pair: modem lines and driver
+    /// counters are emulated there instead of going to ioctls
+    virtual: ?*VirtualPort.Endpoint = null,
+    /// Transmit pacing applied by `writeAll` (see `setPacing`)
+    pacer: ?Pacer = null,
+    /// XON/XOFF state for `FlowControl.software_userspace`
+    flow: SoftFlow = .{},
+    /// Asynchronous writer, started on first use by the C API
+    tx_queue: ?*TxQueue = null,
 
     pub const Error = error{
         OpenFailed,
@@ -32,6 +59,7 @@ pub const Port = struct {
         WriteError,
         Timeout,
         PortClosed,
+        WouldBlock,
     } || std.posix.OpenError || std.posix.TermiosGetError || std.posix.TermiosSetError;
 
     /// Opens a serial port with the specified configuration
@@ -56,165 +84,202 @@ pub const Port = struct {
             return err;
         };
 
-        // Create new termios with raw mode
-        var termios = original;
-
-        // Set raw mode (cfmakeraw equivalent)
-        // Input flags
-        termios.iflag.IGNBRK = false;
-        termios.iflag.BRKINT = false;
-        termios.iflag.PARMRK = false;
-        termios.iflag.ISTRIP = false;
-        termios.iflag.INLCR = false;
-        termios.iflag.IGNCR = false;
-        termios.iflag.ICRNL = false;
-        termios.iflag.IXON = false;
-        termios.iflag.IXOFF = false;
-        termios.iflag.IXANY = false;
-
-        // Output flags
-        termios.oflag.OPOST = false;
-
-        // Local flags
-        termios.lflag.ECHO = false;
-        termios.lflag.ECHONL = false;
-        termios.lflag.ICANON = false;
-        termios.lflag.ISIG = false;
-        termios.lflag.IEXTEN = false;
-
-        // Control flags - clear size bits
-        termios.cflag.CSIZE = .CS8;
-        termios.cflag.PARENB = false;
-        termios.cflag.CSTOPB = false;
-        // Hardware flow control (macOS uses separate flags)
-        termios.cflag.CCTS_OFLOW = false;
-        termios.cflag.CRTS_IFLOW = false;
-
-        // Enable receiver and set local mode
-        termios.cflag.CREAD = true;
-        termios.cflag.CLOCAL = true;
-
-        // Apply data bits
-        termios.cflag.CSIZE = switch (config.data_bits) {
-            .five => .CS5,
-            .six => .CS6,
-            .seven => .CS7,
-            .eight => .CS8,
-        };
-
-        // Apply parity
-        switch (config.parity) {
-            .none => {
-                termios.cflag.PARENB = false;
-            },
-            .odd => {
-                termios.cflag.PARENB = true;
-                termios.cflag.PARODD = true;
-            },
-            .even => {
-                termios.cflag.PARENB = true;
-                termios.cflag.PARODD = false;
-            },
-            .mark, .space => {
-                // Mark/Space parity requires special handling
-                termios.cflag.PARENB = true;
-            },
-        }
-
-        // Apply stop bits
-        termios.cflag.CSTOPB = config.stop_bits == .two;
-
-        // Apply flow control
-        switch (config.flow_control) {
-            .none => {
-                termios.cflag.CCTS_OFLOW = false;
-                termios.cflag.CRTS_IFLOW = false;
-                termios.iflag.IXON = false;
-                termios.iflag.IXOFF = false;
-            },
-            .hardware => {
-                termios.cflag.CCTS_OFLOW = true;
-                termios.cflag.CRTS_IFLOW = true;
-                termios.iflag.IXON = false;
-                termios.iflag.IXOFF = false;
-            },
-            .software => {
-                termios.cflag.CCTS_OFLOW = false;
-                termios.cflag.CRTS_IFLOW = false;
-                termios.iflag.IXON = true;
-                termios.iflag.IXOFF = true;
-            },
-        }
-
-        // Set read timeout behavior
-        // VMIN = 0, VTIME = 1 means return immediately with available data or after 100ms
-        termios.cc[@intFromEnum(std.posix.V.MIN)] = 0;
-        termios.cc[@intFromEnum(std.posix.V.TIME)] = 1;
-
-        // Apply the termios settings
-        std.posix.tcsetattr(fd, .FLUSH, termios) catch |err| {
-            return err;
-        };
-
-        // Set baud rate (macOS-specific for non-standard rates)
-        if (builtin.os.tag == .macos) {
-            const speed: c_ulong = config.baud_rate.toSpeed();
-            if (c.ioctl(fd, c.IOSSIOSPEED, &speed) < 0) {
-                // Fall back to standard cfsetspeed for standard rates
-                const baud_const = baudToConst(config.baud_rate) orelse return Error.InvalidBaudRate;
-                // Cast Zig termios to C termios pointer for cfsetspeed
-                const c_termios_ptr: [*c]c.struct_termios = @ptrCast(&termios);
-                _ = c.cfsetspeed(c_termios_ptr, baud_const);
-                std.posix.tcsetattr(fd, .FLUSH, termios) catch |err| {
-                    return err;
-                };
-            }
-        } else {
-            // Linux/POSIX standard baud rate setting
-            const baud_const = baudToConst(config.baud_rate) orelse return Error.InvalidBaudRate;
-            // Cast Zig termios to C termios pointer
-            const c_termios_ptr: [*c]c.struct_termios = @ptrCast(&termios);
-            _ = c.cfsetispeed(c_termios_ptr, baud_const);
-            _ = c.cfsetospeed(c_termios_ptr, baud_const);
-            std.posix.tcsetattr(fd, .FLUSH, termios) catch |err| {
-                return err;
-            };
-        }
+        // Apply raw mode, framing, flow control and baud rate
+        try applyConfig(fd, original, config, .FLUSH);
 
         // Clear the NONBLOCK flag now that configuration is done
         const flags = std.posix.fcntl(fd, c.F_GETFL, 0) catch 0;
         _ = std.posix.fcntl(fd, c.F_SETFL, flags & ~@as(usize, c.O_NONBLOCK)) catch {};
 
-        return Port{
+        var port = Port{
             .fd = fd,
             .path = path,
             .original_termios = original,
             .config = config,
         };
+        // Driver counters run from boot (or the last open): start the
+        // first getLineStats delta here, not at zero
+        port.stats_baseline = port.getCounters();
+        port.stats_time_ns = clock.now();
+        return port;
     }
 
     /// Closes the serial port and restores original settings
     pub fn close(self: *Port) void {
+        if (self.tx_queue) |queue| queue.destroy();
+        self.tx_queue = null;
         // Restore original termios settings
-        std.posix.tcsetattr(self.fd, .FLUSH, self.original_termios) catch {};
+        if (self.original_termios) |original| {
+            std.posix.tcsetattr(self.fd, .FLUSH, original) catch {};
+        }
         std.posix.close(self.fd);
         self.fd = -1;
+        if (self.virtual) |endpoint| endpoint.pair.release();
+        self.virtual = null;
+    }
+
+    /// Wraps a descriptor that is not a tty, such as one end of a pipe,
+    /// for tests: close leaves its settings alone
+    pub fn fromFdForTesting(fd: std.posix.fd_t, config: Config) Port {
+        return .{ .fd = fd, .path = "pipe", .original_termios = null, .config = config };
+    }
+
+    /// Applies a new configuration to the open port without closing it
+    pub fn setConfig(self: *Port, config: Config) Error!void {
+        if (self.fd < 0) return Error.PortClosed;
+        if (self.virtual != null and !std.posix.isatty(self.fd)) {
+            self.config = config;
+            if (self.pacer) |*pacer| pacer.retime(config);
+            return;
+        }
+        const current = try std.posix.tcgetattr(self.fd);
+        try applyConfig(self.fd, current, config, .NOW);
+        if (config.flow_control != .software_userspace) self.flow.reset(self.fd);
+        self.config = config;
+        self.marks.state = .data;
+        if (self.pacer) |*pacer| pacer.retime(config);
+    }
+
+    /// When `reconfigure` applies a change relative to queued output
+    pub const Apply = enum {
+        /// Immediately; queued output goes out at the new settings
+        now,
+        /// Once queued output has been sent (TCSADRAIN)
+        drain,
+    };
+
+    /// Switches to `config` in place, touching only the termios fields
+    /// that differ from the current config, in a single tcsetattr. Unlike
+    /// close and reopen this keeps DTR asserted, leaves buffered data
+    /// alone and keeps the original termios for `close`.
+    pub fn reconfigure(self: *Port, config: Config, apply: Apply) Error!void {
+        if (self.fd < 0) return Error.PortClosed;
+        const changes = self.config.diff(config);
+        if (changes.termios() and (self.virtual == null or std.posix.isatty(self.fd))) {
+            var termios = try std.posix.tcgetattr(self.fd);
+            if (changes.framing) setFraming(&termios, config);
+            if (changes.framing or changes.mark_errors) setMarking(&termios, config);
+            if (changes.flow_control) setFlow(&termios, config);
+            const baud: ?Config.BaudRate = if (changes.baud_rate) config.baud_rate else null;
+            try applyTermios(self.fd, &termios, baud, if (apply == .drain) .DRAIN else .NOW);
+        }
+        if (changes.flow_control and config.flow_control != .software_userspace) self.flow.reset(self.fd);
+        if (changes.mark_errors) self.marks.state = .data;
+        self.config = config;
+        if (self.pacer) |*pacer| pacer.retime(config);
+    }
+
+    /// Paces `writeAll` for a slow target, or stops pacing (null). Set it
+    /// before traffic starts: the reader thread consults it for echoes.
+    pub fn setPacing(self: *Port, options: ?Pacer.Options) void {
+        self.pacer = if (options) |o| Pacer.init(self.config, o) else null;
+    }
+
+    /// Switches the descriptor between blocking and non-blocking mode.
+    /// In non-blocking mode `read`/`write` return `Error.WouldBlock`
+    /// instead of waiting.
+    pub fn setNonBlocking(self: *Port, enabled: bool) void {
+        if (self.fd < 0) return;
+        const flags = std.posix.fcntl(self.fd, c.F_GETFL, 0) catch return;
+        const nonblock: usize = c.O_NONBLOCK;
+        const new_flags = if (enabled) flags | nonblock else flags & ~nonblock;
+        _ = std.posix.fcntl(self.fd, c.F_SETFL, new_flags) catch {};
+    }
+
+    pub fn isNonBlocking(self: *const Port) bool {
+        if (self.fd < 0) return false;
+        const flags = std.posix.fcntl(self.fd, c.F_GETFL, 0) catch return false;
+        return flags & @as(usize, c.O_NONBLOCK) != 0;
     }
 
     /// Reads data from the serial port
     pub fn read(self: *Port, buffer: []u8) Error!usize {
         if (self.fd < 0) return Error.PortClosed;
-        return std.posix.read(self.fd, buffer) catch return Error.ReadError;
+        const span = trace.span("port", "read");
+        defer span.end();
+        const n = std.posix.read(self.fd, buffer) catch |err| switch (err) {
+            error.WouldBlock => return Error.WouldBlock,
+            else => return Error.ReadError,
+        };
+        self.stats.recordRead(n);
+        if (n > 0) {
+            const ready = self.stats.ready_ns.swap(0, .monotonic);
+            if (ready != 0) self.stats.rx_latency.record(clock.now() -| ready);
+        }
+        var len = if (self.config.mark_errors) self.marks.decode(buffer[0..n]) else n;
+        if (self.config.flow_control == .software_userspace) len = self.flow.receive(self.fd, buffer[0..len]);
+        if (self.pacer) |*pacer| pacer.observe(buffer[0..len]);
+        return len;
     }
 
     /// Writes data to the serial port
     pub fn write(self: *Port, data: []const u8) Error!usize {
         if (self.fd < 0) return Error.PortClosed;
-        return std.posix.write(self.fd, data) catch return Error.WriteError;
+        const span = trace.span("port", "write");
+        defer span.end();
+        if (self.config.flow_control == .software_userspace) try self.waitResumed();
+        self.checkDrained();
+        const n = std.posix.write(self.fd, data) catch |err| switch (err) {
+            error.WouldBlock => return Error.WouldBlock,
+            else => return Error.WriteError,
+        };
+        self.stats.recordWrite(n);
+        _ = self.stats.pending_tx_ns.cmpxchgStrong(0, clock.now(), .monotonic, .monotonic);
+        return n;
+    }
+
+    /// Holds a write while the peer has sent XOFF. Whoever reads the port
+    /// sees the XON; meanwhile this rechecks for close (including the
+    /// async writer shutting down) and non-blocking mode.
+    fn waitResumed(self: *Port) Error!void {
+        while (!self.flow.waitResumed(100 * std.time.ns_per_ms)) {
+            if (self.fd < 0) return Error.PortClosed;
+            if (self.tx_queue) |queue| if (!queue.isRunning()) return Error.PortClosed;
+            const flags = std.posix.fcntl(self.fd, c.F_GETFL, 0) catch 0;
+            if (flags & @as(usize, c.O_NONBLOCK) != 0) return Error.WouldBlock;
+        }
+    }
+
+    /// Stops (`on`) or restarts the peer with XOFF/XON around a consumer's
+    /// backlog; called by `Hub` at its watermarks. Only acts with
+    /// `FlowControl.software_userspace`.
+    pub fn throttle(self: *Port, on: bool) void {
+        if (self.fd < 0 or self.config.flow_control != .software_userspace) return;
+        self.flow.throttle(self.fd, on);
+    }
+
+    /// Bytes written but not yet sent by the driver (TIOCOUTQ)
+    pub fn outputQueued(self: *Port) usize {
+        if (self.fd < 0) return 0;
+        // A virtual end also has bytes on its emulated wire
+        const staged = if (self.virtual) |endpoint| endpoint.outputQueued() else 0;
+        var bytes: c_int = 0;
+        if (c.ioctl(self.fd, c.TIOCOUTQ, &bytes) < 0) return staged;
+        return staged + @as(usize, @intCast(@max(0, bytes)));
+    }
+
+    /// Records drain latency once the output queue has emptied. The
+    /// sample is an upper bound: it depends on how often this runs (on
+    /// writes and in `waitForData`). TIOCOUTQ is sampled at most once per
+    /// character time, which is as fine as the queue can change, so a
+    /// burst of small writes does not pay an ioctl each.
+    fn checkDrained(self: *Port) void {
+        const pending = self.stats.pending_tx_ns.load(.monotonic);
+        if (pending == 0) return;
+        const now = clock.now();
+        const last = self.stats.drain_checked_ns.load(.monotonic);
+        if (now -| last < self.config.charTimeNs()) return;
+        if (self.stats.drain_checked_ns.cmpxchgStrong(last, now, .monotonic, .monotonic) != null) return;
+        if (self.outputQueued() != 0) return;
+        if (self.stats.pending_tx_ns.cmpxchgStrong(pending, 0, .monotonic, .monotonic) == null) {
+            self.stats.drain_latency.record(now -| pending);
+        }
     }
 
-    /// Writes all data to the serial port, handling partial writes
+    /// Writes all data to the serial port, handling partial writes.
+    /// Paced when `setPacing` is in effect.
     pub fn writeAll(self: *Port, data: []const u8) Error!void {
+        if (self.pacer) |*pacer| return pacer.writeAll(self, data);
         var written: usize = 0;
         while (written < data.len) {
             written += try self.write(data[written..]);
@@ -224,38 +289,56 @@ pub const Port = struct {
     /// Sends a break signal
     pub fn sendBreak(self: *Port) void {
         if (self.fd < 0) return;
+        if (self.virtual) |endpoint| return endpoint.sendBreak();
         _ = c.tcsendbreak(self.fd, 0);
     }
 
+    /// Asserts or releases a continuous break condition
+    pub fn setBreak(self: *Port, state: bool) void {
+        if (self.fd < 0) return;
+        _ = c.ioctl(self.fd, if (state) c.TIOCSBRK else c.TIOCCBRK);
+    }
+
     /// Sets the DTR (Data Terminal Ready) signal
     pub fn setDTR(self: *Port, state: bool) void {
         if (self.fd < 0) return;
-        var status: c_int = 0;
-        _ = c.ioctl(self.fd, c.TIOCMGET, &status);
-        if (state) {
-            status |= c.TIOCM_DTR;
-        } else {
-            status &= ~@as(c_int, c.TIOCM_DTR);
-        }
-        _ = c.ioctl(self.fd, c.TIOCMSET, &status);
+        if (self.virtual) |endpoint| return endpoint.setLines(state, null);
+        var bits: c_int = c.TIOCM_DTR;
+        _ = c.ioctl(self.fd, if (state) c.TIOCMBIS else c.TIOCMBIC, &bits);
     }
 
     /// Sets the RTS (Request To Send) signal
     pub fn setRTS(self: *Port, state: bool) void {
         if (self.fd < 0) return;
+        if (self.virtual) |endpoint| return endpoint.setLines(null, state);
+        var bits: c_int = c.TIOCM_RTS;
+        _ = c.ioctl(self.fd, if (state) c.TIOCMBIS else c.TIOCMBIC, &bits);
+    }
+
+    /// Sets DTR and RTS together with one TIOCMSET, so both lines change
+    /// at the same instant (null leaves a line unchanged). False if the
+    /// port has no modem lines.
+    pub fn setLines(self: *Port, dtr: ?bool, rts: ?bool) bool {
+        if (self.fd < 0) return false;
+        if (self.virtual) |endpoint| {
+            endpoint.setLines(dtr, rts);
+            return true;
+        }
         var status: c_int = 0;
-        _ = c.ioctl(self.fd, c.TIOCMGET, &status);
-        if (state) {
-            status |= c.TIOCM_RTS;
-        } else {
-            status &= ~@as(c_int, c.TIOCM_RTS);
+        if (c.ioctl(self.fd, c.TIOCMGET, &status) < 0) return false;
+        if (dtr) |state| {
+            if (state) status |= c.TIOCM_DTR else status &= ~@as(c_int, c.TIOCM_DTR);
         }
-        _ = c.ioctl(self.fd, c.TIOCMSET, &status);
+        if (rts) |state| {
+            if (state) status |= c.TIOCM_RTS else status &= ~@as(c_int, c.TIOCM_RTS);
+        }
+        return c.ioctl(self.fd, c.TIOCMSET, &status) == 0;
     }
 
     /// Gets the current modem status lines
     pub fn getModemStatus(self: *Port) ModemStatus {
         if (self.fd < 0) return .{};
+        if (self.virtual) |endpoint| return endpoint.modemStatus();
         var status: c_int = 0;
         _ = c.ioctl(self.fd, c.TIOCMGET, &status);
         return .{
@@ -268,13 +351,108 @@ pub const Port = struct {
         };
     }
 
+    /// Driver interrupt counters (Linux TIOCGICOUNT). They only ever
+    /// increase (wrapping), so compare two reads to get activity in between.
+    pub const Counters = struct {
+        cts: u32 = 0,
+        dsr: u32 = 0,
+        rng: u32 = 0,
+        dcd: u32 = 0,
+        rx: u32 = 0,
+        tx: u32 = 0,
+        frame: u32 = 0,
+        overrun: u32 = 0,
+        parity: u32 = 0,
+        brk: u32 = 0,
+        buf_overrun: u32 = 0,
+
+        /// Per-field difference from an earlier snapshot
+        pub fn since(self: Counters, earlier: Counters) Counters {
+            var result: Counters = undefined;
+            inline for (std.meta.fields(Counters)) |field| {
+                @field(result, field.name) = @field(self, field.name) -% @field(earlier, field.name);
+            }
+            return result;
+        }
+    };
+
+    /// Reads the driver's interrupt counters; null if unsupported
+    pub fn getCounters(self: *Port) ?Counters {
+        if (self.fd < 0) return null;
+        if (self.virtual) |endpoint| return endpoint.getCounters();
+        if (builtin.os.tag != .linux) return null;
+        var icount: c.struct_serial_icounter_struct = undefined;
+        if (c.ioctl(self.fd, c.TIOCGICOUNT, &icount) < 0) return null;
+        return .{
+            .cts = @bitCast(icount.cts),
+            .dsr = @bitCast(icount.dsr),
+            .rng = @bitCast(icount.rng),
+            .dcd = @bitCast(icount.dcd),
+            .rx = @bitCast(icount.rx),
+            .tx = @bitCast(icount.tx),
+            .frame = @bitCast(icount.frame),
+            .overrun = @bitCast(icount.overrun),
+            .parity = @bitCast(icount.parity),
+            .brk = @bitCast(icount.brk),
+            .buf_overrun = @bitCast(icount.buf_overrun),
+        };
+    }
+
+    /// Error and traffic counts since open, plus the change since the
+    /// previous call
+    pub const LineStats = struct {
+        /// Driver totals (null where TIOCGICOUNT is unsupported)
+        total: ?Counters = null,
+        delta: ?Counters = null,
+        /// Errors and breaks seen through PARMRK markers
+        marked_errors: u64 = 0,
+        marked_breaks: u64 = 0,
+        /// Time covered by `delta`: since open on the first call
+        interval_ns: u64 = 0,
+    };
+
+    pub fn getLineStats(self: *Port) LineStats {
+        const now = clock.now();
+        var stats = LineStats{
+            .total = self.getCounters(),
+            .marked_errors = self.marks.errors,
+            .marked_breaks = self.marks.breaks,
+        };
+        if (stats.total) |total| {
+            const baseline = self.stats_baseline orelse Counters{};
+            stats.delta = total.since(baseline);
+            self.stats_baseline = total;
+        }
+        if (self.stats_time_ns != 0) stats.interval_ns = now - self.stats_time_ns;
+        self.stats_time_ns = now;
+        return stats;
+    }
+
+    /// Blocks until CTS, DSR, DCD or RI changes (Linux TIOCMIWAIT).
+    /// Returns false if interrupted by a signal or unsupported.
+    pub fn waitModemChange(self: *Port) bool {
+        if (self.fd < 0) return false;
+        if (self.virtual) |endpoint| return endpoint.waitModemChange();
+        if (builtin.os.tag != .linux) return false;
+        const mask: c_ulong = c.TIOCM_CTS | c.TIOCM_DSR | c.TIOCM_CD | c.TIOCM_RNG;
+        return c.ioctl(self.fd, c.TIOCMIWAIT, mask) == 0;
+    }
+
     /// Flushes the input buffer
     pub fn flushInput(self: *Port) void {
         if (self.fd < 0) return;
         _ = c.tcflush(self.fd, c.TCIFLUSH);
     }
 
-    /// Flushes the output buffer
+    /// Waits until everything written has been sent (tcdrain)
+    pub fn drain(self: *Port) void {
+        if (self.fd < 0) return;
+        _ = c.tcdrain(self.fd);
+        // A virtual end's wire has its own queue
+        while (self.virtual != null and self.outputQueued() != 0) std.Thread.sleep(std.time.ns_per_ms);
+    }
+
+    /// Discards output not yet sent
     pub fn flushOutput(self: *Port) void {
         if (self.fd < 0) return;
         _ = c.tcflush(self.fd, c.TCOFLUSH);
@@ -307,7 +485,24 @@ pub const Port = struct {
         }};
 
         const result = std.posix.poll(&fds, @intCast(timeout_ms)) catch return false;
-        return result > 0 and (fds[0].revents & std.posix.POLL.IN) != 0;
+        self.checkDrained();
+        const ready = result > 0 and (fds[0].revents & std.posix.POLL.IN) != 0;
+        // Keep the earliest readiness until a read delivers the data
+        if (ready) _ = self.stats.ready_ns.cmpxchgStrong(0, clock.now(), .monotonic, .monotonic);
+        return ready;
+    }
+
+    /// Waits for room in the driver's output buffer (for writers in
+    /// non-blocking mode). Returns false on timeout.
+    pub fn waitWritable(self: *Port, timeout_ms: u32) bool {
+        if (self.fd < 0) return false;
+        var fds = [_]std.posix.pollfd{.{
+            .fd = self.fd,
+            .events = std.posix.POLL.OUT,
+            .revents = 0,
+        }};
+        const result = std.posix.poll(&fds, @intCast(timeout_ms)) catch return false;
+        return result > 0;
     }
 
     /// Modem status line states
@@ -320,6 +515,160 @@ pub const Port = struct {
         ri: bool = false, // Ring Indicator
     };
 
+    /// Builds raw-mode termios for `config` on top of `base` and applies
+    /// it together with the baud rate
+    fn applyConfig(fd: std.posix.fd_t, base: std.posix.termios, config: Config, action: std.posix.TCSA) Error!void {
+        var termios = base;
+
+        // Set raw mode (cfmakeraw equivalent)
+        // Input flags
+        termios.iflag.IGNBRK = false;
+        termios.iflag.BRKINT = false;
+        termios.iflag.PARMRK = false;
+        termios.iflag.ISTRIP = false;
+        termios.iflag.INLCR = false;
+        termios.iflag.IGNCR = false;
+        termios.iflag.ICRNL = false;
+        termios.iflag.IXON = false;
+        termios.iflag.IXOFF = false;
+        termios.iflag.IXANY = false;
+
+        // Output flags
+        termios.oflag.OPOST = false;
+
+        // Local flags
+        termios.lflag.ECHO = false;
+        termios.lflag.ECHONL = false;
+        termios.lflag.ICANON = false;
+        termios.lflag.ISIG = false;
+        termios.lflag.IEXTEN = false;
+
+        // Enable receiver and set local mode
+        termios.cflag.CREAD = true;
+        termios.cflag.CLOCAL = true;
+
+        setFraming(&termios, config);
+        setMarking(&termios, config);
+        setFlow(&termios, config);
+
+        // Set read timeout behavior
+        // VMIN = 0, VTIME = 1 means return immediately with available data or after 100ms
+        termios.cc[@intFromEnum(std.posix.V.MIN)] = 0;
+        termios.cc[@intFromEnum(std.posix.V.TIME)] = 1;
+
+        try applyTermios(fd, &termios, config.baud_rate, action);
+    }
+
+    /// Data bits, parity and stop bits
+    fn setFraming(termios: *std.posix.termios, config: Config) void {
+        termios.cflag.CSIZE = switch (config.data_bits) {
+            .five => .CS5,
+            .six => .CS6,
+            .seven => .CS7,
+            .eight => .CS8,
+        };
+
+        switch (config.parity) {
+            .none => {
+                termios.cflag.PARENB = false;
+            },
+            .odd => {
+                termios.cflag.PARENB = true;
+                termios.cflag.PARODD = true;
+            },
+            .even => {
+                termios.cflag.PARENB = true;
+                termios.cflag.PARODD = false;
+            },
+            .mark, .space => {
+                // Mark/Space parity requires special handling
+                termios.cflag.PARENB = true;
+            },
+        }
+
+        termios.cflag.CSTOPB = config.stop_bits == .two;
+    }
+
+    /// Marks framing/parity errors and breaks in-band (see MarkDecoder)
+    fn setMarking(termios: *std.posix.termios, config: Config) void {
+        termios.iflag.PARMRK = config.mark_errors;
+        if (config.mark_errors) {
+            termios.iflag.IGNPAR = false;
+            termios.iflag.INPCK = config.parity != .none;
+        }
+    }
+
+    fn setFlow(termios: *std.posix.termios, config: Config) void {
+        switch (config.flow_control) {
+            .none => {
+                setHardwareFlow(termios, false);
+                termios.iflag.IXON = false;
+                termios.iflag.IXOFF = false;
+            },
+            .hardware => {
+                setHardwareFlow(termios, true);
+                termios.iflag.IXON = false;
+                termios.iflag.IXOFF = false;
+            },
+            .software => {
+                setHardwareFlow(termios, false);
+                termios.iflag.IXON = true;
+                termios.iflag.IXOFF = true;
+            },
+            .software_userspace => {
+                // XON/XOFF arrive as data and go out via tcflow (SoftFlow)
+                setHardwareFlow(termios, false);
+                termios.iflag.IXON = false;
+                termios.iflag.IXOFF = false;
+            },
+        }
+    }
+
+    /// Applies `termios` and, when given, a new baud rate. On Linux both
+    /// go in one tcsetattr.
+    fn applyTermios(fd: std.posix.fd_t, termios: *std.posix.termios, baud: ?Config.BaudRate, action: std.posix.TCSA) Error!void {
+        // Cast Zig termios to C termios pointer for the cfset* calls
+        const c_termios_ptr: [*c]c.struct_termios = @ptrCast(termios);
+        if (builtin.os.tag == .macos) {
+            // IOSSIOSPEED takes effect at once, so drain first if asked
+            if (baud != null and action == .DRAIN) _ = c.tcdrain(fd);
+            std.posix.tcsetattr(fd, action, termios.*) catch |err| {
+                return err;
+            };
+            const rate = baud orelse return;
+            // Non-standard rates need IOSSIOSPEED
+            const speed: c_ulong = rate.toSpeed();
+            if (c.ioctl(fd, c.IOSSIOSPEED, &speed) < 0) {
+                // Fall back to standard cfsetspeed for standard rates
+                const baud_const = baudToConst(rate) orelse return Error.InvalidBaudRate;
+                _ = c.cfsetspeed(c_termios_ptr, baud_const);
+                std.posix.tcsetattr(fd, .NOW, termios.*) catch |err| {
+                    return err;
+                };
+            }
+        } else {
+            // Linux/POSIX standard baud rate setting
+            if (baud) |rate| {
+                const baud_const = baudToConst(rate) orelse return Error.InvalidBaudRate;
+                _ = c.cfsetispeed(c_termios_ptr, baud_const);
+                _ = c.cfsetospeed(c_termios_ptr, baud_const);
+            }
+            std.posix.tcsetattr(fd, action, termios.*) catch |err| {
+                return err;
+            };
+        }
+    }
+
+    /// Sets RTS/CTS hardware flow control (macOS uses separate flags)
+    fn setHardwareFlow(termios: *std.posix.termios, enabled: bool) void {
+        if (builtin.os.tag == .macos) {
+            termios.cflag.CCTS_OFLOW = enabled;
+            termios.cflag.CRTS_IFLOW = enabled;
+        } else {
+            termios.cflag.CRTSCTS = enabled;
+        }
+    }
+
     /// Convert BaudRate to termios constant
     fn baudToConst(baud: Config.BaudRate) ?c.speed_t {
         return switch (baud) {
@@ -333,34 +682,58 @@ pub const Port = struct {
             .B57600 => c.B57600,
             .B115200 => c.B115200,
             .B230400 => c.B230400,
-            else => null, // Non-standard rates need IOSSIOSPEED on macOS
+            // Linux has constants for the high rates; macOS needs IOSSIOSPEED
+            .B460800 => if (builtin.os.tag == .linux) c.B460800 else null,
+            .B921600 => if (builtin.os.tag == .linux) c.B921600 else null,
         };
     }
 };
 
 /// Enumerate available serial ports on the system
-pub fn enumeratePorts(allocator: std.mem.Allocator) ![][]const u8 {
-    var ports: std.ArrayList([]const u8) = .empty;
+/// One-shot scan of /dev; long-running callers should keep a `Registry`
+/// instead. Free each path and the slice with `allocator`.
+pub fn enumeratePorts(allocator: std.mem.Allocator) ![][:0]const u8 {
+    var ports: std.ArrayList([:0]const u8) = .empty;
     errdefer {
         for (ports.items) |p| allocator.free(p);
         ports.deinit(allocator);
     }
 
-    // On macOS, look for /dev/cu.* devices
     var dev_dir = std.fs.openDirAbsolute("/dev", .{ .iterate = true }) catch return ports.toOwnedSlice(allocator);
     defer dev_dir.close();
 
     var iter = dev_dir.iterate();
     while (iter.next() catch null) |entry| {
-        if (std.mem.startsWith(u8, entry.name, "cu.")) {
-            const full_path = try std.fmt.allocPrint(allocator, "/dev/{s}", .{entry.name});
-            try ports.append(allocator, full_path);
-        }
+        if (!isSerialName(entry.name)) continue;
+        const full_path = try std.fmt.allocPrintSentinel(allocator, "/dev/{s}", .{entry.name}, 0);
+        errdefer allocator.free(full_path);
+        try ports.append(allocator, full_path);
     }
 
     return ports.toOwnedSlice(allocator);
 }
 
+/// Whether a /dev entry is a serial port: `cu.*` callout devices on
+/// macOS; USB, ACM, SoC UART and RFCOMM nodes on Linux
+pub fn isSerialName(name: []const u8) bool {
+    if (builtin.os.tag.isDarwin()) return std.mem.startsWith(u8, name, "cu.");
+
+    const prefixes = [_][]const u8{ "ttyUSB", "ttyACM", "ttyAMA", "ttymxc", "ttySAC", "ttyTHS", "ttyO", "ttyGS", "rfcomm" };
+    for (prefixes) |prefix| {
+        if (std.mem.startsWith(u8, name, prefix)) return true;
+    }
+    // Legacy 8250 nodes exist whether or not a UART is fitted; sysfs
+    // reports type 0 (PORT_UNKNOWN) for the empty ones
+    if (std.mem.startsWith(u8, name, "ttyS")) {
+        var path_buf: [64]u8 = undefined;
+        const path = std.fmt.bufPrint(&path_buf, "/sys/class/tty/{s}/type", .{name}) catch return false;
+        var type_buf: [16]u8 = undefined;
+        const text = std.fs.cwd().readFile(path, &type_buf) catch return false;
+        return !std.mem.eql(u8, std.mem.trim(u8, text, " \n"), "0");
+    }
+    return false;
+}
+
 test "enumeratePorts" {
     const allocator = std.testing.allocator;
     const ports = try enumeratePorts(allocator);
@@ -370,3 +743,33 @@ test "enumeratePorts" {
     }
     // Just verify it doesn't crash - actual ports depend on system
 }
+
+test "isSerialName" {
+    if (builtin.os.tag.isDarwin()) {
+        try std.testing.expect(isSerialName("cu.usbserial-1410"));
+        try std.testing.expect(!isSerialName("tty.usbserial-1410"));
+    } else {
+        try std.testing.expect(isSerialName("ttyUSB0"));
+        try std.testing.expect(isSerialName("ttyACM3"));
+        try std.testing.expect(!isSerialName("tty1"));
+        try std.testing.expect(!isSerialName("null"));
+    }
+}
+
+test "first line stats interval is measured from open" {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = VirtualPort.create(std.testing.allocator, .{ .mode = .pty }) catch return error.SkipZigTest;
+    defer pair.release();
+
+    const before_open = clock.now();
+    var port = try Port.open(pair.endpoints[0].path(), .{});
+    defer port.close();
+
+    std.Thread.sleep(20 * std.time.ns_per_ms);
+    const first = port.getLineStats();
+    try std.testing.expect(first.interval_ns >= 20 * std.time.ns_per_ms);
+    try std.testing.expect(first.interval_ns <= clock.now() - before_open);
+    // The next one covers only the time since the first
+    const second = port.getLineStats();
+    try std.testing.expect(second.interval_ns < first.interval_ns);
+}
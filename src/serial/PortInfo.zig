@@ -0,0 +1,103 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// Identity of a serial device: USB descriptors, driver and the stable
+/// udev links. Fixed-size fields, so copying an index needs no
+/// allocation per string.
+pub const PortInfo = struct {
+    vendor_id: ?u16 = null,
+    product_id: ?u16 = null,
+    interface_number: ?u8 = null,
+    serial_number: Text = .{},
+    manufacturer: Text = .{},
+    product: Text = .{},
+    /// Kernel driver bound to the port (ftdi_sio, cp210x, cdc_acm, ...)
+    driver: Text = .{},
+    /// /dev/serial/by-id/... link, stable across re-plugging
+    by_id: Text = .{},
+    /// /dev/serial/by-path/... link, stable per physical socket
+    by_path: Text = .{},
+
+    /// Short string value; longer input is cut to `CAPACITY`
+    pub const Text = struct {
+        pub const CAPACITY = 127;
+
+        bytes: [CAPACITY]u8 = undefined,
+        len: u8 = 0,
+
+        pub fn get(self: *const Text) ?[]const u8 {
+            return if (self.len == 0) null else self.bytes[0..self.len];
+        }
+
+        pub fn set(self: *Text, value: []const u8) void {
+            const n = @min(value.len, CAPACITY);
+            @memcpy(self.bytes[0..n], value[0..n]);
+            self.len = @intCast(n);
+        }
+
+        pub fn eql(self: *const Text, other: *const Text) bool {
+            return std.mem.eql(u8, self.bytes[0..self.len], other.bytes[0..other.len]);
+        }
+    };
+
+    /// Reads what sysfs knows about /dev/`name` (Linux; empty elsewhere).
+    /// The udev links are filled in separately as they appear.
+    pub fn fromSysfs(name: []const u8) PortInfo {
+        var info = PortInfo{};
+        if (builtin.os.tag != .linux) return info;
+
+        var class_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const class_path = std.fmt.bufPrint(&class_buf, "/sys/class/tty/{s}/device", .{name}) catch return info;
+        var device_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const device = std.fs.realpath(class_path, &device_buf) catch return info;
+
+        var device_dir = std.fs.openDirAbsolute(device, .{}) catch return info;
+        defer device_dir.close();
+        var link_buf: [std.fs.max_path_bytes]u8 = undefined;
+        if (device_dir.readLink("driver", &link_buf)) |driver| {
+            info.driver.set(std.fs.path.basename(driver));
+        } else |_| {}
+
+        // Walk up: the USB interface carries bInterfaceNumber, the USB
+        // device above it the descriptors
+        var attr_buf: [256]u8 = undefined;
+        var next: ?[]const u8 = device;
+        while (next) |path| : (next = std.fs.path.dirname(path)) {
+            if (!std.mem.startsWith(u8, path, "/sys/devices/")) break;
+            var dir = std.fs.openDirAbsolute(path, .{}) catch break;
+            defer dir.close();
+
+            if (info.interface_number == null) {
+                if (readAttr(dir, "bInterfaceNumber", &attr_buf)) |text| {
+                    info.interface_number = std.fmt.parseInt(u8, text, 16) catch null;
+                }
+            }
+            const vendor = readAttr(dir, "idVendor", &attr_buf) orelse continue;
+            info.vendor_id = std.fmt.parseInt(u16, vendor, 16) catch null;
+            if (readAttr(dir, "idProduct", &attr_buf)) |text| info.product_id = std.fmt.parseInt(u16, text, 16) catch null;
+            if (readAttr(dir, "serial", &attr_buf)) |text| info.serial_number.set(text);
+            if (readAttr(dir, "manufacturer", &attr_buf)) |text| info.manufacturer.set(text);
+            if (readAttr(dir, "product", &attr_buf)) |text| info.product.set(text);
+            break;
+        }
+        return info;
+    }
+
+    fn readAttr(dir: std.fs.Dir, name: []const u8, buf: []u8) ?[]const u8 {
+        const text = dir.readFile(name, buf) catch return null;
+        const trimmed = std.mem.trim(u8, text, " \n");
+        return if (trimmed.len == 0) null else trimmed;
+    }
+};
+
+test "text fields truncate and compare" {
+    var a = PortInfo.Text{};
+    try std.testing.expect(a.get() == null);
+    a.set("A50285BI");
+    try std.testing.expectEqualStrings("A50285BI", a.get().?);
+
+    var b = PortInfo.Text{};
+    b.set("x" ** 200);
+    try std.testing.expectEqual(@as(usize, PortInfo.Text.CAPACITY), b.get().?.len);
+    try std.testing.expect(!a.eql(&b));
+}
@@ -0,0 +1,582 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const isSerialName = @import("Port.zig").isSerialName;
+const PortInfo = @import("PortInfo.zig").PortInfo;
+
+const posix = std.posix;
+const linux = std.os.linux;
+
+/// Live list of serial devices, kept current from hotplug notifications.
+///
+/// /dev is scanned once at creation; after that a helper thread applies
+/// inotify events on Linux (kqueue on macOS, which still rescans but only
+/// when /dev changes). Readers take immutable, reference-counted
+/// snapshots, so a port picker refresh is O(1) and never touches /dev.
+///
+/// On Linux each device's sysfs metadata is read once when it appears and
+/// the /dev/serial/by-id and by-path links are tracked as udev creates
+/// them; snapshots index every entry by path, name, serial number and
+/// link for constant-time lookup.
+pub const Registry = struct {
+    pub const Change = enum { added, removed };
+    pub const Callback = *const fn (change: Change, path: [:0]const u8, context: ?*anyopaque) void;
+
+    /// Rescan interval when no change notification source is available
+    const RESCAN_MS = 2000;
+    const DEV = "/dev/";
+    const LINK_DIRS = [_][]const u8{ "/dev/serial/by-id", "/dev/serial/by-path" };
+
+    allocator: std.mem.Allocator,
+    callback: ?Callback,
+    context: ?*anyopaque,
+    thread: ?std.Thread = null,
+
+    /// Further observers sharing the registry (e.g. supervisors). `notify`
+    /// holds the mutex while calling them, so `unsubscribe` waits out a
+    /// call in flight.
+    listeners: std.ArrayList(Listener) = .empty,
+    listeners_mutex: std.Thread.Mutex = .{},
+
+    mutex: std.Thread.Mutex = .{},
+    current: *Snapshot,
+    /// Bumped on every change; cheap "anything new?" check
+    generation: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+
+    /// Known devices sorted by name; only the watcher thread touches
+    /// these after creation
+    entries: std.ArrayList(Entry) = .empty,
+    /// inotify (Linux) or kqueue (macOS) descriptor; -1 when polling
+    watch_fd: posix.fd_t = -1,
+    /// inotify watch on /dev itself (the others are link directories)
+    dev_wd: i32 = -1,
+    /// /dev itself, held open for the kqueue watch (macOS)
+    watch_dir: posix.fd_t = -1,
+    /// Written by `destroy` to stop the watcher thread
+    wake: [2]posix.fd_t,
+
+    pub const Listener = struct {
+        callback: Callback,
+        context: ?*anyopaque,
+    };
+
+    pub const Entry = struct {
+        /// Name under /dev, owned by the registry
+        name: []u8,
+        info: PortInfo,
+    };
+
+    /// An immutable port list. Paths and infos stay valid until
+    /// `release`, even after the registry has moved on or been destroyed.
+    pub const Snapshot = struct {
+        allocator: std.mem.Allocator,
+        refs: std.atomic.Value(u32) = std.atomic.Value(u32).init(1),
+        generation: u64,
+        paths: [][:0]const u8,
+        infos: []PortInfo,
+        /// Every lookup key -> position in `paths`/`infos`
+        index: std.StringHashMapUnmanaged(u32) = .empty,
+        storage: []u8,
+
+        fn create(allocator: std.mem.Allocator, generation: u64, entries: []const Entry) !*Snapshot {
+            var size: usize = 0;
+            for (entries) |entry| size += DEV.len + entry.name.len + 1;
+
+            const self = try allocator.create(Snapshot);
+            errdefer allocator.destroy(self);
+            const paths = try allocator.alloc([:0]const u8, entries.len);
+            errdefer allocator.free(paths);
+            const infos = try allocator.alloc(PortInfo, entries.len);
+            errdefer allocator.free(infos);
+            const storage = try allocator.alloc(u8, size);
+            errdefer allocator.free(storage);
+
+            var offset: usize = 0;
+            for (entries, paths, infos) |entry, *path, *info| {
+                @memcpy(storage[offset..][0..DEV.len], DEV);
+                @memcpy(storage[offset + DEV.len ..][0..entry.name.len], entry.name);
+                const end = offset + DEV.len + entry.name.len;
+                storage[end] = 0;
+                path.* = storage[offset..end :0];
+                info.* = entry.info;
+                offset = end + 1;
+            }
+
+            self.* = .{ .allocator = allocator, .generation = generation, .paths = paths, .infos = infos, .storage = storage };
+            errdefer self.index.deinit(allocator);
+            try self.index.ensureTotalCapacity(allocator, @intCast(entries.len * 5));
+            for (paths, infos, 0..) |path, *info, i| {
+                const position: u32 = @intCast(i);
+                const keys = [_]?[]const u8{
+                    path,
+                    path[DEV.len..],
+                    info.serial_number.get(),
+                    info.by_id.get(),
+                    info.by_path.get(),
+                };
+                // First device wins a shared key (e.g. one serial number on
+                // every port of a multi-port adapter)
+                for (keys) |maybe_key| {
+                    const key = maybe_key orelse continue;
+                    const slot = self.index.getOrPutAssumeCapacity(key);
+                    if (!slot.found_existing) slot.value_ptr.* = position;
+                }
+            }
+            return self;
+        }
+
+        pub fn release(self: *Snapshot) void {
+            if (self.refs.fetchSub(1, .acq_rel) != 1) return;
+            self.index.deinit(self.allocator);
+            self.allocator.free(self.storage);
+            self.allocator.free(self.infos);
+            self.allocator.free(self.paths);
+            self.allocator.destroy(self);
+        }
+
+        /// Position of the device matching `key`: a path, a bare /dev
+        /// name, a USB serial number or a by-id/by-path link
+        pub fn find(self: *const Snapshot, key: []const u8) ?usize {
+            return self.index.get(key);
+        }
+    };
+
+    pub fn create(allocator: std.mem.Allocator, callback: ?Callback, context: ?*anyopaque) !*Registry {
+        const self = try allocator.create(Registry);
+        errdefer allocator.destroy(self);
+
+        const wake = try posix.pipe2(.{ .CLOEXEC = true, .NONBLOCK = true });
+        errdefer {
+            posix.close(wake[0]);
+            posix.close(wake[1]);
+        }
+
+        self.* = .{
+            .allocator = allocator,
+            .callback = callback,
+            .context = context,
+            .current = undefined,
+            .wake = wake,
+        };
+        // Watch before scanning so a device appearing in between is not lost
+        self.openWatch();
+        errdefer self.closeWatch();
+        errdefer freeEntries(allocator, &self.entries);
+
+        self.entries = try scan(allocator);
+        _ = self.updateLinks();
+        self.current = try Snapshot.create(allocator, 0, self.entries.items);
+        errdefer self.current.release();
+
+        self.thread = try std.Thread.spawn(.{}, watchLoop, .{self});
+        return self;
+    }
+
+    /// Stops the watcher; no callbacks run after this returns.
+    /// Outstanding snapshots remain valid.
+    pub fn destroy(self: *Registry) void {
+        _ = posix.write(self.wake[1], "x") catch {};
+        if (self.thread) |t| t.join();
+        posix.close(self.wake[0]);
+        posix.close(self.wake[1]);
+        self.closeWatch();
+        freeEntries(self.allocator, &self.entries);
+        self.listeners.deinit(self.allocator);
+        self.current.release();
+        self.allocator.destroy(self);
+    }
+
+    /// Adds an observer, called on the watcher thread after `callback`.
+    /// Unsubscribe before destroying the registry.
+    pub fn subscribe(self: *Registry, callback: Callback, context: ?*anyopaque) !void {
+        self.listeners_mutex.lock();
+        defer self.listeners_mutex.unlock();
+        try self.listeners.append(self.allocator, .{ .callback = callback, .context = context });
+    }
+
+    /// Removes the observer with `context`; it is not called after this
+    /// returns. Must not be called from a callback.
+    pub fn unsubscribe(self: *Registry, context: ?*anyopaque) void {
+        self.listeners_mutex.lock();
+        defer self.listeners_mutex.unlock();
+        for (self.listeners.items, 0..) |listener, i| {
+            if (listener.context != context) continue;
+            _ = self.listeners.orderedRemove(i);
+            return;
+        }
+    }
+
+    /// Current port list; call `release` on it when done
+    pub fn acquire(self: *Registry) *Snapshot {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        _ = self.current.refs.fetchAdd(1, .monotonic);
+        return self.current;
+    }
+
+    pub fn getGeneration(self: *const Registry) u64 {
+        return self.generation.load(.acquire);
+    }
+
+    fn openWatch(self: *Registry) void {
+        switch (builtin.os.tag) {
+            .linux => {
+                const fd = posix.inotify_init1(linux.IN.NONBLOCK | linux.IN.CLOEXEC) catch return;
+                self.dev_wd = posix.inotify_add_watch(fd, "/dev", WATCH_MASK) catch return posix.close(fd);
+                self.watch_fd = fd;
+                self.watchLinkDirs();
+            },
+            .macos => {
+                const kq = posix.kqueue() catch return;
+                const dir = posix.open("/dev", .{ .ACCMODE = .RDONLY, .CLOEXEC = true }, 0) catch return posix.close(kq);
+                const change = [_]posix.Kevent{.{
+                    .ident = @intCast(dir),
+                    .filter = std.c.EVFILT.VNODE,
+                    .flags = std.c.EV.ADD | std.c.EV.CLEAR,
+                    .fflags = std.c.NOTE.WRITE,
+                    .data = 0,
+                    .udata = 0,
+                }};
+                _ = posix.kevent(kq, &change, &.{}, null) catch {
+                    posix.close(dir);
+                    return posix.close(kq);
+                };
+                self.watch_fd = kq;
+                self.watch_dir = dir;
+            },
+            else => {},
+        }
+    }
+
+    const WATCH_MASK = linux.IN.CREATE | linux.IN.DELETE | linux.IN.MOVED_FROM | linux.IN.MOVED_TO;
+
+    /// udev creates /dev/serial and its link directories with the first
+    /// device, so this is retried whenever they may have appeared.
+    /// Re-adding an existing watch is harmless.
+    fn watchLinkDirs(self: *Registry) void {
+        _ = posix.inotify_add_watch(self.watch_fd, "/dev/serial", WATCH_MASK) catch return;
+        for (LINK_DIRS) |dir| _ = posix.inotify_add_watch(self.watch_fd, dir, WATCH_MASK) catch {};
+    }
+
+    fn closeWatch(self: *Registry) void {
+        if (self.watch_fd >= 0) posix.close(self.watch_fd);
+        if (self.watch_dir >= 0) posix.close(self.watch_dir);
+    }
+
+    fn watchLoop(self: *Registry) void {
+        var fds = [_]posix.pollfd{
+            .{ .fd = self.wake[0], .events = posix.POLL.IN, .revents = 0 },
+            .{ .fd = self.watch_fd, .events = posix.POLL.IN, .revents = 0 },
+        };
+        while (true) {
+            const timeout: i32 = if (self.watch_fd < 0) RESCAN_MS else -1;
+            const ready = posix.poll(&fds, timeout) catch return;
+            if (fds[0].revents != 0) return;
+            if (self.watch_fd < 0) {
+                self.rescan();
+            } else if (ready > 0) {
+                self.drainEvents();
+            }
+        }
+    }
+
+    fn drainEvents(self: *Registry) void {
+        switch (builtin.os.tag) {
+            .linux => self.drainInotify(),
+            .macos => {
+                // kqueue only says /dev changed, not what changed
+                var events: [8]posix.Kevent = undefined;
+                _ = posix.kevent(self.watch_fd, &.{}, &events, null) catch {};
+                self.rescan();
+            },
+            else => self.rescan(),
+        }
+    }
+
+    fn drainInotify(self: *Registry) void {
+        var buf: [4096]u8 align(@alignOf(linux.inotify_event)) = undefined;
+        var links_changed = false;
+        defer if (links_changed) {
+            self.watchLinkDirs();
+            if (self.updateLinks()) self.publish();
+        };
+
+        while (true) {
+            const n = posix.read(self.watch_fd, &buf) catch return;
+            if (n == 0) return;
+            var i: usize = 0;
+            while (i < n) {
+                const event: *const linux.inotify_event = @ptrCast(@alignCast(&buf[i]));
+                i += @sizeOf(linux.inotify_event) + event.len;
+                if (event.mask & linux.IN.Q_OVERFLOW != 0) {
+                    self.rescan();
+                    links_changed = true;
+                    continue;
+                }
+                const name = event.getName() orelse continue;
+                if (event.wd != self.dev_wd) {
+                    links_changed = true;
+                } else if (std.mem.eql(u8, name, "serial")) {
+                    links_changed = true;
+                } else if (event.mask & (linux.IN.CREATE | linux.IN.MOVED_TO) != 0) {
+                    if (isSerialName(name)) self.add(name);
+                } else {
+                    self.remove(name);
+                }
+            }
+        }
+    }
+
+    /// Index of `name` in the sorted list, or where it would be inserted
+    fn position(self: *const Registry, name: []const u8) usize {
+        var low: usize = 0;
+        var high = self.entries.items.len;
+        while (low < high) {
+            const mid = low + (high - low) / 2;
+            if (std.mem.lessThan(u8, self.entries.items[mid].name, name)) low = mid + 1 else high = mid;
+        }
+        return low;
+    }
+
+    fn indexOf(self: *const Registry, name: []const u8) ?usize {
+        const index = self.position(name);
+        if (index < self.entries.items.len and std.mem.eql(u8, self.entries.items[index].name, name)) return index;
+        return null;
+    }
+
+    fn add(self: *Registry, name: []const u8) void {
+        if (self.indexOf(name) != null) return;
+        const owned = self.allocator.dupe(u8, name) catch return;
+        self.entries.insert(self.allocator, self.position(name), .{ .name = owned, .info = PortInfo.fromSysfs(name) }) catch {
+            self.allocator.free(owned);
+            return;
+        };
+        self.publish();
+        self.notify(.added, name);
+    }
+
+    fn remove(self: *Registry, name: []const u8) void {
+        const index = self.indexOf(name) orelse return;
+        self.allocator.free(self.entries.orderedRemove(index).name);
+        self.publish();
+        self.notify(.removed, name);
+    }
+
+    /// Full rescan, reporting the difference from the previous list
+    fn rescan(self: *Registry) void {
+        const fresh = scan(self.allocator) catch return;
+        var old = self.entries;
+        defer freeEntries(self.allocator, &old);
+        self.entries = fresh;
+        _ = self.updateLinks();
+
+        var changed = old.items.len != self.entries.items.len;
+        if (!changed) {
+            for (old.items, self.entries.items) |a, b| {
+                if (!std.mem.eql(u8, a.name, b.name)) changed = true;
+            }
+        }
+        if (!changed) return;
+        self.publish();
+
+        // Merge walk over both sorted lists
+        var i: usize = 0;
+        var j: usize = 0;
+        while (i < old.items.len or j < self.entries.items.len) {
+            const order: std.math.Order = if (i == old.items.len)
+                .gt
+            else if (j == self.entries.items.len)
+                .lt
+            else
+                std.mem.order(u8, old.items[i].name, self.entries.items[j].name);
+            switch (order) {
+                .lt => {
+                    self.notify(.removed, old.items[i].name);
+                    i += 1;
+                },
+                .gt => {
+                    self.notify(.added, self.entries.items[j].name);
+                    j += 1;
+                },
+                .eq => {
+                    i += 1;
+                    j += 1;
+                },
+            }
+        }
+    }
+
+    /// Re-reads the udev link directories into the entries; returns
+    /// whether any link changed
+    fn updateLinks(self: *Registry) bool {
+        if (builtin.os.tag != .linux) return false;
+        const fresh = self.allocator.alloc([LINK_DIRS.len]PortInfo.Text, self.entries.items.len) catch return false;
+        defer self.allocator.free(fresh);
+        @memset(fresh, [_]PortInfo.Text{.{}} ** LINK_DIRS.len);
+
+        for (LINK_DIRS, 0..) |dir_path, which| {
+            var dir = std.fs.openDirAbsolute(dir_path, .{ .iterate = true }) catch continue;
+            defer dir.close();
+            var iter = dir.iterate();
+            while (iter.next() catch null) |link| {
+                var target_buf: [std.fs.max_path_bytes]u8 = undefined;
+                const target = dir.readLink(link.name, &target_buf) catch continue;
+                const index = self.indexOf(std.fs.path.basename(target)) orelse continue;
+                var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+                fresh[index][which].set(std.fmt.bufPrint(&path_buf, "{s}/{s}", .{ dir_path, link.name }) catch continue);
+            }
+        }
+
+        var changed = false;
+        for (self.entries.items, fresh) |*entry, links| {
+            if (entry.info.by_id.eql(&links[0]) and entry.info.by_path.eql(&links[1])) continue;
+            entry.info.by_id = links[0];
+            entry.info.by_path = links[1];
+            changed = true;
+        }
+        return changed;
+    }
+
+    /// Swaps in a snapshot of `entries`; on allocation failure readers keep
+    /// the previous list until the next change
+    fn publish(self: *Registry) void {
+        const generation = self.generation.load(.monotonic) + 1;
+        const snapshot = Snapshot.create(self.allocator, generation, self.entries.items) catch return;
+        self.mutex.lock();
+        const old = self.current;
+        self.current = snapshot;
+        self.mutex.unlock();
+        self.generation.store(generation, .release);
+        old.release();
+    }
+
+    fn notify(self: *Registry, change: Change, name: []const u8) void {
+        var buf: [std.fs.max_path_bytes]u8 = undefined;
+        if (DEV.len + name.len >= buf.len) return;
+        @memcpy(buf[0..DEV.len], DEV);
+        @memcpy(buf[DEV.len..][0..name.len], name);
+        buf[DEV.len + name.len] = 0;
+        const path = buf[0 .. DEV.len + name.len :0];
+
+        if (self.callback) |callback| callback(change, path, self.context);
+        self.listeners_mutex.lock();
+        defer self.listeners_mutex.unlock();
+        for (self.listeners.items) |listener| listener.callback(change, path, listener.context);
+    }
+
+    fn freeEntries(allocator: std.mem.Allocator, entries: *std.ArrayList(Entry)) void {
+        for (entries.items) |entry| allocator.free(entry.name);
+        entries.deinit(allocator);
+    }
+
+    /// Serial devices currently in /dev, sorted by name, with metadata
+    fn scan(allocator: std.mem.Allocator) !std.ArrayList(Entry) {
+        var entries: std.ArrayList(Entry) = .empty;
+        errdefer freeEntries(allocator, &entries);
+
+        var dev_dir = std.fs.openDirAbsolute("/dev", .{ .iterate = true }) catch return entries;
+        defer dev_dir.close();
+        var iter = dev_dir.iterate();
+        while (iter.next() catch null) |item| {
+            if (!isSerialName(item.name)) continue;
+            const owned = try allocator.dupe(u8, item.name);
+            errdefer allocator.free(owned);
+            try entries.append(allocator, .{ .name = owned, .info = PortInfo.fromSysfs(item.name) });
+        }
+        std.mem.sort(Entry, entries.items, {}, lessThan);
+        return entries;
+    }
+
+    fn lessThan(_: void, a: Entry, b: Entry) bool {
+        return std.mem.lessThan(u8, a.name, b.name);
+    }
+};
+
+test "registry snapshots outlive the registry" {
+    const allocator = std.testing.allocator;
+    const registry = try Registry.create(allocator, null, null);
+    const snapshot = registry.acquire();
+    defer snapshot.release();
+    registry.destroy();
+
+    for (snapshot.paths) |path| try std.testing.expect(std.mem.startsWith(u8, path, "/dev/"));
+}
+
+test "registry add and remove publish and notify" {
+    const allocator = std.testing.allocator;
+    const Recorder = struct {
+        added: usize = 0,
+        removed: usize = 0,
+
+        fn record(change: Registry.Change, path: [:0]const u8, context: ?*anyopaque) void {
+            const self: *@This() = @ptrCast(@alignCast(context.?));
+            std.debug.assert(std.mem.startsWith(u8, path, "/dev/"));
+            switch (change) {
+                .added => self.added += 1,
+                .removed => self.removed += 1,
+            }
+        }
+    };
+    var recorder = Recorder{};
+    // No watcher thread: drive the update path directly
+    var registry = Registry{
+        .allocator = allocator,
+        .callback = Recorder.record,
+        .context = &recorder,
+        .current = try Registry.Snapshot.create(allocator, 0, &.{}),
+        .wake = undefined,
+    };
+    defer {
+        Registry.freeEntries(allocator, &registry.entries);
+        registry.listeners.deinit(allocator);
+        registry.current.release();
+    }
+
+    const before = registry.acquire();
+    defer before.release();
+    registry.add("ttyUSB1");
+    registry.add("ttyACM0");
+    registry.add("ttyUSB1");
+    registry.remove("ttyS9");
+
+    const after = registry.acquire();
+    defer after.release();
+    try std.testing.expectEqual(@as(usize, 0), before.paths.len);
+    try std.testing.expectEqual(@as(usize, 2), after.paths.len);
+    try std.testing.expectEqualStrings("/dev/ttyACM0", after.paths[0]);
+    try std.testing.expectEqual(@as(u64, 2), registry.getGeneration());
+    try std.testing.expectEqual(@as(usize, 2), recorder.added);
+
+    registry.remove("ttyACM0");
+    try std.testing.expectEqual(@as(usize, 1), recorder.removed);
+
+    // Subscribers hear the same changes until they unsubscribe
+    var subscriber = Recorder{};
+    try registry.subscribe(Recorder.record, &subscriber);
+    registry.add("ttyUSB2");
+    registry.unsubscribe(&subscriber);
+    registry.remove("ttyUSB2");
+    try std.testing.expectEqual(@as(usize, 1), subscriber.added);
+    try std.testing.expectEqual(@as(usize, 0), subscriber.removed);
+    try std.testing.expectEqual(@as(usize, 2), recorder.removed);
+}
+
+test "snapshot indexes every key" {
+    const allocator = std.testing.allocator;
+    var a = "ttyACM0".*;
+    var b = "ttyUSB1".*;
+    var entries = [_]Registry.Entry{ .{ .name = &a, .info = .{} }, .{ .name = &b, .info = .{} } };
+    entries[1].info.serial_number.set("A50285BI");
+    entries[1].info.by_id.set("/dev/serial/by-id/usb-FTDI_FT232R_USB_UART_A50285BI-if00-port0");
+
+    const snapshot = try Registry.Snapshot.create(allocator, 7, &entries);
+    defer snapshot.release();
+    try std.testing.expectEqual(@as(usize, 2), snapshot.paths.len);
+    try std.testing.expectEqualStrings("/dev/ttyUSB1", snapshot.paths[1]);
+    try std.testing.expectEqual(@as(u8, 0), snapshot.paths[0].ptr[snapshot.paths[0].len]);
+
+    try std.testing.expectEqual(@as(?usize, 1), snapshot.find("A50285BI"));
+    try std.testing.expectEqual(@as(?usize, 1), snapshot.find("/dev/serial/by-id/usb-FTDI_FT232R_USB_UART_A50285BI-if00-port0"));
+    try std.testing.expectEqual(@as(?usize, 0), snapshot.find("/dev/ttyACM0"));
+    try std.testing.expectEqual(@as(?usize, 0), snapshot.find("ttyACM0"));
+    try std.testing.expectEqual(@as(?usize, null), snapshot.find("nope"));
+}
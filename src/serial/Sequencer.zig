@@ -0,0 +1,130 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const clock = @import("clock.zig");
+
+/// Plays scripted DTR/RTS waveforms with tight timing.
+///
+/// Every step is a single `Port.setLines` (one TIOCMSET, or the emulated
+/// lines of a virtual port), so DTR and RTS always change together.
+/// Deadlines are absolute offsets on the monotonic clock (errors do not
+/// accumulate): the thread sleeps until shortly before each one and spins
+/// the rest.
+///
+/// Note that most USB adapters drive the pins inverted: asserting DTR or
+/// RTS pulls the pin low.
+pub const Sequencer = struct {
+    pub const Step = struct {
+        /// New line state, or null to leave it unchanged
+        dtr: ?bool = null,
+        rts: ?bool = null,
+        /// Time until the next step (or the end of the sequence)
+        hold_us: u32 = 0,
+    };
+
+    pub const Options = struct {
+        /// Sleep until this long before a deadline, then busy-wait
+        spin_ns: u64 = 200 * std.time.ns_per_us,
+        /// Optional per-step timing error in ns (actual - scheduled)
+        jitter_out: ?[]i64 = null,
+    };
+
+    pub const Report = struct {
+        steps: usize = 0,
+        /// Largest deviation of a line change from its schedule
+        max_jitter_ns: u64 = 0,
+        mean_jitter_ns: u64 = 0,
+        /// From the first step to the end of the last hold
+        total_ns: u64 = 0,
+    };
+
+    pub const Error = error{LineControlFailed};
+
+    /// esptool "UnixTightReset": EN is on RTS, IO0 on DTR
+    pub const esp32_bootloader = [_]Step{
+        .{ .dtr = false, .rts = false },
+        .{ .dtr = true, .rts = true },
+        .{ .dtr = false, .rts = true, .hold_us = 100_000 }, // IO0 high, EN low: in reset
+        .{ .dtr = true, .rts = false, .hold_us = 50_000 }, // IO0 low, EN high: boots to ROM loader
+        .{ .dtr = false, .rts = false },
+    };
+
+    /// Pulses EN (RTS) with IO0 released, for a normal boot
+    pub const esp32_reset = [_]Step{
+        .{ .dtr = false, .rts = true, .hold_us = 100_000 },
+        .{ .rts = false },
+    };
+
+    /// Common STM32 wiring: NRST on DTR, BOOT0 on RTS
+    pub const stm32_bootloader = [_]Step{
+        .{ .dtr = true, .rts = true, .hold_us = 10_000 }, // BOOT0 up, in reset
+        .{ .dtr = false, .hold_us = 50_000 }, // release reset: system memory boot
+        .{ .rts = false },
+    };
+
+    /// Pulses NRST (DTR) with BOOT0 low, for a normal boot
+    pub const stm32_reset = [_]Step{
+        .{ .dtr = true, .rts = false, .hold_us = 10_000 },
+        .{ .dtr = false },
+    };
+
+    /// Runs `steps` on `port` and reports how closely the schedule was met
+    pub fn run(port: *Port, steps: []const Step, options: Options) Error!Report {
+        // Fail before the first deadline rather than partway through
+        if (!port.setLines(null, null)) return Error.LineControlFailed;
+
+        var report = Report{ .steps = steps.len };
+        var jitter_sum: u64 = 0;
+        const start = clock.now();
+        var deadline = start;
+
+        for (steps, 0..) |step, i| {
+            clock.waitUntil(deadline, options.spin_ns);
+
+            if (step.dtr != null or step.rts != null) {
+                if (!port.setLines(step.dtr, step.rts)) return Error.LineControlFailed;
+            }
+
+            const actual = clock.now();
+            const offset = @as(i64, @intCast(actual)) - @as(i64, @intCast(deadline));
+            const jitter = @abs(offset);
+            report.max_jitter_ns = @max(report.max_jitter_ns, jitter);
+            jitter_sum += jitter;
+            if (options.jitter_out) |out| {
+                if (i < out.len) out[i] = offset;
+            }
+
+            deadline += @as(u64, step.hold_us) * std.time.ns_per_us;
+        }
+        clock.waitUntil(deadline, options.spin_ns);
+
+        report.total_ns = clock.now() - start;
+        if (steps.len > 0) report.mean_jitter_ns = jitter_sum / steps.len;
+        return report;
+    }
+};
+
+test "sequencer drives a virtual port's lines" {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = try VirtualPort.create(std.testing.allocator, .{});
+    var ports = pair.open(.{}) catch |err| {
+        pair.release();
+        return err;
+    };
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    _ = try Sequencer.run(&ports[0], &Sequencer.stm32_reset, .{});
+    // DTR pulsed (the peer's DSR went up and down); RTS stayed low
+    const status = ports[1].getModemStatus();
+    try std.testing.expect(!status.dsr and !status.cts);
+    try std.testing.expectEqual(@as(u32, 2), ports[1].getCounters().dsr);
+    try std.testing.expectEqual(@as(u32, 0), ports[1].getCounters().cts);
+}
+
+test "sequencer rejects a port without modem lines" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{});
+    try std.testing.expectError(Sequencer.Error.LineControlFailed, Sequencer.run(&port, &Sequencer.esp32_reset, .{}));
+}
@@ -0,0 +1,105 @@
+const std = @import("std");
+const clock = @import("clock.zig");
+const scan = @import("scan.zig");
+
+const c = @cImport({
+    @cInclude("termios.h");
+});
+
+/// XON/XOFF handled in userspace (`FlowControl.software_userspace`).
+///
+/// The kernel's IXOFF watches its own input queue, which a reader thread
+/// keeps empty however far behind the consumers fall. Here the hub's ring
+/// level decides instead: `throttle` stops the peer above the high
+/// watermark and restarts it below the low one. Inbound XOFF/XON are
+/// stripped from the read stream by `receive`, which also suspends the
+/// driver's output (tcflow) so bytes already queued stop at once rather
+/// than after the queue drains.
+pub const SoftFlow = struct {
+    pub const XON: u8 = 0x11;
+    pub const XOFF: u8 = 0x13;
+
+    /// 1 while the peer has our output stopped; writers wait on it
+    paused: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+    /// Whether we have the peer stopped
+    throttled: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    xoff_sent: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    xoff_received: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+
+    /// Acts on and removes XON/XOFF in `data`; returns the new length
+    pub fn receive(self: *SoftFlow, fd: std.posix.fd_t, data: []u8) usize {
+        if (scan.indexOfEither(data, 0, XON, XOFF) == null) return data.len;
+        var len: usize = 0;
+        for (data) |byte| {
+            switch (byte) {
+                XOFF => self.stop(fd),
+                XON => self.restart(fd),
+                else => {
+                    data[len] = byte;
+                    len += 1;
+                },
+            }
+        }
+        return len;
+    }
+
+    /// Blocks while the peer has our output stopped. False if `timeout_ns`
+    /// passed first.
+    pub fn waitResumed(self: *SoftFlow, timeout_ns: u64) bool {
+        const deadline = clock.now() + timeout_ns;
+        while (self.paused.load(.acquire) != 0) {
+            const now = clock.now();
+            if (now >= deadline) return false;
+            std.Thread.Futex.timedWait(&self.paused, 1, deadline - now) catch {};
+        }
+        return true;
+    }
+
+    /// Sends XOFF (`on`) or XON on a change of state. On a tty the byte
+    /// goes out ahead of anything already queued.
+    pub fn throttle(self: *SoftFlow, fd: std.posix.fd_t, on: bool) void {
+        if (self.throttled.swap(on, .monotonic) == on) return;
+        if (std.posix.isatty(fd)) {
+            _ = c.tcflow(fd, if (on) c.TCIOFF else c.TCION);
+        } else {
+            _ = std.posix.write(fd, &[_]u8{if (on) XOFF else XON}) catch {};
+        }
+        if (on) _ = self.xoff_sent.fetchAdd(1, .monotonic);
+    }
+
+    /// Drops both directions' state, restarting our output if it was
+    /// stopped (used when leaving userspace flow control)
+    pub fn reset(self: *SoftFlow, fd: std.posix.fd_t) void {
+        self.restart(fd);
+        self.throttled.store(false, .monotonic);
+    }
+
+    fn stop(self: *SoftFlow, fd: std.posix.fd_t) void {
+        if (self.paused.swap(1, .acq_rel) != 0) return;
+        if (std.posix.isatty(fd)) _ = c.tcflow(fd, c.TCOOFF);
+        _ = self.xoff_received.fetchAdd(1, .monotonic);
+    }
+
+    fn restart(self: *SoftFlow, fd: std.posix.fd_t) void {
+        if (self.paused.swap(0, .acq_rel) == 0) return;
+        if (std.posix.isatty(fd)) _ = c.tcflow(fd, c.TCOON);
+        std.Thread.Futex.wake(&self.paused, std.math.maxInt(u32));
+    }
+};
+
+test "receive strips flow bytes and tracks the peer's state" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var flow = SoftFlow{};
+    var data = "ab\x13cd".*;
+    try std.testing.expectEqualStrings("abcd", data[0..flow.receive(fds[1], &data)]);
+    try std.testing.expectEqual(@as(u32, 1), flow.paused.load(.monotonic));
+    try std.testing.expect(!flow.waitResumed(std.time.ns_per_ms));
+
+    var more = "\x11e".*;
+    try std.testing.expectEqualStrings("e", more[0..flow.receive(fds[1], &more)]);
+    try std.testing.expect(flow.waitResumed(0));
+    try std.testing.expectEqual(@as(u64, 1), flow.xoff_received.load(.monotonic));
+}
@@ -0,0 +1,179 @@
+const std = @import("std");
+
+const Counter = std.atomic.Value(u64);
+
+/// Always-on per-port metrics.
+///
+/// Every field is updated with relaxed atomics, so the hot path never
+/// takes a lock; `snapshot` may run on any thread and sees a consistent
+/// value per field (not across fields).
+pub const Stats = struct {
+    rx_bytes: Counter = Counter.init(0),
+    tx_bytes: Counter = Counter.init(0),
+    read_calls: Counter = Counter.init(0),
+    write_calls: Counter = Counter.init(0),
+    /// Largest backlog seen in a shared RX ring
+    ring_high_water: Counter = Counter.init(0),
+    /// Bytes lost to slow consumers
+    dropped_bytes: Counter = Counter.init(0),
+
+    /// Poll reported data ready -> read returned it to the caller
+    rx_latency: Histogram = .{},
+    /// Write submitted -> output queue (TIOCOUTQ) observed empty
+    drain_latency: Histogram = .{},
+
+    /// Monotonic time RX readiness was first seen (0 if not pending)
+    ready_ns: Counter = Counter.init(0),
+    /// Monotonic time of the oldest write not yet seen drained
+    pending_tx_ns: Counter = Counter.init(0),
+    /// Monotonic time the output queue was last sampled for draining
+    drain_checked_ns: Counter = Counter.init(0),
+
+    pub const Snapshot = struct {
+        rx_bytes: u64,
+        tx_bytes: u64,
+        read_calls: u64,
+        write_calls: u64,
+        ring_high_water: u64,
+        dropped_bytes: u64,
+        rx_latency: Histogram.Summary,
+        drain_latency: Histogram.Summary,
+
+        pub fn bytesPerRead(self: Snapshot) u64 {
+            return if (self.read_calls == 0) 0 else self.rx_bytes / self.read_calls;
+        }
+
+        pub fn bytesPerWrite(self: Snapshot) u64 {
+            return if (self.write_calls == 0) 0 else self.tx_bytes / self.write_calls;
+        }
+    };
+
+    pub fn recordRead(self: *Stats, bytes: usize) void {
+        _ = self.read_calls.fetchAdd(1, .monotonic);
+        _ = self.rx_bytes.fetchAdd(bytes, .monotonic);
+    }
+
+    pub fn recordWrite(self: *Stats, bytes: usize) void {
+        _ = self.write_calls.fetchAdd(1, .monotonic);
+        _ = self.tx_bytes.fetchAdd(bytes, .monotonic);
+    }
+
+    pub fn recordBacklog(self: *Stats, bytes: u64) void {
+        _ = self.ring_high_water.fetchMax(bytes, .monotonic);
+    }
+
+    pub fn recordDropped(self: *Stats, bytes: u64) void {
+        _ = self.dropped_bytes.fetchAdd(bytes, .monotonic);
+    }
+
+    pub fn snapshot(self: *const Stats) Snapshot {
+        return .{
+            .rx_bytes = self.rx_bytes.load(.monotonic),
+            .tx_bytes = self.tx_bytes.load(.monotonic),
+            .read_calls = self.read_calls.load(.monotonic),
+            .write_calls = self.write_calls.load(.monotonic),
+            .ring_high_water = self.ring_high_water.load(.monotonic),
+            .dropped_bytes = self.dropped_bytes.load(.monotonic),
+            .rx_latency = self.rx_latency.summarize(),
+            .drain_latency = self.drain_latency.summarize(),
+        };
+    }
+};
+
+/// Log-linear latency histogram in the style of HdrHistogram: each power
+/// of two is split into 8 linear sub-buckets, giving at most 12.5% error
+/// over the whole u64 range in a fixed 4 KiB.
+pub const Histogram = struct {
+    const SUB_BITS = 3;
+    const SUB_COUNT = 1 << SUB_BITS;
+    pub const BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    counts: [BUCKETS]Counter = [_]Counter{Counter.init(0)} ** BUCKETS,
+
+    pub const Summary = struct {
+        count: u64 = 0,
+        p50: u64 = 0,
+        p90: u64 = 0,
+        p99: u64 = 0,
+        p999: u64 = 0,
+        max: u64 = 0,
+    };
+
+    pub fn record(self: *Histogram, value: u64) void {
+        _ = self.counts[bucketOf(value)].fetchAdd(1, .monotonic);
+    }
+
+    pub fn bucketOf(value: u64) usize {
+        if (value < SUB_COUNT) return @intCast(value);
+        const exponent: u6 = @intCast(63 - @clz(value));
+        const sub: usize = @intCast((value >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+        return (@as(usize, exponent) - SUB_BITS + 1) * SUB_COUNT + sub;
+    }
+
+    pub fn lowerBound(bucket: usize) u64 {
+        if (bucket < SUB_COUNT) return bucket;
+        const exponent: u6 = @intCast(bucket / SUB_COUNT + SUB_BITS - 1);
+        const sub: u64 = bucket % SUB_COUNT;
+        return (SUB_COUNT + sub) << (exponent - SUB_BITS);
+    }
+
+    /// Largest value that lands in `bucket`
+    pub fn upperBound(bucket: usize) u64 {
+        if (bucket + 1 >= BUCKETS) return std.math.maxInt(u64);
+        return lowerBound(bucket + 1) - 1;
+    }
+
+    pub fn summarize(self: *const Histogram) Summary {
+        var counts: [BUCKETS]u64 = undefined;
+        var total: u64 = 0;
+        for (&self.counts, &counts) |*counter, *count| {
+            count.* = counter.load(.monotonic);
+            total += count.*;
+        }
+        if (total == 0) return .{};
+
+        var summary = Summary{ .count = total };
+        const targets = [_]struct { per_mille: u64, out: *u64 }{
+            .{ .per_mille = 500, .out = &summary.p50 },
+            .{ .per_mille = 900, .out = &summary.p90 },
+            .{ .per_mille = 990, .out = &summary.p99 },
+            .{ .per_mille = 999, .out = &summary.p999 },
+        };
+        var next: usize = 0;
+        var seen: u64 = 0;
+        for (counts, 0..) |count, bucket| {
+            if (count == 0) continue;
+            seen += count;
+            while (next < targets.len and seen * 1000 >= total * targets[next].per_mille) : (next += 1) {
+                targets[next].out.* = upperBound(bucket);
+            }
+            summary.max = upperBound(bucket);
+        }
+        return summary;
+    }
+};
+
+test "histogram buckets are monotonic and tight" {
+    var previous: usize = 0;
+    var value: u64 = 1;
+    while (value < 1 << 40) : (value = value * 3 / 2 + 1) {
+        const bucket = Histogram.bucketOf(value);
+        try std.testing.expect(bucket >= previous);
+        try std.testing.expect(Histogram.lowerBound(bucket) <= value);
+        try std.testing.expect(Histogram.upperBound(bucket) >= value);
+        // 12.5% relative error bound
+        try std.testing.expect(Histogram.upperBound(bucket) - Histogram.lowerBound(bucket) <= value / 8);
+        previous = bucket;
+    }
+    try std.testing.expectEqual(Histogram.BUCKETS - 1, Histogram.bucketOf(std.math.maxInt(u64)));
+}
+
+test "histogram percentiles" {
+    var histogram = Histogram{};
+    for (1..1001) |i| histogram.record(i * 1000);
+    const summary = histogram.summarize();
+    try std.testing.expectEqual(@as(u64, 1000), summary.count);
+    try std.testing.expect(summary.p50 >= 500_000 and summary.p50 <= 500_000 * 9 / 8);
+    try std.testing.expect(summary.p99 >= 990_000);
+    try std.testing.expect(summary.max >= 1_000_000);
+}
@@ -0,0 +1,279 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const PortInfo = @import("PortInfo.zig").PortInfo;
+const Registry = @import("Registry.zig").Registry;
+const clock = @import("clock.zig");
+
+/// Reopens a port after its USB adapter resets or is re-plugged.
+///
+/// The device is followed by identity rather than path: its USB serial
+/// number (or by-id link when several ports share one), looked up in the
+/// snapshots of a `Registry` that any number of supervisors can share. When it reappears, possibly under a new /dev name,
+/// the same `Port` is reopened in place with the same `Config`, so
+/// whatever holds the port (a `Hub` and its consumers, pacing, statistics)
+/// carries on. A supervised `Hub` waits out the outage instead of failing
+/// and shows each consumer where the gap is.
+///
+/// Devices without USB identity (or not listed, such as ptys) are
+/// followed by path.
+pub const Supervisor = struct {
+    const OPEN_ATTEMPTS = 100;
+    const OPEN_RETRY_MS = 5;
+    /// Retry interval while the device is gone and no hotplug event comes
+    const RETRY_MS = 100;
+
+    allocator: std.mem.Allocator,
+    port: *Port,
+    /// Shared with other users; outlives the supervisor
+    registry: *Registry,
+    /// Serial number, by-id link or path identifying the device; fixed
+    /// once `create` returns
+    key: PortInfo.Text = .{},
+    /// Back `port.path` after a reopen (the name may have changed), used
+    /// in turn so the name a concurrent reader holds stays intact
+    path_bufs: [2][std.fs.max_path_bytes]u8 = undefined,
+    path_slot: u1 = 0,
+    /// Reopens the device, off the registry's watcher thread
+    thread: ?std.Thread = null,
+    stopping: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    mutex: std.Thread.Mutex = .{},
+    changed: std.Thread.Condition = .{},
+    connected: bool = true,
+    /// A device appeared since the last reopen attempt
+    added: bool = false,
+    reconnects: u64 = 0,
+    /// When the current outage began
+    lost_ns: u64 = 0,
+    /// Length of the last outage
+    last_gap_ns: u64 = 0,
+
+    /// Starts following the device behind `port`. Both `port` and
+    /// `registry` must outlive the supervisor.
+    pub fn create(allocator: std.mem.Allocator, port: *Port, registry: *Registry) !*Supervisor {
+        const self = try allocator.create(Supervisor);
+        errdefer allocator.destroy(self);
+        self.* = .{ .allocator = allocator, .port = port, .registry = registry };
+
+        {
+            const snapshot = registry.acquire();
+            defer snapshot.release();
+            self.key.set(identity(snapshot, port.path));
+        }
+
+        self.thread = try std.Thread.spawn(.{}, reopenLoop, .{self});
+        errdefer self.stop();
+        try registry.subscribe(onChange, self);
+        return self;
+    }
+
+    /// Stops following the device. Destroy a supervised hub first.
+    pub fn destroy(self: *Supervisor) void {
+        self.registry.unsubscribe(self);
+        self.stop();
+        self.allocator.destroy(self);
+    }
+
+    fn stop(self: *Supervisor) void {
+        self.mutex.lock();
+        self.stopping.store(true, .release);
+        self.changed.broadcast();
+        self.mutex.unlock();
+        if (self.thread) |t| t.join();
+    }
+
+    /// Marks the device gone (an I/O error or hangup on the port)
+    pub fn lost(self: *Supervisor) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.markLostLocked();
+    }
+
+    pub fn isConnected(self: *Supervisor) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.connected;
+    }
+
+    pub fn reconnectCount(self: *Supervisor) u64 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.reconnects;
+    }
+
+    /// Whether the port still works. A hung-up tty keeps polling readable
+    /// and reading 0 bytes, but fails every ioctl.
+    pub fn check(self: *Supervisor) bool {
+        if (!self.isConnected()) return false;
+        _ = std.posix.tcgetattr(self.port.fd) catch {
+            self.lost();
+            return false;
+        };
+        return true;
+    }
+
+    /// Waits up to `timeout_ms` for the device to be back
+    pub fn waitConnected(self: *Supervisor, timeout_ms: u32) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        if (!self.connected) self.changed.timedWait(&self.mutex, @as(u64, timeout_ms) * std.time.ns_per_ms) catch {};
+        return self.connected;
+    }
+
+    fn markLostLocked(self: *Supervisor) void {
+        if (!self.connected) return;
+        self.connected = false;
+        self.lost_ns = clock.now();
+        self.changed.broadcast();
+    }
+
+    /// Runs on the registry's watcher thread, so it only records the
+    /// change; opening is left to `reopenLoop`
+    fn onChange(change: Registry.Change, path: [:0]const u8, context: ?*anyopaque) void {
+        const self: *Supervisor = @ptrCast(@alignCast(context.?));
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        switch (change) {
+            .removed => if (std.mem.eql(u8, path, self.port.path)) self.markLostLocked(),
+            .added => if (!self.connected) {
+                self.added = true;
+                self.changed.broadcast();
+            },
+        }
+    }
+
+    /// While the device is gone, tries to reopen it: at once (it may have
+    /// returned before the loss was noticed, leaving no hotplug event to
+    /// wait for), persistently after a hotplug event, and every `RETRY_MS`
+    /// otherwise. The mutex is not held while opening.
+    fn reopenLoop(self: *Supervisor) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (!self.stopping.load(.acquire)) {
+            if (self.connected) {
+                self.changed.wait(&self.mutex);
+                continue;
+            }
+            // udev may still be setting permissions, so keep trying briefly
+            const attempts: u32 = if (self.added) OPEN_ATTEMPTS else 1;
+            self.added = false;
+
+            self.mutex.unlock();
+            var path_buf: [std.fs.max_path_bytes]u8 = undefined;
+            const opened = self.openDevice(&path_buf, attempts);
+            self.mutex.lock();
+
+            if (opened) |fresh| {
+                self.handOverLocked(fresh);
+            } else if (!self.added and !self.stopping.load(.acquire)) {
+                self.changed.timedWait(&self.mutex, RETRY_MS * std.time.ns_per_ms) catch {};
+            }
+        }
+    }
+
+    /// Opens the device wherever it is now listed. A key that is not a
+    /// path (a serial number) is only usable once the registry lists it.
+    fn openDevice(self: *Supervisor, path_buf: *[std.fs.max_path_bytes]u8, attempts: u32) ?Port {
+        const key = self.key.get() orelse return null;
+        const path = blk: {
+            const snapshot = self.registry.acquire();
+            defer snapshot.release();
+            const found = if (snapshot.find(key)) |i|
+                snapshot.paths[i]
+            else if (std.fs.path.isAbsolute(key))
+                key
+            else
+                return null;
+            if (found.len > path_buf.len) return null;
+            @memcpy(path_buf[0..found.len], found);
+            break :blk path_buf[0..found.len];
+        };
+
+        var attempt: u32 = 1;
+        while (true) : (attempt += 1) {
+            return Port.open(path, self.port.config) catch {
+                if (attempt >= attempts or self.stopping.load(.acquire)) return null;
+                std.Thread.sleep(OPEN_RETRY_MS * std.time.ns_per_ms);
+                continue;
+            };
+        }
+    }
+
+    /// Hands the freshly opened descriptor over to the port. The new file
+    /// is dup2'd onto the old descriptor number, so threads reading,
+    /// writing or polling the port never see a closed or reused fd: calls
+    /// already in flight finish on the old file and the next ones reach
+    /// the new one.
+    fn handOverLocked(self: *Supervisor, opened: Port) void {
+        var fresh = opened;
+        const path = fresh.path;
+        const old = self.port.fd;
+        if (old >= 0) {
+            // Keep the port's blocking mode, which Port.open resets
+            fresh.setNonBlocking(self.port.isNonBlocking());
+            std.posix.dup2(fresh.fd, old) catch {
+                std.posix.close(fresh.fd);
+                return;
+            };
+            std.posix.close(fresh.fd);
+        } else {
+            self.port.fd = fresh.fd;
+        }
+        self.port.original_termios = fresh.original_termios;
+        // The new device's counters restart; deltas continue from them
+        self.port.stats_baseline = fresh.stats_baseline;
+        if (!std.mem.eql(u8, self.port.path, path)) {
+            self.path_slot +%= 1;
+            const buf = &self.path_bufs[self.path_slot];
+            @memcpy(buf[0..path.len], path);
+            self.port.path = buf[0..path.len];
+        }
+        // The adapter came back reset: no half-decoded marker, no XOFF.
+        // Writers parked on the peer's XOFF are woken, not stranded.
+        self.port.marks.state = .data;
+        self.port.flow.reset(self.port.fd);
+
+        self.connected = true;
+        self.reconnects += 1;
+        self.last_gap_ns = clock.now() -| self.lost_ns;
+        self.changed.broadcast();
+    }
+
+    /// The most specific stable key for the device at `path`
+    fn identity(snapshot: *const Registry.Snapshot, path: []const u8) []const u8 {
+        const i = snapshot.find(path) orelse return path;
+        const info = &snapshot.infos[i];
+        if (info.serial_number.get()) |serial| {
+            // Ports of a multi-port adapter share one serial number
+            if (snapshot.find(serial) == i) return serial;
+        }
+        return info.by_id.get() orelse info.serial_number.get() orelse path;
+    }
+};
+
+test "reopens a lost port in place" {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = VirtualPort.create(std.testing.allocator, .{ .mode = .pty }) catch return error.SkipZigTest;
+    defer pair.release();
+
+    var port = try Port.open(pair.endpoints[0].path(), .{ .baud_rate = .B57600 });
+    defer port.close();
+
+    const registry = try Registry.create(std.testing.allocator, null, null);
+    defer registry.destroy();
+    const supervisor = try Supervisor.create(std.testing.allocator, &port, registry);
+    defer supervisor.destroy();
+    try std.testing.expect(supervisor.check());
+
+    const before = port.fd;
+    port.setNonBlocking(true);
+    supervisor.lost();
+    try std.testing.expect(!supervisor.isConnected());
+    try std.testing.expect(supervisor.waitConnected(1000));
+    try std.testing.expectEqual(@as(u64, 1), supervisor.reconnectCount());
+    // Handed over on the same descriptor number, in the same mode
+    try std.testing.expectEqual(before, port.fd);
+    try std.testing.expect(port.isNonBlocking());
+    try std.testing.expect(std.posix.isatty(port.fd));
+    try std.testing.expectEqual(@as(u32, 57600), port.config.baud_rate.toSpeed());
+}
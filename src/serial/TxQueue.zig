@@ -0,0 +1,359 @@
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+
+/// Asynchronous transmit engine for one port.
+///
+/// `write` copies the data into a fixed ring and returns; a worker thread
+/// hands it to the port in submission order (pacing and flow control
+/// apply; a full non-blocking port is waited on). Each message can report
+/// when the driver accepted it and when it has left the wire: the worker
+/// tracks bytes accepted minus the driver's output queue (TIOCOUTQ), so
+/// drain notices keep flowing during continuous output instead of waiting
+/// for an idle line.
+///
+/// The ring bounds memory: `write` only blocks while it is full.
+pub const TxQueue = struct {
+    pub const CAPACITY = 64 * 1024;
+    const MAX_REQUESTS = 256;
+    /// Longest gap between drain checks
+    const MAX_DRAIN_WAIT_NS = 20 * std.time.ns_per_ms;
+    /// How long the worker waits for a full non-blocking port before
+    /// checking for shutdown
+    const WRITABLE_POLL_MS = 100;
+
+    pub const Event = enum(c_int) {
+        /// The driver has taken every byte of the message
+        accepted = 0,
+        /// The message has been sent on the wire
+        drained = 1,
+        /// The message was not (fully) written, or the queue shut down
+        /// before it drained
+        failed = 2,
+    };
+
+    /// C calling convention so the C API can pass callbacks straight through
+    pub const Callback = *const fn (event: Event, context: ?*anyopaque) callconv(.c) void;
+
+    /// One ring segment; a message larger than the ring spans several
+    const Request = struct {
+        len: usize,
+        /// Last segment of its message: carries the notifications
+        last: bool,
+        want_drained: bool,
+        callback: ?Callback,
+        context: ?*anyopaque,
+    };
+
+    /// A message awaiting its drain notice
+    const Drain = struct {
+        /// `accepted` once the message's last byte was accepted
+        end: u64,
+        callback: Callback,
+        context: ?*anyopaque,
+    };
+
+    allocator: std.mem.Allocator,
+    port: *Port,
+    bytes: []u8,
+    /// Totals ever queued and ever handed to the port
+    byte_head: u64 = 0,
+    byte_tail: u64 = 0,
+    requests: [MAX_REQUESTS]Request = undefined,
+    request_head: u64 = 0,
+    request_tail: u64 = 0,
+    /// At most one per request, so it never overflows
+    drains: [MAX_REQUESTS]Drain = undefined,
+    drain_head: u64 = 0,
+    drain_tail: u64 = 0,
+    /// Bytes the driver has accepted
+    accepted: u64 = 0,
+
+    /// Held by `write` for a whole message, so the segments of one larger
+    /// than the ring are never interleaved with another message
+    writer: std.Thread.Mutex = .{},
+    mutex: std.Thread.Mutex = .{},
+    /// Work for the worker
+    work: std.Thread.Condition = .{},
+    /// Ring space for writers
+    space: std.Thread.Condition = .{},
+    /// Read without the mutex by `Port` while a write waits on the peer
+    running: std.atomic.Value(bool) = std.atomic.Value(bool).init(true),
+    thread: ?std.Thread = null,
+
+    pub fn create(allocator: std.mem.Allocator, port: *Port) !*TxQueue {
+        const self = try allocator.create(TxQueue);
+        errdefer allocator.destroy(self);
+        const bytes = try allocator.alloc(u8, CAPACITY);
+        errdefer allocator.free(bytes);
+        self.* = .{ .allocator = allocator, .port = port, .bytes = bytes };
+        self.thread = try std.Thread.spawn(.{}, run, .{self});
+        return self;
+    }
+
+    /// Stops the worker. Messages not yet written, and drain notices not
+    /// yet delivered, are reported as failed. Only called as the port
+    /// closes: output still queued in the driver is discarded.
+    pub fn destroy(self: *TxQueue) void {
+        self.mutex.lock();
+        self.running.store(false, .release);
+        self.work.signal();
+        self.space.broadcast();
+        self.mutex.unlock();
+
+        // The worker may be stuck in writeAll, held off by CTS or by the
+        // peer's XOFF: make its write fail instead of waiting forever
+        self.port.setNonBlocking(true);
+        self.port.flushOutput();
+        std.Thread.Futex.wake(&self.port.flow.paused, std.math.maxInt(u32));
+        if (self.thread) |t| t.join();
+
+        while (self.request_tail != self.request_head) : (self.request_tail += 1) {
+            const request = self.requests[self.request_tail % MAX_REQUESTS];
+            if (request.last) if (request.callback) |callback| callback(.failed, request.context);
+        }
+        while (self.drain_tail != self.drain_head) : (self.drain_tail += 1) {
+            const pending = self.drains[self.drain_tail % MAX_REQUESTS];
+            pending.callback(.failed, pending.context);
+        }
+        self.allocator.free(self.bytes);
+        self.allocator.destroy(self);
+    }
+
+    /// Queues `data` as one message and returns without waiting for the
+    /// port (unless the ring is full). `callback` gets `accepted` or
+    /// `failed`, then `drained` too if `want_drained`; it runs on the
+    /// worker thread.
+    pub fn write(self: *TxQueue, data: []const u8, want_drained: bool, callback: ?Callback, context: ?*anyopaque) Port.Error!void {
+        self.writer.lock();
+        defer self.writer.unlock();
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        var rest = data;
+        while (true) {
+            while (self.isRunning() and (self.request_head - self.request_tail == MAX_REQUESTS or
+                (rest.len > 0 and self.byte_head - self.byte_tail == CAPACITY)))
+            {
+                self.space.wait(&self.mutex);
+            }
+            if (!self.isRunning()) return Port.Error.PortClosed;
+
+            const room: usize = @intCast(CAPACITY - (self.byte_head - self.byte_tail));
+            const n = @min(rest.len, room);
+            const offset: usize = @intCast(self.byte_head % CAPACITY);
+            const first = @min(n, CAPACITY - offset);
+            @memcpy(self.bytes[offset..][0..first], rest[0..first]);
+            @memcpy(self.bytes[0 .. n - first], rest[first..n]);
+            self.byte_head += n;
+
+            const last = n == rest.len;
+            self.requests[self.request_head % MAX_REQUESTS] = .{
+                .len = n,
+                .last = last,
+                .want_drained = want_drained,
+                .callback = if (last) callback else null,
+                .context = context,
+            };
+            self.request_head += 1;
+            self.work.signal();
+            if (last) return;
+            rest = rest[n..];
+        }
+    }
+
+    pub fn isRunning(self: *const TxQueue) bool {
+        return self.running.load(.acquire);
+    }
+
+    fn run(self: *TxQueue) void {
+        // A message whose earlier segment failed fails as a whole
+        var failing = false;
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (self.isRunning()) {
+            if (self.request_tail != self.request_head) {
+                const request = self.requests[self.request_tail % MAX_REQUESTS];
+                const start = self.byte_tail;
+                self.mutex.unlock();
+                const ok = !failing and self.send(start, request.len);
+                self.mutex.lock();
+
+                self.byte_tail += request.len;
+                self.request_tail += 1;
+                self.space.broadcast();
+                if (ok) self.accepted += request.len;
+                failing = !ok and !request.last;
+                if (!request.last) continue;
+
+                const callback = request.callback orelse continue;
+                if (ok and request.want_drained) {
+                    self.drains[self.drain_head % MAX_REQUESTS] = .{
+                        .end = self.accepted,
+                        .callback = callback,
+                        .context = request.context,
+                    };
+                    self.drain_head += 1;
+                }
+                self.mutex.unlock();
+                callback(if (ok) .accepted else .failed, request.context);
+                self.mutex.lock();
+                continue;
+            }
+
+            if (self.drain_tail == self.drain_head) {
+                self.work.wait(&self.mutex);
+                continue;
+            }
+
+            // Bytes off the wire = accepted - still queued in the driver
+            const queued = self.port.outputQueued();
+            const sent = self.accepted -| queued;
+            const pending = self.drains[self.drain_tail % MAX_REQUESTS];
+            if (pending.end <= sent) {
+                self.drain_tail += 1;
+                self.mutex.unlock();
+                pending.callback(.drained, pending.context);
+                self.mutex.lock();
+                continue;
+            }
+            // Sleep about as long as the rest of that message takes to send
+            const estimate = (pending.end - sent) * self.port.config.charTimeNs();
+            self.work.timedWait(&self.mutex, std.math.clamp(estimate, 100 * std.time.ns_per_us, MAX_DRAIN_WAIT_NS)) catch {};
+        }
+    }
+
+    /// Writes ring bytes [start, start + len), which may wrap
+    fn send(self: *TxQueue, start: u64, len: usize) bool {
+        const offset: usize = @intCast(start % CAPACITY);
+        const first = @min(len, CAPACITY - offset);
+        return self.sendAll(self.bytes[offset..][0..first]) and self.sendAll(self.bytes[0 .. len - first]);
+    }
+
+    /// `Port.writeAll`, except that a non-blocking port with a full
+    /// driver buffer is waited on rather than failing the message. Pacing
+    /// keeps the driver queue under its own ceiling, so paced output goes
+    /// through `writeAll` as is.
+    fn sendAll(self: *TxQueue, data: []const u8) bool {
+        if (self.port.pacer != null) {
+            self.port.writeAll(data) catch return false;
+            return true;
+        }
+        var written: usize = 0;
+        while (written < data.len) {
+            written += self.port.write(data[written..]) catch |err| switch (err) {
+                Port.Error.WouldBlock => {
+                    // Also how `destroy` stops a worker held off by the peer
+                    if (!self.isRunning()) return false;
+                    _ = self.port.waitWritable(WRITABLE_POLL_MS);
+                    continue;
+                },
+                else => return false,
+            };
+        }
+        return true;
+    }
+};
+
+const Recorder = struct {
+    events: [8]TxQueue.Event = undefined,
+    count: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    fn record(event: TxQueue.Event, context: ?*anyopaque) callconv(.c) void {
+        const self: *Recorder = @ptrCast(@alignCast(context.?));
+        const i = self.count.load(.monotonic);
+        self.events[i] = event;
+        self.count.store(i + 1, .release);
+    }
+};
+
+test "messages go out in order with accepted and drained notices" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    var port = Port.fromFdForTesting(fds[1], .{});
+    defer port.close();
+
+    const queue = try TxQueue.create(std.testing.allocator, &port);
+    var first = Recorder{};
+    var second = Recorder{};
+    try queue.write("hello ", true, Recorder.record, &first);
+    try queue.write("async", false, Recorder.record, &second);
+
+    var buf: [11]u8 = undefined;
+    var got: usize = 0;
+    while (got < buf.len) got += try std.posix.read(fds[0], buf[got..]);
+    try std.testing.expectEqualStrings("hello async", &buf);
+    while (first.count.load(.acquire) < 2 or second.count.load(.acquire) < 1) std.Thread.sleep(std.time.ns_per_ms);
+    queue.destroy();
+
+    try std.testing.expectEqual(TxQueue.Event.accepted, first.events[0]);
+    try std.testing.expectEqual(TxQueue.Event.drained, first.events[1]);
+    try std.testing.expectEqual(@as(usize, 1), second.count.load(.acquire));
+}
+
+test "large messages stay whole on a non-blocking port" {
+    const allocator = std.testing.allocator;
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    var port = Port.fromFdForTesting(fds[1], .{});
+    defer port.close();
+    // The pipe fills long before a message is through
+    port.setNonBlocking(true);
+
+    const queue = try TxQueue.create(allocator, &port);
+    defer queue.destroy();
+
+    const size = TxQueue.CAPACITY * 2 + 100;
+    const Writer = struct {
+        fn run(q: *TxQueue, data: []const u8, recorder: *Recorder) void {
+            q.write(data, false, Recorder.record, recorder) catch {};
+        }
+    };
+    const a = try allocator.alloc(u8, size);
+    defer allocator.free(a);
+    @memset(a, 'a');
+    const b = try allocator.alloc(u8, size);
+    defer allocator.free(b);
+    @memset(b, 'b');
+    var recorders = [_]Recorder{.{}} ** 2;
+    const threads = [_]std.Thread{
+        try std.Thread.spawn(.{}, Writer.run, .{ queue, a, &recorders[0] }),
+        try std.Thread.spawn(.{}, Writer.run, .{ queue, b, &recorders[1] }),
+    };
+
+    const received = try allocator.alloc(u8, size * 2);
+    defer allocator.free(received);
+    var got: usize = 0;
+    while (got < received.len) got += try std.posix.read(fds[0], received[got..]);
+    for (threads) |t| t.join();
+
+    // One message after the other, each in one piece
+    const first = received[0];
+    try std.testing.expect(std.mem.allEqual(u8, received[0..size], first));
+    try std.testing.expect(std.mem.allEqual(u8, received[size..], if (first == 'a') 'b' else 'a'));
+    for (&recorders) |*recorder| {
+        while (recorder.count.load(.acquire) < 1) std.Thread.sleep(std.time.ns_per_ms);
+        try std.testing.expectEqual(TxQueue.Event.accepted, recorder.events[0]);
+    }
+}
+
+test "closing a port does not hang on a writer paused by XOFF" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    var port = Port.fromFdForTesting(fds[1], .{ .flow_control = .software_userspace });
+
+    // The peer stops our output and never resumes it
+    var xoff = [_]u8{@import("SoftFlow.zig").SoftFlow.XOFF};
+    _ = port.flow.receive(port.fd, &xoff);
+
+    const queue = try TxQueue.create(std.testing.allocator, &port);
+    port.tx_queue = queue;
+    var recorder = Recorder{};
+    try queue.write("held", false, Recorder.record, &recorder);
+    // Let the worker reach the wait
+    std.Thread.sleep(20 * std.time.ns_per_ms);
+
+    port.close();
+    try std.testing.expectEqual(@as(usize, 1), recorder.count.load(.acquire));
+    try std.testing.expectEqual(TxQueue.Event.failed, recorder.events[0]);
+}
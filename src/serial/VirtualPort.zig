@@ -0,0 +1,516 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const Port = @import("Port.zig").Port;
+const Config = @import("Config.zig").Config;
+const clock = @import("clock.zig");
+
+/// posix_openpt and friends are XSI; glibc hides them by default
+const c = if (builtin.os.tag == .linux) @cImport({
+    @cDefine("_GNU_SOURCE", {});
+    @cInclude("stdlib.h");
+    @cInclude("fcntl.h");
+}) else @cImport({
+    @cInclude("stdlib.h");
+    @cInclude("fcntl.h");
+});
+
+/// Keeps the wire thread alive when a port closes its end of a socket
+const SEND_FLAGS: u32 = if (builtin.os.tag == .linux) std.posix.MSG.NOSIGNAL else 0;
+
+/// Two connected serial ports without hardware, for tests and
+/// benchmarks.
+///
+/// Each end is an ordinary `Port` on a real descriptor, so poll loops,
+/// hubs and expect sessions work unchanged. A wire thread moves bytes
+/// between the ends through a FIFO of `fifo_depth` bytes per direction,
+/// pacing them to the configured line rate and injecting errors on the
+/// way. DTR/RTS are wired null-modem style (DTR to DSR/DCD, RTS to CTS)
+/// and show up in the peer's counters, as TIOCGICOUNT would report them.
+///
+/// In `.memory` mode the ends are socket pairs. In `.pty` mode they are
+/// pseudo-terminal slaves opened with `Port.open`, so the full open and
+/// termios path runs as it would on a USB adapter.
+///
+/// The pair lives until its creator and both ports have released it.
+pub const VirtualPort = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    /// Time one character occupies the line; 0 when unpaced
+    ns_per_char: u64,
+    endpoints: [2]Endpoint,
+    /// [0] carries a to b, [1] b to a
+    directions: [2]Direction,
+    /// Guards endpoint line state and counters
+    mutex: std.Thread.Mutex = .{},
+    refs: std.atomic.Value(u32) = std.atomic.Value(u32).init(1),
+    prng: std.Random.DefaultPrng,
+    thread: ?std.Thread = null,
+    /// Written on destroy to stop the wire thread
+    wake: [2]std.posix.fd_t = .{ -1, -1 },
+
+    pub const Mode = enum { memory, pty };
+
+    pub const Options = struct {
+        mode: Mode = .memory,
+        /// Paces each direction to this line rate; 0 delivers at once
+        baud: u32 = 0,
+        /// Start + data + parity + stop bits per character
+        char_bits: u8 = 10,
+        /// Bytes in flight per direction before the sender is held off
+        fifo_depth: usize = 4096,
+        /// Flips a bit in one byte in this many (a parity error); 0 = never
+        corrupt_one_in: u32 = 0,
+        /// Loses one byte in this many (an overrun); 0 = never
+        drop_one_in: u32 = 0,
+        seed: u64 = 0,
+    };
+
+    pub const Error = error{ OpenFailed, OutOfMemory, SystemResources };
+
+    const DTR: u8 = 1;
+    const RTS: u8 = 2;
+
+    /// Upper bound on one waitModemChange, so callers recheck for stops
+    const WAIT_NS = 100 * std.time.ns_per_ms;
+
+    /// One side of the pair, as seen by its Port
+    pub const Endpoint = struct {
+        pair: *VirtualPort,
+        peer: *Endpoint,
+        /// Descriptor handed to the Port (memory mode, until opened)
+        fd: std.posix.fd_t = -1,
+        /// Descriptor the wire thread moves bytes through
+        wire_fd: std.posix.fd_t = -1,
+        /// Pty mode: slave descriptor held open so the master never hangs up
+        hold_fd: std.posix.fd_t = -1,
+        path_buf: [64]u8 = undefined,
+        path_len: usize = 0,
+        /// Own DTR/RTS outputs
+        lines: u8 = 0,
+        counters: Port.Counters = .{},
+        /// Bumped whenever the peer changes a line this end sees
+        line_seq: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+
+        pub fn path(self: *const Endpoint) []const u8 {
+            return self.path_buf[0..self.path_len];
+        }
+
+        /// Drives DTR/RTS (null leaves a line unchanged)
+        pub fn setLines(self: *Endpoint, dtr: ?bool, rts: ?bool) void {
+            self.pair.mutex.lock();
+            defer self.pair.mutex.unlock();
+            var lines = self.lines;
+            if (dtr) |state| lines = if (state) lines | DTR else lines & ~DTR;
+            if (rts) |state| lines = if (state) lines | RTS else lines & ~RTS;
+            const changed = lines ^ self.lines;
+            self.lines = lines;
+            if (changed == 0) return;
+
+            if (changed & DTR != 0) {
+                self.peer.counters.dsr +%= 1;
+                self.peer.counters.dcd +%= 1;
+            }
+            if (changed & RTS != 0) self.peer.counters.cts +%= 1;
+            _ = self.peer.line_seq.fetchAdd(1, .release);
+            std.Thread.Futex.wake(&self.peer.line_seq, std.math.maxInt(u32));
+        }
+
+        pub fn modemStatus(self: *Endpoint) Port.ModemStatus {
+            self.pair.mutex.lock();
+            defer self.pair.mutex.unlock();
+            return .{
+                .dtr = self.lines & DTR != 0,
+                .rts = self.lines & RTS != 0,
+                .cts = self.peer.lines & RTS != 0,
+                .dsr = self.peer.lines & DTR != 0,
+                .dcd = self.peer.lines & DTR != 0,
+            };
+        }
+
+        pub fn getCounters(self: *Endpoint) Port.Counters {
+            self.pair.mutex.lock();
+            defer self.pair.mutex.unlock();
+            return self.counters;
+        }
+
+        /// Blocks until the peer changes a line, up to `WAIT_NS`
+        pub fn waitModemChange(self: *Endpoint) bool {
+            const seq = self.line_seq.load(.acquire);
+            std.Thread.Futex.timedWait(&self.line_seq, seq, WAIT_NS) catch {};
+            return self.line_seq.load(.acquire) != seq;
+        }
+
+        /// Delivers a break to the peer
+        pub fn sendBreak(self: *Endpoint) void {
+            self.pair.mutex.lock();
+            defer self.pair.mutex.unlock();
+            self.peer.counters.brk +%= 1;
+        }
+
+        /// Bytes written by this end that are still on the wire
+        pub fn outputQueued(self: *const Endpoint) usize {
+            const index: usize = if (self == &self.pair.endpoints[0]) 0 else 1;
+            return self.pair.directions[index].queued.load(.monotonic);
+        }
+    };
+
+    const Direction = struct {
+        ring: []u8,
+        head: usize = 0,
+        len: usize = 0,
+        /// `len`, readable from other threads
+        queued: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+        /// When the next character finishes crossing the line
+        next_due_ns: u64 = 0,
+        /// Destination would block; wait for it to drain
+        blocked: bool = false,
+    };
+
+    pub fn create(allocator: std.mem.Allocator, options: Options) Error!*VirtualPort {
+        const depth = @max(options.fifo_depth, 1);
+        const rings = try allocator.alloc(u8, 2 * depth);
+        errdefer allocator.free(rings);
+        const self = try allocator.create(VirtualPort);
+        errdefer allocator.destroy(self);
+
+        const char_bits: u64 = @max(options.char_bits, 1);
+        self.* = .{
+            .allocator = allocator,
+            .options = options,
+            .ns_per_char = if (options.baud == 0) 0 else char_bits * std.time.ns_per_s / options.baud,
+            .endpoints = .{
+                .{ .pair = self, .peer = &self.endpoints[1] },
+                .{ .pair = self, .peer = &self.endpoints[0] },
+            },
+            .directions = .{
+                .{ .ring = rings[0..depth] },
+                .{ .ring = rings[depth..] },
+            },
+            .prng = std.Random.DefaultPrng.init(options.seed),
+        };
+        errdefer self.closeDescriptors();
+
+        for (&self.endpoints, 0..) |*endpoint, i| {
+            switch (options.mode) {
+                .memory => try openSocketEnd(endpoint, i),
+                .pty => try openPtyEnd(endpoint),
+            }
+            setNonBlocking(endpoint.wire_fd);
+        }
+        self.wake = std.posix.pipe() catch return Error.SystemResources;
+        self.thread = std.Thread.spawn(.{}, run, .{self}) catch return Error.SystemResources;
+        return self;
+    }
+
+    /// Opens both ends as ports; each holds the pair until it is closed
+    pub fn open(self: *VirtualPort, config: Config) Port.Error![2]Port {
+        var a = try self.openEnd(&self.endpoints[0], config);
+        errdefer a.close();
+        const b = try self.openEnd(&self.endpoints[1], config);
+        return .{ a, b };
+    }
+
+    fn openEnd(self: *VirtualPort, endpoint: *Endpoint, config: Config) Port.Error!Port {
+        var p: Port = switch (self.options.mode) {
+            .memory => blk: {
+                if (endpoint.fd < 0) return Port.Error.OpenFailed;
+                defer endpoint.fd = -1;
+                break :blk .{ .fd = endpoint.fd, .path = endpoint.path(), .original_termios = null, .config = config };
+            },
+            .pty => try Port.open(endpoint.path(), config),
+        };
+        p.virtual = endpoint;
+        _ = self.refs.fetchAdd(1, .monotonic);
+        return p;
+    }
+
+    /// Drops a reference; the last one stops the wire and frees the pair
+    pub fn release(self: *VirtualPort) void {
+        if (self.refs.fetchSub(1, .acq_rel) != 1) return;
+        if (self.thread) |t| {
+            _ = std.posix.write(self.wake[1], "x") catch {};
+            t.join();
+        }
+        self.closeDescriptors();
+        self.allocator.free(self.directions[0].ring.ptr[0 .. 2 * self.directions[0].ring.len]);
+        self.allocator.destroy(self);
+    }
+
+    fn closeDescriptors(self: *VirtualPort) void {
+        for (&self.endpoints) |*endpoint| {
+            for ([_]*std.posix.fd_t{ &endpoint.fd, &endpoint.wire_fd, &endpoint.hold_fd }) |fd| {
+                if (fd.* >= 0) std.posix.close(fd.*);
+                fd.* = -1;
+            }
+        }
+        for (&self.wake) |*fd| {
+            if (fd.* >= 0) std.posix.close(fd.*);
+            fd.* = -1;
+        }
+    }
+
+    fn openSocketEnd(endpoint: *Endpoint, index: usize) Error!void {
+        var fds: [2]std.posix.fd_t = undefined;
+        if (std.c.socketpair(std.posix.AF.UNIX, std.posix.SOCK.STREAM, 0, &fds) != 0) return Error.SystemResources;
+        endpoint.fd = fds[0];
+        endpoint.wire_fd = fds[1];
+        if (builtin.os.tag == .macos) {
+            // No MSG_NOSIGNAL on macOS
+            const one = std.mem.toBytes(@as(c_int, 1));
+            std.posix.setsockopt(endpoint.wire_fd, std.posix.SOL.SOCKET, std.posix.SO.NOSIGPIPE, &one) catch {};
+        }
+        const name = if (index == 0) "virtual:a" else "virtual:b";
+        @memcpy(endpoint.path_buf[0..name.len], name);
+        endpoint.path_len = name.len;
+    }
+
+    /// ptsname is not reentrant
+    var ptsname_mutex: std.Thread.Mutex = .{};
+
+    fn openPtyEnd(endpoint: *Endpoint) Error!void {
+        const master = c.posix_openpt(c.O_RDWR | c.O_NOCTTY);
+        if (master < 0) return Error.OpenFailed;
+        endpoint.wire_fd = master;
+        if (c.grantpt(master) != 0 or c.unlockpt(master) != 0) return Error.OpenFailed;
+
+        ptsname_mutex.lock();
+        defer ptsname_mutex.unlock();
+        const raw = c.ptsname(master);
+        if (raw == null) return Error.OpenFailed;
+        const name = std.mem.span(@as([*:0]const u8, @ptrCast(raw)));
+        if (name.len > endpoint.path_buf.len) return Error.OpenFailed;
+        @memcpy(endpoint.path_buf[0..name.len], name);
+        endpoint.path_len = name.len;
+        endpoint.hold_fd = std.posix.open(endpoint.path(), .{ .ACCMODE = .RDWR, .NOCTTY = true }, 0) catch return Error.OpenFailed;
+    }
+
+    fn setNonBlocking(fd: std.posix.fd_t) void {
+        const flags = std.posix.fcntl(fd, c.F_GETFL, 0) catch return;
+        _ = std.posix.fcntl(fd, c.F_SETFL, flags | @as(usize, c.O_NONBLOCK)) catch {};
+    }
+
+    fn run(self: *VirtualPort) void {
+        const POLL = std.posix.POLL;
+        // Ends whose writer is still there
+        var readable = [2]bool{ true, true };
+
+        while (true) {
+            var fds: [3]std.posix.pollfd = undefined;
+            fds[0] = .{ .fd = self.wake[0], .events = POLL.IN, .revents = 0 };
+            for (0..2) |i| {
+                var events: i16 = 0;
+                if (readable[i] and self.directions[i].len < self.directions[i].ring.len) events |= POLL.IN;
+                if (self.directions[1 - i].blocked) events |= POLL.OUT;
+                fds[1 + i] = .{ .fd = if (events == 0) -1 else self.endpoints[i].wire_fd, .events = events, .revents = 0 };
+            }
+
+            _ = std.posix.poll(&fds, self.pollTimeout(clock.now())) catch return;
+            if (fds[0].revents != 0) return;
+
+            for (0..2) |i| {
+                const revents = fds[1 + i].revents;
+                if (fds[1 + i].events & POLL.IN != 0 and revents & (POLL.IN | POLL.HUP | POLL.ERR) != 0) {
+                    readable[i] = self.fill(i);
+                }
+                if (revents & (POLL.OUT | POLL.ERR | POLL.HUP) != 0) self.directions[1 - i].blocked = false;
+            }
+            const now = clock.now();
+            self.deliver(0, now);
+            self.deliver(1, now);
+        }
+    }
+
+    /// Milliseconds until the next paced character is due; -1 if none
+    fn pollTimeout(self: *VirtualPort, now: u64) i32 {
+        var timeout: i32 = -1;
+        for (&self.directions) |*dir| {
+            if (dir.len == 0 or dir.blocked or self.ns_per_char == 0) continue;
+            const wait_ns = dir.next_due_ns -| now;
+            const ms: i32 = @intCast(@min((wait_ns + std.time.ns_per_ms - 1) / std.time.ns_per_ms, std.math.maxInt(i32)));
+            if (timeout < 0 or ms < timeout) timeout = ms;
+        }
+        return timeout;
+    }
+
+    /// Takes what end `i` wrote into its FIFO. False once the end is gone.
+    fn fill(self: *VirtualPort, i: usize) bool {
+        const dir = &self.directions[i];
+        const tail = (dir.head + dir.len) % dir.ring.len;
+        const room = @min(dir.ring.len - dir.len, dir.ring.len - tail);
+        const n = std.posix.read(self.endpoints[i].wire_fd, dir.ring[tail..][0..room]) catch |err| return err == error.WouldBlock;
+        if (n == 0) return false;
+
+        self.mutex.lock();
+        self.endpoints[i].counters.tx +%= @as(u32, @truncate(n));
+        self.mutex.unlock();
+
+        const kept = self.inject(1 - i, dir.ring[tail..][0..n]);
+        // An idle line starts clocking out the first character now
+        if (dir.len == 0 and self.ns_per_char != 0) dir.next_due_ns = clock.now() + self.ns_per_char;
+        dir.len += kept;
+        dir.queued.store(dir.len, .monotonic);
+        return true;
+    }
+
+    /// Applies the configured drops and bit flips to bytes bound for end
+    /// `dst`, compacting in place; returns how many bytes remain
+    fn inject(self: *VirtualPort, dst: usize, bytes: []u8) usize {
+        if (self.options.corrupt_one_in == 0 and self.options.drop_one_in == 0) return bytes.len;
+        const random = self.prng.random();
+        var kept: usize = 0;
+        var dropped: u32 = 0;
+        var corrupted: u32 = 0;
+        for (bytes) |byte| {
+            if (self.options.drop_one_in != 0 and random.uintLessThan(u32, self.options.drop_one_in) == 0) {
+                dropped += 1;
+                continue;
+            }
+            var out = byte;
+            if (self.options.corrupt_one_in != 0 and random.uintLessThan(u32, self.options.corrupt_one_in) == 0) {
+                out ^= @as(u8, 1) << random.int(u3);
+                corrupted += 1;
+            }
+            bytes[kept] = out;
+            kept += 1;
+        }
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.endpoints[dst].counters.overrun +%= dropped;
+        self.endpoints[dst].counters.parity +%= corrupted;
+        return kept;
+    }
+
+    /// Hands the characters that have crossed the line to the other end
+    fn deliver(self: *VirtualPort, i: usize, now: u64) void {
+        const dir = &self.directions[i];
+        const dst = &self.endpoints[1 - i];
+        while (dir.len > 0 and !dir.blocked) {
+            var due = dir.len;
+            if (self.ns_per_char != 0) {
+                if (now < dir.next_due_ns) return;
+                due = @min(due, @as(usize, @intCast(1 + (now - dir.next_due_ns) / self.ns_per_char)));
+            }
+            const chunk = dir.ring[dir.head..][0..@min(due, dir.ring.len - dir.head)];
+
+            const result = switch (self.options.mode) {
+                .memory => std.posix.send(dst.wire_fd, chunk, SEND_FLAGS),
+                .pty => std.posix.write(dst.wire_fd, chunk),
+            };
+            const sent = result catch |err| switch (err) {
+                error.WouldBlock => 0,
+                // Nobody on the other end: the bytes fall off the wire
+                else => chunk.len,
+            };
+            if (sent < chunk.len) dir.blocked = true;
+
+            dir.head = (dir.head + sent) % dir.ring.len;
+            dir.len -= sent;
+            dir.queued.store(dir.len, .monotonic);
+            if (self.ns_per_char != 0) dir.next_due_ns += @as(u64, sent) * self.ns_per_char;
+
+            self.mutex.lock();
+            dst.counters.rx +%= @as(u32, @truncate(sent));
+            self.mutex.unlock();
+        }
+    }
+};
+
+fn readExactly(port: *Port, out: []u8) !void {
+    var got: usize = 0;
+    while (got < out.len) {
+        if (!port.waitForData(2000)) return error.Timeout;
+        got += try port.read(out[got..]);
+    }
+}
+
+test "memory pair carries data both ways and wires modem lines" {
+    const pair = try VirtualPort.create(std.testing.allocator, .{});
+    var ports = try pair.open(.{});
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    try ports[0].writeAll("ping");
+    var buf: [4]u8 = undefined;
+    try readExactly(&ports[1], &buf);
+    try std.testing.expectEqualStrings("ping", &buf);
+
+    try ports[1].writeAll("pong");
+    try readExactly(&ports[0], &buf);
+    try std.testing.expectEqualStrings("pong", &buf);
+
+    ports[0].setDTR(true);
+    ports[0].setRTS(true);
+    const status = ports[1].getModemStatus();
+    try std.testing.expect(status.dsr and status.dcd and status.cts);
+    try std.testing.expect(!ports[0].getModemStatus().cts);
+    const counters = ports[1].getCounters().?;
+    try std.testing.expectEqual(@as(u32, 1), counters.dsr);
+    try std.testing.expectEqual(@as(u32, 1), counters.cts);
+    try std.testing.expectEqual(@as(u32, 4), counters.rx);
+}
+
+test "injected drops are counted at the receiving end" {
+    const pair = try VirtualPort.create(std.testing.allocator, .{ .drop_one_in = 1 });
+    var ports = try pair.open(.{});
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    // Every byte is dropped, so none arrive but all are counted
+    try ports[0].writeAll("lost");
+    try std.testing.expect(!ports[1].waitForData(50));
+    try std.testing.expectEqual(@as(u32, 4), ports[1].getCounters().?.overrun);
+}
+
+test "paced pair delivers no faster than the baud rate" {
+    // 9600 baud, 10 bits a character: 960 characters a second
+    const pair = try VirtualPort.create(std.testing.allocator, .{ .baud = 9600 });
+    var ports = try pair.open(.{});
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    var data: [96]u8 = undefined;
+    @memset(&data, 'x');
+    const start = clock.now();
+    try ports[0].writeAll(&data);
+    var out: [96]u8 = undefined;
+    try readExactly(&ports[1], &out);
+    // 96 characters at 960/s is 100 ms; allow for timer granularity
+    try std.testing.expect(clock.now() - start >= 90 * std.time.ns_per_ms);
+}
+
+test "pty pair opens real terminals" {
+    const pair = VirtualPort.create(std.testing.allocator, .{ .mode = .pty }) catch return error.SkipZigTest;
+    var ports = pair.open(.{}) catch {
+        pair.release();
+        return error.SkipZigTest;
+    };
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    try std.testing.expect(std.posix.isatty(ports[0].fd));
+    try ports[0].writeAll("tty");
+    var buf: [3]u8 = undefined;
+    try readExactly(&ports[1], &buf);
+    try std.testing.expectEqualStrings("tty", &buf);
+}
+
+test "reconfigure switches framing in place" {
+    const pair = VirtualPort.create(std.testing.allocator, .{ .mode = .pty }) catch return error.SkipZigTest;
+    var ports = pair.open(.{}) catch {
+        pair.release();
+        return error.SkipZigTest;
+    };
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    try ports[0].reconfigure(.{ .baud_rate = .B921600, .parity = .even }, .drain);
+    const termios = try std.posix.tcgetattr(ports[0].fd);
+    try std.testing.expect(termios.cflag.PARENB);
+    try std.testing.expect(!termios.cflag.PARODD);
+    try std.testing.expectEqual(Config.BaudRate.B921600, ports[0].config.baud_rate);
+
+    try ports[0].writeAll("alive");
+    var buf: [5]u8 = undefined;
+    try readExactly(&ports[1], &buf);
+    try std.testing.expectEqualStrings("alive", &buf);
+}
@@ -0,0 +1,221 @@
+//! Baud-rate detection for boards of unknown speed.
+//!
+//! Cycles the port through candidate rates with `Port.reconfigure`,
+//! samples what arrives in a short window at each, and scores the sample:
+//! right-rate text is mostly printable, comes in lines and matches known
+//! banners, while a wrong rate yields control bytes and framing errors.
+//! A UART receives at one rate at a time, so candidates are tried one
+//! after another, most common first, stopping at the first convincing one.
+
+const std = @import("std");
+const Config = @import("Config.zig").Config;
+const Port = @import("Port.zig").Port;
+const clock = @import("clock.zig");
+
+pub const Error = error{NotDetected} || Port.Error;
+
+/// Most common console rates first, so typical boards settle early
+pub const default_candidates = [_]Config.BaudRate{
+    .B115200, .B9600,   .B57600, .B38400, .B19200, .B230400,
+    .B460800, .B921600, .B4800,  .B2400,  .B1200,
+};
+
+/// Prompts and boot banners that settle a candidate on their own
+pub const default_banners = [_][]const u8{
+    "U-Boot", "login:", "Password:", "BusyBox", "Linux version", "=> ", "OK\r\n",
+};
+
+pub const Options = struct {
+    candidates: []const Config.BaudRate = &default_candidates,
+    /// Sampling time per candidate
+    window_ms: u32 = 50,
+    /// Hold a break this long before each window (0 = none); many
+    /// bootloaders and consoles answer a break with their prompt
+    break_ms: u32 = 0,
+    /// Sent before each window to provoke output, e.g. "\r"
+    poke: []const u8 = "",
+    banners: []const []const u8 = &default_banners,
+    /// Stop at the first candidate scoring this much
+    accept_score: f32 = 1.0,
+    /// Below this nothing counts as detected
+    min_score: f32 = 0.5,
+};
+
+pub const Result = struct {
+    config: Config,
+    score: f32,
+    /// Bytes sampled at the chosen rate
+    bytes: usize,
+};
+
+/// Finds the rate the peer is sending at and leaves the port configured
+/// for it. The other settings are kept from the current config. On
+/// failure the port goes back to its original rate.
+pub fn detect(port: *Port, options: Options) Error!Result {
+    const original = port.config;
+    var best: ?Result = null;
+    var sample: [1024]u8 = undefined;
+
+    for (options.candidates) |rate| {
+        var candidate = original;
+        candidate.baud_rate = rate;
+        try port.reconfigure(candidate, .now);
+        port.flushInput();
+        const before = port.getCounters();
+
+        if (options.break_ms != 0) {
+            port.setBreak(true);
+            std.Thread.sleep(@as(u64, options.break_ms) * std.time.ns_per_ms);
+            port.setBreak(false);
+        }
+        if (options.poke.len > 0) try port.writeAll(options.poke);
+
+        const len = collect(port, &sample, options.window_ms);
+        const errors = lineErrors(before, port.getCounters());
+        const value = score(sample[0..len], errors, options.banners);
+        if (best == null or value > best.?.score) {
+            best = .{ .config = candidate, .score = value, .bytes = len };
+        }
+        if (value >= options.accept_score) break;
+    }
+
+    if (best) |found| {
+        if (found.score >= options.min_score) {
+            try port.reconfigure(found.config, .now);
+            return found;
+        }
+    }
+    port.reconfigure(original, .now) catch {};
+    return Error.NotDetected;
+}
+
+/// Rates a sample taken at one candidate rate: roughly 0 for noise, up
+/// to about 1 for clean text, more once a banner matches
+pub fn score(sample: []const u8, line_errors: u64, banners: []const []const u8) f32 {
+    if (sample.len == 0) return 0;
+
+    var text: usize = 0;
+    var newlines: usize = 0;
+    for (sample) |byte| {
+        switch (byte) {
+            '\r', '\n' => {
+                text += 1;
+                newlines += 1;
+            },
+            '\t', 0x20...0x7E => text += 1,
+            else => {},
+        }
+    }
+    const len: f32 = @floatFromInt(sample.len);
+    var value = @as(f32, @floatFromInt(text)) / len;
+
+    // A wrong rate also shows up as framing and parity errors
+    value -= @min(1.0, 4.0 * @as(f32, @floatFromInt(line_errors)) / len);
+    // Console output comes in lines of plausible length
+    if (newlines > 0 and sample.len / newlines <= 160) value += 0.2;
+    // A few bytes are weak evidence either way
+    value *= @min(1.0, len / 16.0);
+
+    for (banners) |banner| {
+        if (std.mem.indexOf(u8, sample, banner) != null) {
+            value += 1.0;
+            break;
+        }
+    }
+    return @max(value, 0);
+}
+
+/// Reads for `window_ms` or until `buffer` is full
+fn collect(port: *Port, buffer: []u8, window_ms: u32) usize {
+    const deadline = clock.now() + @as(u64, window_ms) * std.time.ns_per_ms;
+    var len: usize = 0;
+    while (len < buffer.len) {
+        const now = clock.now();
+        if (now >= deadline) break;
+        const remaining: u32 = @intCast(@max(1, (deadline - now) / std.time.ns_per_ms));
+        if (!port.waitForData(remaining)) continue;
+        len += port.read(buffer[len..]) catch |err| switch (err) {
+            Port.Error.WouldBlock => continue,
+            else => break,
+        };
+    }
+    return len;
+}
+
+fn lineErrors(before: ?Port.Counters, after: ?Port.Counters) u64 {
+    const start = before orelse return 0;
+    const delta = (after orelse return 0).since(start);
+    return @as(u64, delta.frame) + delta.parity + delta.brk;
+}
+
+test "text outscores line noise" {
+    const banners = [_][]const u8{};
+    const text = score("Booting kernel...\r\nStarting init\r\n", 0, &banners);
+    const noise = score("\x00\xf0\x80\xfe\x1c\x00\xe0\x80\xf8\x00\x8c\x00\xf0\xff\x80\x00", 6, &banners);
+    try std.testing.expect(text > 1.0);
+    try std.testing.expect(noise < 0.5);
+    try std.testing.expectEqual(@as(f32, 0), score("", 0, &banners));
+}
+
+/// Test peer that only makes sense at `rate`. Each poke opens the next
+/// candidate's window: it answers with its banner when that candidate is
+/// its rate and with line noise otherwise, like a UART read at the wrong
+/// speed. Answering pokes keeps every reply inside its own window.
+const Board = struct {
+    port: *Port,
+    rate: Config.BaudRate,
+    candidates: []const Config.BaudRate = &default_candidates,
+    pokes: usize = 0,
+    stop: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    fn run(self: *Board) void {
+        var buf: [16]u8 = undefined;
+        while (!self.stop.load(.acquire)) {
+            if (!self.port.waitForData(10)) continue;
+            const n = self.port.read(&buf) catch return;
+            for (buf[0..n]) |byte| {
+                if (byte != '\r') continue;
+                const rate = self.candidates[@min(self.pokes, self.candidates.len - 1)];
+                self.pokes += 1;
+                const reply = if (rate == self.rate) "U-Boot 2024.01\r\n=> " else "\x00\xf0\x80\xfe\x1c\x00\xe0\x80\xf8\x00\x8c\x00\xf0\xff\x80\x00";
+                self.port.writeAll(reply) catch return;
+            }
+        }
+    }
+};
+
+fn detectAgainst(rate: Config.BaudRate) !struct { result: Result, pokes: usize } {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = try VirtualPort.create(std.testing.allocator, .{});
+    var ports = pair.open(.{ .baud_rate = .B9600 }) catch |err| {
+        pair.release();
+        return err;
+    };
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    var board = Board{ .port = &ports[1], .rate = rate };
+    const thread = try std.Thread.spawn(.{}, Board.run, .{&board});
+    const result = detect(&ports[0], .{ .poke = "\r" });
+    board.stop.store(true, .release);
+    thread.join();
+
+    const found = try result;
+    try std.testing.expectEqual(found.config.baud_rate, ports[0].config.baud_rate);
+    return .{ .result = found, .pokes = board.pokes };
+}
+
+test "a banner settles the first candidate" {
+    const outcome = try detectAgainst(.B115200);
+    try std.testing.expectEqual(Config.BaudRate.B115200, outcome.result.config.baud_rate);
+    try std.testing.expect(outcome.result.score >= 1.0);
+    try std.testing.expectEqual(@as(usize, 1), outcome.pokes);
+}
+
+test "noise at the common rates does not stop the search" {
+    // Third candidate: the first two windows see only noise
+    const outcome = try detectAgainst(.B57600);
+    try std.testing.expectEqual(Config.BaudRate.B57600, outcome.result.config.baud_rate);
+    try std.testing.expect(outcome.result.score >= 1.0);
+    try std.testing.expectEqual(@as(usize, 3), outcome.pokes);
+}
@@ -1,13 +1,81 @@
 const std = @import("std");
 const Port = @import("Port.zig").Port;
 const Config = @import("Config.zig").Config;
+const Hub = @import("Hub.zig").Hub;
+const Expect = @import("Expect.zig").Expect;
+const Sequencer = @import("Sequencer.zig").Sequencer;
+const LineWatcher = @import("LineWatcher.zig").LineWatcher;
+const Registry = @import("Registry.zig").Registry;
+const PortInfo = @import("PortInfo.zig").PortInfo;
+const HandleTable = @import("HandleTable.zig").HandleTable;
+const CountingAllocator = @import("CountingAllocator.zig").CountingAllocator;
+const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+const Pacer = @import("Pacer.zig").Pacer;
+const Supervisor = @import("Supervisor.zig").Supervisor;
+const TxQueue = @import("TxQueue.zig").TxQueue;
+const Framer = @import("Framer.zig").Framer;
+const trace = @import("trace");
 
 // Re-export modules for internal use
 pub const port = @import("Port.zig");
 pub const config = @import("Config.zig");
+pub const scan = @import("scan.zig");
+pub const hub = @import("Hub.zig");
+pub const expect = @import("Expect.zig");
+pub const aho_corasick = @import("AhoCorasick.zig");
+pub const regex = @import("regex.zig");
+pub const sequencer = @import("Sequencer.zig");
+pub const line_watcher = @import("LineWatcher.zig");
+pub const mark_decoder = @import("MarkDecoder.zig");
+pub const stats = @import("Stats.zig");
+pub const clock = @import("clock.zig");
+pub const metrics = @import("metrics.zig");
+pub const registry = @import("Registry.zig");
+pub const port_info = @import("PortInfo.zig");
+pub const handle_table = @import("HandleTable.zig");
+pub const counting_allocator = @import("CountingAllocator.zig");
+pub const virtual_port = @import("VirtualPort.zig");
+pub const pacer = @import("Pacer.zig");
+pub const soft_flow = @import("SoftFlow.zig");
+pub const autobaud = @import("autobaud.zig");
+pub const supervisor = @import("Supervisor.zig");
+pub const tx_queue = @import("TxQueue.zig");
+pub const framer = @import("Framer.zig");
+pub const modbus = @import("modbus.zig");
+pub const nmea = @import("nmea.zig");
 
-/// Opaque handle to a serial port
-pub const SerialPortHandle = *Port;
+/// Generation-checked port handle (index + generation); 0 is never valid
+pub const SerialPortHandle = u32;
+
+/// Opaque handle to a shared-port hub
+pub const SerialHubHandle = *HubSession;
+
+/// Opaque handle to a hub consumer
+pub const SerialConsumerHandle = *Hub.Consumer;
+
+/// Opaque handle to an expect session
+pub const SerialExpectHandle = *ExpectSession;
+
+/// Opaque handle to a modem-line watcher
+pub const SerialLineWatcherHandle = *LineWatchSession;
+
+/// Opaque handle to a hotplug-tracking port registry
+pub const SerialRegistryHandle = *Registry;
+
+/// Opaque handle to a reconnect supervisor
+pub const SerialSupervisorHandle = *SupervisorSession;
+
+/// Opaque handle to a frame decoder
+pub const SerialFramerHandle = *Framer;
+
+/// Opaque handle to a Modbus RTU master
+pub const SerialModbusHandle = *ModbusSession;
+
+/// Opaque handle to a Modbus RTU bus monitor
+pub const SerialModbusSnifferHandle = *SnifferSession;
+
+/// Opaque handle to an NMEA decoder
+pub const SerialNmeaHandle = *nmea.Decoder;
 
 /// Error codes for C API
 pub const SerialError = enum(c_int) {
@@ -22,6 +90,16 @@ pub const SerialError = enum(c_int) {
     port_closed = -8,
     invalid_handle = -9,
     out_of_memory = -10,
+    disconnected = -11,
+    too_many_consumers = -12,
+    invalid_pattern = -13,
+    line_control_failed = -14,
+    not_found = -15,
+    too_many_ports = -16,
+    allocator_in_use = -17,
+    reconnected = -18,
+    frame_too_large = -19,
+    bad_frame = -20,
 };
 
 /// Serial port configuration for C API
@@ -30,9 +108,10 @@ pub const SerialConfig = extern struct {
     data_bits: u8 = 8,
     parity: u8 = 0, // 0=none, 1=odd, 2=even
     stop_bits: u8 = 1,
-    flow_control: u8 = 0, // 0=none, 1=hardware, 2=software
+    flow_control: u8 = 0, // 0=none, 1=hardware, 2=software, 3=software in userspace
     local_echo: bool = false,
     line_ending: u8 = 0, // 0=CR, 1=LF, 2=CRLF
+    mark_errors: bool = false,
 
     fn toConfig(self: SerialConfig) Config {
         return .{
@@ -52,6 +131,7 @@ pub const SerialConfig = extern struct {
             .flow_control = switch (self.flow_control) {
                 1 => .hardware,
                 2 => .software,
+                3 => .software_userspace,
                 else => .none,
             },
             .local_echo = self.local_echo,
@@ -60,6 +140,7 @@ pub const SerialConfig = extern struct {
                 2 => .crlf,
                 else => .cr,
             },
+            .mark_errors = self.mark_errors,
         };
     }
 
@@ -92,43 +173,186 @@ pub const ModemStatus = extern struct {
 };
 
 var gpa = std.heap.GeneralPurposeAllocator(.{}){};
-const allocator = gpa.allocator();
+
+/// Everything the C API allocates goes through here; the live count says
+/// whether the backing allocator can still be swapped
+var counting = CountingAllocator.init(gpa.allocator());
+const allocator = counting.allocator();
+
+/// Host-supplied allocation callbacks (see serial_set_allocator)
+pub const SerialAllocFn = *const fn (size: usize, alignment: usize, context: ?*anyopaque) callconv(.c) ?*anyopaque;
+pub const SerialFreeFn = *const fn (ptr: *anyopaque, size: usize, alignment: usize, context: ?*anyopaque) callconv(.c) void;
+
+/// Adapts the host callbacks to a Zig allocator. Blocks never grow in
+/// place; containers fall back to allocate-copy-free.
+const HostAllocator = struct {
+    alloc_fn: SerialAllocFn,
+    free_fn: SerialFreeFn,
+    context: ?*anyopaque,
+
+    const vtable = std.mem.Allocator.VTable{
+        .alloc = alloc,
+        .resize = std.mem.Allocator.noResize,
+        .remap = std.mem.Allocator.noRemap,
+        .free = free,
+    };
+
+    fn alloc(ctx: *anyopaque, len: usize, alignment: std.mem.Alignment, _: usize) ?[*]u8 {
+        const self: *HostAllocator = @ptrCast(@alignCast(ctx));
+        const ptr = self.alloc_fn(len, alignment.toByteUnits(), self.context) orelse return null;
+        return @ptrCast(ptr);
+    }
+
+    fn free(ctx: *anyopaque, memory: []u8, alignment: std.mem.Alignment, _: usize) void {
+        const self: *HostAllocator = @ptrCast(@alignCast(ctx));
+        self.free_fn(memory.ptr, memory.len, alignment.toByteUnits(), self.context);
+    }
+};
+
+var host_allocator: HostAllocator = undefined;
+
+/// Open ports that can be in use by the host at once
+const MAX_PORTS = 1024;
+
+/// Every open port. Calls pin their port for the duration, so a close
+/// racing a read on another thread frees the port only after the read.
+var port_table: HandleTable(*Port, MAX_PORTS, destroyPort) = .{};
+
+/// Port storage is recycled rather than freed, so opening and closing
+/// ports in a loop stops allocating once the pool has grown to fit
+var port_pool = std.heap.MemoryPool(Port).init(allocator);
+var port_pool_mutex: std.Thread.Mutex = .{};
+
+fn createPort() ?*Port {
+    port_pool_mutex.lock();
+    defer port_pool_mutex.unlock();
+    return port_pool.create() catch null;
+}
+
+fn destroyPort(p: *Port) void {
+    p.close();
+    port_pool_mutex.lock();
+    defer port_pool_mutex.unlock();
+    port_pool.destroy(p);
+}
 
 // ============================================================================
 // C API Functions
 // ============================================================================
 
+fn openError(err: Port.Error) SerialError {
+    return switch (err) {
+        Port.Error.OpenFailed => .open_failed,
+        Port.Error.ConfigurationFailed => .config_failed,
+        Port.Error.NotATerminal => .not_a_terminal,
+        Port.Error.InvalidBaudRate => .invalid_baud,
+        else => .open_failed,
+    };
+}
+
+/// Moves an open port into pooled storage and the handle table; closes
+/// it on failure
+fn adoptPort(opened: Port, handle_out: *SerialPortHandle) SerialError {
+    const port_ptr = createPort() orelse {
+        var p = opened;
+        p.close();
+        return .out_of_memory;
+    };
+    port_ptr.* = opened;
+    handle_out.* = port_table.insert(port_ptr) orelse {
+        destroyPort(port_ptr);
+        return .too_many_ports;
+    };
+    return .success;
+}
+
 /// Opens a serial port
-export fn serial_open(path: [*:0]const u8, cfg: *const SerialConfig, handle_out: *?SerialPortHandle) SerialError {
-    const port_ptr = allocator.create(Port) catch return .out_of_memory;
-    errdefer allocator.destroy(port_ptr);
+export fn serial_open(path: [*:0]const u8, cfg: *const SerialConfig, handle_out: *SerialPortHandle) SerialError {
+    handle_out.* = 0;
+    const opened = Port.open(std.mem.span(path), cfg.toConfig()) catch |err| return openError(err);
+    return adoptPort(opened, handle_out);
+}
 
-    const path_slice = std.mem.span(path);
-    port_ptr.* = Port.open(path_slice, cfg.toConfig()) catch |err| {
-        return switch (err) {
-            Port.Error.OpenFailed => .open_failed,
-            Port.Error.ConfigurationFailed => .config_failed,
-            Port.Error.NotATerminal => .not_a_terminal,
-            Port.Error.InvalidBaudRate => .invalid_baud,
-            else => .open_failed,
+/// Options for serial_open_virtual_pair
+pub const SerialVirtualOptions = extern struct {
+    mode: u8 = 0, // 0=in-memory, 1=pty
+    char_bits: u8 = 10,
+    baud_rate: u32 = 0, // 0=unpaced
+    fifo_depth: u32 = 4096,
+    corrupt_one_in: u32 = 0,
+    drop_one_in: u32 = 0,
+    seed: u64 = 0,
+
+    fn toOptions(self: SerialVirtualOptions) VirtualPort.Options {
+        return .{
+            .mode = if (self.mode == 1) .pty else .memory,
+            .baud = self.baud_rate,
+            .char_bits = self.char_bits,
+            .fifo_depth = self.fifo_depth,
+            .corrupt_one_in = self.corrupt_one_in,
+            .drop_one_in = self.drop_one_in,
+            .seed = self.seed,
         };
+    }
+};
+
+/// Opens two ports wired to each other without hardware. Each is closed
+/// with serial_close like any other port.
+export fn serial_open_virtual_pair(options: *const SerialVirtualOptions, cfg: *const SerialConfig, a_out: *SerialPortHandle, b_out: *SerialPortHandle) SerialError {
+    a_out.* = 0;
+    b_out.* = 0;
+    const pair = VirtualPort.create(allocator, options.toOptions()) catch |err| {
+        return if (err == error.OutOfMemory) .out_of_memory else .open_failed;
     };
+    defer pair.release();
+    var ports = pair.open(cfg.toConfig()) catch |err| return openError(err);
 
-    handle_out.* = port_ptr;
-    return .success;
+    const result = adoptPort(ports[0], a_out);
+    if (result != .success) {
+        ports[1].close();
+        return result;
+    }
+    const second = adoptPort(ports[1], b_out);
+    if (second != .success) {
+        serial_close(a_out.*);
+        a_out.* = 0;
+    }
+    return second;
 }
 
-/// Closes a serial port
-export fn serial_close(handle: ?SerialPortHandle) void {
-    if (handle) |h| {
-        h.close();
-        allocator.destroy(h);
+/// Routes the library's allocations through host callbacks (a NULL
+/// callback restores the default). Only possible while nothing is
+/// allocated, so call it before opening the first port.
+export fn serial_set_allocator(alloc_fn: ?SerialAllocFn, free_fn: ?SerialFreeFn, context: ?*anyopaque) SerialError {
+    if (counting.liveCount() != 0) return .allocator_in_use;
+    if (alloc_fn == null or free_fn == null) {
+        counting.child = gpa.allocator();
+        return .success;
     }
+    host_allocator = .{ .alloc_fn = alloc_fn.?, .free_fn = free_fn.?, .context = context };
+    counting.child = .{ .ptr = &host_allocator, .vtable = &HostAllocator.vtable };
+    return .success;
+}
+
+/// Reserves storage for this many open ports up front, so later
+/// serial_open calls do not allocate
+export fn serial_reserve_ports(count: usize) SerialError {
+    port_pool_mutex.lock();
+    defer port_pool_mutex.unlock();
+    port_pool.preheat(@min(count, MAX_PORTS)) catch return .out_of_memory;
+    return .success;
+}
+
+/// Closes a serial port. Calls already in progress on other threads
+/// finish first; later calls with the handle return invalid_handle.
+export fn serial_close(handle: SerialPortHandle) void {
+    _ = port_table.remove(handle);
 }
 
 /// Reads data from the serial port
-export fn serial_read(handle: ?SerialPortHandle, buffer: [*]u8, buffer_len: usize, bytes_read: *usize) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_read(handle: SerialPortHandle, buffer: [*]u8, buffer_len: usize, bytes_read: *usize) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     const n = h.read(buffer[0..buffer_len]) catch |err| {
         return switch (err) {
             Port.Error.ReadError => .read_error,
@@ -141,8 +365,9 @@ export fn serial_read(handle: ?SerialPortHandle, buffer: [*]u8, buffer_len: usiz
 }
 
 /// Writes data to the serial port
-export fn serial_write(handle: ?SerialPortHandle, data: [*]const u8, data_len: usize, bytes_written: *usize) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_write(handle: SerialPortHandle, data: [*]const u8, data_len: usize, bytes_written: *usize) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     const n = h.write(data[0..data_len]) catch |err| {
         return switch (err) {
             Port.Error.WriteError => .write_error,
@@ -155,42 +380,151 @@ export fn serial_write(handle: ?SerialPortHandle, data: [*]const u8, data_len: u
 }
 
 /// Writes all data to the serial port
-export fn serial_write_all(handle: ?SerialPortHandle, data: [*]const u8, data_len: usize) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_write_all(handle: SerialPortHandle, data: [*]const u8, data_len: usize) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.writeAll(data[0..data_len]) catch |err| {
         return switch (err) {
             Port.Error.WriteError => .write_error,
             Port.Error.PortClosed => .port_closed,
+            Port.Error.Timeout => .timeout,
             else => .write_error,
         };
     };
     return .success;
 }
 
+/// Serialises starting a port's asynchronous writer
+var tx_queue_mutex: std.Thread.Mutex = .{};
+
+/// Queues data for the port's writer thread and returns at once; the
+/// callback reports acceptance and, if asked, the drain
+export fn serial_write_async(handle: SerialPortHandle, data: [*]const u8, data_len: usize, want_drained: bool, callback: ?TxQueue.Callback, context: ?*anyopaque) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const queue = blk: {
+        tx_queue_mutex.lock();
+        defer tx_queue_mutex.unlock();
+        if (h.tx_queue == null) h.tx_queue = TxQueue.create(allocator, h) catch return .out_of_memory;
+        break :blk h.tx_queue.?;
+    };
+    queue.write(data[0..data_len], want_drained, callback, context) catch return .port_closed;
+    return .success;
+}
+
+/// Waits until everything written has been sent
+export fn serial_drain(handle: SerialPortHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    h.drain();
+    return .success;
+}
+
+/// Changes settings on an open port without closing it; only what differs
+/// from the current configuration is applied. With `drain`, output
+/// already queued goes out at the old settings first.
+export fn serial_reconfigure(handle: SerialPortHandle, cfg: *const SerialConfig, drain: bool) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    h.reconfigure(cfg.toConfig(), if (drain) .drain else .now) catch |err| {
+        return switch (err) {
+            Port.Error.InvalidBaudRate => .invalid_baud,
+            Port.Error.PortClosed => .port_closed,
+            else => .config_failed,
+        };
+    };
+    return .success;
+}
+
+/// Finds the rate the peer is sending at and leaves the port set to it
+export fn serial_detect_baud(handle: SerialPortHandle, window_ms: u32, break_ms: u32, poke: ?[*:0]const u8, baud_out: *u32) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const result = autobaud.detect(h, .{
+        .window_ms = if (window_ms == 0) 50 else window_ms,
+        .break_ms = break_ms,
+        .poke = if (poke) |text| std.mem.span(text) else "",
+    }) catch |err| {
+        return switch (err) {
+            error.NotDetected => .not_found,
+            Port.Error.PortClosed => .port_closed,
+            else => .config_failed,
+        };
+    };
+    baud_out.* = result.config.baud_rate.toSpeed();
+    return .success;
+}
+
+/// Transmit pacing for serial_set_pacing
+pub const SerialPacing = extern struct {
+    mode: u8 = 3, // 0=off, 1=per char, 2=per line, 3=token bucket, 4=echo
+    rate_percent: u8 = 100,
+    burst: u16 = 16,
+    char_delay_us: u32 = 0,
+    line_delay_us: u32 = 0,
+    max_queued: u32 = 16,
+    echo_timeout_ms: u32 = 1000,
+};
+
+/// Paces serial_write_all for a slow target; NULL or mode 0 turns pacing off
+export fn serial_set_pacing(handle: SerialPortHandle, pacing: ?*const SerialPacing) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const p = pacing orelse {
+        h.setPacing(null);
+        return .success;
+    };
+    const mode: Pacer.Mode = switch (p.mode) {
+        0 => {
+            h.setPacing(null);
+            return .success;
+        },
+        1 => .per_char,
+        2 => .per_line,
+        3 => .token_bucket,
+        4 => .echo,
+        else => return .config_failed,
+    };
+    h.setPacing(.{
+        .mode = mode,
+        .char_delay_us = p.char_delay_us,
+        .line_delay_us = p.line_delay_us,
+        .burst = p.burst,
+        .rate_percent = p.rate_percent,
+        .max_queued = p.max_queued,
+        .echo_timeout_ms = p.echo_timeout_ms,
+    });
+    return .success;
+}
+
 /// Sends a break signal
-export fn serial_send_break(handle: ?SerialPortHandle) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_send_break(handle: SerialPortHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.sendBreak();
     return .success;
 }
 
 /// Sets the DTR line
-export fn serial_set_dtr(handle: ?SerialPortHandle, state: bool) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_set_dtr(handle: SerialPortHandle, state: bool) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.setDTR(state);
     return .success;
 }
 
 /// Sets the RTS line
-export fn serial_set_rts(handle: ?SerialPortHandle, state: bool) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_set_rts(handle: SerialPortHandle, state: bool) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.setRTS(state);
     return .success;
 }
 
 /// Gets modem status
-export fn serial_get_modem_status(handle: ?SerialPortHandle, status: *ModemStatus) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_get_modem_status(handle: SerialPortHandle, status: *ModemStatus) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     const s = h.getModemStatus();
     status.* = .{
         .dtr = s.dtr,
@@ -204,44 +538,163 @@ export fn serial_get_modem_status(handle: ?SerialPortHandle, status: *ModemStatu
 }
 
 /// Flushes input buffer
-export fn serial_flush_input(handle: ?SerialPortHandle) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_flush_input(handle: SerialPortHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.flushInput();
     return .success;
 }
 
-/// Flushes output buffer
-export fn serial_flush_output(handle: ?SerialPortHandle) SerialError {
-    const h = handle orelse return .invalid_handle;
+/// Discards output not yet sent
+export fn serial_flush_output(handle: SerialPortHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.flushOutput();
     return .success;
 }
 
 /// Flushes both buffers
-export fn serial_flush(handle: ?SerialPortHandle) SerialError {
-    const h = handle orelse return .invalid_handle;
+export fn serial_flush(handle: SerialPortHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
     h.flush();
     return .success;
 }
 
 /// Returns number of bytes available to read
-export fn serial_bytes_available(handle: ?SerialPortHandle) c_int {
-    const h = handle orelse return 0;
+export fn serial_bytes_available(handle: SerialPortHandle) c_int {
+    const h = port_table.acquire(handle) orelse return 0;
+    defer port_table.release(handle);
     return @intCast(h.bytesAvailable());
 }
 
 /// Waits for data with timeout
-export fn serial_wait_for_data(handle: ?SerialPortHandle, timeout_ms: u32) bool {
-    const h = handle orelse return false;
+export fn serial_wait_for_data(handle: SerialPortHandle, timeout_ms: u32) bool {
+    const h = port_table.acquire(handle) orelse return false;
+    defer port_table.release(handle);
     return h.waitForData(timeout_ms);
 }
 
 /// Gets the file descriptor (for use with select/poll)
-export fn serial_get_fd(handle: ?SerialPortHandle) c_int {
-    const h = handle orelse return -1;
+export fn serial_get_fd(handle: SerialPortHandle) c_int {
+    const h = port_table.acquire(handle) orelse return -1;
+    defer port_table.release(handle);
     return h.fd;
 }
 
+// ============================================================================
+// Line Statistics
+// ============================================================================
+
+/// Driver interrupt counters
+pub const SerialLineCounters = extern struct {
+    rx: u32 = 0,
+    tx: u32 = 0,
+    frame: u32 = 0,
+    parity: u32 = 0,
+    overrun: u32 = 0,
+    buf_overrun: u32 = 0,
+    brk: u32 = 0,
+
+    fn fromCounters(counters: Port.Counters) SerialLineCounters {
+        return .{
+            .rx = counters.rx,
+            .tx = counters.tx,
+            .frame = counters.frame,
+            .parity = counters.parity,
+            .overrun = counters.overrun,
+            .buf_overrun = counters.buf_overrun,
+            .brk = counters.brk,
+        };
+    }
+};
+
+/// Line error statistics for C API
+pub const SerialLineStats = extern struct {
+    /// false if the driver does not keep counters (total/delta are zero)
+    counters_valid: bool = false,
+    total: SerialLineCounters = .{},
+    delta: SerialLineCounters = .{},
+    marked_errors: u64 = 0,
+    marked_breaks: u64 = 0,
+    interval_ns: u64 = 0,
+};
+
+/// Reads error counters; the delta covers the time since the previous call
+export fn serial_get_line_stats(handle: SerialPortHandle, stats: *SerialLineStats) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const s = h.getLineStats();
+    stats.* = .{
+        .counters_valid = s.total != null,
+        .marked_errors = s.marked_errors,
+        .marked_breaks = s.marked_breaks,
+        .interval_ns = s.interval_ns,
+    };
+    if (s.total) |total| stats.total = SerialLineCounters.fromCounters(total);
+    if (s.delta) |delta| stats.delta = SerialLineCounters.fromCounters(delta);
+    return .success;
+}
+
+/// Latency distribution summary (nanoseconds)
+pub const SerialLatency = extern struct {
+    count: u64 = 0,
+    p50_ns: u64 = 0,
+    p90_ns: u64 = 0,
+    p99_ns: u64 = 0,
+    p999_ns: u64 = 0,
+    max_ns: u64 = 0,
+
+    fn fromSummary(summary: stats.Histogram.Summary) SerialLatency {
+        return .{
+            .count = summary.count,
+            .p50_ns = summary.p50,
+            .p90_ns = summary.p90,
+            .p99_ns = summary.p99,
+            .p999_ns = summary.p999,
+            .max_ns = summary.max,
+        };
+    }
+};
+
+/// Traffic statistics for C API
+pub const SerialStats = extern struct {
+    rx_bytes: u64 = 0,
+    tx_bytes: u64 = 0,
+    read_calls: u64 = 0,
+    write_calls: u64 = 0,
+    ring_high_water: u64 = 0,
+    dropped_bytes: u64 = 0,
+    rx_latency: SerialLatency = .{},
+    drain_latency: SerialLatency = .{},
+};
+
+/// Snapshots the port's traffic counters and latency histograms
+export fn serial_get_stats(handle: SerialPortHandle, out: *SerialStats) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const snap = h.stats.snapshot();
+    out.* = .{
+        .rx_bytes = snap.rx_bytes,
+        .tx_bytes = snap.tx_bytes,
+        .read_calls = snap.read_calls,
+        .write_calls = snap.write_calls,
+        .ring_high_water = snap.ring_high_water,
+        .dropped_bytes = snap.dropped_bytes,
+        .rx_latency = SerialLatency.fromSummary(snap.rx_latency),
+        .drain_latency = SerialLatency.fromSummary(snap.drain_latency),
+    };
+    return .success;
+}
+
+/// Writes recorded trace events as Chrome trace JSON.
+/// Returns open_failed when tracing is not compiled in.
+export fn serial_trace_dump(path: [*:0]const u8) SerialError {
+    if (!trace.enabled) return .open_failed;
+    trace.dumpToFile(std.mem.span(path)) catch return .write_error;
+    return .success;
+}
+
 // ============================================================================
 // Port Enumeration
 // ============================================================================
@@ -257,12 +710,1017 @@ export fn serial_enumerate_ports(callback: EnumCallback, context: ?*anyopaque) S
         allocator.free(ports);
     }
 
-    for (ports) |p| {
-        // Create null-terminated string
-        const path_z = allocator.dupeZ(u8, p) catch continue;
-        defer allocator.free(path_z);
-        callback(path_z.ptr, context);
+    for (ports) |p| callback(p.ptr, context);
+    return .success;
+}
+
+// ============================================================================
+// Port Registry
+// ============================================================================
+
+/// Called with is_added true for a new device, false for a removed one
+pub const RegistryCallback = *const fn (is_added: bool, path: [*:0]const u8, context: ?*anyopaque) callconv(.c) void;
+
+/// C callback and context, kept alongside the registry
+const RegistryBridge = struct {
+    callback: RegistryCallback,
+    context: ?*anyopaque,
+
+    fn forward(change: Registry.Change, path: [:0]const u8, context: ?*anyopaque) void {
+        const self: *RegistryBridge = @ptrCast(@alignCast(context.?));
+        self.callback(change == .added, path.ptr, self.context);
+    }
+};
+
+/// Scans once and then tracks hotplug events on a helper thread
+export fn serial_registry_create(callback: ?RegistryCallback, context: ?*anyopaque, registry_out: *?SerialRegistryHandle) SerialError {
+    var bridge: ?*RegistryBridge = null;
+    if (callback) |cb| {
+        bridge = allocator.create(RegistryBridge) catch return .out_of_memory;
+        bridge.?.* = .{ .callback = cb, .context = context };
     }
+    const forward: ?Registry.Callback = if (bridge != null) &RegistryBridge.forward else null;
 
+    registry_out.* = Registry.create(allocator, forward, bridge) catch {
+        if (bridge) |b| allocator.destroy(b);
+        return .out_of_memory;
+    };
     return .success;
 }
+
+/// Stops tracking; no callbacks run after this returns
+export fn serial_registry_destroy(registry_handle: ?SerialRegistryHandle) void {
+    const r = registry_handle orelse return;
+    const bridge = r.context;
+    r.destroy();
+    if (bridge) |b| allocator.destroy(@as(*RegistryBridge, @ptrCast(@alignCast(b))));
+}
+
+/// Increments whenever the port list changes
+export fn serial_registry_generation(registry_handle: ?SerialRegistryHandle) u64 {
+    const r = registry_handle orelse return 0;
+    return r.getGeneration();
+}
+
+/// Device identity; strings are NUL-terminated and empty when unknown
+pub const SerialPortInfo = extern struct {
+    path: [128]u8,
+    serial_number: [128]u8,
+    manufacturer: [128]u8,
+    product: [128]u8,
+    driver: [128]u8,
+    by_id: [128]u8,
+    by_path: [128]u8,
+    vendor_id: u16, // 0 if unknown
+    product_id: u16,
+    interface_number: i16, // -1 if unknown
+
+    fn fromInfo(path: []const u8, info: *const PortInfo) SerialPortInfo {
+        var result: SerialPortInfo = undefined;
+        copyText(&result.path, path);
+        copyText(&result.serial_number, info.serial_number.get() orelse "");
+        copyText(&result.manufacturer, info.manufacturer.get() orelse "");
+        copyText(&result.product, info.product.get() orelse "");
+        copyText(&result.driver, info.driver.get() orelse "");
+        copyText(&result.by_id, info.by_id.get() orelse "");
+        copyText(&result.by_path, info.by_path.get() orelse "");
+        result.vendor_id = info.vendor_id orelse 0;
+        result.product_id = info.product_id orelse 0;
+        result.interface_number = if (info.interface_number) |n| n else -1;
+        return result;
+    }
+
+    fn copyText(dest: *[128]u8, value: []const u8) void {
+        const n = @min(value.len, dest.len - 1);
+        @memcpy(dest[0..n], value[0..n]);
+        dest[n] = 0;
+    }
+};
+
+pub const PortInfoCallback = *const fn (info: *const SerialPortInfo, context: ?*anyopaque) callconv(.c) void;
+
+/// Finds a port by path, /dev name, USB serial number or by-id/by-path link
+export fn serial_registry_lookup(registry_handle: ?SerialRegistryHandle, key: [*:0]const u8, info_out: *SerialPortInfo) SerialError {
+    const r = registry_handle orelse return .invalid_handle;
+    const snapshot = r.acquire();
+    defer snapshot.release();
+    const index = snapshot.find(std.mem.span(key)) orelse return .not_found;
+    info_out.* = SerialPortInfo.fromInfo(snapshot.paths[index], &snapshot.infos[index]);
+    return .success;
+}
+
+/// Calls `callback` with the metadata of each port in the current list
+export fn serial_registry_port_infos(registry_handle: ?SerialRegistryHandle, callback: PortInfoCallback, context: ?*anyopaque) SerialError {
+    const r = registry_handle orelse return .invalid_handle;
+    const snapshot = r.acquire();
+    defer snapshot.release();
+    for (snapshot.paths, snapshot.infos) |path, *info| {
+        const converted = SerialPortInfo.fromInfo(path, info);
+        callback(&converted, context);
+    }
+    return .success;
+}
+
+/// Calls `callback` for each port in the current list, without scanning
+export fn serial_registry_ports(registry_handle: ?SerialRegistryHandle, callback: EnumCallback, context: ?*anyopaque) SerialError {
+    const r = registry_handle orelse return .invalid_handle;
+    const snapshot = r.acquire();
+    defer snapshot.release();
+    for (snapshot.paths) |path| callback(path.ptr, context);
+    return .success;
+}
+
+// ============================================================================
+// Shared Port (Hub)
+// ============================================================================
+
+/// A hub and the port handle it keeps pinned
+pub const HubSession = struct {
+    hub: *Hub,
+    handle: SerialPortHandle,
+};
+
+/// Starts sharing an open port between several consumers
+export fn serial_hub_create(handle: SerialPortHandle, ring_size: usize, hub_out: *?SerialHubHandle) SerialError {
+    hub_out.* = null;
+    // Stays pinned until serial_hub_destroy
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(HubSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    const created = Hub.create(allocator, h, ring_size) catch {
+        allocator.destroy(session);
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{ .hub = created, .handle = handle };
+    hub_out.* = session;
+    return .success;
+}
+
+/// Sets the backlog levels that send XOFF and XON (userspace flow control)
+export fn serial_hub_set_watermarks(hub_handle: ?SerialHubHandle, high_water: usize, low_water: usize) SerialError {
+    const hb = hub_handle orelse return .invalid_handle;
+    if (low_water >= high_water) return .config_failed;
+    hb.hub.setWatermarks(high_water, low_water);
+    return .success;
+}
+
+/// Stops sharing and frees the hub (the port stays open)
+export fn serial_hub_destroy(hub_handle: ?SerialHubHandle) void {
+    const hb = hub_handle orelse return;
+    hb.hub.destroy();
+    port_table.release(hb.handle);
+    allocator.destroy(hb);
+}
+
+/// Attaches a consumer with its own read cursor
+export fn serial_hub_attach(hub_handle: ?SerialHubHandle, policy: u8, consumer_out: *?SerialConsumerHandle) SerialError {
+    const hb = hub_handle orelse return .invalid_handle;
+    const p: Hub.Policy = switch (policy) {
+        1 => .block,
+        2 => .disconnect,
+        else => .drop_oldest,
+    };
+    consumer_out.* = hb.hub.attach(p) catch return .too_many_consumers;
+    return .success;
+}
+
+/// Detaches a consumer
+export fn serial_hub_detach(consumer: ?SerialConsumerHandle) void {
+    if (consumer) |cn| cn.hub.detach(cn);
+}
+
+/// Reads from a consumer's cursor, waiting up to timeout_ms
+export fn serial_hub_read(consumer: ?SerialConsumerHandle, buffer: [*]u8, buffer_len: usize, timeout_ms: u32, bytes_read: *usize) SerialError {
+    const cn = consumer orelse return .invalid_handle;
+    bytes_read.* = cn.read(buffer[0..buffer_len], timeout_ms) catch |err| {
+        return switch (err) {
+            Hub.Error.Disconnected => .disconnected,
+            Hub.Error.PortClosed => .port_closed,
+            Hub.Error.Reconnected => .reconnected,
+            else => .read_error,
+        };
+    };
+    return .success;
+}
+
+/// Returns the number of bytes a consumer has lost to drop-oldest
+export fn serial_hub_dropped(consumer: ?SerialConsumerHandle) u64 {
+    const cn = consumer orelse return 0;
+    cn.hub.mutex.lock();
+    defer cn.hub.mutex.unlock();
+    return cn.dropped;
+}
+
+/// Writes a message atomically with respect to other hub writers
+export fn serial_hub_write(hub_handle: ?SerialHubHandle, data: [*]const u8, data_len: usize) SerialError {
+    const hb = hub_handle orelse return .invalid_handle;
+    hb.hub.write(data[0..data_len]) catch |err| {
+        return switch (err) {
+            Hub.Error.PortClosed => .port_closed,
+            else => .write_error,
+        };
+    };
+    return .success;
+}
+
+/// A supervisor and the port handle it keeps pinned
+pub const SupervisorSession = struct {
+    supervisor: *Supervisor,
+    handle: SerialPortHandle,
+};
+
+/// Reopens the port in place when its adapter comes back after a reset or
+/// re-plug, found by serial number in `registry_handle`, which may serve
+/// any number of supervisors. A hub given here rides out the outage.
+export fn serial_supervise(handle: SerialPortHandle, registry_handle: ?SerialRegistryHandle, hub_handle: ?SerialHubHandle, supervisor_out: *?SerialSupervisorHandle) SerialError {
+    supervisor_out.* = null;
+    const r = registry_handle orelse return .invalid_handle;
+    // Stays pinned until serial_supervisor_destroy
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(SupervisorSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    const created = Supervisor.create(allocator, h, r) catch {
+        allocator.destroy(session);
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{ .supervisor = created, .handle = handle };
+    if (hub_handle) |hb| hb.hub.supervise(created);
+    supervisor_out.* = session;
+    return .success;
+}
+
+/// Stops supervising; destroy a supervised hub first
+export fn serial_supervisor_destroy(supervisor_handle: ?SerialSupervisorHandle) void {
+    const s = supervisor_handle orelse return;
+    s.supervisor.destroy();
+    port_table.release(s.handle);
+    allocator.destroy(s);
+}
+
+/// Number of times the port has been reopened
+export fn serial_supervisor_reconnects(supervisor_handle: ?SerialSupervisorHandle) u64 {
+    const s = supervisor_handle orelse return 0;
+    return s.supervisor.reconnectCount();
+}
+
+// ============================================================================
+// Framing
+// ============================================================================
+
+/// Frame format for serial_framer_create and serial_frame_encode
+pub const SerialFramerOptions = extern struct {
+    kind: u8 = 0, // 0=line, 1=SLIP, 2=COBS, 3/4/5=u8/u16/u32 length prefix
+    crc: u8 = 0, // 0=none, 1=CRC-16/CCITT, 2=CRC-16/MODBUS, 3=CRC-32
+    little_endian: bool = false,
+    max_frame: u32 = 4096,
+
+    fn toOptions(self: SerialFramerOptions) ?Framer.Options {
+        if (self.kind > @intFromEnum(Framer.Kind.length_u32)) return null;
+        if (self.crc > @intFromEnum(Framer.Crc.crc32)) return null;
+        return .{
+            .kind = @enumFromInt(self.kind),
+            .crc = @enumFromInt(self.crc),
+            .endian = if (self.little_endian) .little else .big,
+            .max_frame = if (self.max_frame == 0) 4096 else self.max_frame,
+        };
+    }
+};
+
+/// Creates a frame decoder
+export fn serial_framer_create(options: *const SerialFramerOptions, framer_out: *?SerialFramerHandle) SerialError {
+    framer_out.* = null;
+    const opts = options.toOptions() orelse return .config_failed;
+    const f = allocator.create(Framer) catch return .out_of_memory;
+    f.* = Framer.init(allocator, opts) catch {
+        allocator.destroy(f);
+        return .out_of_memory;
+    };
+    framer_out.* = f;
+    return .success;
+}
+
+export fn serial_framer_destroy(framer_handle: ?SerialFramerHandle) void {
+    const f = framer_handle orelse return;
+    f.deinit();
+    allocator.destroy(f);
+}
+
+/// Copies received bytes (from a hub consumer, say) into the decoder
+export fn serial_framer_feed(framer_handle: ?SerialFramerHandle, data: [*]const u8, data_len: usize, accepted: *usize) SerialError {
+    const f = framer_handle orelse return .invalid_handle;
+    accepted.* = f.feed(data[0..data_len]);
+    return .success;
+}
+
+/// Takes the next complete frame, if any
+export fn serial_framer_next(framer_handle: ?SerialFramerHandle, frame: *?[*]const u8, frame_len: *usize) bool {
+    frame.* = null;
+    frame_len.* = 0;
+    const f = framer_handle orelse return false;
+    const payload = f.next() orelse return false;
+    frame.* = payload.ptr;
+    frame_len.* = payload.len;
+    return true;
+}
+
+/// Reads the port straight into the decoder until a frame is complete
+export fn serial_framer_read(framer_handle: ?SerialFramerHandle, handle: SerialPortHandle, timeout_ms: u32, frame: *?[*]const u8, frame_len: *usize) SerialError {
+    const f = framer_handle orelse return .invalid_handle;
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+
+    const deadline = clock.now() + @as(u64, timeout_ms) * std.time.ns_per_ms;
+    while (!serial_framer_next(f, frame, frame_len)) {
+        const now = clock.now();
+        if (now >= deadline) return .timeout;
+        const wait_ms = (deadline - now + std.time.ns_per_ms - 1) / std.time.ns_per_ms;
+        if (!h.waitForData(@intCast(@min(wait_ms, std.math.maxInt(u32))))) continue;
+        _ = f.readFrom(h) catch |err| switch (err) {
+            Port.Error.WouldBlock => {},
+            Port.Error.PortClosed => return .port_closed,
+            else => return .read_error,
+        };
+    }
+    return .success;
+}
+
+/// Encodes one frame into `out`
+export fn serial_frame_encode(options: *const SerialFramerOptions, payload: [*]const u8, payload_len: usize, out: [*]u8, out_len: usize, encoded_len: *usize) SerialError {
+    encoded_len.* = 0;
+    const opts = options.toOptions() orelse return .config_failed;
+    const encoded = Framer.encode(opts, payload[0..payload_len], out[0..out_len]) catch return .frame_too_large;
+    encoded_len.* = encoded.len;
+    return .success;
+}
+
+// ============================================================================
+// Modbus RTU
+// ============================================================================
+
+/// A Modbus master and the port handle it keeps pinned
+pub const ModbusSession = struct {
+    master: modbus.Master,
+    handle: SerialPortHandle,
+};
+
+/// A bus monitor and the port handle it keeps pinned
+pub const SnifferSession = struct {
+    sniffer: modbus.Sniffer,
+    handle: SerialPortHandle,
+};
+
+/// A received Modbus frame; `data` points into the master or sniffer
+/// and stays valid until its next call
+pub const SerialModbusFrame = extern struct {
+    unit: u8 = 0,
+    function: u8 = 0,
+    response: bool = false,
+    data: ?[*]const u8 = null,
+    data_len: usize = 0,
+    timestamp_ns: u64 = 0,
+
+    fn from(frame: modbus.Frame, response: bool) SerialModbusFrame {
+        return .{
+            .unit = frame.unit,
+            .function = frame.function,
+            .response = response,
+            .data = frame.data.ptr,
+            .data_len = frame.data.len,
+            .timestamp_ns = frame.timestamp_ns,
+        };
+    }
+};
+
+/// One slave query for serial_modbus_poll; `failures` and `skip` carry
+/// the offline back-off between cycles
+pub const SerialModbusPoll = extern struct {
+    unit: u8,
+    function: u8,
+    data: [*]const u8,
+    data_len: usize,
+    failures: u32 = 0,
+    skip: u32 = 0,
+};
+
+pub const ModbusPollCallback = *const fn (poll: *const SerialModbusPoll, status: SerialError, response: ?*const SerialModbusFrame, context: ?*anyopaque) callconv(.c) void;
+
+fn modbusError(err: modbus.Error) SerialError {
+    return switch (err) {
+        modbus.Error.Timeout => .timeout,
+        modbus.Error.CrcMismatch, modbus.Error.UnexpectedResponse => .bad_frame,
+        modbus.Error.FrameTooLarge => .frame_too_large,
+        modbus.Error.PortClosed => .port_closed,
+        modbus.Error.WriteError => .write_error,
+        else => .read_error,
+    };
+}
+
+/// Starts a Modbus RTU master on the port
+export fn serial_modbus_create(handle: SerialPortHandle, response_timeout_ms: u32, master_out: *?SerialModbusHandle) SerialError {
+    master_out.* = null;
+    // Stays pinned until serial_modbus_destroy
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(ModbusSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{
+        .master = modbus.Master.init(h, .{ .response_timeout_ms = if (response_timeout_ms == 0) 100 else response_timeout_ms }),
+        .handle = handle,
+    };
+    master_out.* = session;
+    return .success;
+}
+
+export fn serial_modbus_destroy(master_handle: ?SerialModbusHandle) void {
+    const m = master_handle orelse return;
+    port_table.release(m.handle);
+    allocator.destroy(m);
+}
+
+/// Sends one request and waits for the response (none for unit 0)
+export fn serial_modbus_transact(master_handle: ?SerialModbusHandle, unit: u8, function: u8, data: [*]const u8, data_len: usize, response: *SerialModbusFrame) SerialError {
+    response.* = .{};
+    const m = master_handle orelse return .invalid_handle;
+    const frame = m.master.transact(unit, function, data[0..data_len]) catch |err| return modbusError(err);
+    if (frame) |f| response.* = SerialModbusFrame.from(f, true);
+    return .success;
+}
+
+/// Runs one polling cycle, reporting each slave's result to `callback`
+export fn serial_modbus_poll(master_handle: ?SerialModbusHandle, polls: [*]SerialModbusPoll, count: usize, callback: ModbusPollCallback, context: ?*anyopaque) SerialError {
+    const m = master_handle orelse return .invalid_handle;
+    for (polls[0..count]) |*p| {
+        var poll = modbus.Master.Poll{
+            .unit = p.unit,
+            .function = p.function,
+            .data = p.data[0..p.data_len],
+            .failures = p.failures,
+            .skip = p.skip,
+        };
+        const result = m.master.pollOne(&poll);
+        p.failures = poll.failures;
+        p.skip = poll.skip;
+        const outcome = result orelse continue;
+        if (outcome) |frame| {
+            const response = SerialModbusFrame.from(frame, true);
+            callback(p, .success, &response, context);
+        } else |err| {
+            callback(p, modbusError(err), null, context);
+        }
+    }
+    return .success;
+}
+
+/// Starts a passive monitor on the port; it never transmits
+export fn serial_modbus_sniffer_create(handle: SerialPortHandle, sniffer_out: *?SerialModbusSnifferHandle) SerialError {
+    sniffer_out.* = null;
+    // Stays pinned until serial_modbus_sniffer_destroy
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(SnifferSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{ .sniffer = modbus.Sniffer.init(h), .handle = handle };
+    sniffer_out.* = session;
+    return .success;
+}
+
+export fn serial_modbus_sniffer_destroy(sniffer_handle: ?SerialModbusSnifferHandle) void {
+    const s = sniffer_handle orelse return;
+    port_table.release(s.handle);
+    allocator.destroy(s);
+}
+
+/// Waits for the next frame on the bus
+export fn serial_modbus_sniff(sniffer_handle: ?SerialModbusSnifferHandle, timeout_ms: u32, frame: *SerialModbusFrame) SerialError {
+    frame.* = .{};
+    const s = sniffer_handle orelse return .invalid_handle;
+    const capture = s.sniffer.next(timeout_ms) catch |err| return modbusError(err);
+    frame.* = SerialModbusFrame.from(capture.frame, capture.response);
+    return .success;
+}
+
+// ============================================================================
+// NMEA
+// ============================================================================
+
+/// Fix data; NaN or UINT32_MAX where the receiver left a field empty
+pub const SerialNmeaGga = extern struct {
+    latitude: f64,
+    longitude: f64,
+    hdop: f32,
+    altitude_m: f32,
+    geoid_separation_m: f32,
+    time_ms: u32,
+    quality: u8,
+    satellites: u8,
+};
+
+/// Recommended minimum data; NaN, UINT32_MAX or a zero date where empty
+pub const SerialNmeaRmc = extern struct {
+    latitude: f64,
+    longitude: f64,
+    speed_knots: f32,
+    course_deg: f32,
+    time_ms: u32,
+    year: u16,
+    month: u8,
+    day: u8,
+    valid: bool,
+};
+
+/// One satellite in view; -1 where empty
+pub const SerialNmeaSatellite = extern struct {
+    prn: u16,
+    elevation_deg: i16,
+    azimuth_deg: i16,
+    snr: i16,
+};
+
+pub const SerialNmeaGsv = extern struct {
+    total_messages: u8,
+    message: u8,
+    satellites_in_view: u8,
+    count: u8,
+    signal_id: i16,
+    satellites: [4]SerialNmeaSatellite,
+};
+
+/// A decoded sentence; only the pointer matching `kind` is set
+pub const SerialNmeaSentence = extern struct {
+    raw: [*]const u8,
+    raw_len: usize,
+    talker: [4]u8,
+    formatter: [8]u8,
+    kind: u8, // 0=other, 1=GGA, 2=RMC, 3=GSV
+    gga: ?*const SerialNmeaGga = null,
+    rmc: ?*const SerialNmeaRmc = null,
+    gsv: ?*const SerialNmeaGsv = null,
+};
+
+pub const NmeaCallback = *const fn (sentence: *const SerialNmeaSentence, context: ?*anyopaque) callconv(.c) void;
+
+/// Converts decoded sentences for a C callback
+const NmeaBridge = struct {
+    callback: NmeaCallback,
+    context: ?*anyopaque,
+
+    fn orNan(comptime T: type, value: ?T) T {
+        return value orelse std.math.nan(T);
+    }
+
+    fn orMinus(value: anytype) i16 {
+        return if (value) |v| std.math.cast(i16, v) orelse -1 else -1;
+    }
+
+    /// Copies `text` NUL-terminated, truncating to fit
+    fn fill(out: []u8, text: []const u8) void {
+        const n = @min(text.len, out.len - 1);
+        @memcpy(out[0..n], text[0..n]);
+        @memset(out[n..], 0);
+    }
+
+    fn deliver(sentence: *const nmea.Sentence, context: ?*anyopaque) void {
+        const self: *const NmeaBridge = @ptrCast(@alignCast(context.?));
+        var out = SerialNmeaSentence{
+            .raw = sentence.raw.ptr,
+            .raw_len = sentence.raw.len,
+            .talker = undefined,
+            .formatter = undefined,
+            .kind = 0,
+        };
+        fill(&out.talker, sentence.talker);
+        fill(&out.formatter, sentence.formatter);
+
+        var gga: SerialNmeaGga = undefined;
+        var rmc: SerialNmeaRmc = undefined;
+        var gsv: SerialNmeaGsv = undefined;
+        switch (sentence.data) {
+            .gga => |g| {
+                gga = .{
+                    .latitude = orNan(f64, g.latitude),
+                    .longitude = orNan(f64, g.longitude),
+                    .hdop = orNan(f32, g.hdop),
+                    .altitude_m = orNan(f32, g.altitude_m),
+                    .geoid_separation_m = orNan(f32, g.geoid_separation_m),
+                    .time_ms = g.time_ms orelse std.math.maxInt(u32),
+                    .quality = g.quality,
+                    .satellites = g.satellites,
+                };
+                out.kind = 1;
+                out.gga = &gga;
+            },
+            .rmc => |r| {
+                const date = r.date orelse nmea.Date{ .year = 0, .month = 0, .day = 0 };
+                rmc = .{
+                    .latitude = orNan(f64, r.latitude),
+                    .longitude = orNan(f64, r.longitude),
+                    .speed_knots = orNan(f32, r.speed_knots),
+                    .course_deg = orNan(f32, r.course_deg),
+                    .time_ms = r.time_ms orelse std.math.maxInt(u32),
+                    .year = date.year,
+                    .month = date.month,
+                    .day = date.day,
+                    .valid = r.valid,
+                };
+                out.kind = 2;
+                out.rmc = &rmc;
+            },
+            .gsv => |v| {
+                gsv = .{
+                    .total_messages = v.total_messages,
+                    .message = v.message,
+                    .satellites_in_view = v.satellites_in_view,
+                    .count = v.count,
+                    .signal_id = orMinus(v.signal_id),
+                    .satellites = undefined,
+                };
+                for (v.satellites[0..v.count], gsv.satellites[0..v.count]) |sat, *c_sat| {
+                    c_sat.* = .{
+                        .prn = sat.prn,
+                        .elevation_deg = orMinus(sat.elevation_deg),
+                        .azimuth_deg = orMinus(sat.azimuth_deg),
+                        .snr = orMinus(sat.snr),
+                    };
+                }
+                out.kind = 3;
+                out.gsv = &gsv;
+            },
+            .other => {},
+        }
+        self.callback(&out, self.context);
+    }
+};
+
+/// Creates a streaming NMEA-0183 decoder
+export fn serial_nmea_create(decoder_out: *?SerialNmeaHandle) SerialError {
+    const d = allocator.create(nmea.Decoder) catch {
+        decoder_out.* = null;
+        return .out_of_memory;
+    };
+    d.* = .{};
+    decoder_out.* = d;
+    return .success;
+}
+
+export fn serial_nmea_destroy(decoder_handle: ?SerialNmeaHandle) void {
+    const d = decoder_handle orelse return;
+    allocator.destroy(d);
+}
+
+/// Decodes received bytes (from a hub consumer, say)
+export fn serial_nmea_feed(decoder_handle: ?SerialNmeaHandle, data: [*]const u8, data_len: usize, callback: NmeaCallback, context: ?*anyopaque) SerialError {
+    const d = decoder_handle orelse return .invalid_handle;
+    const bridge = NmeaBridge{ .callback = callback, .context = context };
+    d.feed(data[0..data_len], NmeaBridge.deliver, @constCast(&bridge));
+    return .success;
+}
+
+/// Waits for data on the port and decodes one read's worth
+export fn serial_nmea_read(decoder_handle: ?SerialNmeaHandle, handle: SerialPortHandle, timeout_ms: u32, callback: NmeaCallback, context: ?*anyopaque) SerialError {
+    const d = decoder_handle orelse return .invalid_handle;
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    if (!h.waitForData(timeout_ms)) return .timeout;
+    const bridge = NmeaBridge{ .callback = callback, .context = context };
+    _ = d.readFrom(h, NmeaBridge.deliver, @constCast(&bridge)) catch |err| {
+        return switch (err) {
+            Port.Error.WouldBlock => .success,
+            Port.Error.PortClosed => .port_closed,
+            else => .read_error,
+        };
+    };
+    return .success;
+}
+
+// ============================================================================
+// Expect Automation
+// ============================================================================
+
+/// One alternative for serial_expect (regex and reply may be NULL)
+pub const SerialExpectPattern = extern struct {
+    literal: [*:0]const u8,
+    regex: ?[*:0]const u8 = null,
+    reply: ?[*:0]const u8 = null,
+};
+
+/// An expect session plus scratch memory for compiling patterns. The
+/// arena keeps its capacity between calls, so a script that waits on
+/// the same kind of pattern set over and over stops allocating.
+pub const ExpectSession = struct {
+    expect: Expect,
+    scratch: std.heap.ArenaAllocator,
+    /// Kept pinned until serial_expect_destroy
+    handle: SerialPortHandle,
+};
+
+/// Starts an expect session on a port
+export fn serial_expect_create(handle: SerialPortHandle, session_out: *?SerialExpectHandle) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(ExpectSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{
+        .expect = Expect.init(.{ .port = h }),
+        .scratch = std.heap.ArenaAllocator.init(allocator),
+        .handle = handle,
+    };
+    session_out.* = session;
+    return .success;
+}
+
+/// Frees an expect session (the port stays open)
+export fn serial_expect_destroy(session: ?SerialExpectHandle) void {
+    const s = session orelse return;
+    s.scratch.deinit();
+    port_table.release(s.handle);
+    allocator.destroy(s);
+}
+
+/// Sends data through an expect session
+export fn serial_expect_send(session: ?SerialExpectHandle, data: [*]const u8, data_len: usize) SerialError {
+    const s = session orelse return .invalid_handle;
+    s.expect.send(data[0..data_len]) catch return .write_error;
+    return .success;
+}
+
+/// Waits for any of the patterns; stores the index of the one that matched
+export fn serial_expect(session: ?SerialExpectHandle, patterns: [*]const SerialExpectPattern, count: usize, timeout_ms: u32, match_index: *usize) SerialError {
+    const s = session orelse return .invalid_handle;
+    defer _ = s.scratch.reset(.retain_capacity);
+    const scratch = s.scratch.allocator();
+
+    const converted = scratch.alloc(Expect.Pattern, count) catch return .out_of_memory;
+    for (patterns[0..count], converted) |in, *out| {
+        out.* = .{
+            .literal = std.mem.span(in.literal),
+            .regex = if (in.regex) |r| std.mem.span(r) else null,
+            .reply = if (in.reply) |r| std.mem.span(r) else null,
+        };
+    }
+
+    var matcher = Expect.Matcher.init(scratch, converted) catch |err| {
+        return switch (err) {
+            Expect.Error.OutOfMemory => .out_of_memory,
+            else => .invalid_pattern,
+        };
+    };
+    defer matcher.deinit();
+
+    match_index.* = s.expect.expect(&matcher, timeout_ms) catch |err| {
+        return switch (err) {
+            Expect.Error.Timeout => .timeout,
+            Expect.Error.PortClosed => .port_closed,
+            Expect.Error.WriteError => .write_error,
+            else => .read_error,
+        };
+    };
+    return .success;
+}
+
+// ============================================================================
+// Line Sequencing
+// ============================================================================
+
+/// One step of a DTR/RTS waveform (-1 leaves a line unchanged)
+pub const SerialLineStep = extern struct {
+    dtr: i8 = -1,
+    rts: i8 = -1,
+    hold_us: u32 = 0,
+};
+
+/// Achieved timing of a sequence run
+pub const SerialLineTiming = extern struct {
+    steps: u32 = 0,
+    max_jitter_ns: u64 = 0,
+    mean_jitter_ns: u64 = 0,
+    total_ns: u64 = 0,
+};
+
+/// Plays up to this many steps per call (no allocation)
+const MAX_LINE_STEPS = 64;
+
+/// Plays a DTR/RTS waveform on the port
+export fn serial_run_line_sequence(handle: SerialPortHandle, steps: [*]const SerialLineStep, count: usize, timing: ?*SerialLineTiming) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    if (count > MAX_LINE_STEPS) return .line_control_failed;
+
+    var converted: [MAX_LINE_STEPS]Sequencer.Step = undefined;
+    for (steps[0..count], converted[0..count]) |in, *out| {
+        out.* = .{
+            .dtr = if (in.dtr < 0) null else in.dtr != 0,
+            .rts = if (in.rts < 0) null else in.rts != 0,
+            .hold_us = in.hold_us,
+        };
+    }
+    return runSequence(h, converted[0..count], timing);
+}
+
+/// Plays a built-in reset/bootloader sequence (see SerialLinePreset)
+export fn serial_run_line_preset(handle: SerialPortHandle, preset: u8, timing: ?*SerialLineTiming) SerialError {
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    defer port_table.release(handle);
+    const steps: []const Sequencer.Step = switch (preset) {
+        0 => &Sequencer.esp32_bootloader,
+        1 => &Sequencer.esp32_reset,
+        2 => &Sequencer.stm32_bootloader,
+        3 => &Sequencer.stm32_reset,
+        else => return .line_control_failed,
+    };
+    return runSequence(h, steps, timing);
+}
+
+fn runSequence(h: *Port, steps: []const Sequencer.Step, timing: ?*SerialLineTiming) SerialError {
+    const report = Sequencer.run(h, steps, .{}) catch return .line_control_failed;
+    if (timing) |t| {
+        t.* = .{
+            .steps = @intCast(report.steps),
+            .max_jitter_ns = report.max_jitter_ns,
+            .mean_jitter_ns = report.mean_jitter_ns,
+            .total_ns = report.total_ns,
+        };
+    }
+    return .success;
+}
+
+// ============================================================================
+// Modem-Line Watching
+// ============================================================================
+
+/// A change on CTS/DSR/DCD/RI
+pub const SerialLineEvent = extern struct {
+    timestamp_ns: u64,
+    status: ModemStatus,
+    cts_changes: u32,
+    dsr_changes: u32,
+    dcd_changes: u32,
+    ri_changes: u32,
+
+    fn fromEvent(event: *const LineWatcher.Event) SerialLineEvent {
+        return .{
+            .timestamp_ns = event.timestamp_ns,
+            .status = .{
+                .dtr = event.status.dtr,
+                .rts = event.status.rts,
+                .cts = event.status.cts,
+                .dsr = event.status.dsr,
+                .dcd = event.status.dcd,
+                .ri = event.status.ri,
+            },
+            .cts_changes = event.cts_changes,
+            .dsr_changes = event.dsr_changes,
+            .dcd_changes = event.dcd_changes,
+            .ri_changes = event.ri_changes,
+        };
+    }
+};
+
+pub const LineEventCallback = *const fn (event: *const SerialLineEvent, context: ?*anyopaque) callconv(.c) void;
+
+/// A watcher, its C callback and context, and the port handle it keeps
+/// pinned
+pub const LineWatchSession = struct {
+    watcher: *LineWatcher = undefined,
+    callback: ?LineEventCallback,
+    context: ?*anyopaque,
+    handle: SerialPortHandle,
+
+    fn forward(event: *const LineWatcher.Event, context: ?*anyopaque) void {
+        const self: *LineWatchSession = @ptrCast(@alignCast(context.?));
+        const converted = SerialLineEvent.fromEvent(event);
+        self.callback.?(&converted, self.context);
+    }
+};
+
+/// Chooses the signal that interrupts TIOCMIWAIT when a watcher stops
+/// (0 = none: watchers poll). Call before starting any watcher.
+export fn serial_line_watch_set_signal(signal: c_int) SerialError {
+    if (signal < 0 or signal > 63) return .config_failed;
+    LineWatcher.wake_signal = @intCast(signal);
+    return .success;
+}
+
+/// Starts watching the modem input lines on a helper thread
+export fn serial_line_watch_start(handle: SerialPortHandle, callback: ?LineEventCallback, context: ?*anyopaque, watcher_out: *?SerialLineWatcherHandle) SerialError {
+    watcher_out.* = null;
+    // Stays pinned until serial_line_watch_stop
+    const h = port_table.acquire(handle) orelse return .invalid_handle;
+    const session = allocator.create(LineWatchSession) catch {
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    session.* = .{ .callback = callback, .context = context, .handle = handle };
+    const forward: ?LineWatcher.Callback = if (callback != null) &LineWatchSession.forward else null;
+
+    session.watcher = LineWatcher.create(allocator, h, forward, session) catch {
+        allocator.destroy(session);
+        port_table.release(handle);
+        return .out_of_memory;
+    };
+    watcher_out.* = session;
+    return .success;
+}
+
+/// Stops a watcher; no callbacks run after this returns
+export fn serial_line_watch_stop(watcher: ?SerialLineWatcherHandle) void {
+    const w = watcher orelse return;
+    w.watcher.destroy();
+    port_table.release(w.handle);
+    allocator.destroy(w);
+}
+
+/// Copies queued events (oldest first); returns how many were copied
+export fn serial_line_watch_poll(watcher: ?SerialLineWatcherHandle, events: [*]SerialLineEvent, max_events: usize) usize {
+    const w = watcher orelse return 0;
+    var buf: [16]LineWatcher.Event = undefined;
+    var total: usize = 0;
+    while (total < max_events) {
+        const n = w.watcher.poll(buf[0..@min(buf.len, max_events - total)]);
+        if (n == 0) break;
+        for (buf[0..n], events[total..][0..n]) |*in, *out| out.* = SerialLineEvent.fromEvent(in);
+        total += n;
+    }
+    return total;
+}
+
+test {
+    _ = port;
+    _ = config;
+    _ = scan;
+    _ = hub;
+    _ = expect;
+    _ = aho_corasick;
+    _ = regex;
+    _ = sequencer;
+    _ = line_watcher;
+    _ = mark_decoder;
+    _ = stats;
+    _ = clock;
+    _ = metrics;
+    _ = registry;
+    _ = port_info;
+    _ = handle_table;
+    _ = counting_allocator;
+    _ = virtual_port;
+    _ = pacer;
+    _ = soft_flow;
+    _ = autobaud;
+    _ = supervisor;
+    _ = tx_queue;
+    _ = framer;
+    _ = modbus;
+    _ = nmea;
+}
+
+test "steady-state port and expect calls do not allocate" {
+    const rx = try std.posix.pipe();
+    defer std.posix.close(rx[1]);
+    const tx = try std.posix.pipe();
+    defer std.posix.close(tx[0]);
+
+    const reader = createPort().?;
+    reader.* = Port.fromFdForTesting(rx[0], .{});
+    const rx_handle = port_table.insert(reader).?;
+    defer serial_close(rx_handle);
+    const writer = createPort().?;
+    writer.* = Port.fromFdForTesting(tx[1], .{});
+    const tx_handle = port_table.insert(writer).?;
+    defer serial_close(tx_handle);
+
+    var session: ?SerialExpectHandle = null;
+    try std.testing.expectEqual(SerialError.success, serial_expect_create(rx_handle, &session));
+    defer serial_expect_destroy(session);
+    try std.testing.expectEqual(SerialError.allocator_in_use, serial_set_allocator(null, null, null));
+
+    const patterns = [_]SerialExpectPattern{ .{ .literal = "login: " }, .{ .literal = "$ " } };
+    var buf: [64]u8 = undefined;
+    var warm: u64 = 0;
+    for (0..8) |round| {
+        _ = try std.posix.write(rx[1], "login: ");
+        var index: usize = undefined;
+        try std.testing.expectEqual(SerialError.success, serial_expect(session, &patterns, patterns.len, 1000, &index));
+        try std.testing.expectEqual(@as(usize, 0), index);
+
+        var written: usize = 0;
+        try std.testing.expectEqual(SerialError.success, serial_write(tx_handle, "root\n", 5, &written));
+        try std.testing.expectEqual(@as(usize, 5), try std.posix.read(tx[0], &buf));
+
+        _ = try std.posix.write(rx[1], "motd");
+        var n: usize = 0;
+        try std.testing.expectEqual(SerialError.success, serial_read(rx_handle, &buf, buf.len, &n));
+        try std.testing.expectEqual(@as(usize, 4), n);
+
+        // The first rounds size the expect scratch arena
+        if (round == 1) warm = counting.callCount();
+    }
+    try std.testing.expectEqual(warm, counting.callCount());
+}
@@ -0,0 +1,44 @@
+//! Monotonic clock helpers for timing-sensitive code.
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+const c = @cImport({
+    @cInclude("time.h");
+});
+
+/// Nanoseconds on CLOCK_MONOTONIC
+pub fn now() u64 {
+    var ts: c.timespec = undefined;
+    if (c.clock_gettime(c.CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return @as(u64, @intCast(ts.tv_sec)) * std.time.ns_per_s + @as(u64, @intCast(ts.tv_nsec));
+}
+
+/// Sleeps until `deadline` (a `now()` value)
+pub fn sleepUntil(deadline: u64) void {
+    if (builtin.os.tag == .linux) {
+        const ts = c.timespec{
+            .tv_sec = @intCast(deadline / std.time.ns_per_s),
+            .tv_nsec = @intCast(deadline % std.time.ns_per_s),
+        };
+        // Absolute deadline: an interrupted sleep simply resumes
+        while (c.clock_nanosleep(c.CLOCK_MONOTONIC, c.TIMER_ABSTIME, &ts, null) == @intFromEnum(std.posix.E.INTR)) {}
+    } else {
+        // No clock_nanosleep on macOS
+        const current = now();
+        if (deadline > current) std.Thread.sleep(deadline - current);
+    }
+}
+
+/// Sleeps until `spin_ns` before `deadline`, then busy-waits the rest.
+/// Scheduler wakeup latency only affects the sleep phase.
+pub fn waitUntil(deadline: u64, spin_ns: u64) void {
+    if (deadline > now() + spin_ns) sleepUntil(deadline - spin_ns);
+    while (now() < deadline) std.atomic.spinLoopHint();
+}
+
+test "waitUntil does not return early" {
+    const deadline = now() + 2 * std.time.ns_per_ms;
+    waitUntil(deadline, 200 * std.time.ns_per_us);
+    try std.testing.expect(now() >= deadline);
+}
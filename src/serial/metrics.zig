@@ -0,0 +1,451 @@
+//! Prometheus/OpenMetrics text exposition for port and transfer metrics.
+//!
+//! Rendering writes into a caller-owned buffer and never allocates, so a
+//! scrape costs a handful of atomic loads and one TIOCGICOUNT per port.
+//! Counters are exported raw; rates come from PromQL `rate()`.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const Port = @import("Port.zig").Port;
+const Histogram = @import("Stats.zig").Histogram;
+
+const posix = std.posix;
+
+pub const Kind = enum { counter, gauge, summary };
+
+pub const Label = struct {
+    name: []const u8,
+    value: []const u8,
+};
+
+/// Text exposition built in a fixed buffer. A sample or family header
+/// that does not fit is dropped whole and `truncated` set, so the output
+/// always ends on a complete line.
+pub const Exposition = struct {
+    buffer: []u8,
+    len: usize = 0,
+    truncated: bool = false,
+
+    pub fn init(buffer: []u8) Exposition {
+        return .{ .buffer = buffer };
+    }
+
+    pub fn bytes(self: *const Exposition) []const u8 {
+        return self.buffer[0..self.len];
+    }
+
+    pub fn family(self: *Exposition, name: []const u8, kind: Kind, help: []const u8) void {
+        const start = self.len;
+        self.append("# HELP {s} {s}\n# TYPE {s} {s}\n", .{ name, help, name, @tagName(kind) });
+        if (self.truncated) self.len = start;
+    }
+
+    /// One sample line; `value` may be any integer or float
+    pub fn sample(self: *Exposition, name: []const u8, labels: []const Label, value: anytype) void {
+        const start = self.len;
+        self.append("{s}", .{name});
+        if (labels.len > 0) {
+            self.append("{{", .{});
+            for (labels, 0..) |label, i| {
+                if (i > 0) self.append(",", .{});
+                self.append("{s}=\"", .{label.name});
+                self.appendEscaped(label.value);
+                self.append("\"", .{});
+            }
+            self.append("}}", .{});
+        }
+        self.append(" {d}\n", .{value});
+        if (self.truncated) self.len = start;
+    }
+
+    fn append(self: *Exposition, comptime fmt: []const u8, args: anytype) void {
+        if (self.truncated) return;
+        const text = std.fmt.bufPrint(self.buffer[self.len..], fmt, args) catch {
+            self.truncated = true;
+            return;
+        };
+        self.len += text.len;
+    }
+
+    /// Label values escape backslash, double quote and newline
+    fn appendEscaped(self: *Exposition, value: []const u8) void {
+        for (value) |byte| {
+            switch (byte) {
+                '\\' => self.append("\\\\", .{}),
+                '"' => self.append("\\\"", .{}),
+                '\n' => self.append("\\n", .{}),
+                else => self.append("{c}", .{byte}),
+            }
+        }
+    }
+};
+
+/// Renders the per-port families for `ports`, labelled by device path:
+/// traffic counters, ring occupancy, line errors and latency summaries.
+pub fn renderPorts(e: *Exposition, ports: []const *Port) void {
+    const counters = [_]struct { name: []const u8, help: []const u8, field: []const u8 }{
+        .{ .name = "serialterm_rx_bytes_total", .help = "Bytes read from the port.", .field = "rx_bytes" },
+        .{ .name = "serialterm_tx_bytes_total", .help = "Bytes written to the port.", .field = "tx_bytes" },
+        .{ .name = "serialterm_reads_total", .help = "Read calls that returned data.", .field = "read_calls" },
+        .{ .name = "serialterm_writes_total", .help = "Write calls.", .field = "write_calls" },
+        .{ .name = "serialterm_dropped_bytes_total", .help = "Bytes lost to slow shared-ring consumers.", .field = "dropped_bytes" },
+    };
+    inline for (counters) |counter| {
+        e.family(counter.name, .counter, counter.help);
+        for (ports) |port| {
+            e.sample(counter.name, &.{.{ .name = "port", .value = port.path }}, @field(port.stats, counter.field).load(.monotonic));
+        }
+    }
+
+    e.family("serialterm_ring_high_water_bytes", .gauge, "Largest backlog seen in the shared RX ring.");
+    for (ports) |port| {
+        e.sample("serialterm_ring_high_water_bytes", &.{.{ .name = "port", .value = port.path }}, port.stats.ring_high_water.load(.monotonic));
+    }
+
+    e.family("serialterm_line_errors_total", .counter, "UART errors counted by the driver (TIOCGICOUNT) and through PARMRK markers.");
+    for (ports) |port| {
+        if (port.getCounters()) |total| {
+            const driver = [_]struct { kind: []const u8, value: u32 }{
+                .{ .kind = "frame", .value = total.frame },
+                .{ .kind = "parity", .value = total.parity },
+                .{ .kind = "overrun", .value = total.overrun },
+                .{ .kind = "buffer_overrun", .value = total.buf_overrun },
+                .{ .kind = "break", .value = total.brk },
+            };
+            for (driver) |entry| {
+                e.sample("serialterm_line_errors_total", &.{
+                    .{ .name = "port", .value = port.path },
+                    .{ .name = "source", .value = "driver" },
+                    .{ .name = "type", .value = entry.kind },
+                }, entry.value);
+            }
+        }
+        e.sample("serialterm_line_errors_total", &.{
+            .{ .name = "port", .value = port.path },
+            .{ .name = "source", .value = "marked" },
+            .{ .name = "type", .value = "frame_parity" },
+        }, port.marks.errors);
+        e.sample("serialterm_line_errors_total", &.{
+            .{ .name = "port", .value = port.path },
+            .{ .name = "source", .value = "marked" },
+            .{ .name = "type", .value = "break" },
+        }, port.marks.breaks);
+    }
+
+    e.family("serialterm_rx_latency_seconds", .summary, "Poll readiness to read completion.");
+    for (ports) |port| renderSummary(e, "serialterm_rx_latency_seconds", port.path, &port.stats.rx_latency);
+
+    e.family("serialterm_tx_drain_latency_seconds", .summary, "Write submission to output queue drained.");
+    for (ports) |port| renderSummary(e, "serialterm_tx_drain_latency_seconds", port.path, &port.stats.drain_latency);
+}
+
+/// Quantiles from a nanosecond histogram, in seconds
+fn renderSummary(e: *Exposition, comptime name: []const u8, path: []const u8, histogram: *const Histogram) void {
+    const summary = histogram.summarize();
+    const quantiles = [_]struct { label: []const u8, ns: u64 }{
+        .{ .label = "0.5", .ns = summary.p50 },
+        .{ .label = "0.9", .ns = summary.p90 },
+        .{ .label = "0.99", .ns = summary.p99 },
+        .{ .label = "0.999", .ns = summary.p999 },
+    };
+    for (quantiles) |q| {
+        e.sample(name, &.{ .{ .name = "port", .value = path }, .{ .name = "quantile", .value = q.label } }, seconds(q.ns));
+    }
+    e.sample(name ++ "_count", &.{.{ .name = "port", .value = path }}, summary.count);
+}
+
+fn seconds(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_s;
+}
+
+/// File transfer progress, kept up to date by whoever drives the engines
+pub const TransferStats = struct {
+    active: bool = false,
+    /// Bytes moved by the current (or most recent) transfer
+    bytes: u64 = 0,
+    started_ns: u64 = 0,
+    finished_ns: u64 = 0,
+    /// Retried blocks over all transfers
+    retries: u64 = 0,
+    completed: u64 = 0,
+    failed: u64 = 0,
+    retries_before: u64 = 0,
+
+    pub fn begin(self: *TransferStats, now_ns: u64) void {
+        self.active = true;
+        self.bytes = 0;
+        self.started_ns = now_ns;
+        self.retries_before = self.retries;
+    }
+
+    /// `error_count` is the engine's per-transfer retry count
+    pub fn progress(self: *TransferStats, bytes: u64, error_count: u32) void {
+        self.bytes = bytes;
+        self.retries = self.retries_before + error_count;
+    }
+
+    pub fn finish(self: *TransferStats, ok: bool, now_ns: u64) void {
+        if (!self.active) return;
+        self.active = false;
+        self.finished_ns = now_ns;
+        if (ok) self.completed += 1 else self.failed += 1;
+    }
+
+    /// Payload bytes per second of the current or most recent transfer
+    pub fn goodput(self: TransferStats, now_ns: u64) f64 {
+        const end = if (self.active) now_ns else self.finished_ns;
+        if (end <= self.started_ns) return 0;
+        return @as(f64, @floatFromInt(self.bytes)) / seconds(end - self.started_ns);
+    }
+};
+
+pub fn renderTransfer(e: *Exposition, transfers: TransferStats, now_ns: u64) void {
+    e.family("serialterm_transfer_active", .gauge, "1 while a file transfer is running.");
+    e.sample("serialterm_transfer_active", &.{}, @intFromBool(transfers.active));
+    e.family("serialterm_transfer_bytes", .gauge, "Payload bytes moved by the current or last transfer.");
+    e.sample("serialterm_transfer_bytes", &.{}, transfers.bytes);
+    e.family("serialterm_transfer_goodput_bytes_per_second", .gauge, "Payload throughput of the current or last transfer.");
+    e.sample("serialterm_transfer_goodput_bytes_per_second", &.{}, transfers.goodput(now_ns));
+    e.family("serialterm_transfer_retries_total", .counter, "Blocks retried by the transfer protocols.");
+    e.sample("serialterm_transfer_retries_total", &.{}, transfers.retries);
+    e.family("serialterm_transfers_total", .counter, "Finished file transfers by result.");
+    e.sample("serialterm_transfers_total", &.{.{ .name = "result", .value = "completed" }}, transfers.completed);
+    e.sample("serialterm_transfers_total", &.{.{ .name = "result", .value = "failed" }}, transfers.failed);
+}
+
+/// Scrape endpoint speaking just enough HTTP/1.0 for Prometheus and curl,
+/// over TCP or a Unix socket (`curl --unix-socket`). The listener is
+/// non-blocking so it can sit in the caller's poll/epoll set.
+pub const Endpoint = struct {
+    fd: posix.fd_t,
+    /// Socket file removed again on close
+    unix_path: ?[]const u8 = null,
+
+    pub const Error = error{InvalidAddress} || posix.SocketError || posix.BindError || posix.ListenError || posix.SetSockOptError;
+
+    /// `spec` is "unix:<path>", "<host>:<port>" or a bare port, which
+    /// binds loopback only
+    pub fn listen(spec: []const u8) Error!Endpoint {
+        if (std.mem.startsWith(u8, spec, "unix:")) {
+            const path = spec["unix:".len..];
+            const address = std.net.Address.initUnix(path) catch return error.InvalidAddress;
+            removeStaleSocket(path);
+            const fd = try posix.socket(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC, 0);
+            errdefer posix.close(fd);
+            try posix.bind(fd, &address.any, address.getOsSockLen());
+            try posix.listen(fd, 4);
+            return .{ .fd = fd, .unix_path = path };
+        }
+
+        const colon = std.mem.lastIndexOfScalar(u8, spec, ':');
+        const host = if (colon) |i| spec[0..i] else "127.0.0.1";
+        const port_text = if (colon) |i| spec[i + 1 ..] else spec;
+        const tcp_port = std.fmt.parseInt(u16, port_text, 10) catch return error.InvalidAddress;
+        const address = std.net.Address.parseIp(if (host.len == 0) "127.0.0.1" else host, tcp_port) catch return error.InvalidAddress;
+
+        const fd = try posix.socket(address.any.family, posix.SOCK.STREAM | posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC, posix.IPPROTO.TCP);
+        errdefer posix.close(fd);
+        const one: c_int = 1;
+        try posix.setsockopt(fd, posix.SOL.SOCKET, posix.SO.REUSEADDR, std.mem.asBytes(&one));
+        try posix.bind(fd, &address.any, address.getOsSockLen());
+        try posix.listen(fd, 4);
+        return .{ .fd = fd };
+    }
+
+    pub fn close(self: *Endpoint) void {
+        posix.close(self.fd);
+        if (self.unix_path) |path| posix.unlink(path) catch {};
+    }
+
+    /// Next pending scrape connection, if any
+    pub fn accept(self: *Endpoint) ?posix.fd_t {
+        return posix.accept(self.fd, null, null, posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC) catch null;
+    }
+
+    /// A socket left by an unclean exit would make bind fail; anything
+    /// other than a socket is left alone so bind reports the clash
+    fn removeStaleSocket(path: []const u8) void {
+        const st = posix.fstatat(posix.AT.FDCWD, path, 0) catch return;
+        if ((st.mode & posix.S.IFMT) == posix.S.IFSOCK) posix.unlink(path) catch {};
+    }
+};
+
+/// One scrape connection, advanced a step at a time on readiness events
+/// so a slow or idle scraper never blocks the caller's loop. The reply is
+/// built in a caller-owned buffer: `HEADER_ROOM` bytes for the HTTP
+/// header, then the body.
+pub const Scrape = struct {
+    pub const HEADER_ROOM = 160;
+    /// Total time a scraper gets to send its request and read the reply
+    pub const TIMEOUT_MS = 5000;
+
+    pub const Progress = enum {
+        /// Waiting for the socket; poll for `events()`
+        waiting,
+        /// Request complete: render into `body()`, then call `reply`
+        needs_body,
+        /// Finished or failed; the connection is closed
+        closed,
+    };
+
+    fd: posix.fd_t = -1,
+    buffer: []u8 = &.{},
+    request: [1024]u8 = undefined,
+    request_len: usize = 0,
+    /// Empty while the request is still being read
+    response: []const u8 = &.{},
+    sent: usize = 0,
+    deadline_ms: i64 = 0,
+
+    /// Takes over `conn` (non-blocking, from `Endpoint.accept`)
+    pub fn start(self: *Scrape, conn: posix.fd_t, buffer: []u8, now_ms: i64) void {
+        std.debug.assert(buffer.len > HEADER_ROOM);
+        if (builtin.os.tag.isDarwin()) {
+            const one: c_int = 1;
+            posix.setsockopt(conn, posix.SOL.SOCKET, posix.SO.NOSIGPIPE, std.mem.asBytes(&one)) catch {};
+        }
+        self.* = .{ .fd = conn, .buffer = buffer, .deadline_ms = now_ms + TIMEOUT_MS };
+    }
+
+    pub fn isActive(self: *const Scrape) bool {
+        return self.fd >= 0;
+    }
+
+    /// poll events to wait for: input while reading, output while sending
+    pub fn events(self: *const Scrape) i16 {
+        return if (self.response.len == 0) posix.POLL.IN else posix.POLL.OUT;
+    }
+
+    pub fn body(self: *Scrape) []u8 {
+        return self.buffer[HEADER_ROOM..];
+    }
+
+    /// Reads or sends whatever the socket allows without blocking
+    pub fn advance(self: *Scrape) Progress {
+        if (!self.isActive()) return .closed;
+        if (self.response.len == 0) {
+            // Only the request line matters; read until the header ends
+            while (std.mem.indexOf(u8, self.request[0..self.request_len], "\r\n\r\n") == null and self.request_len < self.request.len) {
+                const n = posix.read(self.fd, self.request[self.request_len..]) catch |err| switch (err) {
+                    error.WouldBlock => return .waiting,
+                    else => return self.finish(),
+                };
+                if (n == 0) break;
+                self.request_len += n;
+            }
+            if (self.request_len == 0) return self.finish();
+            if (!std.mem.startsWith(u8, self.request[0..self.request_len], "GET ")) {
+                self.response = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            } else {
+                return .needs_body;
+            }
+        }
+
+        const flags: u32 = if (builtin.os.tag == .linux) posix.MSG.NOSIGNAL else 0;
+        while (self.sent < self.response.len) {
+            self.sent += posix.send(self.fd, self.response[self.sent..], flags) catch |err| switch (err) {
+                error.WouldBlock => return .waiting,
+                else => return self.finish(),
+            };
+        }
+        return self.finish();
+    }
+
+    /// Queues the first `body_len` bytes of `body()` as the reply; call
+    /// `advance` to send it
+    pub fn reply(self: *Scrape, body_len: usize) void {
+        var header: [HEADER_ROOM]u8 = undefined;
+        const head = std.fmt.bufPrint(&header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: {d}\r\nConnection: close\r\n\r\n", .{body_len}) catch unreachable;
+        const begin = HEADER_ROOM - head.len;
+        @memcpy(self.buffer[begin..HEADER_ROOM], head);
+        self.response = self.buffer[begin .. HEADER_ROOM + body_len];
+    }
+
+    /// Closes the connection if its time is up
+    pub fn expire(self: *Scrape, now_ms: i64) void {
+        if (self.isActive() and now_ms >= self.deadline_ms) _ = self.finish();
+    }
+
+    fn finish(self: *Scrape) Progress {
+        posix.close(self.fd);
+        self.fd = -1;
+        return .closed;
+    }
+};
+
+test "exposition renders families, labels and escapes" {
+    var buffer: [512]u8 = undefined;
+    var e = Exposition.init(&buffer);
+    e.family("demo_total", .counter, "A demo.");
+    e.sample("demo_total", &.{.{ .name = "port", .value = "a\"b\\c" }}, @as(u64, 42));
+    e.sample("demo_seconds", &.{}, @as(f64, 0.25));
+    try std.testing.expectEqualStrings(
+        \\# HELP demo_total A demo.
+        \\# TYPE demo_total counter
+        \\demo_total{port="a\"b\\c"} 42
+        \\demo_seconds 0.25
+        \\
+    , e.bytes());
+    try std.testing.expect(!e.truncated);
+}
+
+test "exposition drops samples that do not fit" {
+    var buffer: [24]u8 = undefined;
+    var e = Exposition.init(&buffer);
+    e.sample("short", &.{}, @as(u64, 1));
+    e.sample("a_much_longer_metric_name", &.{}, @as(u64, 2));
+    try std.testing.expectEqualStrings("short 1\n", e.bytes());
+    try std.testing.expect(e.truncated);
+}
+
+test "transfer goodput and retries" {
+    var transfers = TransferStats{};
+    transfers.begin(0);
+    transfers.progress(1000, 2);
+    try std.testing.expectEqual(@as(f64, 2000), transfers.goodput(std.time.ns_per_s / 2));
+    transfers.finish(true, std.time.ns_per_s);
+    transfers.begin(2 * std.time.ns_per_s);
+    transfers.progress(10, 1);
+    try std.testing.expectEqual(@as(u64, 3), transfers.retries);
+    try std.testing.expectEqual(@as(u64, 1), transfers.completed);
+}
+
+test "scrape steps through request and reply without blocking" {
+    var fds: [2]posix.fd_t = undefined;
+    if (std.c.socketpair(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.NONBLOCK, 0, &fds) != 0) return error.SkipZigTest;
+    defer posix.close(fds[1]);
+
+    var buffer: [Scrape.HEADER_ROOM + 64]u8 = undefined;
+    var scrape = Scrape{};
+    scrape.start(fds[0], &buffer, 0);
+
+    // A scraper that has not sent anything yet costs nothing
+    try std.testing.expectEqual(Scrape.Progress.waiting, scrape.advance());
+    _ = try posix.write(fds[1], "GET /metrics HTTP/1.0\r\n");
+    try std.testing.expectEqual(Scrape.Progress.waiting, scrape.advance());
+    _ = try posix.write(fds[1], "\r\n");
+    try std.testing.expectEqual(Scrape.Progress.needs_body, scrape.advance());
+
+    @memcpy(scrape.body()[0..5], "up 1\n");
+    scrape.reply(5);
+    try std.testing.expectEqual(Scrape.Progress.closed, scrape.advance());
+
+    var out: [256]u8 = undefined;
+    const n = try posix.read(fds[1], &out);
+    try std.testing.expect(std.mem.startsWith(u8, out[0..n], "HTTP/1.0 200 OK\r\n"));
+    try std.testing.expect(std.mem.endsWith(u8, out[0..n], "Content-Length: 5\r\nConnection: close\r\n\r\nup 1\n"));
+}
+
+test "an idle scrape expires" {
+    var fds: [2]posix.fd_t = undefined;
+    if (std.c.socketpair(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.NONBLOCK, 0, &fds) != 0) return error.SkipZigTest;
+    defer posix.close(fds[1]);
+
+    var buffer: [Scrape.HEADER_ROOM + 1]u8 = undefined;
+    var scrape = Scrape{};
+    scrape.start(fds[0], &buffer, 1000);
+    scrape.expire(1000 + Scrape.TIMEOUT_MS - 1);
+    try std.testing.expect(scrape.isActive());
+    scrape.expire(1000 + Scrape.TIMEOUT_MS);
+    try std.testing.expect(!scrape.isActive());
+}
@@ -0,0 +1,392 @@
+//! Modbus RTU over a serial line: CRC, frame timing, a polling master
+//! and a passive bus monitor.
+//!
+//! RTU frames carry no delimiters; a frame ends when the line stays
+//! silent for 3.5 character times (1.75 ms fixed above 19200 baud, as the
+//! specification recommends). Reads are timestamped against that interval
+//! to find boundaries. The master also knows how long each response must
+//! be, so it completes a response the moment its last byte arrives instead
+//! of waiting out the silence.
+
+const std = @import("std");
+const Config = @import("Config.zig").Config;
+const Port = @import("Port.zig").Port;
+const clock = @import("clock.zig");
+
+/// Longest RTU frame: address, 253-byte PDU, CRC
+pub const MAX_ADU = 256;
+
+pub const Error = error{
+    /// The frame's CRC does not match
+    CrcMismatch,
+    /// A frame from another unit or for another function
+    UnexpectedResponse,
+    FrameTooLarge,
+} || Port.Error;
+
+const crc_table = blk: {
+    @setEvalBranchQuota(4096);
+    var table: [256]u16 = undefined;
+    for (&table, 0..) |*entry, i| {
+        var crc: u16 = @intCast(i);
+        for (0..8) |_| crc = if (crc & 1 != 0) (crc >> 1) ^ 0xA001 else crc >> 1;
+        entry.* = crc;
+    }
+    break :blk table;
+};
+
+/// CRC-16/MODBUS, one table lookup per byte
+pub fn crc16(data: []const u8) u16 {
+    var crc: u16 = 0xFFFF;
+    for (data) |byte| crc = (crc >> 8) ^ crc_table[@as(u8, @truncate(crc)) ^ byte];
+    return crc;
+}
+
+/// The inter-frame silence (t3.5) at the port's framing
+pub fn silenceNs(config: Config) u64 {
+    if (config.baud_rate.toSpeed() > 19200) return 1750 * std.time.ns_per_us;
+    return config.charTimeNs() * 7 / 2;
+}
+
+pub const Frame = struct {
+    unit: u8,
+    function: u8,
+    /// PDU after the function code, CRC removed
+    data: []const u8,
+    /// When the frame's last byte was read
+    timestamp_ns: u64,
+
+    pub fn isException(self: Frame) bool {
+        return self.function & 0x80 != 0;
+    }
+
+    /// Checks the CRC and splits an ADU
+    pub fn parse(adu: []const u8, timestamp_ns: u64) Error!Frame {
+        if (adu.len < 4) return Error.CrcMismatch;
+        const body = adu[0 .. adu.len - 2];
+        if (crc16(body) != std.mem.readInt(u16, adu[adu.len - 2 ..][0..2], .little)) return Error.CrcMismatch;
+        return .{ .unit = adu[0], .function = adu[1], .data = body[2..], .timestamp_ns = timestamp_ns };
+    }
+};
+
+/// Builds an ADU (unit, function, data, CRC) in `out`
+pub fn encode(unit: u8, function: u8, data: []const u8, out: []u8) Error![]u8 {
+    const len = data.len + 4;
+    if (len > MAX_ADU or len > out.len) return Error.FrameTooLarge;
+    out[0] = unit;
+    out[1] = function;
+    @memcpy(out[2..][0..data.len], data);
+    std.mem.writeInt(u16, out[len - 2 ..][0..2], crc16(out[0 .. len - 2]), .little);
+    return out[0..len];
+}
+
+/// Length of the response whose first bytes are `adu`, once they tell
+/// (null for functions whose length only silence can show)
+pub fn responseLength(adu: []const u8) ?usize {
+    if (adu.len < 2) return null;
+    if (adu[1] & 0x80 != 0) return 5;
+    return switch (adu[1]) {
+        // Read coils/inputs/registers, read-write registers: byte count
+        1, 2, 3, 4, 0x17 => if (adu.len >= 3) @as(usize, adu[2]) + 5 else null,
+        // Write single/multiple: echo of address and value or quantity
+        5, 6, 15, 16 => 8,
+        else => null,
+    };
+}
+
+/// Collects one frame at a time from a port, ending it at the silence
+const Receiver = struct {
+    buf: [MAX_ADU]u8 = undefined,
+    len: usize = 0,
+    /// When the last bytes were read
+    last_ns: u64 = 0,
+
+    /// Reads until a frame ends (by silence, or at its known length if
+    /// `sized`). Fails with Timeout if nothing starts by `deadline`.
+    fn receive(self: *Receiver, port: *Port, silence_ns: u64, deadline: u64, sized: bool) Error![]u8 {
+        while (true) {
+            const now = clock.now();
+            var until = deadline;
+            if (self.len > 0) {
+                const known = if (sized) responseLength(self.buf[0..self.len]) else null;
+                if (known) |n| {
+                    if (self.len >= n) return self.take(n);
+                }
+                if (now -| self.last_ns >= silence_ns) return self.take(self.len);
+                until = self.last_ns + silence_ns;
+            } else if (now >= deadline) {
+                return Error.Timeout;
+            }
+
+            const wait_ns = until -| now;
+            if (!port.waitForData(@intCast(@min((wait_ns + std.time.ns_per_ms - 1) / std.time.ns_per_ms, std.math.maxInt(u32))))) continue;
+            if (self.len == self.buf.len) {
+                // Longer than any RTU frame: noise or a wrong baud rate
+                self.len = 0;
+                return Error.FrameTooLarge;
+            }
+            const n = port.read(self.buf[self.len..]) catch |err| switch (err) {
+                Port.Error.WouldBlock => continue,
+                else => return err,
+            };
+            if (n == 0) continue;
+            self.len += n;
+            self.last_ns = clock.now();
+        }
+    }
+
+    /// Hands out the first `n` bytes; anything after them is dropped
+    fn take(self: *Receiver, n: usize) []u8 {
+        self.len = 0;
+        return self.buf[0..n];
+    }
+};
+
+/// Polls slaves on a bus. RTU allows one request in flight, so requests
+/// go out back to back: each as soon as the previous response's last byte
+/// plus t3.5 has passed, with no fixed inter-poll delay.
+pub const Master = struct {
+    /// Consecutive failures before a slave counts as offline
+    const OFFLINE_AFTER = 3;
+    /// Cycles an offline slave sits out between retries
+    const RETRY_EVERY = 8;
+
+    pub const Options = struct {
+        /// How long a slave may take to start answering
+        response_timeout_ms: u32 = 100,
+        /// Bus quiet time after a broadcast, for slaves to act on it
+        turnaround_ms: u32 = 100,
+    };
+
+    /// One slave query in a polling cycle
+    pub const Poll = struct {
+        unit: u8,
+        function: u8,
+        data: []const u8,
+        /// Consecutive failures
+        failures: u32 = 0,
+        /// Cycles left to skip while offline
+        skip: u32 = 0,
+    };
+
+    pub const Callback = *const fn (poll: *Poll, result: Error!Frame, context: ?*anyopaque) void;
+
+    port: *Port,
+    options: Options,
+    receiver: Receiver = .{},
+    /// When the bus last went quiet
+    idle_ns: u64 = 0,
+    request: [MAX_ADU]u8 = undefined,
+
+    pub fn init(port: *Port, options: Options) Master {
+        return .{ .port = port, .options = options };
+    }
+
+    /// Sends one request and waits for its response (null for a
+    /// broadcast to unit 0). An exception response is returned as a
+    /// frame; check `isException`. The frame is valid until the next call.
+    pub fn transact(self: *Master, unit: u8, function: u8, data: []const u8) Error!?Frame {
+        const adu = try encode(unit, function, data, &self.request);
+        // Read each time: the port may have been reconfigured
+        const silence_ns = silenceNs(self.port.config);
+        clock.sleepUntil(self.idle_ns + silence_ns);
+        // A late answer to an earlier request must not pass for this one
+        self.port.flushInput();
+        self.receiver.len = 0;
+        try self.port.writeAll(adu);
+
+        // Nothing can come back before the request has left the wire
+        const sent_ns = clock.now() + adu.len * self.port.config.charTimeNs();
+        if (unit == 0) {
+            self.idle_ns = sent_ns + @as(u64, self.options.turnaround_ms) * std.time.ns_per_ms;
+            return null;
+        }
+        const deadline = sent_ns + @as(u64, self.options.response_timeout_ms) * std.time.ns_per_ms;
+        const response = self.receiver.receive(self.port, silence_ns, deadline, true) catch |err| {
+            self.idle_ns = clock.now();
+            return err;
+        };
+        self.idle_ns = self.receiver.last_ns;
+
+        const frame = try Frame.parse(response, self.receiver.last_ns);
+        if (frame.unit != unit or frame.function & 0x7F != function) return Error.UnexpectedResponse;
+        return frame;
+    }
+
+    /// Runs `poll` unless its slave is sitting out a cycle; null then and
+    /// for broadcasts. Tracks failures so an offline slave costs a timeout only every
+    /// `RETRY_EVERY` cycles
+    pub fn pollOne(self: *Master, poll: *Poll) ?(Error!Frame) {
+        if (poll.skip > 0) {
+            poll.skip -= 1;
+            return null;
+        }
+        const result = self.transact(poll.unit, poll.function, poll.data);
+        if (result) |frame| {
+            poll.failures = 0;
+            return frame orelse return null;
+        } else |err| {
+            poll.failures += 1;
+            if (poll.failures >= OFFLINE_AFTER) poll.skip = RETRY_EVERY;
+            return err;
+        }
+    }
+
+    /// One pass over `polls`, reporting each result to `callback`
+    pub fn cycle(self: *Master, polls: []Poll, callback: Callback, context: ?*anyopaque) void {
+        for (polls) |*poll| {
+            if (self.pollOne(poll)) |result| callback(poll, result, context);
+        }
+    }
+};
+
+/// Passive bus monitor: reports every frame on the line, requests and
+/// responses alike, without transmitting
+pub const Sniffer = struct {
+    pub const Capture = struct {
+        frame: Frame,
+        /// Answers the previous frame (same unit and function)
+        response: bool,
+    };
+
+    port: *Port,
+    receiver: Receiver = .{},
+    /// A second frame read together with the previous one
+    held: [MAX_ADU]u8 = undefined,
+    held_len: usize = 0,
+    current: [MAX_ADU]u8 = undefined,
+    /// Unit and function of the last request seen, if it is unanswered
+    request: ?[2]u8 = null,
+    frames: u64 = 0,
+    crc_errors: u64 = 0,
+
+    pub fn init(port: *Port) Sniffer {
+        return .{ .port = port };
+    }
+
+    /// Waits up to `timeout_ms` for the next good frame, which stays
+    /// valid until the next call. Frames failing their CRC are counted
+    /// and skipped.
+    pub fn next(self: *Sniffer, timeout_ms: u32) Error!Capture {
+        const deadline = clock.now() + @as(u64, timeout_ms) * std.time.ns_per_ms;
+        while (true) {
+            var adu: []const u8 = undefined;
+            if (self.held_len > 0) {
+                @memcpy(self.current[0..self.held_len], self.held[0..self.held_len]);
+                adu = self.current[0..self.held_len];
+                self.held_len = 0;
+            } else {
+                adu = self.receiver.receive(self.port, silenceNs(self.port.config), deadline, false) catch |err| switch (err) {
+                    Error.FrameTooLarge => {
+                        self.crc_errors += 1;
+                        continue;
+                    },
+                    else => return err,
+                };
+            }
+
+            const parsed: ?Frame = Frame.parse(adu, self.receiver.last_ns) catch self.split(adu);
+            const frame = parsed orelse {
+                self.crc_errors += 1;
+                continue;
+            };
+            self.frames += 1;
+            return self.classify(frame);
+        }
+    }
+
+    /// A request and its response can reach one read when the driver
+    /// buffers across the silence. Finds the split where both halves
+    /// pass their CRC; the second is held for the next call.
+    fn split(self: *Sniffer, adu: []const u8) ?Frame {
+        var at: usize = 4;
+        while (at + 4 <= adu.len) : (at += 1) {
+            _ = Frame.parse(adu[0..at], 0) catch continue;
+            _ = Frame.parse(adu[at..], 0) catch continue;
+            @memcpy(self.held[0 .. adu.len - at], adu[at..]);
+            self.held_len = adu.len - at;
+            // The receiver's buffer is reused by the next read
+            @memcpy(self.current[0..at], adu[0..at]);
+            return Frame.parse(self.current[0..at], self.receiver.last_ns) catch unreachable;
+        }
+        return null;
+    }
+
+    fn classify(self: *Sniffer, frame: Frame) Capture {
+        const key = [2]u8{ frame.unit, frame.function & 0x7F };
+        const response = if (self.request) |request| std.mem.eql(u8, &request, &key) else false;
+        self.request = if (response) null else key;
+        return .{ .frame = frame, .response = response };
+    }
+};
+
+test "crc16 matches the CRC-16/MODBUS check value" {
+    try std.testing.expectEqual(@as(u16, 0x4B37), crc16("123456789"));
+    try std.testing.expectEqual(std.hash.crc.Crc16Modbus.hash("\x01\x03\x00\x00\x00\x0a"), crc16("\x01\x03\x00\x00\x00\x0a"));
+
+    var buf: [MAX_ADU]u8 = undefined;
+    const adu = try encode(1, 3, "\x00\x00\x00\x0a", &buf);
+    try std.testing.expectEqualSlices(u8, "\x01\x03\x00\x00\x00\x0a\xc5\xcd", adu);
+    const frame = try Frame.parse(adu, 0);
+    try std.testing.expectEqualSlices(u8, "\x00\x00\x00\x0a", frame.data);
+    try std.testing.expectEqual(@as(?usize, 8), responseLength("\x01\x06"));
+    try std.testing.expectEqual(@as(?usize, 9), responseLength("\x01\x03\x04"));
+}
+
+test "silence is 3.5 characters, fixed above 19200 baud" {
+    try std.testing.expectEqual(@as(u64, 3_645_831), silenceNs(.{ .baud_rate = .B9600 }));
+    try std.testing.expectEqual(@as(u64, 1_750_000), silenceNs(.{ .baud_rate = .B115200 }));
+}
+
+fn answerTwice(port: *Port) void {
+    var sniffer = Sniffer.init(port);
+    var buf: [MAX_ADU]u8 = undefined;
+    for (0..2) |_| {
+        const capture = sniffer.next(1000) catch return;
+        const reply = encode(capture.frame.unit, capture.frame.function, "\x02\x12\x34", &buf) catch return;
+        port.writeAll(reply) catch return;
+    }
+}
+
+test "master polls a slave and skips one that stays silent" {
+    const VirtualPort = @import("VirtualPort.zig").VirtualPort;
+    const pair = try VirtualPort.create(std.testing.allocator, .{});
+    var ports = try pair.open(.{ .baud_rate = .B19200 });
+    pair.release();
+    defer for (&ports) |*p| p.close();
+
+    const slave = try std.Thread.spawn(.{}, answerTwice, .{&ports[1]});
+    var master = Master.init(&ports[0], .{ .response_timeout_ms = 20 });
+    for (0..2) |_| {
+        const frame = (try master.transact(7, 3, "\x00\x10\x00\x01")).?;
+        try std.testing.expectEqual(@as(u8, 7), frame.unit);
+        try std.testing.expectEqualSlices(u8, "\x02\x12\x34", frame.data);
+    }
+    slave.join();
+
+    var dead = Master.Poll{ .unit = 9, .function = 3, .data = "\x00\x00\x00\x01" };
+    for (0..Master.OFFLINE_AFTER) |_| {
+        try std.testing.expectError(Error.Timeout, master.pollOne(&dead).?);
+    }
+    try std.testing.expect(master.pollOne(&dead) == null);
+}
+
+test "sniffer splits a request and response read together" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[1]);
+    var port = Port.fromFdForTesting(fds[0], .{ .baud_rate = .B9600 });
+    defer port.close();
+
+    var buf: [2 * MAX_ADU]u8 = undefined;
+    const request = try encode(4, 6, "\x00\x01\x00\x03", &buf);
+    const response = try encode(4, 6, "\x00\x01\x00\x03", buf[request.len..]);
+    _ = try std.posix.write(fds[1], buf[0 .. request.len + response.len]);
+
+    var sniffer = Sniffer.init(&port);
+    const first = try sniffer.next(100);
+    try std.testing.expect(!first.response);
+    const second = try sniffer.next(100);
+    try std.testing.expect(second.response);
+    try std.testing.expectEqualSlices(u8, "\x00\x01\x00\x03", second.frame.data);
+    try std.testing.expectError(Error.Timeout, sniffer.next(10));
+}
@@ -0,0 +1,372 @@
+//! Streaming NMEA-0183 decoder for GNSS receivers.
+//!
+//! Sentences are located with the vector scanners (`$`, `*`, LF), their
+//! XOR checksums verified with `scan.xorBytes`, and their fields split
+//! into slices of the received data, so decoding allocates nothing and
+//! copies only a sentence cut off at the end of a read. GGA, RMC and GSV
+//! are parsed into structs; other sentences are delivered with their
+//! fields only.
+
+const std = @import("std");
+const Port = @import("Port.zig").Port;
+const scan = @import("scan.zig");
+
+/// Longest sentence kept across reads. The standard allows 82
+/// characters; receivers' proprietary sentences run longer.
+pub const MAX_SENTENCE = 256;
+/// Fields beyond this are not split out
+pub const MAX_FIELDS = 40;
+
+pub const Date = struct {
+    year: u16,
+    month: u8,
+    day: u8,
+};
+
+/// Fix data (GGA)
+pub const Gga = struct {
+    /// UTC milliseconds since midnight
+    time_ms: ?u32,
+    /// Degrees, south and west negative
+    latitude: ?f64,
+    longitude: ?f64,
+    /// 0 no fix, 1 GPS, 2 DGPS, 4 RTK fixed, 5 RTK float, ...
+    quality: u8,
+    satellites: u8,
+    hdop: ?f32,
+    /// Above mean sea level
+    altitude_m: ?f32,
+    geoid_separation_m: ?f32,
+};
+
+/// Recommended minimum data (RMC)
+pub const Rmc = struct {
+    time_ms: ?u32,
+    /// Status A; V means the receiver has no valid fix
+    valid: bool,
+    latitude: ?f64,
+    longitude: ?f64,
+    speed_knots: ?f32,
+    course_deg: ?f32,
+    date: ?Date,
+};
+
+pub const Satellite = struct {
+    prn: u16,
+    elevation_deg: ?u8,
+    azimuth_deg: ?u16,
+    /// C/N0 in dB-Hz; null when not tracking
+    snr: ?u8,
+};
+
+/// Satellites in view (GSV), up to four per sentence
+pub const Gsv = struct {
+    total_messages: u8,
+    message: u8,
+    satellites_in_view: u8,
+    satellites: [4]Satellite,
+    count: u8,
+    /// NMEA 4.10 signal ID, if present
+    signal_id: ?u8,
+};
+
+pub const Data = union(enum) {
+    gga: Gga,
+    rmc: Rmc,
+    gsv: Gsv,
+    other,
+};
+
+pub const Sentence = struct {
+    /// Whole sentence from `$` up to the checksum
+    raw: []const u8,
+    /// "GP", "GN", "GA", ... ("P" for proprietary sentences)
+    talker: []const u8,
+    /// "GGA", "RMC", ... (the manufacturer code and type if proprietary)
+    formatter: []const u8,
+    /// Fields after the address
+    fields: []const []const u8,
+    data: Data,
+};
+
+pub const Callback = *const fn (sentence: *const Sentence, context: ?*anyopaque) void;
+
+pub const Decoder = struct {
+    /// Start of a sentence cut off by the end of the last read
+    partial: [MAX_SENTENCE]u8 = undefined,
+    partial_len: usize = 0,
+    sentences: u64 = 0,
+    checksum_errors: u64 = 0,
+    /// Sentences longer than MAX_SENTENCE, dropped
+    overflows: u64 = 0,
+
+    /// Decodes the sentences in `data`, calling `callback` for each one
+    /// with a good checksum. The sentence is valid only during the call.
+    pub fn feed(self: *Decoder, data: []const u8, callback: Callback, context: ?*anyopaque) void {
+        var i: usize = 0;
+        if (self.partial_len > 0) {
+            const end = scan.indexOfByte(data, 0, '\n');
+            const tail = data[0 .. if (end) |e| e + 1 else data.len];
+            if (self.partial_len + tail.len > self.partial.len) {
+                self.overflows += 1;
+                self.partial_len = 0;
+            } else {
+                @memcpy(self.partial[self.partial_len..][0..tail.len], tail);
+                self.partial_len += tail.len;
+                if (end == null) return;
+                const line = self.partial[0..self.partial_len];
+                self.partial_len = 0;
+                self.decodeLine(line, callback, context);
+            }
+            i = tail.len;
+        }
+
+        while (scan.indexOfByte(data, i, '$')) |start| {
+            const end = scan.indexOfByte(data, start, '\n') orelse {
+                const rest = data[start..];
+                if (rest.len > self.partial.len) {
+                    self.overflows += 1;
+                    return;
+                }
+                @memcpy(self.partial[0..rest.len], rest);
+                self.partial_len = rest.len;
+                return;
+            };
+            self.decodeLine(data[start .. end + 1], callback, context);
+            i = end + 1;
+        }
+    }
+
+    /// Reads once from `port` and decodes what arrived
+    pub fn readFrom(self: *Decoder, port: *Port, callback: Callback, context: ?*anyopaque) Port.Error!usize {
+        var buf: [4096]u8 = undefined;
+        const n = try port.read(&buf);
+        self.feed(buf[0..n], callback, context);
+        return n;
+    }
+
+    /// `line` runs from `$` through LF
+    fn decodeLine(self: *Decoder, line: []const u8, callback: Callback, context: ?*anyopaque) void {
+        // A sentence cut short by noise leaves a second `$` in the line
+        const start = std.mem.lastIndexOfScalar(u8, line, '$') orelse return;
+        const text = line[start..];
+        const star = scan.indexOfEither(text, 1, '*', '\n') orelse return;
+        if (text[star] != '*' or star + 3 > text.len) {
+            self.checksum_errors += 1;
+            return;
+        }
+        const body = text[1..star];
+        const expected = std.fmt.parseInt(u8, text[star + 1 .. star + 3], 16) catch {
+            self.checksum_errors += 1;
+            return;
+        };
+        if (scan.xorBytes(body) != expected) {
+            self.checksum_errors += 1;
+            return;
+        }
+
+        var slices: [MAX_FIELDS + 1][]const u8 = undefined;
+        const count = splitFields(body, &slices);
+        const address = slices[0];
+        const proprietary = address.len > 0 and address[0] == 'P';
+        const talker_len: usize = if (proprietary) 1 else @min(address.len, 2);
+        const fields = slices[1..count];
+
+        const formatter = address[talker_len..];
+        const data: Data = if (std.mem.eql(u8, formatter, "GGA") and !proprietary)
+            .{ .gga = parseGga(fields) }
+        else if (std.mem.eql(u8, formatter, "RMC") and !proprietary)
+            .{ .rmc = parseRmc(fields) }
+        else if (std.mem.eql(u8, formatter, "GSV") and !proprietary)
+            .{ .gsv = parseGsv(fields) }
+        else
+            .other;
+
+        const sentence = Sentence{
+            .raw = text[0..star],
+            .talker = address[0..talker_len],
+            .formatter = formatter,
+            .fields = fields,
+            .data = data,
+        };
+        self.sentences += 1;
+        callback(&sentence, context);
+    }
+};
+
+/// Splits comma-separated `body` into `out`; returns the field count.
+/// Fields past `out.len` stay joined to the last one.
+pub fn splitFields(body: []const u8, out: [][]const u8) usize {
+    var count: usize = 0;
+    var start: usize = 0;
+    while (count + 1 < out.len) {
+        const comma = scan.indexOfByte(body, start, ',') orelse break;
+        out[count] = body[start..comma];
+        count += 1;
+        start = comma + 1;
+    }
+    out[count] = body[start..];
+    return count + 1;
+}
+
+fn field(fields: []const []const u8, i: usize) []const u8 {
+    return if (i < fields.len) fields[i] else "";
+}
+
+fn int(comptime T: type, text: []const u8) ?T {
+    if (text.len == 0) return null;
+    return std.fmt.parseInt(T, text, 10) catch null;
+}
+
+fn float(comptime T: type, text: []const u8) ?T {
+    if (text.len == 0) return null;
+    return std.fmt.parseFloat(T, text) catch null;
+}
+
+/// "hhmmss.sss" to milliseconds since midnight
+fn parseTime(text: []const u8) ?u32 {
+    if (text.len < 6) return null;
+    const hours = int(u32, text[0..2]) orelse return null;
+    const minutes = int(u32, text[2..4]) orelse return null;
+    const seconds = float(f64, text[4..]) orelse return null;
+    // Also rejects NaN, and exponents that would overflow the conversion;
+    // 60 allows for a leap second
+    if (hours > 23 or minutes > 59 or !(seconds >= 0 and seconds < 61)) return null;
+    return (hours * 60 + minutes) * 60_000 + @as(u32, @intFromFloat(@round(seconds * 1000)));
+}
+
+/// "ddmmyy"
+fn parseDate(text: []const u8) ?Date {
+    if (text.len != 6) return null;
+    return .{
+        .day = int(u8, text[0..2]) orelse return null,
+        .month = int(u8, text[2..4]) orelse return null,
+        .year = 2000 + (int(u16, text[4..6]) orelse return null),
+    };
+}
+
+/// "(d)ddmm.mmmm" plus hemisphere to signed degrees
+fn parseCoordinate(text: []const u8, hemisphere: []const u8) ?f64 {
+    const dot = std.mem.indexOfScalar(u8, text, '.') orelse text.len;
+    if (dot < 3) return null;
+    const degrees = float(f64, text[0 .. dot - 2]) orelse return null;
+    const minutes = float(f64, text[dot - 2 ..]) orelse return null;
+    const value = degrees + minutes / 60;
+    if (hemisphere.len != 1) return null;
+    return switch (hemisphere[0]) {
+        'N', 'E' => value,
+        'S', 'W' => -value,
+        else => null,
+    };
+}
+
+fn parseGga(fields: []const []const u8) Gga {
+    return .{
+        .time_ms = parseTime(field(fields, 0)),
+        .latitude = parseCoordinate(field(fields, 1), field(fields, 2)),
+        .longitude = parseCoordinate(field(fields, 3), field(fields, 4)),
+        .quality = int(u8, field(fields, 5)) orelse 0,
+        .satellites = int(u8, field(fields, 6)) orelse 0,
+        .hdop = float(f32, field(fields, 7)),
+        .altitude_m = float(f32, field(fields, 8)),
+        .geoid_separation_m = float(f32, field(fields, 10)),
+    };
+}
+
+fn parseRmc(fields: []const []const u8) Rmc {
+    return .{
+        .time_ms = parseTime(field(fields, 0)),
+        .valid = std.mem.eql(u8, field(fields, 1), "A"),
+        .latitude = parseCoordinate(field(fields, 2), field(fields, 3)),
+        .longitude = parseCoordinate(field(fields, 4), field(fields, 5)),
+        .speed_knots = float(f32, field(fields, 6)),
+        .course_deg = float(f32, field(fields, 7)),
+        .date = parseDate(field(fields, 8)),
+    };
+}
+
+fn parseGsv(fields: []const []const u8) Gsv {
+    var gsv = Gsv{
+        .total_messages = int(u8, field(fields, 0)) orelse 0,
+        .message = int(u8, field(fields, 1)) orelse 0,
+        .satellites_in_view = int(u8, field(fields, 2)) orelse 0,
+        .satellites = undefined,
+        .count = 0,
+        .signal_id = null,
+    };
+    const rest = fields[@min(fields.len, 3)..];
+    // Blocks of four fields, optionally followed by the signal ID
+    if (rest.len % 4 == 1) gsv.signal_id = int(u8, rest[rest.len - 1]);
+    var i: usize = 0;
+    while (i + 4 <= rest.len and gsv.count < gsv.satellites.len) : (i += 4) {
+        const prn = int(u16, rest[i]) orelse continue;
+        gsv.satellites[gsv.count] = .{
+            .prn = prn,
+            .elevation_deg = int(u8, rest[i + 1]),
+            .azimuth_deg = int(u16, rest[i + 2]),
+            .snr = int(u8, rest[i + 3]),
+        };
+        gsv.count += 1;
+    }
+    return gsv;
+}
+
+const Collector = struct {
+    seen: [4]Data = undefined,
+    count: usize = 0,
+
+    fn collect(sentence: *const Sentence, context: ?*anyopaque) void {
+        const self: *Collector = @ptrCast(@alignCast(context.?));
+        self.seen[self.count] = sentence.data;
+        self.count += 1;
+    }
+};
+
+test "decodes GGA, RMC and GSV across split reads" {
+    const stream =
+        "$GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*69\r\n" ++
+        "$GNRMC,123519.00,A,4807.038,N,01131.000,E,022.4,084.4,230324,003.1,W*51\r\n" ++
+        "$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45*75\r\n";
+
+    var decoder = Decoder{};
+    var collector = Collector{};
+    // Cut mid-sentence, as reads from a fast receiver usually are
+    decoder.feed(stream[0..40], Collector.collect, &collector);
+    decoder.feed(stream[40..100], Collector.collect, &collector);
+    decoder.feed(stream[100..], Collector.collect, &collector);
+    try std.testing.expectEqual(@as(usize, 3), collector.count);
+    try std.testing.expectEqual(@as(u64, 0), decoder.checksum_errors);
+
+    const gga = collector.seen[0].gga;
+    try std.testing.expectEqual(@as(?u32, 45_319_000), gga.time_ms);
+    try std.testing.expectApproxEqAbs(@as(f64, 48.1173), gga.latitude.?, 1e-9);
+    try std.testing.expectApproxEqAbs(@as(f64, 11.516667), gga.longitude.?, 1e-6);
+    try std.testing.expectEqual(@as(u8, 8), gga.satellites);
+
+    const rmc = collector.seen[1].rmc;
+    try std.testing.expect(rmc.valid);
+    try std.testing.expectEqual(Date{ .year = 2024, .month = 3, .day = 23 }, rmc.date.?);
+
+    const gsv = collector.seen[2].gsv;
+    try std.testing.expectEqual(@as(u8, 4), gsv.count);
+    try std.testing.expectEqual(@as(u16, 14), gsv.satellites[3].prn);
+    try std.testing.expectEqual(@as(?u8, 45), gsv.satellites[3].snr);
+}
+
+test "bad checksums and truncated sentences are dropped" {
+    var decoder = Decoder{};
+    var collector = Collector{};
+    decoder.feed("$GPGGA,1*00\r\n$GPRMC,12$GPXTE,A,A,0.67,L,N*6F\r\n", Collector.collect, &collector);
+    try std.testing.expectEqual(@as(usize, 1), collector.count);
+    try std.testing.expect(collector.seen[0] == .other);
+    try std.testing.expectEqual(@as(u64, 1), decoder.checksum_errors);
+}
+
+test "malformed times are rejected, not converted" {
+    try std.testing.expectEqual(@as(?u32, 45_296_500), parseTime("123456.5"));
+    try std.testing.expectEqual(@as(?u32, 86_400_000), parseTime("235960"));
+    try std.testing.expectEqual(@as(?u32, null), parseTime("1200-1"));
+    try std.testing.expectEqual(@as(?u32, null), parseTime("12005e30"));
+    try std.testing.expectEqual(@as(?u32, null), parseTime("1200nan"));
+    try std.testing.expectEqual(@as(?u32, null), parseTime("246000"));
+}
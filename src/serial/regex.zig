@@ -0,0 +1,155 @@
+//! Minimal backtracking regular expressions for confirming expect matches.
+//!
+//! Supported: literals, `.`, `[abc]`, `[^a-z]`, `\d \w \s` (and `\D \W \S`),
+//! `\r \n \t`, escaped metacharacters, the quantifiers `* + ?` and the
+//! anchors `^` (leading) and `$` (trailing). There are no groups or
+//! alternation; patterns are interpreted directly without compilation.
+
+const std = @import("std");
+
+pub const Error = error{InvalidPattern};
+
+/// Checks that `pattern` is well formed
+pub fn validate(pattern: []const u8) Error!void {
+    var p = pattern;
+    if (p.len > 0 and p[0] == '^') p = p[1..];
+    while (p.len > 0) {
+        if (p.len == 1 and p[0] == '$') return;
+        if (isQuantifier(p[0])) return Error.InvalidPattern;
+        const len = atomLength(p) orelse return Error.InvalidPattern;
+        p = p[len..];
+        if (p.len > 0 and isQuantifier(p[0])) p = p[1..];
+    }
+}
+
+/// Returns true if `pattern` matches anywhere in `text`.
+/// The pattern must have passed `validate`.
+pub fn search(pattern: []const u8, text: []const u8) bool {
+    if (pattern.len > 0 and pattern[0] == '^') return matchHere(pattern[1..], text, 0);
+    var i: usize = 0;
+    while (i <= text.len) : (i += 1) {
+        if (matchHere(pattern, text, i)) return true;
+    }
+    return false;
+}
+
+fn matchHere(pattern: []const u8, text: []const u8, start: usize) bool {
+    var p = pattern;
+    var i = start;
+    while (true) {
+        if (p.len == 0) return true;
+        if (p.len == 1 and p[0] == '$') return i == text.len;
+
+        const len = atomLength(p) orelse return false;
+        const atom = p[0..len];
+        const rest = p[len..];
+
+        if (rest.len > 0 and isQuantifier(rest[0])) {
+            const min: usize = if (rest[0] == '+') 1 else 0;
+            const max: usize = if (rest[0] == '?') 1 else std.math.maxInt(usize);
+            var n: usize = 0;
+            while (i + n < text.len and n < max and atomMatches(atom, text[i + n])) n += 1;
+            // Greedy: try the longest run first, then back off
+            while (n >= min) : (n -= 1) {
+                if (matchHere(rest[1..], text, i + n)) return true;
+                if (n == 0) break;
+            }
+            return false;
+        }
+
+        if (i >= text.len or !atomMatches(atom, text[i])) return false;
+        p = rest;
+        i += 1;
+    }
+}
+
+fn isQuantifier(c: u8) bool {
+    return c == '*' or c == '+' or c == '?';
+}
+
+/// Length of the atom at the start of `p`, or null if it is malformed
+fn atomLength(p: []const u8) ?usize {
+    switch (p[0]) {
+        '\\' => return if (p.len >= 2) 2 else null,
+        '[' => {
+            var j: usize = 1;
+            if (j < p.len and p[j] == '^') j += 1;
+            // A leading ']' is a literal member
+            if (j < p.len and p[j] == ']') j += 1;
+            while (j < p.len) : (j += 1) {
+                if (p[j] == '\\') {
+                    j += 1;
+                } else if (p[j] == ']') {
+                    return j + 1;
+                }
+            }
+            return null;
+        },
+        else => return 1,
+    }
+}
+
+fn atomMatches(atom: []const u8, c: u8) bool {
+    return switch (atom[0]) {
+        '.' => true,
+        '\\' => escapeMatches(atom[1], c),
+        '[' => classMatches(atom[1 .. atom.len - 1], c),
+        else => atom[0] == c,
+    };
+}
+
+fn escapeMatches(e: u8, c: u8) bool {
+    return switch (e) {
+        'd' => std.ascii.isDigit(c),
+        'D' => !std.ascii.isDigit(c),
+        'w' => std.ascii.isAlphanumeric(c) or c == '_',
+        'W' => !(std.ascii.isAlphanumeric(c) or c == '_'),
+        's' => std.ascii.isWhitespace(c),
+        'S' => !std.ascii.isWhitespace(c),
+        'r' => c == '\r',
+        'n' => c == '\n',
+        't' => c == '\t',
+        else => e == c,
+    };
+}
+
+fn classMatches(body: []const u8, c: u8) bool {
+    var b = body;
+    const negate = b.len > 0 and b[0] == '^';
+    if (negate) b = b[1..];
+
+    var found = false;
+    var j: usize = 0;
+    while (j < b.len) {
+        if (b[j] == '\\' and j + 1 < b.len) {
+            if (escapeMatches(b[j + 1], c)) found = true;
+            j += 2;
+        } else if (j + 2 < b.len and b[j + 1] == '-') {
+            if (c >= b[j] and c <= b[j + 2]) found = true;
+            j += 3;
+        } else {
+            if (b[j] == c) found = true;
+            j += 1;
+        }
+    }
+    return found != negate;
+}
+
+test "regex search" {
+    try std.testing.expect(search("U-Boot 20\\d\\d", "U-Boot 2024.01 (Jan 01)"));
+    try std.testing.expect(search("^root@\\w+:.*# $", "root@imx8:~# "));
+    try std.testing.expect(!search("^root@\\w+:.*# $", "echo root@x:# done"));
+    try std.testing.expect(search("[Ll]ogin: ?$", "board login:"));
+    try std.testing.expect(search("colou?r", "color"));
+    try std.testing.expect(!search("[^0-9]+$", "abc1"));
+    try std.testing.expect(search("a.+c", "xxabbbcxx"));
+}
+
+test "regex validate" {
+    try validate("^[a-z]+\\d*$");
+    try validate("[]x]");
+    try std.testing.expectError(Error.InvalidPattern, validate("*abc"));
+    try std.testing.expectError(Error.InvalidPattern, validate("[abc"));
+    try std.testing.expectError(Error.InvalidPattern, validate("abc\\"));
+    try std.testing.expectError(Error.InvalidPattern, validate("a**"));
+}
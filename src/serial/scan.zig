@@ -0,0 +1,99 @@
+//! Vectorized byte scanning helpers shared by the stream parsers
+
+const std = @import("std");
+
+/// Native vector width for byte comparisons (falls back to 16 lanes)
+pub const vector_len = std.simd.suggestVectorLength(u8) orelse 16;
+
+const ByteVector = @Vector(vector_len, u8);
+
+/// Returns the index of the first `needle` at or after `start`
+pub fn indexOfByte(data: []const u8, start: usize, needle: u8) ?usize {
+    var i = start;
+    const needles: ByteVector = @splat(needle);
+    while (i + vector_len <= data.len) : (i += vector_len) {
+        const chunk: ByteVector = data[i..][0..vector_len].*;
+        const hits = chunk == needles;
+        if (@reduce(.Or, hits)) {
+            return i + std.simd.firstTrue(hits).?;
+        }
+    }
+    while (i < data.len) : (i += 1) {
+        if (data[i] == needle) return i;
+    }
+    return null;
+}
+
+/// Returns the index of the first byte equal to either `a` or `b`
+pub fn indexOfEither(data: []const u8, start: usize, a: u8, b: u8) ?usize {
+    var i = start;
+    const as: ByteVector = @splat(a);
+    const bs: ByteVector = @splat(b);
+    while (i + vector_len <= data.len) : (i += vector_len) {
+        const chunk: ByteVector = data[i..][0..vector_len].*;
+        const hits = (chunk == as) | (chunk == bs);
+        if (@reduce(.Or, hits)) {
+            return i + std.simd.firstTrue(hits).?;
+        }
+    }
+    while (i < data.len) : (i += 1) {
+        if (data[i] == a or data[i] == b) return i;
+    }
+    return null;
+}
+
+/// Counts occurrences of `needle` in `data`
+pub fn countByte(data: []const u8, needle: u8) usize {
+    var count: usize = 0;
+    var i: usize = 0;
+    const needles: ByteVector = @splat(needle);
+    while (i + vector_len <= data.len) : (i += vector_len) {
+        const chunk: ByteVector = data[i..][0..vector_len].*;
+        const mask: std.meta.Int(.unsigned, vector_len) = @bitCast(chunk == needles);
+        count += @popCount(mask);
+    }
+    while (i < data.len) : (i += 1) {
+        if (data[i] == needle) count += 1;
+    }
+    return count;
+}
+
+/// XOR of every byte in `data` (NMEA-style checksum)
+pub fn xorBytes(data: []const u8) u8 {
+    var acc: ByteVector = @splat(0);
+    var i: usize = 0;
+    while (i + vector_len <= data.len) : (i += vector_len) {
+        const chunk: ByteVector = data[i..][0..vector_len].*;
+        acc ^= chunk;
+    }
+    var result = @reduce(.Xor, acc);
+    while (i < data.len) : (i += 1) result ^= data[i];
+    return result;
+}
+
+test "indexOfByte across vector boundaries" {
+    var data = [_]u8{'a'} ** 100;
+    try std.testing.expectEqual(@as(?usize, null), indexOfByte(&data, 0, 0xFF));
+    data[37] = 0xFF;
+    data[90] = 0xFF;
+    try std.testing.expectEqual(@as(?usize, 37), indexOfByte(&data, 0, 0xFF));
+    try std.testing.expectEqual(@as(?usize, 90), indexOfByte(&data, 38, 0xFF));
+    try std.testing.expectEqual(@as(usize, 2), countByte(&data, 0xFF));
+}
+
+test "indexOfEither" {
+    const data = "0123456789abcdef0123456789*abc\r\n";
+    try std.testing.expectEqual(@as(?usize, 26), indexOfEither(data, 0, '*', '\r'));
+    try std.testing.expectEqual(@as(?usize, 30), indexOfEither(data, 27, '*', '\r'));
+}
+
+test "xorBytes matches a bytewise fold" {
+    var data: [77]u8 = undefined;
+    var expected: u8 = 0;
+    for (&data, 0..) |*byte, i| {
+        byte.* = @truncate(i * 37 + 11);
+        expected ^= byte.*;
+    }
+    try std.testing.expectEqual(expected, xorBytes(&data));
+    try std.testing.expectEqual(@as(u8, 0), xorBytes(""));
+}
@@ -0,0 +1,617 @@
+const std = @import("std");
+const serial = @import("serial");
+const telnet = @import("telnet.zig");
+const rfc2217 = @import("rfc2217.zig");
+const trace = @import("trace");
+
+const linux = std.os.linux;
+const posix = std.posix;
+
+const Port = serial.port.Port;
+const Config = serial.config.Config;
+const metrics = serial.metrics;
+
+const usage =
+    \\Usage: serialterm-server [options] <device> [<device> ...]
+    \\
+    \\Exposes local serial ports over TCP using RFC 2217 (Telnet COM-PORT-OPTION).
+    \\Each device is served on its own TCP port, starting at the base port.
+    \\
+    \\Options:
+    \\  -l, --listen <addr>   Address to bind (default 0.0.0.0)
+    \\  -p, --port <port>     First TCP port (default 7000)
+    \\  -b, --baud <rate>     Initial baud rate (default 115200)
+    \\  -t, --trace <file>    Write a Chrome trace to <file> on SIGUSR1
+    \\                        (needs a -Dtrace=true build)
+    \\  -m, --metrics <addr>  Serve Prometheus metrics over HTTP on
+    \\                        [host:]port (default host 127.0.0.1) or unix:<path>
+    \\  -h, --help            Show this help
+    \\
+;
+
+/// Size of each forwarding buffer. Network-bound data may double in size
+/// when every byte is an IAC, so that buffer is twice as large.
+const BUFFER_SIZE = 16 * 1024;
+
+/// How often modem lines are sampled for NOTIFY-MODEMSTATE
+const MODEM_POLL_MS = 50;
+
+/// How often a device that hung up is tried again
+const REOPEN_MS = 1000;
+
+/// Metrics render buffer: fixed families plus room for each port's samples
+const METRICS_BASE_SIZE = 4 * 1024;
+const METRICS_PORT_SIZE = 4 * 1024;
+/// Scrapes served concurrently; further connections are refused
+const MAX_SCRAPES = 4;
+
+/// epoll user data: session index in the upper bits, descriptor kind below
+const Kind = enum(u2) {
+    listener,
+    client,
+    serial,
+    metrics,
+};
+
+fn eventTag(index: usize, kind: Kind) u64 {
+    return (@as(u64, index) << 2) | @intFromEnum(kind);
+}
+
+/// One served serial port and its (single) telnet client
+const Session = struct {
+    port: Port,
+    listen_fd: posix.fd_t,
+    client_fd: ?posix.fd_t = null,
+    parser: telnet.Parser = .{},
+    /// Reset to an inert state (nothing suspended) whenever no client is
+    /// attached; see `resetCom`
+    com: rfc2217.ComPort = undefined,
+
+    /// Serial -> network, already IAC-escaped
+    net_out: [2 * BUFFER_SIZE]u8 = undefined,
+    net_start: usize = 0,
+    net_end: usize = 0,
+
+    /// Network -> serial, already unescaped
+    ser_out: [BUFFER_SIZE]u8 = undefined,
+    ser_start: usize = 0,
+    ser_end: usize = 0,
+
+    /// Replies and notifications queued ahead of serial data
+    ctl_out: [1024]u8 = undefined,
+    ctl_len: usize = 0,
+
+    /// Currently registered epoll interest for each descriptor
+    client_events: u32 = 0,
+    serial_events: u32 = 0,
+    /// Device vanished (hangup); the serial fd is no longer polled and
+    /// clients are refused until `reopenSerial` gets it back
+    serial_lost: bool = false,
+
+    /// Drops per-client COM-PORT state such as a flow-control suspend
+    fn resetCom(self: *Session) void {
+        self.com = .{ .port = &self.port };
+    }
+
+    fn netPending(self: *const Session) bool {
+        return self.net_end > self.net_start or self.ctl_len > 0;
+    }
+
+    fn serPending(self: *const Session) bool {
+        return self.ser_end > self.ser_start;
+    }
+
+    /// Queues a control reply; dropped if the control buffer is full
+    fn queueControl(self: *Session, bytes: []const u8) void {
+        if (self.ctl_len + bytes.len > self.ctl_out.len) return;
+        @memcpy(self.ctl_out[self.ctl_len..][0..bytes.len], bytes);
+        self.ctl_len += bytes.len;
+    }
+
+    /// Telnet command handler invoked by the parser
+    pub fn onCommand(self: *Session, command: telnet.Command) void {
+        var buf: [rfc2217.MAX_REPLY]u8 = undefined;
+        switch (command) {
+            .will => |option| switch (option) {
+                telnet.Option.COM_PORT, telnet.Option.BINARY, telnet.Option.SGA => {},
+                else => self.queueControl(telnet.negotiation(&buf, telnet.DONT, option)),
+            },
+            .do => |option| switch (option) {
+                telnet.Option.BINARY, telnet.Option.SGA, telnet.Option.ECHO => {},
+                else => self.queueControl(telnet.negotiation(&buf, telnet.WONT, option)),
+            },
+            .wont, .dont, .other => {},
+            .subnegotiation => |payload| {
+                if (payload.len > 0 and payload[0] == telnet.Option.COM_PORT) {
+                    self.queueControl(self.com.handle(payload[1..], &buf));
+                }
+            },
+        }
+    }
+};
+
+/// Set from the SIGUSR1 handler; the event loop writes the trace
+var trace_requested = std.atomic.Value(bool).init(false);
+
+fn onTraceSignal(_: i32) callconv(.c) void {
+    trace_requested.store(true, .release);
+}
+
+/// Prometheus scrape endpoint; everything is allocated once at startup.
+/// Each scrape slot renders into its own `slot_size` share of `buffer`.
+const Metrics = struct {
+    endpoint: metrics.Endpoint,
+    buffer: []u8,
+    ports: []*Port,
+    scrapes: [MAX_SCRAPES]metrics.Scrape = [_]metrics.Scrape{.{}} ** MAX_SCRAPES,
+
+    fn slotBuffer(self: *Metrics, slot: usize) []u8 {
+        const size = self.buffer.len / MAX_SCRAPES;
+        return self.buffer[slot * size ..][0..size];
+    }
+};
+
+const Server = struct {
+    epoll_fd: posix.fd_t,
+    sessions: []Session,
+    trace_path: ?[]const u8 = null,
+    metrics: ?Metrics = null,
+
+    fn run(self: *Server) !void {
+        var events: [64]linux.epoll_event = undefined;
+        var last_modem_poll = std.time.milliTimestamp();
+        var last_reopen = last_modem_poll;
+
+        while (true) {
+            const n = posix.epoll_wait(self.epoll_fd, &events, MODEM_POLL_MS);
+            for (events[0..n]) |ev| {
+                const index: usize = @intCast(ev.data.u64 >> 2);
+                const kind: Kind = @enumFromInt(@as(u2, @truncate(ev.data.u64)));
+                if (kind == .metrics) {
+                    // Index 0 is the listener, scrape slot i is index i + 1
+                    if (index == 0) self.acceptScrapes() else self.serviceScrape(index - 1);
+                    continue;
+                }
+                const session = &self.sessions[index];
+                switch (kind) {
+                    .listener => self.acceptClient(index),
+                    .client => self.serviceClient(session, ev.events),
+                    .serial => self.serviceSerial(session, ev.events),
+                    .metrics => unreachable,
+                }
+                self.updateInterest(index);
+            }
+
+            if (trace_requested.swap(false, .acquire)) {
+                if (self.trace_path) |path| {
+                    trace.dumpToFile(path) catch |err| std.log.err("trace dump failed: {s}", .{@errorName(err)});
+                    std.log.info("trace written to {s}", .{path});
+                }
+            }
+
+            const now = std.time.milliTimestamp();
+            if (now - last_modem_poll >= MODEM_POLL_MS) {
+                last_modem_poll = now;
+                if (self.metrics) |*m| {
+                    for (&m.scrapes) |*scrape| scrape.expire(now);
+                }
+                for (self.sessions, 0..) |*session, index| {
+                    if (session.client_fd == null) continue;
+                    var buf: [rfc2217.MAX_REPLY]u8 = undefined;
+                    session.queueControl(session.com.pollModemState(&buf));
+                    self.flushNet(session);
+                    self.updateInterest(index);
+                }
+            }
+            if (now - last_reopen >= REOPEN_MS) {
+                last_reopen = now;
+                for (self.sessions, 0..) |*session, index| {
+                    if (session.serial_lost) self.reopenSerial(session, index);
+                }
+            }
+        }
+    }
+
+    /// Takes pending scrape connections into free slots. Scrapes are
+    /// stepped on readiness like every other descriptor, so a stalled
+    /// scraper never holds up forwarding.
+    fn acceptScrapes(self: *Server) void {
+        const m = if (self.metrics) |*active| active else return;
+        while (m.endpoint.accept()) |conn| {
+            const slot = for (&m.scrapes, 0..) |*scrape, i| {
+                if (!scrape.isActive()) break i;
+            } else {
+                posix.close(conn);
+                continue;
+            };
+            var ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(slot + 1, .metrics) } };
+            posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_ADD, conn, &ev) catch {
+                posix.close(conn);
+                continue;
+            };
+            m.scrapes[slot].start(conn, m.slotBuffer(slot), std.time.milliTimestamp());
+            self.serviceScrape(slot);
+        }
+    }
+
+    fn serviceScrape(self: *Server, slot: usize) void {
+        const m = if (self.metrics) |*active| active else return;
+        const scrape = &m.scrapes[slot];
+        var progress = scrape.advance();
+        if (progress == .needs_body) {
+            scrape.reply(self.renderMetrics(scrape.body()));
+            progress = scrape.advance();
+        }
+        if (progress == .waiting) {
+            // Closing the socket drops it from the epoll set by itself
+            const events: u32 = if (scrape.events() == posix.POLL.OUT) linux.EPOLL.OUT else linux.EPOLL.IN;
+            var ev = linux.epoll_event{ .events = events, .data = .{ .u64 = eventTag(slot + 1, .metrics) } };
+            posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_MOD, scrape.fd, &ev) catch {};
+        }
+    }
+
+    fn renderMetrics(self: *Server, buffer: []u8) usize {
+        const m = &self.metrics.?;
+        var e = metrics.Exposition.init(buffer);
+        metrics.renderPorts(&e, m.ports);
+
+        e.family("serialterm_client_connected", .gauge, "1 while a network client is attached to the port.");
+        for (self.sessions) |*session| {
+            e.sample("serialterm_client_connected", &.{.{ .name = "port", .value = session.port.path }}, @intFromBool(session.client_fd != null));
+        }
+        e.family("serialterm_buffer_bytes", .gauge, "Bytes waiting in the forwarding buffers.");
+        for (self.sessions) |*session| {
+            e.sample("serialterm_buffer_bytes", &.{ .{ .name = "port", .value = session.port.path }, .{ .name = "direction", .value = "to_network" } }, session.net_end - session.net_start);
+            e.sample("serialterm_buffer_bytes", &.{ .{ .name = "port", .value = session.port.path }, .{ .name = "direction", .value = "to_serial" } }, session.ser_end - session.ser_start);
+        }
+
+        if (e.truncated) std.log.warn("metrics output truncated at {d} bytes", .{buffer.len});
+        return e.bytes().len;
+    }
+
+    fn acceptClient(self: *Server, index: usize) void {
+        const session = &self.sessions[index];
+        const fd = posix.accept(session.listen_fd, null, null, posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC) catch |err| {
+            if (err != error.WouldBlock) std.log.warn("accept failed: {s}", .{@errorName(err)});
+            return;
+        };
+
+        if (session.client_fd != null or session.serial_lost) {
+            // One client per port; refuse extras so bytes are never split
+            _ = posix.send(fd, "Port in use\r\n", posix.MSG.NOSIGNAL) catch {};
+            posix.close(fd);
+            return;
+        }
+
+        const one: c_int = 1;
+        posix.setsockopt(fd, posix.IPPROTO.TCP, posix.TCP.NODELAY, std.mem.asBytes(&one)) catch {};
+
+        var ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(index, .client) } };
+        posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_ADD, fd, &ev) catch |err| {
+            std.log.warn("epoll_ctl failed: {s}", .{@errorName(err)});
+            posix.close(fd);
+            return;
+        };
+
+        session.client_fd = fd;
+        session.client_events = linux.EPOLL.IN;
+        session.parser = .{};
+        session.com = rfc2217.ComPort.init(&session.port);
+        session.net_start = 0;
+        session.net_end = 0;
+        session.ser_start = 0;
+        session.ser_end = 0;
+        session.ctl_len = 0;
+
+        // Binary, character-at-a-time, remote echo; invite COM-PORT-OPTION
+        var buf: [3]u8 = undefined;
+        session.queueControl(telnet.negotiation(&buf, telnet.WILL, telnet.Option.BINARY));
+        session.queueControl(telnet.negotiation(&buf, telnet.DO, telnet.Option.BINARY));
+        session.queueControl(telnet.negotiation(&buf, telnet.WILL, telnet.Option.SGA));
+        session.queueControl(telnet.negotiation(&buf, telnet.WILL, telnet.Option.ECHO));
+        session.queueControl(telnet.negotiation(&buf, telnet.DO, telnet.Option.COM_PORT));
+        self.flushNet(session);
+
+        std.log.info("{s}: client connected", .{session.port.path});
+    }
+
+    fn dropClient(self: *Server, session: *Session) void {
+        const fd = session.client_fd orelse return;
+        posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_DEL, fd, null) catch {};
+        posix.close(fd);
+        session.client_fd = null;
+        session.client_events = 0;
+        if (session.com.break_on) session.port.setBreak(false);
+        session.resetCom();
+        std.log.info("{s}: client disconnected", .{session.port.path});
+    }
+
+    fn serviceClient(self: *Server, session: *Session, events: u32) void {
+        const fd = session.client_fd orelse return;
+
+        // Whatever is still buffered, a gone client is gone: HUP and ERR
+        // are reported whether or not we ask, so waiting would spin
+        if (events & (linux.EPOLL.HUP | linux.EPOLL.ERR) != 0) return self.dropClient(session);
+
+        if (events & linux.EPOLL.OUT != 0) self.flushNet(session);
+
+        if (events & linux.EPOLL.IN != 0 and !session.serPending()) {
+            var buf: [BUFFER_SIZE]u8 = undefined;
+            const n = posix.read(fd, &buf) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return self.dropClient(session),
+            };
+            if (n == 0) return self.dropClient(session);
+
+            session.ser_start = 0;
+            session.ser_end = session.parser.feed(buf[0..n], &session.ser_out, session);
+            self.flushSerial(session);
+            self.flushNet(session);
+        }
+    }
+
+    /// Opens a hung-up device again (e.g. a USB adapter plugged back in)
+    /// with the settings it had. The new file takes over the old
+    /// descriptor number, so the port and its statistics carry on.
+    fn reopenSerial(self: *Server, session: *Session, index: usize) void {
+        var fresh = Port.open(session.port.path, session.port.config) catch return;
+        fresh.setNonBlocking(true);
+        posix.dup2(fresh.fd, session.port.fd) catch |err| {
+            std.log.err("{s}: reopen failed: {s}", .{ session.port.path, @errorName(err) });
+            fresh.close();
+            return;
+        };
+        posix.close(fresh.fd);
+        session.port.original_termios = fresh.original_termios;
+        session.port.stats_baseline = fresh.stats_baseline;
+        session.port.marks.state = .data;
+        session.port.flow.reset(session.port.fd);
+
+        var ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(index, .serial) } };
+        posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_ADD, session.port.fd, &ev) catch |err| {
+            std.log.err("{s}: epoll_ctl failed: {s}", .{ session.port.path, @errorName(err) });
+            return;
+        };
+        session.serial_events = linux.EPOLL.IN;
+        session.serial_lost = false;
+        std.log.info("{s}: device back", .{session.port.path});
+    }
+
+    fn serviceSerial(self: *Server, session: *Session, events: u32) void {
+        if (events & (linux.EPOLL.HUP | linux.EPOLL.ERR) != 0) {
+            std.log.err("{s}: device hung up", .{session.port.path});
+            posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_DEL, session.port.fd, null) catch {};
+            session.serial_lost = true;
+            session.serial_events = 0;
+            self.dropClient(session);
+            return;
+        }
+
+        if (events & linux.EPOLL.OUT != 0) self.flushSerial(session);
+
+        if (events & linux.EPOLL.IN != 0 and !session.netPending()) {
+            var buf: [BUFFER_SIZE]u8 = undefined;
+            const n = session.port.read(&buf) catch |err| switch (err) {
+                Port.Error.WouldBlock => return,
+                else => {
+                    std.log.err("{s}: read failed: {s}", .{ session.port.path, @errorName(err) });
+                    return;
+                },
+            };
+            // Without a client the console output is discarded
+            if (session.client_fd == null or n == 0) return;
+
+            session.net_start = 0;
+            session.net_end = telnet.escapeIac(buf[0..n], &session.net_out);
+            self.flushNet(session);
+        }
+    }
+
+    /// Sends queued control replies, then escaped serial data
+    fn flushNet(self: *Server, session: *Session) void {
+        const fd = session.client_fd orelse return;
+        const span = trace.span("server", "flush_net");
+        defer span.end();
+
+        if (session.ctl_len > 0) {
+            const sent = posix.send(fd, session.ctl_out[0..session.ctl_len], posix.MSG.NOSIGNAL) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return self.dropClient(session),
+            };
+            std.mem.copyForwards(u8, session.ctl_out[0 .. session.ctl_len - sent], session.ctl_out[sent..session.ctl_len]);
+            session.ctl_len -= sent;
+            if (session.ctl_len > 0) return;
+        }
+
+        while (session.net_end > session.net_start) {
+            const sent = posix.send(fd, session.net_out[session.net_start..session.net_end], posix.MSG.NOSIGNAL) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return self.dropClient(session),
+            };
+            session.net_start += sent;
+        }
+    }
+
+    fn flushSerial(self: *Server, session: *Session) void {
+        _ = self;
+        const span = trace.span("server", "flush_serial");
+        defer span.end();
+        while (session.ser_end > session.ser_start) {
+            const written = session.port.write(session.ser_out[session.ser_start..session.ser_end]) catch |err| switch (err) {
+                Port.Error.WouldBlock => return,
+                else => {
+                    std.log.err("{s}: write failed: {s}", .{ session.port.path, @errorName(err) });
+                    session.ser_start = session.ser_end;
+                    return;
+                },
+            };
+            session.ser_start += written;
+        }
+    }
+
+    /// Re-arms epoll so that a full buffer pauses its producer
+    /// and a pending buffer waits for its consumer to become writable
+    fn updateInterest(self: *Server, index: usize) void {
+        const session = &self.sessions[index];
+
+        var serial_events: u32 = 0;
+        const suspended = session.client_fd != null and session.com.suspended;
+        if (!session.netPending() and !suspended) serial_events |= linux.EPOLL.IN;
+        if (session.serPending()) serial_events |= linux.EPOLL.OUT;
+        if (!session.serial_lost and serial_events != session.serial_events) {
+            var ev = linux.epoll_event{ .events = serial_events, .data = .{ .u64 = eventTag(index, .serial) } };
+            posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_MOD, session.port.fd, &ev) catch {};
+            session.serial_events = serial_events;
+        }
+
+        const fd = session.client_fd orelse return;
+        var client_events: u32 = 0;
+        if (!session.serPending()) client_events |= linux.EPOLL.IN;
+        if (session.netPending()) client_events |= linux.EPOLL.OUT;
+        if (client_events != session.client_events) {
+            var ev = linux.epoll_event{ .events = client_events, .data = .{ .u64 = eventTag(index, .client) } };
+            posix.epoll_ctl(self.epoll_fd, linux.EPOLL.CTL_MOD, fd, &ev) catch {};
+            session.client_events = client_events;
+        }
+    }
+};
+
+fn listenOn(address: std.net.Address) !posix.fd_t {
+    const fd = try posix.socket(address.any.family, posix.SOCK.STREAM | posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC, posix.IPPROTO.TCP);
+    errdefer posix.close(fd);
+    const one: c_int = 1;
+    try posix.setsockopt(fd, posix.SOL.SOCKET, posix.SO.REUSEADDR, std.mem.asBytes(&one));
+    try posix.bind(fd, &address.any, address.getOsSockLen());
+    try posix.listen(fd, 4);
+    return fd;
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var listen_addr: []const u8 = "0.0.0.0";
+    var base_port: u16 = 7000;
+    var config = Config{};
+    var trace_path: ?[]const u8 = null;
+    var metrics_addr: ?[]const u8 = null;
+    var devices: std.ArrayList([]const u8) = .empty;
+    defer devices.deinit(allocator);
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "-h") or std.mem.eql(u8, arg, "--help")) {
+            std.debug.print("{s}", .{usage});
+            return;
+        } else if (std.mem.eql(u8, arg, "-l") or std.mem.eql(u8, arg, "--listen")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            listen_addr = args[i];
+        } else if (std.mem.eql(u8, arg, "-p") or std.mem.eql(u8, arg, "--port")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            base_port = std.fmt.parseInt(u16, args[i], 10) catch return fail("invalid port: {s}", .{args[i]});
+        } else if (std.mem.eql(u8, arg, "-b") or std.mem.eql(u8, arg, "--baud")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            const speed = std.fmt.parseInt(u32, args[i], 10) catch return fail("invalid baud rate: {s}", .{args[i]});
+            config.baud_rate = Config.BaudRate.fromSpeed(speed) orelse return fail("unsupported baud rate: {s}", .{args[i]});
+        } else if (std.mem.eql(u8, arg, "-t") or std.mem.eql(u8, arg, "--trace")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            if (!trace.enabled) return fail("{s}: tracing is not compiled in (build with -Dtrace=true)", .{arg});
+            trace_path = args[i];
+        } else if (std.mem.eql(u8, arg, "-m") or std.mem.eql(u8, arg, "--metrics")) {
+            i += 1;
+            if (i >= args.len) return fail("missing value for {s}", .{arg});
+            metrics_addr = args[i];
+        } else if (std.mem.startsWith(u8, arg, "-")) {
+            return fail("unknown option: {s}", .{arg});
+        } else {
+            try devices.append(allocator, arg);
+        }
+    }
+
+    if (devices.items.len == 0) {
+        std.debug.print("{s}", .{usage});
+        std.process.exit(2);
+    }
+
+    const epoll_fd = try posix.epoll_create1(linux.EPOLL.CLOEXEC);
+    defer posix.close(epoll_fd);
+
+    const sessions = try allocator.alloc(Session, devices.items.len);
+    defer allocator.free(sessions);
+
+    for (devices.items, 0..) |path, index| {
+        const tcp_port = base_port + @as(u16, @intCast(index));
+        const address = std.net.Address.parseIp(listen_addr, tcp_port) catch return fail("invalid listen address: {s}", .{listen_addr});
+
+        const session = &sessions[index];
+        session.* = .{
+            .port = Port.open(path, config) catch |err| return fail("{s}: open failed: {s}", .{ path, @errorName(err) }),
+            .listen_fd = listenOn(address) catch |err| return fail("{s}:{d}: listen failed: {s}", .{ listen_addr, tcp_port, @errorName(err) }),
+        };
+        session.port.setNonBlocking(true);
+        session.resetCom();
+
+        var listen_ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(index, .listener) } };
+        try posix.epoll_ctl(epoll_fd, linux.EPOLL.CTL_ADD, session.listen_fd, &listen_ev);
+
+        var serial_ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(index, .serial) } };
+        try posix.epoll_ctl(epoll_fd, linux.EPOLL.CTL_ADD, session.port.fd, &serial_ev);
+        session.serial_events = linux.EPOLL.IN;
+
+        std.log.info("serving {s} on {s}:{d}", .{ path, listen_addr, tcp_port });
+    }
+
+    if (trace_path != null) {
+        const action = posix.Sigaction{
+            .handler = .{ .handler = onTraceSignal },
+            .mask = posix.sigemptyset(),
+            .flags = posix.SA.RESTART,
+        };
+        posix.sigaction(posix.SIG.USR1, &action, null);
+    }
+
+    var server = Server{ .epoll_fd = epoll_fd, .sessions = sessions, .trace_path = trace_path };
+
+    if (metrics_addr) |addr| {
+        var endpoint = metrics.Endpoint.listen(addr) catch |err| return fail("{s}: metrics listen failed: {s}", .{ addr, @errorName(err) });
+        errdefer endpoint.close();
+        const slot_size = metrics.Scrape.HEADER_ROOM + METRICS_BASE_SIZE + METRICS_PORT_SIZE * sessions.len;
+        const buffer = try allocator.alloc(u8, slot_size * MAX_SCRAPES);
+        errdefer allocator.free(buffer);
+        const ports = try allocator.alloc(*Port, sessions.len);
+        errdefer allocator.free(ports);
+        for (sessions, ports) |*session, *port| port.* = &session.port;
+
+        var ev = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .u64 = eventTag(0, .metrics) } };
+        try posix.epoll_ctl(epoll_fd, linux.EPOLL.CTL_ADD, endpoint.fd, &ev);
+        server.metrics = .{ .endpoint = endpoint, .buffer = buffer, .ports = ports };
+        std.log.info("metrics on {s}", .{addr});
+    }
+    defer if (server.metrics) |*m| {
+        for (&m.scrapes) |*scrape| scrape.expire(std.math.maxInt(i64));
+        m.endpoint.close();
+        allocator.free(m.buffer);
+        allocator.free(m.ports);
+    };
+
+    try server.run();
+}
+
+fn fail(comptime fmt: []const u8, args: anytype) error{InvalidArgument} {
+    std.log.err(fmt, args);
+    return error.InvalidArgument;
+}
+
+test {
+    _ = telnet;
+    _ = rfc2217;
+}
@@ -0,0 +1,284 @@
+const std = @import("std");
+const serial = @import("serial");
+const telnet = @import("telnet.zig");
+
+const Port = serial.port.Port;
+const Config = serial.config.Config;
+
+/// RFC 2217 COM-PORT-OPTION client commands.
+/// Server replies use the same code plus `SERVER_OFFSET`.
+pub const Command = struct {
+    pub const SIGNATURE: u8 = 0;
+    pub const SET_BAUDRATE: u8 = 1;
+    pub const SET_DATASIZE: u8 = 2;
+    pub const SET_PARITY: u8 = 3;
+    pub const SET_STOPSIZE: u8 = 4;
+    pub const SET_CONTROL: u8 = 5;
+    pub const NOTIFY_LINESTATE: u8 = 6;
+    pub const NOTIFY_MODEMSTATE: u8 = 7;
+    pub const FLOWCONTROL_SUSPEND: u8 = 8;
+    pub const FLOWCONTROL_RESUME: u8 = 9;
+    pub const SET_LINESTATE_MASK: u8 = 10;
+    pub const SET_MODEMSTATE_MASK: u8 = 11;
+    pub const PURGE_DATA: u8 = 12;
+};
+
+pub const SERVER_OFFSET: u8 = 100;
+
+/// SET-CONTROL values
+const Control = struct {
+    const FLOW_REQUEST: u8 = 0;
+    const FLOW_NONE: u8 = 1;
+    const FLOW_XONXOFF: u8 = 2;
+    const FLOW_HARDWARE: u8 = 3;
+    const BREAK_REQUEST: u8 = 4;
+    const BREAK_ON: u8 = 5;
+    const BREAK_OFF: u8 = 6;
+    const DTR_REQUEST: u8 = 7;
+    const DTR_ON: u8 = 8;
+    const DTR_OFF: u8 = 9;
+    const RTS_REQUEST: u8 = 10;
+    const RTS_ON: u8 = 11;
+    const RTS_OFF: u8 = 12;
+};
+
+/// NOTIFY-MODEMSTATE bits
+const ModemState = struct {
+    const CD: u8 = 0x80;
+    const RI: u8 = 0x40;
+    const DSR: u8 = 0x20;
+    const CTS: u8 = 0x10;
+    const DELTA_CD: u8 = 0x08;
+    const TRAILING_RI: u8 = 0x04;
+    const DELTA_DSR: u8 = 0x02;
+    const DELTA_CTS: u8 = 0x01;
+};
+
+pub const SIGNATURE = "SerialTerm RFC 2217 server";
+
+/// Maximum encoded size of a single server reply
+pub const MAX_REPLY = 2 * (SIGNATURE.len + 4) + 6;
+
+/// Per-connection COM-PORT-OPTION state mapped onto a `Port`
+pub const ComPort = struct {
+    port: *Port,
+    modemstate_mask: u8 = 0xFF,
+    linestate_mask: u8 = 0,
+    last_modemstate: u8 = 0,
+    break_on: bool = false,
+    /// Client asked us to stop sending serial data (FLOWCONTROL-SUSPEND)
+    suspended: bool = false,
+
+    pub fn init(port: *Port) ComPort {
+        var self = ComPort{ .port = port };
+        self.last_modemstate = self.readModemState();
+        return self;
+    }
+
+    /// Handles one COM-PORT-OPTION subnegotiation payload (without the
+    /// leading option byte). Writes the encoded reply into `out` and
+    /// returns it; the reply is empty for commands that need none.
+    pub fn handle(self: *ComPort, payload: []const u8, out: []u8) []const u8 {
+        if (payload.len == 0) return out[0..0];
+        const command = payload[0];
+        const value = payload[1..];
+
+        switch (command) {
+            Command.SIGNATURE => return encode(out, command, SIGNATURE),
+            Command.SET_BAUDRATE => {
+                if (value.len >= 4) {
+                    const requested = std.mem.readInt(u32, value[0..4], .big);
+                    if (requested != 0) {
+                        if (Config.BaudRate.fromSpeed(requested)) |baud| {
+                            var cfg = self.port.config;
+                            cfg.baud_rate = baud;
+                            self.apply(cfg);
+                        } else {
+                            std.log.warn("{s}: unsupported baud rate {d}", .{ self.port.path, requested });
+                        }
+                    }
+                }
+                var reply: [4]u8 = undefined;
+                std.mem.writeInt(u32, &reply, self.port.config.baud_rate.toSpeed(), .big);
+                return encode(out, command, &reply);
+            },
+            Command.SET_DATASIZE => {
+                if (value.len >= 1 and value[0] != 0) {
+                    var cfg = self.port.config;
+                    cfg.data_bits = switch (value[0]) {
+                        5 => .five,
+                        6 => .six,
+                        7 => .seven,
+                        else => .eight,
+                    };
+                    self.apply(cfg);
+                }
+                return encode(out, command, &[_]u8{@intFromEnum(self.port.config.data_bits)});
+            },
+            Command.SET_PARITY => {
+                if (value.len >= 1 and value[0] != 0) {
+                    var cfg = self.port.config;
+                    cfg.parity = switch (value[0]) {
+                        2 => .odd,
+                        3 => .even,
+                        4 => .mark,
+                        5 => .space,
+                        else => .none,
+                    };
+                    self.apply(cfg);
+                }
+                const parity: u8 = switch (self.port.config.parity) {
+                    .none => 1,
+                    .odd => 2,
+                    .even => 3,
+                    .mark => 4,
+                    .space => 5,
+                };
+                return encode(out, command, &[_]u8{parity});
+            },
+            Command.SET_STOPSIZE => {
+                // 1.5 stop bits (value 3) is not supported by Config
+                if (value.len >= 1 and (value[0] == 1 or value[0] == 2)) {
+                    var cfg = self.port.config;
+                    cfg.stop_bits = if (value[0] == 2) .two else .one;
+                    self.apply(cfg);
+                }
+                const stop: u8 = if (self.port.config.stop_bits == .two) 2 else 1;
+                return encode(out, command, &[_]u8{stop});
+            },
+            Command.SET_CONTROL => {
+                if (value.len < 1) return out[0..0];
+                return encode(out, command, &[_]u8{self.control(value[0])});
+            },
+            // Flow control notices get no acknowledgement (RFC 2217)
+            Command.FLOWCONTROL_SUSPEND => {
+                self.suspended = true;
+                return out[0..0];
+            },
+            Command.FLOWCONTROL_RESUME => {
+                self.suspended = false;
+                return out[0..0];
+            },
+            Command.SET_LINESTATE_MASK => {
+                if (value.len >= 1) self.linestate_mask = value[0];
+                return encode(out, command, &[_]u8{self.linestate_mask});
+            },
+            Command.SET_MODEMSTATE_MASK => {
+                if (value.len >= 1) self.modemstate_mask = value[0];
+                return encode(out, command, &[_]u8{self.modemstate_mask});
+            },
+            Command.PURGE_DATA => {
+                if (value.len < 1) return out[0..0];
+                switch (value[0]) {
+                    1 => self.port.flushInput(),
+                    2 => self.port.flushOutput(),
+                    3 => self.port.flush(),
+                    else => {},
+                }
+                return encode(out, command, value[0..1]);
+            },
+            else => return out[0..0],
+        }
+    }
+
+    /// Returns an encoded NOTIFY-MODEMSTATE when a masked modem line changed
+    pub fn pollModemState(self: *ComPort, out: []u8) []const u8 {
+        const state = self.readModemState();
+        const changed = state ^ self.last_modemstate;
+        self.last_modemstate = state;
+        if (changed == 0) return out[0..0];
+
+        var notify = state;
+        if (changed & ModemState.CD != 0) notify |= ModemState.DELTA_CD;
+        if (changed & ModemState.DSR != 0) notify |= ModemState.DELTA_DSR;
+        if (changed & ModemState.CTS != 0) notify |= ModemState.DELTA_CTS;
+        if (changed & ModemState.RI != 0 and state & ModemState.RI == 0) notify |= ModemState.TRAILING_RI;
+
+        notify &= self.modemstate_mask;
+        if (notify == 0) return out[0..0];
+        return encode(out, Command.NOTIFY_MODEMSTATE, &[_]u8{notify});
+    }
+
+    fn control(self: *ComPort, value: u8) u8 {
+        switch (value) {
+            Control.FLOW_NONE, Control.FLOW_XONXOFF, Control.FLOW_HARDWARE => {
+                var cfg = self.port.config;
+                cfg.flow_control = switch (value) {
+                    Control.FLOW_XONXOFF => .software,
+                    Control.FLOW_HARDWARE => .hardware,
+                    else => .none,
+                };
+                self.apply(cfg);
+                return flowValue(self.port.config.flow_control);
+            },
+            Control.FLOW_REQUEST => return flowValue(self.port.config.flow_control),
+            Control.BREAK_ON, Control.BREAK_OFF => {
+                self.break_on = value == Control.BREAK_ON;
+                self.port.setBreak(self.break_on);
+                return value;
+            },
+            Control.BREAK_REQUEST => return if (self.break_on) Control.BREAK_ON else Control.BREAK_OFF,
+            Control.DTR_ON, Control.DTR_OFF => {
+                self.port.setDTR(value == Control.DTR_ON);
+                return value;
+            },
+            Control.DTR_REQUEST => return if (self.port.getModemStatus().dtr) Control.DTR_ON else Control.DTR_OFF,
+            Control.RTS_ON, Control.RTS_OFF => {
+                self.port.setRTS(value == Control.RTS_ON);
+                return value;
+            },
+            Control.RTS_REQUEST => return if (self.port.getModemStatus().rts) Control.RTS_ON else Control.RTS_OFF,
+            // Inbound flow control settings (13..19) are not configurable separately
+            else => return value,
+        }
+    }
+
+    fn apply(self: *ComPort, cfg: Config) void {
+        // In place, so a client changing speed does not drop DTR
+        self.port.reconfigure(cfg, .now) catch |err| {
+            std.log.warn("{s}: reconfiguration failed: {s}", .{ self.port.path, @errorName(err) });
+        };
+    }
+
+    fn readModemState(self: *ComPort) u8 {
+        const status = self.port.getModemStatus();
+        var state: u8 = 0;
+        if (status.dcd) state |= ModemState.CD;
+        if (status.ri) state |= ModemState.RI;
+        if (status.dsr) state |= ModemState.DSR;
+        if (status.cts) state |= ModemState.CTS;
+        return state;
+    }
+
+    fn flowValue(flow: Config.FlowControl) u8 {
+        return switch (flow) {
+            .none => Control.FLOW_NONE,
+            .software, .software_userspace => Control.FLOW_XONXOFF,
+            .hardware => Control.FLOW_HARDWARE,
+        };
+    }
+};
+
+/// Encodes IAC SB COM-PORT-OPTION <command + 100> <value> IAC SE
+pub fn encode(out: []u8, command: u8, value: []const u8) []const u8 {
+    var pos: usize = 0;
+    out[pos] = telnet.IAC;
+    out[pos + 1] = telnet.SB;
+    out[pos + 2] = telnet.Option.COM_PORT;
+    out[pos + 3] = command + SERVER_OFFSET;
+    pos += 4;
+    pos += telnet.escapeIac(value, out[pos..]);
+    out[pos] = telnet.IAC;
+    out[pos + 1] = telnet.SE;
+    return out[0 .. pos + 2];
+}
+
+test "encode escapes IAC in values" {
+    var out: [MAX_REPLY]u8 = undefined;
+    const reply = encode(&out, Command.SET_BAUDRATE, &[_]u8{ 0x00, 0x01, 0xFF, 0x00 });
+    try std.testing.expectEqualSlices(u8, &[_]u8{
+        telnet.IAC, telnet.SB, telnet.Option.COM_PORT, 101,
+        0x00,       0x01,      0xFF,                   0xFF,
+        0x00,       telnet.IAC, telnet.SE,
+    }, reply);
+}
@@ -0,0 +1,209 @@
+const std = @import("std");
+const serial = @import("serial");
+const trace = @import("trace");
+
+const scan = serial.scan;
+
+/// Telnet command bytes (RFC 854)
+pub const IAC: u8 = 255;
+pub const DONT: u8 = 254;
+pub const DO: u8 = 253;
+pub const WONT: u8 = 252;
+pub const WILL: u8 = 251;
+pub const SB: u8 = 250;
+pub const SE: u8 = 240;
+
+/// Telnet option codes used by the server
+pub const Option = struct {
+    pub const BINARY: u8 = 0;
+    pub const ECHO: u8 = 1;
+    pub const SGA: u8 = 3;
+    pub const COM_PORT: u8 = 44; // RFC 2217
+};
+
+/// Commands decoded from the telnet stream
+pub const Command = union(enum) {
+    will: u8,
+    wont: u8,
+    do: u8,
+    dont: u8,
+    /// Subnegotiation payload, starting with the option byte, IAC IAC unescaped
+    subnegotiation: []const u8,
+    /// Any other two-byte command (NOP, BRK, AYT, ...)
+    other: u8,
+};
+
+/// Incremental telnet stream decoder
+/// Separates payload bytes from IAC commands across arbitrary chunk boundaries
+pub const Parser = struct {
+    const MAX_SUBNEGOTIATION = 64;
+
+    state: State = .data,
+    verb: u8 = 0,
+    sb_buffer: [MAX_SUBNEGOTIATION]u8 = undefined,
+    sb_len: usize = 0,
+
+    const State = enum {
+        data,
+        iac,
+        option,
+        sb,
+        sb_iac,
+    };
+
+    /// Decodes `input`, copying payload bytes into `out` and invoking
+    /// `handler.onCommand(Command)` for each command.
+    /// `out` must be at least `input.len` bytes. Returns the payload length.
+    pub fn feed(self: *Parser, input: []const u8, out: []u8, handler: anytype) usize {
+        const span = trace.span("telnet", "feed");
+        defer span.end();
+        var out_len: usize = 0;
+        var i: usize = 0;
+        while (i < input.len) {
+            switch (self.state) {
+                .data => {
+                    // Copy the run up to the next IAC in one go
+                    const end = scan.indexOfByte(input, i, IAC) orelse input.len;
+                    const run = input[i..end];
+                    @memcpy(out[out_len..][0..run.len], run);
+                    out_len += run.len;
+                    i = end;
+                    if (i < input.len) {
+                        self.state = .iac;
+                        i += 1;
+                    }
+                },
+                .iac => {
+                    const byte = input[i];
+                    i += 1;
+                    switch (byte) {
+                        IAC => {
+                            out[out_len] = IAC;
+                            out_len += 1;
+                            self.state = .data;
+                        },
+                        WILL, WONT, DO, DONT => {
+                            self.verb = byte;
+                            self.state = .option;
+                        },
+                        SB => {
+                            self.sb_len = 0;
+                            self.state = .sb;
+                        },
+                        else => {
+                            handler.onCommand(.{ .other = byte });
+                            self.state = .data;
+                        },
+                    }
+                },
+                .option => {
+                    const option = input[i];
+                    i += 1;
+                    self.state = .data;
+                    handler.onCommand(switch (self.verb) {
+                        WILL => .{ .will = option },
+                        WONT => .{ .wont = option },
+                        DO => .{ .do = option },
+                        else => .{ .dont = option },
+                    });
+                },
+                .sb => {
+                    const byte = input[i];
+                    i += 1;
+                    if (byte == IAC) {
+                        self.state = .sb_iac;
+                    } else {
+                        self.appendSub(byte);
+                    }
+                },
+                .sb_iac => {
+                    const byte = input[i];
+                    i += 1;
+                    if (byte == SE) {
+                        self.state = .data;
+                        handler.onCommand(.{ .subnegotiation = self.sb_buffer[0..self.sb_len] });
+                    } else {
+                        // IAC IAC inside a subnegotiation is a literal 0xFF
+                        self.appendSub(byte);
+                        self.state = .sb;
+                    }
+                },
+            }
+        }
+        return out_len;
+    }
+
+    fn appendSub(self: *Parser, byte: u8) void {
+        // Oversized subnegotiations are truncated rather than rejected
+        if (self.sb_len < self.sb_buffer.len) {
+            self.sb_buffer[self.sb_len] = byte;
+            self.sb_len += 1;
+        }
+    }
+};
+
+/// Copies `input` into `out` doubling every IAC byte.
+/// `out` must be at least `2 * input.len` bytes. Returns the encoded length.
+pub fn escapeIac(input: []const u8, out: []u8) usize {
+    var out_len: usize = 0;
+    var i: usize = 0;
+    while (scan.indexOfByte(input, i, IAC)) |hit| {
+        const run = input[i .. hit + 1];
+        @memcpy(out[out_len..][0..run.len], run);
+        out_len += run.len;
+        out[out_len] = IAC;
+        out_len += 1;
+        i = hit + 1;
+    }
+    const tail = input[i..];
+    @memcpy(out[out_len..][0..tail.len], tail);
+    return out_len + tail.len;
+}
+
+/// Writes a three-byte option negotiation (IAC verb option)
+pub fn negotiation(out: []u8, verb: u8, option: u8) []const u8 {
+    out[0] = IAC;
+    out[1] = verb;
+    out[2] = option;
+    return out[0..3];
+}
+
+const TestHandler = struct {
+    commands: [8]Command = undefined,
+    count: usize = 0,
+
+    pub fn onCommand(self: *TestHandler, command: Command) void {
+        self.commands[self.count] = command;
+        self.count += 1;
+    }
+};
+
+test "telnet parser splits payload and commands across chunks" {
+    var parser = Parser{};
+    var handler = TestHandler{};
+    var out: [32]u8 = undefined;
+
+    const first = [_]u8{ 'a', 'b', IAC, IAC, 'c', IAC };
+    const second = [_]u8{ WILL, Option.COM_PORT, 'd', IAC, SB, Option.COM_PORT, 1, IAC, IAC, IAC, SE, 'e' };
+
+    var n = parser.feed(&first, &out, &handler);
+    try std.testing.expectEqualSlices(u8, &[_]u8{ 'a', 'b', IAC, 'c' }, out[0..n]);
+
+    n = parser.feed(&second, &out, &handler);
+    try std.testing.expectEqualSlices(u8, "de", out[0..n]);
+    try std.testing.expectEqual(@as(usize, 2), handler.count);
+    try std.testing.expectEqual(Option.COM_PORT, handler.commands[0].will);
+    try std.testing.expectEqualSlices(u8, &[_]u8{ Option.COM_PORT, 1, IAC }, handler.commands[1].subnegotiation);
+}
+
+test "escapeIac doubles every IAC" {
+    var input = [_]u8{0x41} ** 40;
+    input[3] = IAC;
+    input[39] = IAC;
+    var out: [80]u8 = undefined;
+    const n = escapeIac(&input, &out);
+    try std.testing.expectEqual(@as(usize, 42), n);
+    try std.testing.expectEqual(IAC, out[3]);
+    try std.testing.expectEqual(IAC, out[4]);
+    try std.testing.expectEqual(IAC, out[41]);
+}
@@ -0,0 +1,192 @@
+//! Compile-time-gated event tracing (`zig build -Dtrace=true`).
+//!
+//! Each thread records begin/end/instant events into its own fixed ring,
+//! so recording never takes a lock. `dump` writes every ring as Chrome
+//! trace JSON, viewable in chrome://tracing or ui.perfetto.dev. With
+//! tracing disabled every call compiles to nothing.
+
+const std = @import("std");
+const build_options = @import("build_options");
+
+pub const enabled = build_options.trace;
+
+/// Events kept per thread; older ones are overwritten
+pub const RING_SIZE = 8192;
+/// Threads that can record; later threads are silently ignored
+pub const MAX_THREADS = 64;
+
+pub const Phase = enum(u8) {
+    begin = 'B',
+    end = 'E',
+    instant = 'i',
+};
+
+const Event = struct {
+    /// Static strings only: the pointers are read back at dump time
+    category: [*:0]const u8,
+    name: [*:0]const u8,
+    timestamp_ns: u64,
+    arg: u64,
+    phase: Phase,
+};
+
+const Ring = struct {
+    thread_id: u64,
+    head: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    events: [RING_SIZE]Event = undefined,
+};
+
+var rings: [MAX_THREADS]std.atomic.Value(?*Ring) = [_]std.atomic.Value(?*Ring){std.atomic.Value(?*Ring).init(null)} ** MAX_THREADS;
+var ring_count = std.atomic.Value(usize).init(0);
+threadlocal var local_ring: ?*Ring = null;
+threadlocal var local_disabled = false;
+
+var epoch: ?std.time.Instant = null;
+var epoch_once = std.once(initEpoch);
+
+fn initEpoch() void {
+    epoch = std.time.Instant.now() catch null;
+}
+
+/// Marks the start of a duration on the calling thread
+pub inline fn begin(comptime category: [:0]const u8, name: [*:0]const u8) void {
+    if (enabled) record(category, name, .begin, 0);
+}
+
+/// Closes the innermost open duration with the same name
+pub inline fn end(comptime category: [:0]const u8, name: [*:0]const u8) void {
+    if (enabled) record(category, name, .end, 0);
+}
+
+/// A point event with one numeric argument
+pub inline fn instant(comptime category: [:0]const u8, name: [*:0]const u8, arg: u64) void {
+    if (enabled) record(category, name, .instant, arg);
+}
+
+/// Scoped duration: `const s = trace.span("port", "read"); defer s.end();`
+pub inline fn span(comptime category: [:0]const u8, comptime name: [:0]const u8) Span(category, name) {
+    begin(category, name);
+    return .{};
+}
+
+pub fn Span(comptime category: [:0]const u8, comptime name: [:0]const u8) type {
+    return struct {
+        pub inline fn end(_: @This()) void {
+            if (enabled) record(category, name, .end, 0);
+        }
+    };
+}
+
+fn record(category: [*:0]const u8, name: [*:0]const u8, phase: Phase, arg: u64) void {
+    const ring = local_ring orelse (registerThread() orelse return);
+    const head = ring.head.load(.monotonic);
+    ring.events[@intCast(head % RING_SIZE)] = .{
+        .category = category,
+        .name = name,
+        .timestamp_ns = now(),
+        .arg = arg,
+        .phase = phase,
+    };
+    ring.head.store(head + 1, .release);
+}
+
+fn registerThread() ?*Ring {
+    if (local_disabled) return null;
+    const slot = ring_count.fetchAdd(1, .monotonic);
+    if (slot >= MAX_THREADS) {
+        local_disabled = true;
+        return null;
+    }
+    const ring = std.heap.page_allocator.create(Ring) catch {
+        local_disabled = true;
+        return null;
+    };
+    ring.* = .{ .thread_id = @intCast(std.Thread.getCurrentId()) };
+    rings[slot].store(ring, .release);
+    local_ring = ring;
+    return ring;
+}
+
+fn now() u64 {
+    epoch_once.call();
+    const start = epoch orelse return 0;
+    const current = std.time.Instant.now() catch return 0;
+    return current.since(start);
+}
+
+/// Writes all recorded events as Chrome trace JSON to `fd`. Best taken
+/// when the pipeline is quiet: events overwritten during the dump may
+/// show stale values.
+pub fn dump(fd: std.posix.fd_t) !void {
+    var out = Output{ .fd = fd };
+    try out.print("{{\"traceEvents\":[", .{});
+    var first = true;
+
+    const count = @min(ring_count.load(.acquire), MAX_THREADS);
+    for (rings[0..count]) |*slot| {
+        const ring = slot.load(.acquire) orelse continue;
+        const head = ring.head.load(.acquire);
+        const oldest = head -| RING_SIZE;
+        var i = oldest;
+        while (i < head) : (i += 1) {
+            const event = ring.events[@intCast(i % RING_SIZE)];
+            if (!first) try out.print(",", .{});
+            first = false;
+            try out.print("\n{{\"cat\":\"{s}\",\"name\":\"{s}\",\"ph\":\"{c}\",\"ts\":{d}.{d:0>3},\"pid\":1,\"tid\":{d}", .{
+                std.mem.span(event.category),
+                std.mem.span(event.name),
+                @intFromEnum(event.phase),
+                event.timestamp_ns / 1000,
+                event.timestamp_ns % 1000,
+                ring.thread_id,
+            });
+            if (event.phase == .instant) {
+                try out.print(",\"s\":\"t\",\"args\":{{\"value\":{d}}}", .{event.arg});
+            }
+            try out.print("}}", .{});
+        }
+    }
+    try out.print("\n]}}\n", .{});
+    try out.flush();
+}
+
+/// Dumps to a new file at `path` (relative to the working directory)
+pub fn dumpToFile(path: []const u8) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+    try dump(file.handle);
+}
+
+/// Small buffered fd writer for `dump`
+const Output = struct {
+    fd: std.posix.fd_t,
+    buffer: [4096]u8 = undefined,
+    len: usize = 0,
+
+    fn print(self: *Output, comptime fmt: []const u8, args: anytype) !void {
+        if (self.len + 512 > self.buffer.len) try self.flush();
+        const text = try std.fmt.bufPrint(self.buffer[self.len..], fmt, args);
+        self.len += text.len;
+    }
+
+    fn flush(self: *Output) !void {
+        var written: usize = 0;
+        while (written < self.len) {
+            written += try std.posix.write(self.fd, self.buffer[written..self.len]);
+        }
+        self.len = 0;
+    }
+};
+
+test "trace events land in the calling thread's ring" {
+    if (!enabled) return error.SkipZigTest;
+    const s = span("test", "outer");
+    instant("test", "marker", 42);
+    s.end();
+
+    const ring = local_ring.?;
+    const head = ring.head.load(.acquire);
+    try std.testing.expect(head >= 3);
+    try std.testing.expectEqual(Phase.end, ring.events[@intCast((head - 1) % RING_SIZE)].phase);
+    try std.testing.expectEqual(@as(u64, 42), ring.events[@intCast((head - 2) % RING_SIZE)].arg);
+}
@@ -50,6 +50,12 @@ pub fn checksum(data: []const u8) u8 {
     return sum;
 }
 
+/// Most a receive buffer reserves up front from the file size the peer
+/// announces. Small files never grow during the data phase; beyond this
+/// the buffer grows geometrically as blocks arrive, so a bogus or hostile
+/// announcement cannot make the receiver reserve more than this.
+pub const MAX_PREALLOC: u64 = 1024 * 1024;
+
 /// Transfer direction
 pub const Direction = enum {
     send,
@@ -0,0 +1,17 @@
+//! File transfer protocol engines
+
+pub const common = @import("common.zig");
+pub const xmodem = @import("xmodem.zig");
+pub const ymodem = @import("ymodem.zig");
+pub const zmodem = @import("zmodem.zig");
+
+pub const XModem = xmodem.XModem;
+pub const YModem = ymodem.YModem;
+pub const ZModem = zmodem.ZModem;
+
+test {
+    _ = common;
+    _ = xmodem;
+    _ = ymodem;
+    _ = zmodem;
+}
@@ -1,5 +1,6 @@
 const std = @import("std");
 const common = @import("common.zig");
+const trace = @import("trace");
 
 const Control = common.Control;
 const Progress = common.Progress;
@@ -76,9 +77,15 @@ pub const XModem = struct {
         self.recv_buffer.deinit(self.allocator);
     }
 
+    /// Every state change goes through here so it shows up in traces
+    fn setState(self: *XModem, state: State) void {
+        self.state = state;
+        trace.instant("xmodem", @tagName(state), 0);
+    }
+
     /// Start sending a file
     pub fn startSend(self: *XModem, data: []const u8) void {
-        self.state = .send_waiting_for_init;
+        self.setState(.send_waiting_for_init);
         self.send_data = data;
         self.send_offset = 0;
         self.block_num = 1;
@@ -92,7 +99,7 @@ pub const XModem = struct {
 
     /// Start receiving a file
     pub fn startReceive(self: *XModem) void {
-        self.state = .recv_send_init;
+        self.setState(.recv_send_init);
         self.block_num = 1;
         self.retry_count = 0;
         self.recv_buffer.clearRetainingCapacity();
@@ -106,7 +113,14 @@ pub const XModem = struct {
             .file_size = 0,
         } }, self.context);
 
-        self.state = .recv_waiting_for_block;
+        self.setState(.recv_waiting_for_block);
+    }
+
+    /// XMODEM carries no file size, so a receiver that knows it can size
+    /// the buffer up front (rounded up to a 1K block, the most padding a
+    /// sender adds) and take the data phase without allocating
+    pub fn reserveReceive(self: *XModem, bytes: usize) std.mem.Allocator.Error!void {
+        try self.recv_buffer.ensureTotalCapacity(self.allocator, std.mem.alignForward(usize, bytes, BLOCK_SIZE_1K));
     }
 
     /// Process received byte(s) from serial port
@@ -138,9 +152,9 @@ pub const XModem = struct {
                     self.retry_count = 0;
                     if (self.send_offset >= (self.send_data orelse &[_]u8{}).len) {
                         // All data sent, send EOT
-                        self.state = .send_eot;
+                        self.setState(.send_eot);
                         self.callback(.{ .send_data = &[_]u8{Control.EOT} }, self.context);
-                        self.state = .send_waiting_for_eot_ack;
+                        self.setState(.send_waiting_for_eot_ack);
                     } else {
                         self.block_num +%= 1;
                         self.sendBlock();
@@ -159,7 +173,7 @@ pub const XModem = struct {
 
             .send_waiting_for_eot_ack => {
                 if (byte == Control.ACK) {
-                    self.state = .completed;
+                    self.setState(.completed);
                     self.callback(.completed, self.context);
                 } else if (byte == Control.NAK) {
                     self.retry_count += 1;
@@ -178,17 +192,17 @@ pub const XModem = struct {
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block_header;
+                    self.setState(.recv_block_header);
                 } else if (byte == Control.STX) {
                     self.expected_block_size = BLOCK_SIZE_1K;
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block_header;
+                    self.setState(.recv_block_header);
                 } else if (byte == Control.EOT) {
                     // End of transmission
                     self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
-                    self.state = .completed;
+                    self.setState(.completed);
                     self.callback(.completed, self.context);
                 } else if (byte == Control.CAN) {
                     self.handleCancel();
@@ -206,7 +220,7 @@ pub const XModem = struct {
                         // Block number error
                         self.sendNak();
                     } else {
-                        self.state = .recv_block_data;
+                        self.setState(.recv_block_data);
                     }
                 }
             },
@@ -219,7 +233,7 @@ pub const XModem = struct {
                 const total_size = 3 + self.expected_block_size + check_size;
 
                 if (self.block_pos >= total_size) {
-                    self.state = .recv_block_check;
+                    self.setState(.recv_block_check);
                     self.verifyAndAcceptBlock();
                 }
             },
@@ -260,7 +274,7 @@ pub const XModem = struct {
         }
 
         self.send_offset += copy_len;
-        self.state = .send_waiting_for_ack;
+        self.setState(.send_waiting_for_ack);
 
         // Report progress
         self.callback(.{
@@ -338,7 +352,7 @@ pub const XModem = struct {
 
         // Send ACK
         self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
-        self.state = .recv_waiting_for_block;
+        self.setState(.recv_waiting_for_block);
 
         _ = check_size;
     }
@@ -349,19 +363,19 @@ pub const XModem = struct {
             self.handleError("Too many errors");
         } else {
             self.callback(.{ .send_data = &[_]u8{Control.NAK} }, self.context);
-            self.state = .recv_waiting_for_block;
+            self.setState(.recv_waiting_for_block);
         }
     }
 
     fn handleError(self: *XModem, message: []const u8) void {
-        self.state = .failed;
+        self.setState(.failed);
         // Send cancel sequence
         self.callback(.{ .send_data = &[_]u8{ Control.CAN, Control.CAN, Control.CAN } }, self.context);
         self.callback(.{ .failed = message }, self.context);
     }
 
     fn handleCancel(self: *XModem) void {
-        self.state = .cancelled;
+        self.setState(.cancelled);
         self.callback(.cancelled, self.context);
     }
 
@@ -371,7 +385,7 @@ pub const XModem = struct {
             self.state != .failed and self.state != .cancelled)
         {
             self.callback(.{ .send_data = &[_]u8{ Control.CAN, Control.CAN, Control.CAN } }, self.context);
-            self.state = .cancelled;
+            self.setState(.cancelled);
             self.callback(.cancelled, self.context);
         }
     }
@@ -393,3 +407,60 @@ test "XMODEM CRC calculation" {
     const crc = common.crc16(&data);
     try std.testing.expect(crc != 0);
 }
+
+/// Byte pipe between two engines in a test
+const Wire = struct {
+    bytes: [2 * (3 + XModem.BLOCK_SIZE_1K + 2)]u8 = undefined,
+    len: usize = 0,
+    done: bool = false,
+
+    fn onEvent(event: Event, context: ?*anyopaque) void {
+        const wire: *Wire = @ptrCast(@alignCast(context.?));
+        switch (event) {
+            .send_data => |data| {
+                @memcpy(wire.bytes[wire.len..][0..data.len], data);
+                wire.len += data.len;
+            },
+            .completed, .failed, .cancelled => wire.done = true,
+            else => {},
+        }
+    }
+
+    /// Hands everything queued so far to `engine`
+    fn deliver(self: *Wire, engine: *XModem) void {
+        var chunk: [@sizeOf(@TypeOf(self.bytes))]u8 = undefined;
+        const n = self.len;
+        @memcpy(chunk[0..n], self.bytes[0..n]);
+        self.len = 0;
+        engine.processData(chunk[0..n]);
+    }
+};
+
+test "reserved receive does not allocate during the transfer" {
+    var data: [3000]u8 = undefined;
+    for (&data, 0..) |*b, i| b.* = @truncate(i * 7);
+
+    // Only the reservation may allocate; growing it would fail the transfer
+    var failing = std.testing.FailingAllocator.init(std.testing.allocator, .{ .fail_index = 1, .resize_fail_index = 0 });
+    var to_sender = Wire{};
+    var to_receiver = Wire{};
+
+    var receiver = XModem.init(failing.allocator(), Wire.onEvent, &to_sender);
+    defer receiver.deinit();
+    var sender = XModem.init(std.testing.allocator, Wire.onEvent, &to_receiver);
+    defer sender.deinit();
+
+    try receiver.reserveReceive(data.len);
+    sender.startSend(&data);
+    receiver.startReceive();
+    while (!to_receiver.done) {
+        to_sender.deliver(&sender);
+        to_receiver.deliver(&receiver);
+    }
+    to_sender.deliver(&sender);
+
+    try std.testing.expectEqual(XModem.State.completed, receiver.state);
+    try std.testing.expectEqual(XModem.State.completed, sender.state);
+    try std.testing.expectEqualSlices(u8, &data, receiver.getReceivedData()[0..data.len]);
+    try std.testing.expectEqual(@as(usize, 1), failing.allocations);
+}
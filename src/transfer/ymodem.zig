@@ -1,5 +1,6 @@
 const std = @import("std");
 const common = @import("common.zig");
+const trace = @import("trace");
 
 const Control = common.Control;
 const Progress = common.Progress;
@@ -81,9 +82,15 @@ pub const YModem = struct {
         self.recv_buffer.deinit(self.allocator);
     }
 
+    /// Every state change goes through here so it shows up in traces
+    fn setState(self: *YModem, state: State) void {
+        self.state = state;
+        trace.instant("ymodem", @tagName(state), 0);
+    }
+
     /// Start sending a file
     pub fn startSend(self: *YModem, file_name: []const u8, data: []const u8) void {
-        self.state = .send_waiting_for_init;
+        self.setState(.send_waiting_for_init);
         self.send_data = data;
         self.send_offset = 0;
         self.block_num = 0;
@@ -103,7 +110,7 @@ pub const YModem = struct {
 
     /// Start receiving files
     pub fn startReceive(self: *YModem) void {
-        self.state = .recv_send_init;
+        self.setState(.recv_send_init);
         self.block_num = 0;
         self.retry_count = 0;
         self.recv_buffer.clearRetainingCapacity();
@@ -113,7 +120,7 @@ pub const YModem = struct {
 
         // Send 'C' to request CRC mode
         self.callback(.{ .send_data = &[_]u8{Control.CRC} }, self.context);
-        self.state = .recv_waiting_for_block0;
+        self.setState(.recv_waiting_for_block0);
 
         self.callback(.{ .started = .{
             .file_name = null,
@@ -143,7 +150,7 @@ pub const YModem = struct {
 
             .send_waiting_for_block0_ack => {
                 if (byte == Control.ACK) {
-                    self.state = .send_waiting_for_data_init;
+                    self.setState(.send_waiting_for_data_init);
                 } else if (byte == Control.NAK) {
                     self.handleRetry(&YModem.sendBlock0);
                 } else if (byte == Control.CAN) {
@@ -182,7 +189,7 @@ pub const YModem = struct {
                     self.callback(.{ .send_data = &[_]u8{Control.EOT} }, self.context);
                 } else if (byte == Control.ACK) {
                     // Send empty block 0 to signal end of batch
-                    self.state = .send_final_block0;
+                    self.setState(.send_final_block0);
                     self.sendFinalBlock0();
                 } else if (byte == Control.CRC) {
                     // Receiver ready for next file, send empty block 0
@@ -192,7 +199,7 @@ pub const YModem = struct {
 
             .send_waiting_for_final_ack => {
                 if (byte == Control.ACK) {
-                    self.state = .completed;
+                    self.setState(.completed);
                     self.callback(.completed, self.context);
                 }
             },
@@ -204,13 +211,13 @@ pub const YModem = struct {
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block0_header;
+                    self.setState(.recv_block0_header);
                 } else if (byte == Control.STX) {
                     self.expected_block_size = BLOCK_SIZE_1K;
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block0_header;
+                    self.setState(.recv_block0_header);
                 } else if (byte == Control.CAN) {
                     self.handleCancel();
                 }
@@ -220,7 +227,7 @@ pub const YModem = struct {
                 self.block_buffer[self.block_pos] = byte;
                 self.block_pos += 1;
                 if (self.block_pos >= 3) {
-                    self.state = .recv_block0_data;
+                    self.setState(.recv_block0_data);
                 }
             },
 
@@ -240,13 +247,13 @@ pub const YModem = struct {
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block_header;
+                    self.setState(.recv_block_header);
                 } else if (byte == Control.STX) {
                     self.expected_block_size = BLOCK_SIZE_1K;
                     self.block_pos = 0;
                     self.block_buffer[self.block_pos] = byte;
                     self.block_pos += 1;
-                    self.state = .recv_block_header;
+                    self.setState(.recv_block_header);
                 } else if (byte == Control.EOT) {
                     // Send NAK first (YMODEM quirk)
                     self.callback(.{ .send_data = &[_]u8{Control.NAK} }, self.context);
@@ -255,7 +262,7 @@ pub const YModem = struct {
                     self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
                     // Send C to indicate ready for next file
                     self.callback(.{ .send_data = &[_]u8{Control.CRC} }, self.context);
-                    self.state = .recv_waiting_for_block0;
+                    self.setState(.recv_waiting_for_block0);
                     self.block_num = 0;
                 } else if (byte == Control.CAN) {
                     self.handleCancel();
@@ -266,7 +273,7 @@ pub const YModem = struct {
                 self.block_buffer[self.block_pos] = byte;
                 self.block_pos += 1;
                 if (self.block_pos >= 3) {
-                    self.state = .recv_block_data;
+                    self.setState(.recv_block_data);
                 }
             },
 
@@ -313,7 +320,7 @@ pub const YModem = struct {
         block[3 + BLOCK_SIZE_1K + 1] = @intCast(crc & 0xFF);
 
         self.callback(.{ .send_data = block[0 .. 3 + BLOCK_SIZE_1K + 2] }, self.context);
-        self.state = .send_waiting_for_block0_ack;
+        self.setState(.send_waiting_for_block0_ack);
     }
 
     fn sendBlock(self: *YModem) void {
@@ -342,7 +349,7 @@ pub const YModem = struct {
 
         self.callback(.{ .send_data = block[0 .. 3 + BLOCK_SIZE_1K + 2] }, self.context);
         self.send_offset += copy_len;
-        self.state = .send_waiting_for_ack;
+        self.setState(.send_waiting_for_ack);
 
         // Report progress
         self.callback(.{
@@ -370,7 +377,7 @@ pub const YModem = struct {
 
     fn sendEOT(self: *YModem) void {
         self.callback(.{ .send_data = &[_]u8{Control.EOT} }, self.context);
-        self.state = .send_waiting_for_eot_ack;
+        self.setState(.send_waiting_for_eot_ack);
     }
 
     fn sendFinalBlock0(self: *YModem) void {
@@ -386,7 +393,7 @@ pub const YModem = struct {
         block[3 + BLOCK_SIZE + 1] = @intCast(crc & 0xFF);
 
         self.callback(.{ .send_data = block[0 .. 3 + BLOCK_SIZE + 2] }, self.context);
-        self.state = .send_waiting_for_final_ack;
+        self.setState(.send_waiting_for_final_ack);
     }
 
     fn processBlock0(self: *YModem) void {
@@ -405,7 +412,7 @@ pub const YModem = struct {
         // Check for empty block (end of batch)
         if (data_slice[0] == 0) {
             self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
-            self.state = .completed;
+            self.setState(.completed);
             self.callback(.completed, self.context);
             return;
         }
@@ -425,13 +432,15 @@ pub const YModem = struct {
         }
         self.file_size = size;
         self.bytes_remaining = size;
+        // Best effort: on failure appends still grow the buffer
+        self.recv_buffer.ensureTotalCapacity(self.allocator, @intCast(@min(size, common.MAX_PREALLOC))) catch {};
 
         // ACK block 0 and send C to start data transfer
         self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
         self.callback(.{ .send_data = &[_]u8{Control.CRC} }, self.context);
 
         self.block_num = 1;
-        self.state = .recv_waiting_for_block;
+        self.setState(.recv_waiting_for_block);
 
         // Report file info
         self.callback(.{ .started = .{
@@ -480,7 +489,7 @@ pub const YModem = struct {
         }
 
         self.callback(.{ .send_data = &[_]u8{Control.ACK} }, self.context);
-        self.state = .recv_waiting_for_block;
+        self.setState(.recv_waiting_for_block);
     }
 
     fn sendNak(self: *YModem) void {
@@ -502,13 +511,13 @@ pub const YModem = struct {
     }
 
     fn handleError(self: *YModem, message: []const u8) void {
-        self.state = .failed;
+        self.setState(.failed);
         self.callback(.{ .send_data = &[_]u8{ Control.CAN, Control.CAN, Control.CAN } }, self.context);
         self.callback(.{ .failed = message }, self.context);
     }
 
     fn handleCancel(self: *YModem) void {
-        self.state = .cancelled;
+        self.setState(.cancelled);
         self.callback(.cancelled, self.context);
     }
 
@@ -517,7 +526,7 @@ pub const YModem = struct {
             self.state != .failed and self.state != .cancelled)
         {
             self.callback(.{ .send_data = &[_]u8{ Control.CAN, Control.CAN, Control.CAN } }, self.context);
-            self.state = .cancelled;
+            self.setState(.cancelled);
             self.callback(.cancelled, self.context);
         }
     }
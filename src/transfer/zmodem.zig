@@ -1,5 +1,6 @@
 const std = @import("std");
 const common = @import("common.zig");
+const trace = @import("trace");
 
 const Progress = common.Progress;
 const Event = common.Event;
@@ -130,6 +131,12 @@ pub const ZModem = struct {
         self.recv_buffer.deinit(self.allocator);
     }
 
+    /// Every state change goes through here so it shows up in traces
+    fn setState(self: *ZModem, state: State) void {
+        self.state = state;
+        trace.instant("zmodem", @tagName(state), 0);
+    }
+
     /// Check if data contains ZMODEM auto-start sequence
     pub fn detectAutoStart(data: []const u8) bool {
         // Look for "rz\r" or ZRQINIT header
@@ -140,7 +147,7 @@ pub const ZModem = struct {
 
     /// Start sending a file
     pub fn startSend(self: *ZModem, file_name: []const u8, data: []const u8) void {
-        self.state = .send_zrqinit;
+        self.setState(.send_zrqinit);
         self.send_data = data;
         self.send_offset = 0;
         self.file_size = data.len;
@@ -163,7 +170,7 @@ pub const ZModem = struct {
 
     /// Start receiving files
     pub fn startReceive(self: *ZModem) void {
-        self.state = .recv_zrinit_sent;
+        self.setState(.recv_zrinit_sent);
         self.file_name_len = 0;
         self.file_size = 0;
         self.file_pos = 0;
@@ -232,7 +239,7 @@ pub const ZModem = struct {
                         self.use_crc32 = (self.rx_capabilities & CANFC32) != 0;
                         // Send ZFILE
                         self.sendZFILE();
-                        self.state = .send_waiting_zrpos;
+                        self.setState(.send_waiting_zrpos);
                     }
                 }
             },
@@ -249,7 +256,7 @@ pub const ZModem = struct {
                         self.sendDataPackets();
                     } else if (frame.frame_type == ZSKIP) {
                         // File skipped
-                        self.state = .completed;
+                        self.setState(.completed);
                         self.callback(.completed, self.context);
                     }
                 }
@@ -287,11 +294,11 @@ pub const ZModem = struct {
                         self.parseFileInfo(frame.data);
                         // Send ZRPOS to start from position 0
                         self.sendZRPOS(0);
-                        self.state = .recv_waiting_zdata;
+                        self.setState(.recv_waiting_zdata);
                     } else if (frame.frame_type == ZFIN) {
                         // Session complete
                         self.sendZFIN();
-                        self.state = .completed;
+                        self.setState(.completed);
                         self.callback(.completed, self.context);
                     }
                 }
@@ -303,7 +310,7 @@ pub const ZModem = struct {
                 if (self.tryParseFrame()) |frame| {
                     if (frame.frame_type == ZDATA) {
                         self.file_pos = frame.getPosition();
-                        self.state = .recv_data;
+                        self.setState(.recv_data);
                     }
                 }
             },
@@ -461,7 +468,7 @@ pub const ZModem = struct {
 
         if (subpacket_type == ZCRCE or subpacket_type == ZCRCW) {
             // Wait for next frame
-            self.state = .recv_waiting_zdata;
+            self.setState(.recv_waiting_zdata);
         }
 
         _ = subpacket_type;
@@ -484,6 +491,8 @@ pub const ZModem = struct {
             size = size * 10 + (data[i] - '0');
         }
         self.file_size = size;
+        // Best effort: on failure appends still grow the buffer
+        self.recv_buffer.ensureTotalCapacity(self.allocator, @intCast(@min(size, common.MAX_PREALLOC))) catch {};
 
         self.callback(.{ .started = .{
             .file_name = self.file_name[0..self.file_name_len],
@@ -496,7 +505,7 @@ pub const ZModem = struct {
         var buf: [32]u8 = undefined;
         const len = self.buildHexFrame(&buf, ZRQINIT, &[_]u8{ 0, 0, 0, 0 });
         self.callback(.{ .send_data = buf[0..len] }, self.context);
-        self.state = .send_waiting_zrinit;
+        self.setState(.send_waiting_zrinit);
     }
 
     fn sendZRINIT(self: *ZModem) void {
@@ -560,7 +569,7 @@ pub const ZModem = struct {
             @intCast((self.file_pos >> 24) & 0xFF),
         });
         self.callback(.{ .send_data = buf[0..len] }, self.context);
-        self.state = .send_zfin;
+        self.setState(.send_zfin);
     }
 
     fn sendZFIN(self: *ZModem) void {
@@ -609,7 +618,7 @@ pub const ZModem = struct {
             }, self.context);
         }
 
-        self.state = .send_waiting_zack;
+        self.setState(.send_waiting_zack);
     }
 
     fn sendDataSubpacket(self: *ZModem, data: []const u8, subpacket_type: u8) void {
@@ -711,7 +720,7 @@ pub const ZModem = struct {
     }
 
     fn handleError(self: *ZModem, message: []const u8) void {
-        self.state = .failed;
+        self.setState(.failed);
         // Send ZCAN
         const cancel = [_]u8{ ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 };
         self.callback(.{ .send_data = &cancel }, self.context);
@@ -724,7 +733,7 @@ pub const ZModem = struct {
         {
             const cancel_seq = [_]u8{ ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 };
             self.callback(.{ .send_data = &cancel_seq }, self.context);
-            self.state = .cancelled;
+            self.setState(.cancelled);
             self.callback(.cancelled, self.context);
         }
     }